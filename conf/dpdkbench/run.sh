@@ -0,0 +1,29 @@
+#!/bin/bash
+# Usage: run.sh "CONFIGS" "THREADS" [PARAM=VALUE...]
+# Runs each configuration with each thread count on virtual devices and
+# prints one JSON line per run
+
+if [ $# -lt 2 ] ; then
+    echo "Usage: $0 \"CONFIGS\" \"THREADS\" [PARAM=VALUE...]" >&2
+    echo "An empty CONFIGS or THREADS means io or 1" >&2
+    exit 1
+fi
+CONFIGS=${1:-io}
+THREADS=${2:-1}
+shift 2
+DIR=$(dirname "$0")
+CLICK=${CLICK:-click}
+EAL=${EAL:---no-huge -m 1024 --no-pci --log-level=1}
+
+for c in $CONFIGS ; do
+    for t in $THREADS ; do
+        echo "# $c $t"
+        if [ -n "$MANAGER" ] ; then
+            $CLICK --dpdk -l 0-$((t - 1)) $EAL -- \
+                -e "$(sed "s/FlowIPManager_DPDK/$MANAGER/" "$DIR/$c.click")" \
+                THREADS=$t "$@" || exit 1
+        else
+            $CLICK --dpdk -l 0-$((t - 1)) $EAL -- "$DIR/$c.click" THREADS=$t "$@" || exit 1
+        fi
+    done
+done
@@ -0,0 +1,27 @@
+#!/bin/bash
+# Usage: run.sh "BACKENDS" "THREADS" [PARAM=VALUE...]
+# Runs each backend with each thread count and prints one JSON line per run
+
+if [ $# -lt 2 ] ; then
+    echo "Usage: $0 \"BACKENDS\" \"THREADS\" [PARAM=VALUE...]" >&2
+    echo "An empty BACKENDS or THREADS means tagcuckoo or 1" >&2
+    exit 1
+fi
+BACKENDS=${1:-tagcuckoo}
+THREADS=${2:-1}
+shift 2
+DIR=$(dirname "$0")
+CLICK=${CLICK:-click}
+
+for b in $BACKENDS ; do
+    for t in $THREADS ; do
+        case $b in
+            flowipmanager|flowipmanagermp|cuckoopp|dpdk|bucket)
+                args="--dpdk -l 0-$((t - 1)) --" ;;
+            *)
+                args="-j $t" ;;
+        esac
+        echo "# $b $t"
+        $CLICK $args "$DIR/$b.click" THREADS=$t "$@" || exit 1
+    done
+done
@@ -0,0 +1,23 @@
+/*
+ * XDP program redirecting all packets to the AF_XDP socket of their queue,
+ * or to the kernel if no socket is bound to the queue.
+ *
+ * Build with: clang -O2 -g -target bpf -c xsk_redirect.c -o xsk_redirect.o
+ */
+#include <linux/bpf.h>
+#include <bpf/bpf_helpers.h>
+
+struct {
+    __uint(type, BPF_MAP_TYPE_XSKMAP);
+    __uint(max_entries, 64);
+    __type(key, __u32);
+    __type(value, __u32);
+} xsks_map SEC(".maps");
+
+SEC("xdp")
+int xsk_redirect(struct xdp_md *ctx)
+{
+    return bpf_redirect_map(&xsks_map, ctx->rx_queue_index, XDP_PASS);
+}
+
+char _license[] SEC("license") = "GPL";
@@ -1,5 +1,5 @@
 /*
- * flowcounter.{cc,hh} -- remove insults in web pages
+ * flowacl.{cc,hh} -- filters flows against an access control list
  * Tom Barbette
  */
 
@@ -18,43 +18,63 @@ FlowACL::FlowACL()
 
 int FlowACL::configure(Vector<String> &conf, ErrorHandler *errh)
 {
-    if(Args(conf, this, errh)
-    .complete() < 0)
+    Vector<IPACLTable::Rule> rules;
+    if (IPACLTable::parse_rules(conf, 1, rules, this, errh) < 0)
         return -1;
-
+    _table.build(rules);
     return 0;
 }
 
 void FlowACL::push_flow(int, int* fcb, PacketBatch* flow)
 {
-    output_push_batch(0, flow);
+    if (likely(*fcb == 0)) {
+        output_push_batch(0, flow);
+    } else {
+        _state->dropped += flow->count();
+        checked_output_push_batch(1, flow);
+    }
 }
 
 #if FLOW_PUSH_BATCH
-inline void FlowACL::push_flow_batch(int port, int** fcb, PacketBatch *head) 
+void FlowACL::push_flow_batch(int, int** fcb, PacketBatch* &batch)
 {
+    int i = 0;
+    auto fnt = [fcb,&i](Packet* p) -> Packet* {
+        if (likely(*fcb[i++] == 0))
+            return p;
+        return 0;
+    };
+    EXECUTE_FOR_EACH_PACKET_DROP_LIST(fnt, batch, drop);
+    if (drop) {
+        _state->dropped += drop->count();
+        checked_output_push_batch(1, drop);
+    }
 }
 #endif
 
-enum { h_count };
+enum { h_dropped };
 
 String
 FlowACL::read_handler(Element *e, void *thunk)
 {
-    return "<error>";
-}
-
-int
-FlowACL::write_handler(const String &s_in, Element *e, void *thunk, ErrorHandler *errh)
-{
-    return -1;
+    FlowACL *fa = static_cast<FlowACL *>(e);
+    switch ((intptr_t)thunk) {
+        case h_dropped:
+        {
+            PER_THREAD_MEMBER_SUM(uint64_t, dropped, fa->_state, dropped);
+            return String(dropped);
+        }
+        default:
+            return "<error>";
+    }
 }
 
 void
 FlowACL::add_handlers() {
-    add_read_handler("count", read_handler, h_count);
+    add_read_handler("dropped", read_handler, h_dropped);
 }
 
 CLICK_ENDDECLS
+ELEMENT_REQUIRES(flow IPACLTable)
 EXPORT_ELEMENT(FlowACL)
 ELEMENT_MT_SAFE(FlowACL)
@@ -4,6 +4,7 @@
 #include <click/vector.hh>
 #include <click/multithread.hh>
 #include <click/flow/flowelement.hh>
+#include "elements/ip/ipacltable.hh"
 
 CLICK_DECLS
 
@@ -11,25 +12,39 @@ CLICK_DECLS
 /*
 =c
 
-FlowCounter([CLOSECONNECTION])
+FlowACL(ACTION_1 PATTERN_1, ..., ACTION_N PATTERN_N)
 
 =s flow
 
-Counts all flows passing by, the number of active flows, and the number of 
-packets per flow.
+Filters flows against an access control list
 
+=d
+
+Classifies the first packet of each flow against a list of 5-tuple rules,
+and applies the verdict to all the packets of the flow. ACTIONs are
+'C<allow>' and 'C<deny>'; PATTERNs use the syntax of IPACLFilter(n), and the
+lookup uses the same tuple space search. Flows matching no rule are denied.
+
+Allowed flows are pushed to output 0. Denied flows are pushed to output 1 if
+it exists, or dropped.
+
+=h dropped read-only
+
+Number of packets of denied flows.
+
+=a IPACLFilter, FlowIPManager
  */
 
 
 class FlowACL : public FlowStateElement<FlowACL,int>
 {
 public:
-    /** @brief Construct an FlowCounter element
+    /** @brief Construct an FlowACL element
      */
     FlowACL() CLICK_COLD;
 
     const char *class_name() const override        { return "FlowACL"; }
-    const char *port_count() const override        { return PORTS_1_1; }
+    const char *port_count() const override        { return "1/1-2"; }
     const char *processing() const override        { return PUSH; }
 
     int configure(Vector<String> &, ErrorHandler *) override CLICK_COLD;
@@ -42,19 +57,25 @@ public:
     void push_flow(int port, int* fcb, PacketBatch*);
 
 #if FLOW_PUSH_BATCH
-    inline void push_flow_batch(int port, int** fcb, PacketBatch *head);
+    void push_flow_batch(int port, int** fcb, PacketBatch* &);
 #endif
 
-    inline bool new_flow(int* state, Packet*) {
-        *state = 1;
+    inline bool new_flow(int* state, Packet* p) {
+        *state = _table.lookup(p);
         return true;
     }
 
     void add_handlers() override CLICK_COLD;
 protected:
 
+    IPACLTable _table;
+
+    struct State {
+        uint64_t dropped;
+    };
+    per_thread<State> _state;
+
     static String read_handler(Element *, void *) CLICK_COLD;
-    static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
 };
 
 CLICK_ENDDECLS
@@ -0,0 +1,447 @@
+/*
+ * flowbenchsource.{cc,hh} -- synthetic flow workloads for benchmarking
+ */
+
+#include <click/config.h>
+#include <click/router.hh>
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/master.hh>
+#include <clicknet/ether.h>
+#include <clicknet/ip.h>
+#include <clicknet/udp.h>
+#if HAVE_JSON
+# include <click/json.hh>
+#endif
+#include <algorithm>
+#include <math.h>
+#ifdef __linux__
+# include <linux/perf_event.h>
+# include <sys/syscall.h>
+# include <sys/ioctl.h>
+# include <unistd.h>
+# define FLOWBENCH_PERF 1
+#endif
+#include "flowbenchsource.hh"
+
+CLICK_DECLS
+
+FlowBenchSource::FlowBenchSource()
+{
+    in_batch_mode = BATCH_MODE_YES;
+}
+
+FlowBenchSource::~FlowBenchSource()
+{
+}
+
+int
+FlowBenchSource::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    _flows = 65536;
+    _zipf = 1;
+    _new_rate = 0;
+    _burst = 32;
+    _length = 64;
+    _limit = 1000000;
+    _nthreads = 1;
+    _seed = 0;
+    _cache_misses = false;
+    _active = true;
+    _stop = false;
+
+    if (Args(conf, this, errh)
+        .read("FLOWS", _flows)
+        .read("ZIPF", _zipf)
+        .read("NEW_RATE", _new_rate)
+        .read("BURST", _burst)
+        .read("LENGTH", _length)
+        .read("LIMIT", _limit)
+        .read("THREADS", _nthreads)
+        .read("SEED", _seed)
+        .read("CACHE_MISSES", _cache_misses)
+        .read("ACTIVE", _active)
+        .read("STOP", _stop)
+        .complete() < 0)
+        return -1;
+
+    if (_flows == 0 || _flows > (1 << 24))
+        return errh->error("FLOWS must be between 1 and 2^24");
+    if (_new_rate < 0 || _new_rate > 1)
+        return errh->error("NEW_RATE must be between 0 and 1");
+    if (_burst <= 0)
+        return errh->error("BURST must be positive");
+    if (_nthreads <= 0)
+        return errh->error("THREADS must be positive");
+    int min_length = sizeof(click_ether) + sizeof(click_ip) + sizeof(click_udp);
+    if (_length < min_length)
+        return errh->error("LENGTH must be at least %d", min_length);
+    if (_zipf < 0)
+        return errh->error("ZIPF must be positive");
+
+    if (_zipf > 0) {
+        _cdf.resize(_flows);
+        double sum = 0;
+        for (uint32_t i = 0; i < _flows; i++) {
+            sum += 1.0 / pow(i + 1, _zipf);
+            _cdf[i] = sum;
+        }
+        for (uint32_t i = 0; i < _flows; i++)
+            _cdf[i] /= sum;
+    }
+
+    //Only the addresses and ports change from packet to packet
+    StringAccum sa;
+    char* data = sa.extend(_length);
+    memset(data, 0, _length);
+    click_ether* eth = reinterpret_cast<click_ether*>(data);
+    memset(eth->ether_dhost, 0x02, 6);
+    memset(eth->ether_shost, 0x04, 6);
+    eth->ether_type = htons(ETHERTYPE_IP);
+    click_ip* ip = reinterpret_cast<click_ip*>(eth + 1);
+    ip->ip_v = 4;
+    ip->ip_hl = sizeof(click_ip) >> 2;
+    ip->ip_len = htons(_length - sizeof(click_ether));
+    ip->ip_ttl = 64;
+    ip->ip_p = IP_PROTO_UDP;
+    ip->ip_dst.s_addr = htonl(0x0AFFFFFE);
+    click_udp* udp = reinterpret_cast<click_udp*>(ip + 1);
+    udp->uh_dport = htons(80);
+    udp->uh_ulen = htons(_length - sizeof(click_ether) - sizeof(click_ip));
+    _template = sa.take_string();
+
+    return 0;
+}
+
+int
+FlowBenchSource::initialize(ErrorHandler *errh)
+{
+    if (_nthreads > master()->nthreads())
+        return errh->error("THREADS is %d but Click only has %d threads", _nthreads, master()->nthreads());
+
+    _tasks.resize(_nthreads);
+    for (int i = 0; i < _nthreads; i++) {
+        ThreadState &s = _state.get_value_for_thread(i);
+        s.rand = ((uint64_t)_seed << 32) + i * 0x9E3779B97F4A7C15ULL + 1;
+        s.count = 0;
+        s.cycles = 0;
+        s.next_new = 0;
+        s.perf_fd = -1;
+        s.done = false;
+
+        _tasks[i] = new Task(this);
+        _tasks[i]->initialize(this, false);
+        _tasks[i]->move_thread(i);
+        if (_active)
+            _tasks[i]->reschedule();
+    }
+    _running = _nthreads;
+    return 0;
+}
+
+void
+FlowBenchSource::cleanup(CleanupStage)
+{
+    for (int i = 0; i < _tasks.size(); i++) {
+#if FLOWBENCH_PERF
+        ThreadState &s = _state.get_value_for_thread(i);
+        if (s.perf_fd >= 0)
+            close(s.perf_fd);
+#endif
+        delete _tasks[i];
+    }
+    _tasks.clear();
+}
+
+bool
+FlowBenchSource::get_spawning_threads(Bitvector& b, bool, int)
+{
+    for (int i = 0; i < _nthreads && i < b.size(); i++)
+        b[i] = 1;
+    return true;
+}
+
+/**
+ * Rank of the flow in the Zipf distribution, mixed so popular flows are
+ * not close in the address space. Multiplying by an odd number is a
+ * bijection modulo 2^24.
+ */
+inline uint32_t
+FlowBenchSource::pick_flow(ThreadState &s)
+{
+    uint32_t rank;
+    if (_cdf.size()) {
+        double u = (next_rand(s.rand) >> 11) * (1.0 / 9007199254740992.0);
+        rank = std::upper_bound(_cdf.begin(), _cdf.end(), u) - _cdf.begin();
+        if (rank >= _flows)
+            rank = _flows - 1;
+    } else
+        rank = next_rand(s.rand) % _flows;
+    return (rank * 2654435761U) & 0xFFFFFF;
+}
+
+inline Packet*
+FlowBenchSource::make_packet(uint32_t src, uint16_t sport)
+{
+    WritablePacket* p = Packet::make(Packet::default_headroom, _template.data(), _length, 0);
+    if (!p)
+        return 0;
+    click_ip* ip = reinterpret_cast<click_ip*>(p->data() + sizeof(click_ether));
+    click_udp* udp = reinterpret_cast<click_udp*>(ip + 1);
+    ip->ip_src.s_addr = htonl(src);
+    udp->uh_sport = htons(sport);
+    ip->ip_sum = click_in_cksum((unsigned char*)ip, sizeof(click_ip));
+    p->set_mac_header(p->data(), sizeof(click_ether));
+    p->set_ip_header(ip, sizeof(click_ip));
+    SET_AGGREGATE_ANNO(p, (src ^ ((uint32_t)sport << 16)) * 0x9E3779B1);
+    return p;
+}
+
+inline uint64_t
+FlowBenchSource::read_cache_misses(ThreadState &s)
+{
+#if FLOWBENCH_PERF
+    uint64_t v;
+    if (s.perf_fd >= 0 && read(s.perf_fd, &v, sizeof(v)) == sizeof(v))
+        return v;
+#endif
+    return 0;
+}
+
+/**
+ * Mark the thread as done, stopping the driver with STOP once all are. The
+ * task may run again through the active handler, so a thread is only
+ * counted once.
+ */
+void
+FlowBenchSource::finish(ThreadState &s)
+{
+    if (s.done)
+        return;
+    s.done = true;
+    if (_running.dec_and_test() && _stop)
+        router()->please_stop_driver();
+}
+
+bool
+FlowBenchSource::run_task(Task *t)
+{
+    if (!_active)
+        return false;
+    ThreadState &s = *_state;
+
+    int n = _burst;
+    if (_limit >= 0 && s.count + n >= (uint64_t)_limit)
+        n = s.count >= (uint64_t)_limit ? 0 : _limit - s.count;
+    if (n == 0) {
+        finish(s);
+        return false;
+    }
+
+#if FLOWBENCH_PERF
+    if (unlikely(_cache_misses && s.perf_fd == -1)) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        s.perf_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        if (s.perf_fd < 0) {
+            click_chatter("%p{element}: cannot count cache misses on thread %d: %s", this, click_current_cpu_id(), strerror(errno));
+            s.perf_fd = -2;
+        }
+    }
+#endif
+
+    uint32_t new_threshold = _new_rate * 4294967295.0;
+    Packet* head = 0;
+    Packet* last = 0;
+    int count = 0;
+    bool failed = false;
+    for (int i = 0; i < n; i++) {
+        //Recurring flows come from 10.0.0.0/8, new flows from 11.0.0.0/8
+        //with the thread and a sequence number making them unique
+        uint32_t src;
+        uint16_t sport;
+        if (_new_rate > 0 && (uint32_t)next_rand(s.rand) <= new_threshold) {
+            uint64_t seq = s.next_new++;
+            src = (11 << 24) | ((seq & 0x3FFFF) << 6) | (click_current_cpu_id() & 0x3F);
+            sport = 1024 + ((seq >> 18) & 0x7FFF);
+        } else {
+            uint32_t flow = pick_flow(s);
+            src = (10 << 24) | flow;
+            sport = 1024 + (flow & 0x3FF);
+        }
+
+        Packet* p = make_packet(src, sport);
+        if (unlikely(!p)) {
+            click_chatter("%p{element}: out of memory on thread %d, stopping it", this, click_current_cpu_id());
+            failed = true;
+            break;
+        }
+        if (last)
+            last->set_next(p);
+        else
+            head = p;
+        last = p;
+        count++;
+    }
+    if (!head) {
+        finish(s);
+        return false;
+    }
+    PacketBatch* batch = PacketBatch::start_head(head)->make_tail(last, count);
+
+#if FLOWBENCH_PERF
+    if (s.perf_fd >= 0)
+        ioctl(s.perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    click_cycles_t start = click_get_cycles();
+    output_push_batch(0, batch);
+    s.cycles += click_get_cycles() - start;
+#if FLOWBENCH_PERF
+    if (s.perf_fd >= 0)
+        ioctl(s.perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+#endif
+
+    s.count += count;
+    if (unlikely(failed))
+        finish(s);
+    else
+        t->fast_reschedule();
+    return true;
+}
+
+void
+FlowBenchSource::reset()
+{
+    for (int i = 0; i < _nthreads; i++) {
+        ThreadState &s = _state.get_value_for_thread(i);
+        s.count = 0;
+        s.cycles = 0;
+        s.done = false;
+#if FLOWBENCH_PERF
+        if (s.perf_fd >= 0)
+            ioctl(s.perf_fd, PERF_EVENT_IOC_RESET, 0);
+#endif
+    }
+    _running = _nthreads;
+}
+
+String
+FlowBenchSource::read_handler(Element *e, void *thunk)
+{
+    FlowBenchSource *fb = static_cast<FlowBenchSource *>(e);
+    uint64_t count = 0, cycles = 0, misses = 0;
+    double mpps = 0;
+    bool has_misses = false;
+    for (int i = 0; i < fb->_nthreads; i++) {
+        ThreadState &s = fb->_state.get_value_for_thread(i);
+        count += s.count;
+        cycles += s.cycles;
+        if (s.cycles)
+            mpps += (double)s.count * cycles_hz() / s.cycles / 1000000;
+        if (s.perf_fd >= 0) {
+            misses += fb->read_cache_misses(s);
+            has_misses = true;
+        }
+    }
+
+    switch ((intptr_t)thunk) {
+    case h_count:
+        return String(count);
+    case h_cycles:
+        return String(count ? (double)cycles / count : 0);
+    case h_mpps:
+        return String(mpps);
+    case h_cache_misses:
+        if (!has_misses)
+            return "-1";
+        return String(count ? (double)misses / count : 0);
+    case h_active:
+        return String(fb->_active);
+    case h_stats: {
+#if HAVE_JSON
+        Json jthreads = Json::make_array();
+#else
+        StringAccum sa;
+#endif
+        for (int i = 0; i < fb->_nthreads; i++) {
+            ThreadState &s = fb->_state.get_value_for_thread(i);
+            double c = s.count ? (double)s.cycles / s.count : 0;
+            double m = s.cycles ? (double)s.count * cycles_hz() / s.cycles / 1000000 : 0;
+            double cm = s.perf_fd < 0 ? -1 : (s.count ? (double)fb->read_cache_misses(s) / s.count : 0);
+#if HAVE_JSON
+            Json jt = Json::make_object();
+            jt.set("thread", i);
+            jt.set("count", s.count);
+            jt.set("cycles", c);
+            jt.set("mpps", m);
+            jt.set("cache_misses", cm);
+            jthreads.push_back(std::move(jt));
+#else
+            sa << "thread " << i << " count " << s.count << " cycles " << c
+               << " mpps " << m << " cache_misses " << cm << "\n";
+#endif
+        }
+#if HAVE_JSON
+        Json j = Json::make_object();
+        j.set("backend", fb->output(0).element()->class_name());
+        j.set("threads", fb->_nthreads);
+        j.set("mpps", mpps);
+        j.set("cycles", count ? (double)cycles / count : 0);
+        j.set("per_thread", std::move(jthreads));
+        return j.unparse();
+#else
+        return sa.take_string();
+#endif
+    }
+    default:
+        return "<error>";
+    }
+}
+
+int
+FlowBenchSource::write_handler(const String &s, Element *e, void *thunk, ErrorHandler *errh)
+{
+    FlowBenchSource *fb = static_cast<FlowBenchSource *>(e);
+    switch ((intptr_t)thunk) {
+    case h_reset:
+        fb->reset();
+        return 0;
+    case h_active: {
+        bool active;
+        if (!BoolArg().parse(s, active))
+            return errh->error("syntax error");
+        fb->_active = active;
+        if (active)
+            for (int i = 0; i < fb->_tasks.size(); i++)
+                fb->_tasks[i]->reschedule();
+        return 0;
+    }
+    default:
+        return -1;
+    }
+}
+
+void
+FlowBenchSource::add_handlers()
+{
+    add_read_handler("count", read_handler, h_count);
+    add_read_handler("cycles", read_handler, h_cycles);
+    add_read_handler("mpps", read_handler, h_mpps);
+    add_read_handler("cache_misses", read_handler, h_cache_misses);
+    add_read_handler("stats", read_handler, h_stats);
+    add_read_handler("active", read_handler, h_active, Handler::f_checkbox);
+    add_write_handler("active", write_handler, h_active);
+    add_write_handler("reset", write_handler, h_reset, Handler::f_button);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel batch flow)
+EXPORT_ELEMENT(FlowBenchSource)
+ELEMENT_MT_SAFE(FlowBenchSource)
@@ -0,0 +1,195 @@
+#ifndef CLICK_FLOWBENCHSOURCE_HH
+#define CLICK_FLOWBENCHSOURCE_HH
+#include <click/batchelement.hh>
+#include <click/task.hh>
+#include <click/vector.hh>
+#include <click/multithread.hh>
+#include <click/string.hh>
+CLICK_DECLS
+
+/*
+=c
+
+FlowBenchSource([I<keywords> FLOWS, ZIPF, NEW_RATE, BURST, LIMIT, THREADS])
+
+=s flow
+
+generates synthetic flow workloads and measures the downstream path
+
+=d
+
+Generates in-memory batches of Ethernet/IPv4/UDP packets and pushes them out
+its single output, measuring the cycles spent in the downstream elements. It
+is meant to compare flow managers without NICs nor traffic generator, e.g.:
+
+  FlowBenchSource(FLOWS 100000, ZIPF 1.1, THREADS 4)
+    -> FlowIPManager_TagCuckoo(CAPACITY 1048576)
+    -> FlowCounter -> Discard;
+
+Flows are picked following a Zipf distribution among FLOWS flows. A
+fraction NEW_RATE of the packets starts a flow that was never seen. The
+AGGREGATE annotation is set to a hash of the flow, like a NIC would with
+the RSS hash.
+
+Only the time spent pushing the batches is measured, the generation of the
+packets is not.
+
+Keyword arguments are:
+
+=over 8
+
+=item FLOWS
+
+Integer. Number of recurring flows, at most 2^24. Default is 65536.
+
+=item ZIPF
+
+Double. Skew of the Zipf distribution. 0 picks flows uniformly. Default is 1.
+
+=item NEW_RATE
+
+Double between 0 and 1. Fraction of packets of new flows. Default is 0.
+
+=item BURST
+
+Integer. Number of packets per batch. Default is 32.
+
+=item LENGTH
+
+Integer. Length of the packets. Default is 64.
+
+=item LIMIT
+
+Integer. Number of packets to generate per thread, -1 for no limit. Default
+is 1000000.
+
+=item THREADS
+
+Integer. Number of threads generating packets, from thread 0. Each thread
+has its own random stream. Default is 1.
+
+=item SEED
+
+Integer. Seed of the random streams. Default is 0.
+
+=item CACHE_MISSES
+
+Boolean. If true, count the cache misses of the downstream elements using
+the Linux perf events. It costs two system calls per batch. Default is
+false.
+
+=item ACTIVE
+
+Boolean. Whether packets are generated. Default is true.
+
+=item STOP
+
+Boolean. If true, stop the driver once all threads sent LIMIT packets.
+Default is false.
+
+=back
+
+=h count read-only
+
+Number of packets pushed by all threads.
+
+=h cycles read-only
+
+Cycles per packet spent downstream.
+
+=h mpps read-only
+
+Rate in millions of packets per second that the downstream path sustains,
+summed over all threads.
+
+=h cache_misses read-only
+
+Cache misses per packet, -1 if they are not counted.
+
+=h stats read-only
+
+All the above per thread, in JSON if available.
+
+=h reset write-only
+
+Resets all counters.
+
+=h active read/write
+
+Same as the ACTIVE argument.
+
+=a FlowIPManager_TagCuckoo, FlowCounter, InfiniteSource
+*/
+
+class FlowBenchSource : public BatchElement { public:
+
+    FlowBenchSource() CLICK_COLD;
+    ~FlowBenchSource() CLICK_COLD;
+
+    const char *class_name() const override  { return "FlowBenchSource"; }
+    const char *port_count() const override  { return PORTS_0_1; }
+    const char *processing() const override  { return PUSH; }
+
+    int configure(Vector<String> &, ErrorHandler *) override CLICK_COLD;
+    int initialize(ErrorHandler *) override CLICK_COLD;
+    void cleanup(CleanupStage) override CLICK_COLD;
+    void add_handlers() override CLICK_COLD;
+
+    bool get_spawning_threads(Bitvector& b, bool isoutput, int port) override;
+
+    bool run_task(Task *) override;
+
+  private:
+
+    struct ThreadState {
+        uint64_t rand;
+        uint64_t count;
+        uint64_t cycles;
+        uint64_t next_new;
+        int perf_fd;
+        //Whether the thread stopped sending, counted once in _running
+        bool done;
+    };
+
+    per_thread<ThreadState> _state;
+    Vector<Task*> _tasks;
+    //Cumulative distribution of the flow ranks, empty if uniform
+    Vector<double> _cdf;
+
+    uint32_t _flows;
+    double _zipf;
+    double _new_rate;
+    int _burst;
+    int _length;
+    int64_t _limit;
+    int _nthreads;
+    uint32_t _seed;
+    bool _cache_misses;
+    bool _active;
+    bool _stop;
+    atomic_uint32_t _running;
+
+    String _template;
+
+    static inline uint64_t next_rand(uint64_t &s) {
+        //xorshift64*
+        s ^= s >> 12;
+        s ^= s << 25;
+        s ^= s >> 27;
+        return s * 0x2545F4914F6CDD1DULL;
+    }
+
+    inline uint32_t pick_flow(ThreadState &s);
+    inline Packet* make_packet(uint32_t src, uint16_t sport);
+    inline uint64_t read_cache_misses(ThreadState &s);
+    void finish(ThreadState &s);
+
+    void reset();
+
+    enum { h_count, h_cycles, h_mpps, h_cache_misses, h_stats, h_reset, h_active };
+    static String read_handler(Element *e, void *thunk) CLICK_COLD;
+    static int write_handler(const String &, Element *e, void *thunk, ErrorHandler *errh) CLICK_COLD;
+};
+
+CLICK_ENDDECLS
+#endif
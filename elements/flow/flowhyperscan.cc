@@ -259,46 +259,67 @@ int onMatch(unsigned int id, unsigned long long from, unsigned long long to,
     return 0; // continue matching
 }
 
-void FlowHyperScan::push_flow(int port, FlowHyperScanState* flowdata, PacketBatch* batch)
+/**
+ * Open the stream of a new flow
+ * @return false if the packets of the flow must be dropped
+ */
+inline bool FlowHyperScan::check_stream(FlowHyperScanState* flowdata)
 {
     if (!flowdata->stream) {
         hs_error_t err = hs_open_stream(db_streaming, 0, &flowdata->stream);
         if (err) {
             click_chatter("Cannot alloc stream!");
-            goto err;
+            return false;
         }
     } else if (unlikely(flowdata->found)) {
         if (_kill)
-            goto err;
-        output_push_batch(0, batch);
-        return;
+            return false;
     }
+    return true;
+}
 
-    FOR_EACH_PACKET(batch, p) {
-        if (p->length() == 0) continue;
-        size_t matchCount = 0;
-
-        hs_error_t err = hs_scan_stream(flowdata->stream,
-        reinterpret_cast<const char*>(p->data()), p->length(), 0,
-        _state->scratch, onMatch, &matchCount);
-        if (unlikely(err != HS_SUCCESS)) {
-            if (err == HS_SCAN_TERMINATED) {
-                flowdata->found = true;
-                goto m;
-            }
+/**
+ * Scan the content of p in the stream of its flow
+ * @return true if a pattern matched
+ */
+inline bool FlowHyperScan::scan(FlowHyperScanState* flowdata, Packet* p)
+{
+    if (p->length() == 0)
+        return false;
+    size_t matchCount = 0;
+
+    hs_error_t err = hs_scan_stream(flowdata->stream,
+    reinterpret_cast<const char*>(p->data()), p->length(), 0,
+    _state->scratch, onMatch, &matchCount);
+    if (unlikely(err != HS_SUCCESS)) {
+        if (err == HS_SCAN_TERMINATED) {
+            flowdata->found = true;
+        } else {
             click_chatter("Matching error");
             hs_reset_stream(flowdata->stream, 0, _state->scratch, 0, 0);
-
         }
-    m:
-        if (matchCount > 0) {
-            if (_verbose)
-                click_chatter("MATCHED");
-            _state->matches++;
-        }
-        if (_kill)
-            goto err;
+    }
+    if (matchCount > 0) {
+        if (_verbose)
+            click_chatter("MATCHED");
+        _state->matches++;
+        return true;
+    }
+    return false;
+}
 
+void FlowHyperScan::push_flow(int port, FlowHyperScanState* flowdata, PacketBatch* batch)
+{
+    if (!check_stream(flowdata))
+        goto err;
+    if (unlikely(flowdata->found)) {
+        output_push_batch(0, batch);
+        return;
+    }
+
+    FOR_EACH_PACKET(batch, p) {
+        if (scan(flowdata, p) && _kill)
+            goto err;
     }
     output_push_batch(0, batch);
 
@@ -308,6 +329,31 @@ void FlowHyperScan::push_flow(int port, FlowHyperScanState* flowdata, PacketBatc
 
 }
 
+#if FLOW_PUSH_BATCH
+void FlowHyperScan::push_flow_batch(int port, PacketBatch* batch)
+{
+    auto fnt = [this](Packet* p) -> Packet* {
+        //The stream state of the packet two ahead is needed soon
+        Packet* ahead = p->next() ? p->next()->next() : 0;
+        if (ahead)
+            __builtin_prefetch(fcb_data_for(*(fcb_queue + FLOW_ID_ANNO(ahead))));
+
+        FlowHyperScanState* flowdata = fcb_data_for(*(fcb_queue + FLOW_ID_ANNO(p)));
+        if (!check_stream(flowdata))
+            return 0;
+        if (unlikely(flowdata->found))
+            return p;
+        if (scan(flowdata, p) && _kill)
+            return 0;
+        return p;
+    };
+    EXECUTE_FOR_EACH_PACKET_DROPPABLE(fnt, batch, [](Packet* p) { p->kill(); });
+
+    if (batch)
+        output_push_batch(0, batch);
+}
+#endif
+
 
 CLICK_ENDDECLS
 
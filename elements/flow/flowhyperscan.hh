@@ -51,10 +51,16 @@ class FlowHyperScan : public FlowSpaceElement<FlowHyperScanState> {
         void cleanup(CleanupStage) CLICK_COLD;
 
         void push_flow(int, FlowHyperScanState*, PacketBatch *);
+#if FLOW_PUSH_BATCH
+        void push_flow_batch(int, PacketBatch *) override;
+#endif
 
         bool is_valid_patterns(Vector<String> &patterns, ErrorHandler *errh);
 
     protected:
+        inline bool check_stream(FlowHyperScanState*);
+        inline bool scan(FlowHyperScanState*, Packet*);
+
         hs_database_t *db_streaming;
         bool _payload_only;
         unsigned _flags;
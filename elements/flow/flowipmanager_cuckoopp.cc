@@ -16,6 +16,12 @@ extern "C" {
 
 CLICK_DECLS
 
+static inline void
+flow_to_key(const IPFlow5ID &f, hash_key_t &key)
+{
+    key.a = ((uint64_t) f.saddr().addr() << 32) | ((uint64_t)f.daddr().addr());
+    key.b = ((uint64_t) f.proto() << 32) | ((uint64_t)f.sport() << 16) | ((uint64_t)f.dport());
+}
 
 int FlowIPManager_CuckooPP::configure(Vector<String> &conf, ErrorHandler *errh) {
     Args args(conf, this, errh);
@@ -50,32 +56,59 @@ FlowIPManager_CuckooPP::alloc(FlowIPManager_CuckooPPState & table, int core, Err
 	    return 1;
     }
 
+    table.keys = (hash_key_t*)CLICK_ALIGNED_ALLOC(sizeof(hash_key_t) * RTE_HASH_HVARIANT_LOOKUP_BULK_MAX);
+    table.data = (hash_data_t*)CLICK_ALIGNED_ALLOC(sizeof(hash_data_t) * RTE_HASH_HVARIANT_LOOKUP_BULK_MAX);
+    if (!table.keys || !table.data)
+        return errh->error("Could not allocate bulk lookup space for core %d!", core);
+
     return 0;
 }
 
+/**
+ * Lookup a whole batch, RTE_HASH_HVARIANT_LOOKUP_BULK_MAX packets at a time.
+ * All keys of a chunk are built first, then the bloom variant hashes them,
+ * prefetches the primary buckets (and the secondary ones only when the bloom
+ * filter says the key may have been kicked there) and finally compares.
+ * Misses are reported as -1, hits as the flow id given at insertion.
+ */
 void
 FlowIPManager_CuckooPP::find_bulk(PacketBatch *batch, int32_t* positions)
 {
-    auto *table = 	reinterpret_cast<rte_hash*>(_tables->hash);
-
-    for (int i = 0; i< batch->count(); i++){
-        positions[i] = 0;
-    }  
+    auto &state = *_tables;
+    auto *table = reinterpret_cast<rte_hash_hvariant *>(state.hash);
+    hash_key_t *keys = state.keys;
+    hash_data_t *data = state.data;
+
+    Packet* p = batch->first();
+    int base = 0;
+    while (p) {
+        int n = 0;
+        for (; p && n < RTE_HASH_HVARIANT_LOOKUP_BULK_MAX; p = p->next(), n++) {
+            flow_to_key(IPFlow5ID(p), keys[n]);
+        }
+
+        uint64_t hits = 0;
+        rte_hash_bloom_lookup_bulk_data(table, keys, n, &hits, data, 0);
+
+        for (int i = 0; i < n; i++) {
+            positions[base + i] = (hits & (1ULL << i)) ? (int32_t)data[i].a : -1;
+        }
+        base += n;
+    }
 }
 
 int
 FlowIPManager_CuckooPP::find(IPFlow5ID &f)
 {
     auto *table = 	reinterpret_cast<rte_hash_hvariant *>(_tables->hash);
-    hash_key_t key = {0};
-    key.a = ((uint64_t) f.saddr().addr() << 32) | ((uint64_t)f.daddr().addr());
-    key.b = ((uint64_t) f.proto() << 32) | ((uint64_t)f.sport() << 16) | ((uint64_t)f.dport());
+    hash_key_t key;
+    flow_to_key(f, key);
 
     hash_data_t data = {0};
 
     int ret = rte_hash_bloom_lookup_data(table, key, &data, 0);
 
-    return ret >= 0 ? data.a: 0;
+    return ret >= 0 ? data.a : -1;
 }
 
 
@@ -95,9 +128,8 @@ int
 FlowIPManager_CuckooPP::insert(IPFlow5ID &f, int flowid)
 {
     auto *table = reinterpret_cast<rte_hash_hvariant *> (_tables->hash);
-    hash_key_t key = {0};
-    key.a = ((uint64_t) f.saddr().addr() << 32) | ((uint64_t)f.daddr().addr());
-    key.b = ((uint64_t) f.proto() << 32) | ((uint64_t)f.sport() << 16) | ((uint64_t)f.dport());
+    hash_key_t key;
+    flow_to_key(f, key);
 
     hash_data_t data = {0};
 
@@ -111,9 +143,8 @@ int
 FlowIPManager_CuckooPP::remove(IPFlow5ID &f)
 {
     auto *table = reinterpret_cast<rte_hash_hvariant *> (_tables->hash);
-    hash_key_t key = {0};
-    key.a = ((uint64_t) f.saddr().addr() << 32) | ((uint64_t)f.daddr().addr());
-    key.b = ((uint64_t) f.proto() << 32) | ((uint64_t)f.sport() << 16) | ((uint64_t)f.dport());
+    hash_key_t key;
+    flow_to_key(f, key);
 
     int ret = rte_hash_bloom_del_key(table, key, 0);
 
@@ -122,6 +153,15 @@ FlowIPManager_CuckooPP::remove(IPFlow5ID &f)
 
 void FlowIPManager_CuckooPP::cleanup(CleanupStage stage)
 {
+    for (int i = 0; i < _tables.weight(); i++) {
+        auto &t = _tables.get_value(i);
+        if (t.keys)
+            CLICK_ALIGNED_FREE(t.keys, sizeof(hash_key_t) * RTE_HASH_HVARIANT_LOOKUP_BULK_MAX);
+        if (t.data)
+            CLICK_ALIGNED_FREE(t.data, sizeof(hash_data_t) * RTE_HASH_HVARIANT_LOOKUP_BULK_MAX);
+        t.keys = 0;
+        t.data = 0;
+    }
 }
 
 CLICK_ENDDECLS
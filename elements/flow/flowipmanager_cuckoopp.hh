@@ -10,10 +10,16 @@
 #include <click/flow/common.hh>
 #include <click/batchbuilder.hh>
 
+struct rte_tch_key;
+struct rte_tch_data;
+
 CLICK_DECLS
 
 class FlowIPManager_CuckooPPState: public FlowManagerIMPState { public:
     void *hash = 0;
+    //Scratch space for find_bulk, so the burst lookup does not allocate
+    rte_tch_key *keys = 0;
+    rte_tch_data *data = 0;
 } CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
 
 class FlowIPManager_CuckooPP: public VirtualFlowManagerIMP<FlowIPManager_CuckooPP, FlowIPManager_CuckooPPState>
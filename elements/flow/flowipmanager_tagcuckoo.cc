@@ -0,0 +1,25 @@
+/**
+ * flowipmanager_tagcuckoo.{cc,hh}
+ */
+
+#include <click/config.h>
+#include <click/glue.hh>
+#include "flowipmanager_tagcuckoo.hh"
+
+CLICK_DECLS
+
+CLICK_ENDDECLS
+
+ELEMENT_REQUIRES(flow cxx17)
+EXPORT_ELEMENT(FlowIPManager_TagCuckoo)
+ELEMENT_MT_SAFE(FlowIPManager_TagCuckoo)
+EXPORT_ELEMENT(FlowIP6Manager_TagCuckoo)
+ELEMENT_MT_SAFE(FlowIP6Manager_TagCuckoo)
+EXPORT_ELEMENT(FlowIPVLANManager_TagCuckoo)
+ELEMENT_MT_SAFE(FlowIPVLANManager_TagCuckoo)
+EXPORT_ELEMENT(FlowIP6VLANManager_TagCuckoo)
+ELEMENT_MT_SAFE(FlowIP6VLANManager_TagCuckoo)
+EXPORT_ELEMENT(FlowIPTunnelManager_TagCuckoo)
+ELEMENT_MT_SAFE(FlowIPTunnelManager_TagCuckoo)
+EXPORT_ELEMENT(FlowIP6TunnelManager_TagCuckoo)
+ELEMENT_MT_SAFE(FlowIP6TunnelManager_TagCuckoo)
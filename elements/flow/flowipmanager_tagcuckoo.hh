@@ -0,0 +1,291 @@
+#ifndef CLICK_FLOWIPMANAGER_TAGCUCKOO_HH
+#define CLICK_FLOWIPMANAGER_TAGCUCKOO_HH
+#include <click/config.h>
+#include <click/string.hh>
+#include <click/timer.hh>
+#include <click/vector.hh>
+#include <click/multithread.hh>
+#include <click/pair.hh>
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/flow/common.hh>
+#include <click/flow/virtualflowmanager.hh>
+#include <click/flow/flowkey.hh>
+#include <click/batchbuilder.hh>
+#include <click/tagcuckootable.hh>
+
+CLICK_DECLS
+
+template <typename K>
+class FlowManager_TagCuckooState: public FlowManagerIMPState { public:
+    TagCuckooTable<K> table;
+    //Keys and hashes of the current burst, computed before touching the table
+    K *keys = new K[256];
+    uint32_t *hashes = new uint32_t[256];
+} CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+
+/**
+ * Software cuckoo flow manager, generic over the flow key K. The concrete
+ * elements below only select the key.
+ */
+template <class Derived, typename K>
+class FlowManager_TagCuckoo: public VirtualFlowManagerIMP<Derived, FlowManager_TagCuckooState<K>, K>
+{
+    typedef FlowManager_TagCuckooState<K> State;
+    typedef VirtualFlowManagerIMP<Derived, State, K> Base;
+
+    public:
+        const char *port_count() const override { return "1/1"; }
+
+        const char *processing() const override { return Element::PUSH; }
+
+        int configure(Vector<String> &conf, ErrorHandler *errh) override CLICK_COLD {
+            Args args(conf, this, errh);
+
+            if (this->parse(&args) || args.complete())
+                return errh->error("Error while parsing arguments!");
+
+            this->find_children(this->_verbose);
+            this->router()->get_root_init_future()->postOnce(&this->_fcb_builded_init_future);
+            this->_fcb_builded_init_future.post(this);
+
+            this->_reserve += Base::reserve_size();
+
+            return 0;
+        }
+
+        void cleanup(Element::CleanupStage) override CLICK_COLD {
+            //The tables are only mapped to threads once initialized
+            if (!this->_tables.initialized())
+                return;
+            for (int i = 0; i < this->_tables.weight(); i++)
+                this->_tables.get_value(i).table.destroy();
+        }
+
+    protected:
+
+    //Implemented for VirtualFlowManagerIMP. It is using CRTP so no override.
+    inline int alloc(State& table, int core, ErrorHandler* errh) {
+        if (table.table.initialize(this->_capacity) != 0)
+            return errh->error("Could not init flow table %d!", core);
+        return 0;
+    }
+
+    /**
+     * Lookup a whole batch in three passes. First all keys are built and
+     * hashed and both candidate buckets are prefetched, then the keys of the
+     * slots with a matching signature are prefetched, and finally the keys
+     * are compared. Misses are reported as -1.
+     */
+    inline void find_bulk(PacketBatch *batch, int32_t* positions) {
+        State &state = *this->_tables;
+        K *keys = state.keys;
+        uint32_t *hashes = state.hashes;
+
+        int n = 0;
+        FOR_EACH_PACKET(batch, p) {
+            keys[n] = K(p);
+            hashes[n] = state.table.hash(keys[n]);
+            state.table.prefetch(hashes[n]);
+            n++;
+        }
+
+        for (int i = 0; i < n; i++)
+            state.table.prefetch_keys(hashes[i]);
+
+        for (int i = 0; i < n; i++)
+            positions[i] = state.table.find_hashed(keys[i], hashes[i]);
+    }
+
+    inline int find(K &f) {
+        return this->_tables->table.find(f);
+    }
+
+    inline int insert(K &f, int flowid) {
+        return this->_tables->table.insert(f, flowid) == 0 ? flowid : -1;
+    }
+
+    inline int remove(K &f) {
+        return this->_tables->table.remove(f);
+    }
+
+    inline int count() {
+        int total = 0;
+        for (int i = 0; i < this->_tables.weight(); i++)
+            total += this->_tables.get_value(i).table.count();
+        return total;
+    }
+
+    friend class VirtualFlowManagerIMP<Derived, State, K>;
+};
+
+/**
+ * =c
+ * FlowIPManager_TagCuckoo(CAPACITY [, RESERVE, TIMEOUT])
+ *
+ * =s flow
+ *  FCB packet classifier - software cuckoo per-thread
+ *
+ * =d
+ *
+ * Initialize the FCB stack for every packets passing by.
+ * The classification is done using a per-core bucketized cuckoo hash table
+ * implemented natively, so this element does not need DPDK. Each bucket
+ * holds 8 entries, whose 16-bit signatures are compared at once using SIMD.
+ *
+ * Bulk searches hash the whole batch and prefetch the candidate buckets
+ * before comparing the keys.
+ *
+ * With GROUPS, flows are split in that many groups according to the
+ * AGGREGATE annotation and follow their group when it moves to another core,
+ * either through RSS++ (DeviceBalancer) or the migrate handler. The
+ * handover needs the maintenance timer when the source core is idle.
+ *
+ * This element does not find automatically the FCB layout for FlowElement,
+ * neither set the offsets for placement in the FCB automatically. Look at
+ * the middleclick branch for alternatives.
+ *
+ * =h lookups read-only
+ *
+ * Number of table lookups, summed over all cores. The hits, inserts,
+ * insert_failures (refused by the table), table_full (no flow ID left) and
+ * evictions (timed out flows) handlers are similar.
+ *
+ * =h wheel_backlog read-only
+ *
+ * Histogram of the number of FCBs the timer wheel went through at each
+ * tick. The first bucket counts empty ticks, bucket I counts ticks going
+ * through 2^(I-1) to 2^I - 1 FCBs.
+ *
+ * =h stats read-only
+ *
+ * All counters of each core, in JSON.
+ *
+ * =h migrate write-only
+ *
+ * Takes a group and a core, and moves the flows of the group to that core.
+ *
+ * =h migrated read-only
+ *
+ * Number of flows received from other cores.
+ *
+ * =h migration_drops read-only
+ *
+ * Packets dropped because they reached a core that does not own their group.
+ *
+ * =a FlowIPManager_DPDK, FlowIPManager_CuckooPP, FlowIP6Manager_TagCuckoo,
+ * FlowIPVLANManager_TagCuckoo, FlowIPTunnelManager_TagCuckoo
+ *
+ */
+class FlowIPManager_TagCuckoo: public FlowManager_TagCuckoo<FlowIPManager_TagCuckoo, IPFlow5ID>
+{
+    public:
+        const char *class_name() const override { return "FlowIPManager_TagCuckoo"; }
+};
+
+/**
+ * =c
+ * FlowIP6Manager_TagCuckoo(CAPACITY [, RESERVE, TIMEOUT])
+ *
+ * =s flow
+ *  FCB packet classifier for IPv6 - software cuckoo per-thread
+ *
+ * =d
+ *
+ * Like FlowIPManager_TagCuckoo, but flows are identified by the IPv6
+ * 5-tuple. The packets must have their network header set to the IPv6
+ * header, e.g. by CheckIP6Header.
+ *
+ * =a FlowIPManager_TagCuckoo, FlowIP6VLANManager_TagCuckoo
+ */
+class FlowIP6Manager_TagCuckoo: public FlowManager_TagCuckoo<FlowIP6Manager_TagCuckoo, IP6Flow5ID>
+{
+    public:
+        const char *class_name() const override { return "FlowIP6Manager_TagCuckoo"; }
+};
+
+/**
+ * =c
+ * FlowIPVLANManager_TagCuckoo(CAPACITY [, RESERVE, TIMEOUT])
+ *
+ * =s flow
+ *  FCB packet classifier per VLAN - software cuckoo per-thread
+ *
+ * =d
+ *
+ * Like FlowIPManager_TagCuckoo, but the VLAN ID of the VLAN_TCI annotation
+ * is part of the flow key, so tenants with overlapping address spaces get
+ * separate flows. Set the annotation with VLANDecap or the VLAN offload of
+ * FromDPDKDevice.
+ *
+ * =a FlowIPManager_TagCuckoo, FlowIP6VLANManager_TagCuckoo, VLANDecap
+ */
+class FlowIPVLANManager_TagCuckoo: public FlowManager_TagCuckoo<FlowIPVLANManager_TagCuckoo, IPFlow5VLANID>
+{
+    public:
+        const char *class_name() const override { return "FlowIPVLANManager_TagCuckoo"; }
+};
+
+/**
+ * =c
+ * FlowIP6VLANManager_TagCuckoo(CAPACITY [, RESERVE, TIMEOUT])
+ *
+ * =s flow
+ *  FCB packet classifier for IPv6 per VLAN - software cuckoo per-thread
+ *
+ * =d
+ *
+ * IPv6 version of FlowIPVLANManager_TagCuckoo.
+ *
+ * =a FlowIPVLANManager_TagCuckoo, FlowIP6Manager_TagCuckoo
+ */
+class FlowIP6VLANManager_TagCuckoo: public FlowManager_TagCuckoo<FlowIP6VLANManager_TagCuckoo, IP6Flow5VLANID>
+{
+    public:
+        const char *class_name() const override { return "FlowIP6VLANManager_TagCuckoo"; }
+};
+
+/**
+ * =c
+ * FlowIPTunnelManager_TagCuckoo(CAPACITY [, RESERVE, TIMEOUT])
+ *
+ * =s flow
+ *  FCB packet classifier per tunnel - software cuckoo per-thread
+ *
+ * =d
+ *
+ * Like FlowIPManager_TagCuckoo, but the AGGREGATE annotation is part of the
+ * flow key. Tunnel decapsulation elements such as GTPDecap set it to the
+ * tunnel identifier, so inner flows of different tunnels never collide.
+ * As GROUPS splits flows by the same annotation, it cannot be used.
+ *
+ * =a FlowIPManager_TagCuckoo, FlowIP6TunnelManager_TagCuckoo, GTPDecap
+ */
+class FlowIPTunnelManager_TagCuckoo: public FlowManager_TagCuckoo<FlowIPTunnelManager_TagCuckoo, IPFlow5TunnelID>
+{
+    public:
+        const char *class_name() const override { return "FlowIPTunnelManager_TagCuckoo"; }
+};
+
+/**
+ * =c
+ * FlowIP6TunnelManager_TagCuckoo(CAPACITY [, RESERVE, TIMEOUT])
+ *
+ * =s flow
+ *  FCB packet classifier for IPv6 per tunnel - software cuckoo per-thread
+ *
+ * =d
+ *
+ * IPv6 version of FlowIPTunnelManager_TagCuckoo.
+ *
+ * =a FlowIPTunnelManager_TagCuckoo, FlowIP6Manager_TagCuckoo
+ */
+class FlowIP6TunnelManager_TagCuckoo: public FlowManager_TagCuckoo<FlowIP6TunnelManager_TagCuckoo, IP6Flow5TunnelID>
+{
+    public:
+        const char *class_name() const override { return "FlowIP6TunnelManager_TagCuckoo"; }
+};
+
+CLICK_ENDDECLS
+
+#endif
@@ -163,37 +163,72 @@ void FlowIPNAT::release_flow(NATEntryIN* fcb)
 }
 
 
-void FlowIPNAT::push_flow(int port, NATEntryIN* flowdata, PacketBatch* batch)
+/**
+ * Rewrite p, the flow of which is on the FCB stack
+ * @return false if p closed the flow
+ */
+inline bool FlowIPNAT::rewrite(NATEntryIN* flowdata, Packet* &p)
+{
+    WritablePacket* q=p->uniqueify();
+    //click_chatter("Rewrite to %s %d",_sip.unparse().c_str(),htons(flowdata->ref->port));
+    q->rewrite_ipport(_sip, flowdata->ref->port, 0, isTCP(q));
+    p = q;
+
+    if (!_own_state || update_state<NATState>(flowdata,q)) {
+        return true;
+    } else {
+        close_flow();
+        release_flow(flowdata);
+        return false;
+    }
+}
+
+inline void FlowIPNAT::check_reopen(NATEntryIN* flowdata, Packet* p)
 {
-    if (!_own_state && flowdata->ref && flowdata->ref->closing && isSyn(batch->first())) {
+    if (!_own_state && flowdata->ref && flowdata->ref->closing && isSyn(p)) {
         // If the state is not handled by us, another manager could have deleted the other side while
         // this side has still a handle.
         release_ref(flowdata->ref, _own_state);
-        new_flow(flowdata, batch->first());
+        new_flow(flowdata, p);
     }
+}
+
+void FlowIPNAT::push_flow(int, NATEntryIN* flowdata, PacketBatch* batch)
+{
+    check_reopen(flowdata, batch->first());
     auto fnt = [this,flowdata](Packet* &p) -> bool {
         if (!flowdata->ref) {
             return false;
         }
-
-        WritablePacket* q=p->uniqueify();
-        //click_chatter("Rewrite to %s %d",_sip.unparse().c_str(),htons(flowdata->ref->port));
-        q->rewrite_ipport(_sip, flowdata->ref->port, 0, isTCP(q));
-        p = q;
-
-        if (!_own_state || update_state<NATState>(flowdata,q)) {
-            return true;
-        } else {
-            close_flow();
-            release_flow(flowdata);
-            return false;
-        }
+        return rewrite(flowdata, p);
     };
     EXECUTE_FOR_EACH_PACKET_UNTIL_DROP(fnt, batch);
 
     output_push_batch(0, batch);
 }
 
+#if FLOW_PUSH_BATCH
+void FlowIPNAT::push_flow_batch(int, NATEntryIN** flowdata, PacketBatch* &batch)
+{
+    FlowControlBlock* tmp = fcb_stack;
+    int i = 0;
+    auto fnt = [this,flowdata,&i](Packet* p) -> Packet* {
+        NATEntryIN* fcb = flowdata[i++];
+        //Packets following the one that closed the flow are dropped
+        if (unlikely(is_flow_closed(p)))
+            return 0;
+        set_fcb_stack_for(p);
+        check_reopen(fcb, p);
+        if (!fcb->ref)
+            return 0;
+        rewrite(fcb, p);
+        return p;
+    };
+    EXECUTE_FOR_EACH_PACKET_DROPPABLE(fnt, batch, [](Packet* p) { p->kill(); });
+    fcb_stack = tmp;
+}
+#endif
+
 FlowIPNATReverse::FlowIPNATReverse()
 {
 }
@@ -248,41 +283,76 @@ void FlowIPNATReverse::release_flow(NATEntryOUT* fcb) {
 
 }
 
-void FlowIPNATReverse::push_flow(int port, NATEntryOUT* flowdata, PacketBatch* batch)
+/**
+ * Rewrite p, the flow of which is on the FCB stack
+ * @return false if p closed the flow
+ */
+inline bool FlowIPNATReverse::rewrite(NATEntryOUT* flowdata, Packet* &p)
+{
+    //click_chatter("Rewrite to %s %d",flowdata->map.ip.unparse().c_str(),ntohs(flowdata->map.port));
+    WritablePacket* q=p->uniqueify();
+    p = q;
+    q->rewrite_ipport(flowdata->map.ip, flowdata->map.port, 1, isTCP(q));
+    q->set_dst_ip_anno(flowdata->map.ip);
+
+    if (!_in->_own_state || update_state<NATState>(flowdata, q)) {
+        return true;
+    } else {
+        close_flow();
+        release_flow(flowdata);
+        return false;
+    }
+}
+
+inline void FlowIPNATReverse::check_reopen(NATEntryOUT* flowdata, Packet* p)
 {
-    if (!_in->_own_state && flowdata->ref && flowdata->ref->closing && isSyn(batch->first())) {
+    if (!_in->_own_state && flowdata->ref && flowdata->ref->closing && isSyn(p)) {
         // If the state is not handled by us, another manager could have deleted the other side while
         // this side has still a handle.
         release_ref(flowdata->ref, _in->_own_state);
-        new_flow(flowdata, batch->first());
+        new_flow(flowdata, p);
     }
+}
+
+void FlowIPNATReverse::push_flow(int, NATEntryOUT* flowdata, PacketBatch* batch)
+{
+    check_reopen(flowdata, batch->first());
 
     //_state->port_epoch[*flowdata] = epoch;
     auto fnt = [this,flowdata](Packet* &p) -> bool {
-        //click_chatter("Rewrite to %s %d",flowdata->map.ip.unparse().c_str(),ntohs(flowdata->map.port));
         if (!flowdata->ref) {
             click_chatter("Return flow without ref?");
             return false;
         }
-        WritablePacket* q=p->uniqueify();
-        p = q;
-        q->rewrite_ipport(flowdata->map.ip, flowdata->map.port, 1, isTCP(q));
-        q->set_dst_ip_anno(flowdata->map.ip);
-
-        if (!_in->_own_state || update_state<NATState>(flowdata, q)) {
-            return true;
-        } else {
-            close_flow();
-            release_flow(flowdata);
-            return false;
-        }
-
+        return rewrite(flowdata, p);
     };
     EXECUTE_FOR_EACH_PACKET_UNTIL_DROP(fnt, batch);
 
     output_push_batch(0, batch);
 }
 
+#if FLOW_PUSH_BATCH
+void FlowIPNATReverse::push_flow_batch(int, NATEntryOUT** flowdata, PacketBatch* &batch)
+{
+    FlowControlBlock* tmp = fcb_stack;
+    int i = 0;
+    auto fnt = [this,flowdata,&i](Packet* p) -> Packet* {
+        NATEntryOUT* fcb = flowdata[i++];
+        //Packets following the one that closed the flow are dropped
+        if (unlikely(is_flow_closed(p)))
+            return 0;
+        set_fcb_stack_for(p);
+        check_reopen(fcb, p);
+        if (!fcb->ref)
+            return 0;
+        rewrite(fcb, p);
+        return p;
+    };
+    EXECUTE_FOR_EACH_PACKET_DROPPABLE(fnt, batch, [](Packet* p) { p->kill(); });
+    fcb_stack = tmp;
+}
+#endif
+
 CLICK_ENDDECLS
 
 ELEMENT_REQUIRES(flow)
@@ -126,8 +126,14 @@ class FlowIPNAT : public FlowStateElement<FlowIPNAT,NATEntryIN> , TCPHelper {
         void release_flow(NATEntryIN*);
 
         void push_flow(int, NATEntryIN*, PacketBatch *);
+#if FLOW_PUSH_BATCH
+        void push_flow_batch(int, NATEntryIN**, PacketBatch* &);
+#endif
 
     private:
+        inline bool rewrite(NATEntryIN*, Packet* &);
+        inline void check_reopen(NATEntryIN*, Packet*);
+
         struct state {
             MPSCDynamicRing<NATCommon*> available_ports;
         };
@@ -160,8 +166,14 @@ class FlowIPNATReverse : public FlowStateElement<FlowIPNATReverse,NATEntryOUT>,
         void release_flow(NATEntryOUT*);
 
         void push_flow(int, NATEntryOUT*, PacketBatch *);
+#if FLOW_PUSH_BATCH
+        void push_flow_batch(int, NATEntryOUT**, PacketBatch* &);
+#endif
 
     private:
+        inline bool rewrite(NATEntryOUT*, Packet* &);
+        inline void check_reopen(NATEntryOUT*, Packet*);
+
         FlowIPNAT* _in;
 };
 
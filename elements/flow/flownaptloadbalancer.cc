@@ -193,23 +193,30 @@ void FlowNAPTLoadBalancer::release_flow(TTuple* fcb) {
     release_ref(fcb->ref, _own_state);
 }
 
+/**
+ * Rewrite p, the flow of which is on the FCB stack
+ * @return false if p closed the flow
+ */
+inline bool FlowNAPTLoadBalancer::rewrite(TTuple* flowdata, Packet* &p) {
+    WritablePacket* q =p->uniqueify();
+    p = q;
+
+    q->rewrite_ips_ports(flowdata->pair, flowdata->get_port(), 0);
+    q->set_dst_ip_anno(flowdata->pair.dst);
+    if (likely(!_own_state || likely(update_state<TTuple>(flowdata, q)))) {
+        return true;
+    } else {
+        close_flow();
+        release_flow(flowdata);
+        return false;
+    }
+}
+
 void FlowNAPTLoadBalancer::push_flow(int, TTuple* flowdata, PacketBatch* batch) {
     nat_debug_chatter("Forward entry X:X -> %s:%d to %s:X", flowdata->pair.src.unparse().c_str(), ntohs(flowdata->get_port()), flowdata->pair.dst.unparse().c_str());
-    state &s = *_state;
 
     auto fnt = [this,flowdata](Packet*&p) -> bool {
-        WritablePacket* q =p->uniqueify();
-        p = q;
-
-        q->rewrite_ips_ports(flowdata->pair, flowdata->get_port(), 0);
-        q->set_dst_ip_anno(flowdata->pair.dst);
-        if (likely(!_own_state || likely(update_state<TTuple>(flowdata, q)))) {
-            return true;
-        } else {
-            close_flow();
-            release_flow(flowdata);
-            return false;
-        }
+        return rewrite(flowdata, p);
     };
     EXECUTE_FOR_EACH_PACKET_UNTIL_DROP(fnt, batch);
 
@@ -217,6 +224,24 @@ void FlowNAPTLoadBalancer::push_flow(int, TTuple* flowdata, PacketBatch* batch)
         checked_output_push_batch(0, batch);
 }
 
+#if FLOW_PUSH_BATCH
+void FlowNAPTLoadBalancer::push_flow_batch(int, TTuple** flowdata, PacketBatch* &batch) {
+    FlowControlBlock* tmp = fcb_stack;
+    int i = 0;
+    auto fnt = [this,flowdata,&i](Packet* p) -> Packet* {
+        TTuple* fcb = flowdata[i++];
+        //Packets following the one that closed the flow are dropped
+        if (unlikely(is_flow_closed(p)))
+            return 0;
+        set_fcb_stack_for(p);
+        rewrite(fcb, p);
+        return p;
+    };
+    EXECUTE_FOR_EACH_PACKET_DROPPABLE(fnt, batch, [](Packet* p) { p->kill(); });
+    fcb_stack = tmp;
+}
+#endif
+
 
 FlowNAPTLoadBalancerReverse::FlowNAPTLoadBalancerReverse() {
 
@@ -324,21 +349,29 @@ void FlowNAPTLoadBalancerReverse::release_flow(LBEntryOut* fcb) {
     release_ref(fcb->ref,_lb->_own_state);
 }
 
+/**
+ * Rewrite p, the flow of which is on the FCB stack
+ * @return false if p closed the flow
+ */
+inline bool FlowNAPTLoadBalancerReverse::rewrite(LBEntryOut* flowdata, Packet* &p) {
+    WritablePacket* q =p->uniqueify();
+    p = q;
+    q->rewrite_ips_ports(flowdata->pair, 0, flowdata->get_original_sport());
+    q->set_dst_ip_anno(flowdata->pair.dst);
+    if (likely(!_lb->_own_state || likely(update_state<TTuple>(flowdata, q)))) {
+        return true;
+    } else {
+        close_flow();
+        release_flow(flowdata);
+        return false;
+    }
+}
+
 void FlowNAPTLoadBalancerReverse::push_flow(int, LBEntryOut* flowdata, PacketBatch* batch) {
         nat_debug_chatter("Saved entry X:%d -> %s:%d to %s:X",ntohs(flowdata->get_port()), flowdata->pair.src.unparse().c_str(), ntohs(flowdata->get_original_sport()), flowdata->pair.dst.unparse().c_str());
 
     auto fnt = [this,flowdata](Packet* &p) -> bool {
-        WritablePacket* q =p->uniqueify();
-        p = q;
-        q->rewrite_ips_ports(flowdata->pair, 0, flowdata->get_original_sport());
-        q->set_dst_ip_anno(flowdata->pair.dst);
-        if (likely(!_lb->_own_state || likely(update_state<TTuple>(flowdata, q)))) {
-            return true;
-        } else {
-            close_flow();
-            release_flow(flowdata);
-            return false;
-        }
+        return rewrite(flowdata, p);
     };
 
     EXECUTE_FOR_EACH_PACKET_UNTIL_DROP(fnt, batch);
@@ -347,6 +380,24 @@ void FlowNAPTLoadBalancerReverse::push_flow(int, LBEntryOut* flowdata, PacketBat
         checked_output_push_batch(0, batch);
 }
 
+#if FLOW_PUSH_BATCH
+void FlowNAPTLoadBalancerReverse::push_flow_batch(int, LBEntryOut** flowdata, PacketBatch* &batch) {
+    FlowControlBlock* tmp = fcb_stack;
+    int i = 0;
+    auto fnt = [this,flowdata,&i](Packet* p) -> Packet* {
+        LBEntryOut* fcb = flowdata[i++];
+        //Packets following the one that closed the flow are dropped
+        if (unlikely(is_flow_closed(p)))
+            return 0;
+        set_fcb_stack_for(p);
+        rewrite(fcb, p);
+        return p;
+    };
+    EXECUTE_FOR_EACH_PACKET_DROPPABLE(fnt, batch, [](Packet* p) { p->kill(); });
+    fcb_stack = tmp;
+}
+#endif
+
 enum {h_conn, h_open};
 String FlowNAPTLoadBalancer::read_handler(Element* e, void* thunk) {
     FlowNAPTLoadBalancer* tc = static_cast<FlowNAPTLoadBalancer*>(e);
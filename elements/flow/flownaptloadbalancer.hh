@@ -116,6 +116,9 @@ public:
     void release_flow(TTuple*);
 
     void push_flow(int, TTuple*, PacketBatch *);
+#if FLOW_PUSH_BATCH
+    void push_flow_batch(int, TTuple**, PacketBatch* &);
+#endif
 
     static String read_handler(Element* e, void* thunk) CLICK_COLD;
     void add_handlers() override CLICK_COLD;
@@ -149,6 +152,7 @@ private:
     bool _accept_nonsyn;
 
     NATCommon* pick_port();
+    inline bool rewrite(TTuple*, Packet* &);
 
     LBHashtable _map;
     friend class FlowNAPTLoadBalancerReverse;
@@ -178,7 +182,12 @@ public:
 
 
     void push_flow(int, LBEntryOut*, PacketBatch *);
+#if FLOW_PUSH_BATCH
+    void push_flow_batch(int, LBEntryOut**, PacketBatch* &);
+#endif
 private:
+    inline bool rewrite(LBEntryOut*, Packet* &);
+
     FlowNAPTLoadBalancer* _lb;
 };
 
@@ -81,6 +81,23 @@ void FlowRateLimiter::push_flow(int, FRLState* fcb, PacketBatch* flow)
     }
 }
 
+#if FLOW_PUSH_BATCH
+void FlowRateLimiter::push_flow_batch(int, FRLState** fcb, PacketBatch* &batch)
+{
+    int i = 0;
+    unsigned dropped = 0;
+    auto fnt = [fcb,&i,&dropped](Packet* p) -> Packet* {
+        TokenBucket &tb = fcb[i++]->tb;
+        tb.refill();
+        if (likely(tb.remove_if(1)))
+            return p;
+        dropped++;
+        return 0;
+    };
+    EXECUTE_FOR_EACH_PACKET_DROPPABLE(fnt, batch, [](Packet* p) { p->kill(); });
+    _state->dropped += dropped;
+}
+#endif
 
 String
 FlowRateLimiter::read_handler(Element *e, void *thunk)
@@ -28,7 +28,7 @@ class StateChecker { public:
     struct str  {
     };
     static inline bool seen(void* v, str*) {
-        return ((FRLState*)v)->tb.time_point() == 0;
+        return ((FRLState*)v)->tb.time_point() != 0;
     }
     static inline void mark_seen(void* v, str*) {
     }
@@ -58,6 +58,9 @@ public:
     const static int timeout = 15000;
 
     void push_flow(int port, FRLState* fcb, PacketBatch*);
+#if FLOW_PUSH_BATCH
+    void push_flow_batch(int port, FRLState** fcb, PacketBatch* &);
+#endif
 
     inline bool new_flow(FRLState* state, Packet*) {
         state->tb = _tb;
@@ -203,6 +203,11 @@ int SFMaker::solve_initialize(ErrorHandler *errh)
         }
 #endif
         s.ready_batch = 0;
+#if SF_PRIO
+        //Priorities are in microseconds, or in packets for PRIO_SENT
+        s.queue.initialize(_max_capacity > 0 ? _max_capacity : 4096,
+                           _prio == PRIO_SENT ? 0 : FlowQueue::shift_for_range(2 * _delay.usecval()));
+#endif
     s.last_tx_time = TSCTimestamp::now_steady();
 
 #if SF_LLDS
@@ -219,10 +224,6 @@ int SFMaker::solve_initialize(ErrorHandler *errh)
     return Router::InitFuture::solve_initialize(errh);
 }
 
-bool operator<(const Burst& lhs, const Burst& rhs) {
-    return lhs.prio < rhs.prio;
-}
-
 bool
 SFMaker::get_spawning_threads(Bitvector& b, bool, int port) {
     #if SF_PIPELINE
@@ -378,7 +379,7 @@ bool SFMaker::schedule_burst_from_flow(SFSlot& f, TSCTimestamp& now, unsigned ma
         fcb_stack = stack_from_flow(&f);
     }
     Burst b = {.prio = f.prio(now, this), .batch = all, .fcb = fcb_stack};
-    q.insert(b);
+    q.insert(b.prio, b);
 #else
     if (_remanage) {
         fcb_stack = stack_from_flow(&f);
@@ -427,14 +428,13 @@ bool SFMaker::run_task(Task* t)
     if (!_remanage)
         assert(fcb_stack == 0);
 #endif
+    //S is the state for this thread. It is not copied (passed by reference) for performance
+    auto &s = *_state;
 #if SF_PRIO
     //Priority queue ordering bursts of different flows by emergency
-    FlowQueue q = FlowQueue();
+    FlowQueue &q = s.queue;
 #endif
 
-    //S is the state for this thread. It is not copied (passed by reference) for performance
-    auto &s = *_state;
-
     //We're going to play with indexes, so we need to take the lock
 #if SF_PIPELINE
     //STEP 1 : look for new indexes that have been allocated (in new_allocated) and add them in allocated
@@ -673,8 +673,8 @@ start:
         if (_remanage) {
             assert(!batch);
         }
-        for(FlowQueue::iterator it = q.begin(); it != q.end(); ) {
-            Burst &b = *const_cast<Burst*>(&(*it)); //Horrible but safe
+        Burst b;
+        while (q.pop(b)) {
 
             if (_remanage) { //We have to keep bursts together if we re-manage
                 fcb_stack = b.fcb;
@@ -713,8 +713,6 @@ start:
                     b.batch = 0;
                 }
             }
-            it = q.erase(it);
-
         }
             
         if (batch) {
@@ -767,7 +765,7 @@ inline void SFMaker::push_flow_batch(int port, SFFlow** fcb, PacketBatch *head)
     FlowControlBlock* tmp = fcb_stack;
 
     FOR_EACH_PACKET_SAFE(head, p) {
-        fcb_stack = *(fcb_queue + i);
+        fcb_stack = *(fcb_queue + FLOW_ID_ANNO(p));
         head = head->pop_front();
         push_flow(port, fcb[i], PacketBatch::make_from_packet(p));
 
@@ -4,8 +4,8 @@
 #include <click/multithread.hh>
 #include <click/flow/flowelement.hh>
 #include <click/tcphelper.hh>
-#include <set>
 #include <click/tsctimestamp.hh>
+#include <click/calendarqueue.hh>
 
 CLICK_DECLS
 
@@ -239,7 +239,7 @@ public:
 
     void run_timer(Timer* t) override;
 
-    typedef std::multiset<Burst> FlowQueue;
+    typedef CalendarQueue<Burst> FlowQueue;
 
     inline void prepareBurst(SFSlot& f, PacketBatch* &all);
 #if SF_PRIO
@@ -305,7 +305,11 @@ protected:
 #endif
         Timer* timer;
         Task* task;
-        
+#if SF_PRIO
+        //Bursts of the flows ready to be sent, ordered by priority
+        FlowQueue queue;
+#endif
+
 	TSCTimestamp last_tx_time;
 	PacketBatch* ready_batch;
 
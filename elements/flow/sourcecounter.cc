@@ -150,5 +150,6 @@ SourceCounter::add_handlers() {
 }
 
 CLICK_ENDDECLS
+ELEMENT_REQUIRES(dpdk)
 EXPORT_ELEMENT(SourceCounter)
 ELEMENT_MT_SAFE(SourceCounter)
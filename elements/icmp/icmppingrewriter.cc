@@ -158,7 +158,7 @@ ICMPPingRewriter::add_flow(int, const IPFlowID &flowid,
 	 !!_timeouts[click_current_cpu_id()][1], click_jiffies() +
          relevant_timeout(_timeouts[click_current_cpu_id()]), input);
 
-    return store_flow(flow, input, _state->map);
+    return store_flow(flow, input, *_state);
 }
 
 int
@@ -0,0 +1,116 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * ipaclfilter.{cc,hh} -- filters IP packets against large 5-tuple rule sets
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "ipaclfilter.hh"
+#include <click/error.hh>
+CLICK_DECLS
+
+IPACLFilter::IPACLFilter()
+    : _table(0), _old_table(0), _nrules(0)
+{
+}
+
+IPACLFilter::~IPACLFilter()
+{
+    delete _table;
+    delete _old_table;
+}
+
+int
+IPACLFilter::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    Vector<IPACLTable::Rule> rules;
+    int nrules = IPACLTable::parse_rules(conf, noutputs(), rules, this, errh);
+    if (nrules < 0)
+        return -1;
+
+    IPACLTable *table = new IPACLTable();
+    table->build(rules);
+
+    delete _old_table;
+    _old_table = _table;
+    click_write_fence();
+    _table = table;
+    _nrules = nrules;
+    return 0;
+}
+
+#if HAVE_BATCH
+void
+IPACLFilter::push_batch(int, PacketBatch *batch)
+{
+    const IPACLTable *table = _table;
+    IPACLTable::Key keys[IPACLTable::batch_size];
+    int actions[IPACLTable::batch_size];
+    int n = 0, i = 0;
+
+    // Each chunk is looked up when its first packet is reached, before the
+    // batch is split there
+    auto next_action = [&](Packet *p) {
+        if (i == n) {
+            for (n = 0; n < IPACLTable::batch_size && p; ++n, p = p->next())
+                IPACLTable::make_key(p, keys[n]);
+            table->lookup_batch(keys, actions, n);
+            i = 0;
+        }
+        return actions[i++];
+    };
+    CLASSIFY_EACH_PACKET(
+        (noutputs() + 1),
+        next_action,
+        batch,
+        checked_output_push_batch
+    );
+}
+#endif
+
+void
+IPACLFilter::push(int, Packet *p)
+{
+    checked_output_push(_table->lookup(p), p);
+}
+
+String
+IPACLFilter::read_handler(Element *e, void *thunk)
+{
+    IPACLFilter *f = static_cast<IPACLFilter *>(e);
+    switch ((intptr_t) thunk) {
+    case H_RULES:
+        return String(f->_nrules);
+    case H_ENTRIES:
+        return String(f->_table->nentries());
+    case H_TUPLES:
+        return String(f->_table->ntuples());
+    case H_TABLE:
+        return f->_table->unparse();
+    default:
+        return "<error>";
+    }
+}
+
+void
+IPACLFilter::add_handlers()
+{
+    add_read_handler("rules", read_handler, H_RULES);
+    add_read_handler("entries", read_handler, H_ENTRIES);
+    add_read_handler("tuples", read_handler, H_TUPLES);
+    add_read_handler("table", read_handler, H_TABLE);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(IPACLTable)
+EXPORT_ELEMENT(IPACLFilter)
+ELEMENT_MT_SAFE(IPACLFilter)
@@ -0,0 +1,126 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+#ifndef CLICK_IPACLFILTER_HH
+#define CLICK_IPACLFILTER_HH
+#include <click/batchelement.hh>
+#include "ipacltable.hh"
+CLICK_DECLS
+
+/*
+=c
+
+IPACLFilter(ACTION_1 PATTERN_1, ..., ACTION_N PATTERN_N)
+
+=s ip
+
+filters IP packets against large 5-tuple rule sets
+
+=d
+
+Filters IP packets like IPFilter, with patterns restricted to the IP 5-tuple,
+but with a lookup time that does not grow with the number of rules. It is
+meant for access control lists of thousands of rules, where IPFilter's
+decision tree becomes too large or too slow to build.
+
+ACTIONs are the same as IPFilter's: an output port number, 'C<allow>'
+(port 0), or 'C<deny>'/'C<drop>'. Rules may be loaded from a file with the
+'C<file>' ACTION, one rule per line; lines starting with '#' are ignored.
+Packets matching no rule are dropped.
+
+A PATTERN is 'C<->', 'C<any>', 'C<all>', or terms joined by 'C<and>' or
+'C<&&>'. Terms are the subset of IPClassifier(n) terms testing the 5-tuple:
+
+=over 8
+
+=item 'C<ip>', 'C<tcp>', 'C<udp>', 'C<icmp>', 'C<[ip] proto PROTO>'
+
+Tests the IP protocol.
+
+=item 'C<[tcp | udp] [src | dst | src or dst | src and dst] port [OP] PORT>'
+
+Tests the ports of TCP or UDP first fragments. OP is one of 'C<=>',
+'C<!=>', 'C<< > >>', 'C<< < >>', 'C<< >= >>' and 'C<< <= >>', with the same
+meaning as in IPClassifier(n). Without a protocol, the test matches TCP and
+UDP packets.
+
+=item 'C<[src | dst | src or dst | src and dst] [host | net] ADDR>'
+
+Tests the IP addresses. ADDR is an address or a prefix.
+
+=back
+
+Negations, 'C<or>' and parentheses are not supported. Each rule is expanded
+to prefix rules: a port range becomes the prefixes covering it, and 'C<src
+or dst>' becomes two rules. The expanded rules are grouped by prefix
+lengths, in as many hash tables, and a packet is looked up in each of them
+(tuple space search). The hash tables are visited in the order of the
+best rule they contain, so that a packet matching an early rule does not
+visit the others. Batches are looked up one hash table at a time for all
+their packets, prefetching the buckets.
+
+The cost of a lookup thus depends on the number of different prefix length
+combinations among the rules, as reported by the C<tuples> handler, and not
+on the number of rules.
+
+Input packets must have their IP header annotation set; CheckIPHeader and
+MarkIPHeader do this.
+
+=h rules read-only
+
+Returns the number of rules.
+
+=h entries read-only
+
+Returns the number of prefix rules after expansion.
+
+=h tuples read-only
+
+Returns the number of hash tables.
+
+=h table read-only
+
+Returns a description of each hash table, in lookup order.
+
+=e
+
+  IPACLFilter(allow src net 10.0.0.0/8 && tcp dst port 80,
+              deny src host 10.1.2.3,
+              allow udp && dst port >= 1024,
+              file /etc/click/acl.rules)
+
+=a
+
+IPFilter, FlowACL, IPClassifier, CheckIPHeader */
+
+class IPACLFilter : public BatchElement { public:
+
+    IPACLFilter() CLICK_COLD;
+    ~IPACLFilter() CLICK_COLD;
+
+    const char *class_name() const override      { return "IPACLFilter"; }
+    const char *port_count() const override      { return "1/-"; }
+    const char *processing() const override      { return PUSH; }
+    bool can_live_reconfigure() const override   { return true; }
+
+    int configure(Vector<String> &, ErrorHandler *) override CLICK_COLD;
+    void add_handlers() override CLICK_COLD;
+
+#if HAVE_BATCH
+    void push_batch(int port, PacketBatch *) override;
+#endif
+    void push(int port, Packet *) override;
+
+  private:
+
+    // The previous table is kept until the next reconfiguration, so that a
+    // thread still using it after a live reconfiguration is safe
+    IPACLTable *_table;
+    IPACLTable *_old_table;
+    int _nrules;
+
+    enum { H_RULES, H_ENTRIES, H_TUPLES, H_TABLE };
+    static String read_handler(Element *, void *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
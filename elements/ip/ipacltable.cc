@@ -0,0 +1,613 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * ipacltable.{cc,hh} -- tuple space search of IPv4 5-tuple rules
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "ipacltable.hh"
+#include <click/args.hh>
+#include <click/confparse.hh>
+#include <click/error.hh>
+#include <click/hashtable.hh>
+#include <click/nameinfo.hh>
+#include <click/straccum.hh>
+#include <click/ipaddress.hh>
+CLICK_DECLS
+
+namespace {
+
+// A conjunction of constraints on the 5 fields. Addresses are in host order.
+struct Clause {
+    uint32_t src, src_mask;
+    uint32_t dst, dst_mask;
+    uint32_t sport[2], dport[2];
+    int proto;
+    bool ports;
+
+    Clause()
+        : src(0), src_mask(0), dst(0), dst_mask(0), proto(-1), ports(false) {
+        sport[0] = dport[0] = 0;
+        sport[1] = dport[1] = 0xFFFF;
+    }
+
+    bool intersect(const Clause &o) {
+        // Prefix masks are nested, so the longest one is their union
+        if ((src ^ o.src) & src_mask & o.src_mask)
+            return false;
+        if (o.src_mask & ~src_mask)
+            src = o.src;
+        src_mask |= o.src_mask;
+        if ((dst ^ o.dst) & dst_mask & o.dst_mask)
+            return false;
+        if (o.dst_mask & ~dst_mask)
+            dst = o.dst;
+        dst_mask |= o.dst_mask;
+        sport[0] = (o.sport[0] > sport[0] ? o.sport[0] : sport[0]);
+        sport[1] = (o.sport[1] < sport[1] ? o.sport[1] : sport[1]);
+        dport[0] = (o.dport[0] > dport[0] ? o.dport[0] : dport[0]);
+        dport[1] = (o.dport[1] < dport[1] ? o.dport[1] : dport[1]);
+        if (sport[0] > sport[1] || dport[0] > dport[1])
+            return false;
+        if (o.proto >= 0) {
+            if (proto >= 0 && proto != o.proto)
+                return false;
+            proto = o.proto;
+        }
+        ports |= o.ports;
+        return true;
+    }
+};
+
+enum { SD_SRC, SD_DST, SD_OR, SD_AND };
+
+// Qualifiers of the previous term of a pattern
+struct Previous {
+    int sd;
+    String type;
+    int qual;
+
+    Previous()
+        : sd(-1), qual(-1) {
+    }
+};
+
+}
+
+// alts = alts AND (term_0 OR term_1 OR ...)
+static void
+conjoin(Vector<Clause> &alts, const Vector<Clause> &term)
+{
+    Vector<Clause> out;
+    for (int i = 0; i < alts.size(); i++)
+        for (int j = 0; j < term.size(); j++) {
+            Clause c = alts[i];
+            if (c.intersect(term[j]))
+                out.push_back(c);
+        }
+    alts.swap(out);
+}
+
+static inline uint32_t
+prefix_mask(int len, int bits)
+{
+    return len == 0 ? 0 : (uint32_t) ((~0ULL << (bits - len)) & ((1ULL << bits) - 1));
+}
+
+static bool
+is_and(const String &w)
+{
+    return w == "and" || w == "&&";
+}
+
+static int
+parse_term(const Vector<String> &words, int pos, Vector<Clause> &alts,
+           Previous &prev, const Element *context, ErrorHandler *errh)
+{
+    const String &first = words[pos];
+    int start = pos;
+    if (first == "not" || first == "!" || first == "or" || first == "||"
+        || first == "(" || first == ")" || first == "[" || first[0] == '(')
+        return errh->error("%<%s%> is not supported, use IPFilter for general patterns", first.c_str());
+
+    Vector<Clause> term;
+    Clause c;
+
+    int qual = -1;
+    if (first == "ip")
+        pos++;
+    else if (first == "tcp") {
+        qual = IP_PROTO_TCP;
+        pos++;
+    } else if (first == "udp") {
+        qual = IP_PROTO_UDP;
+        pos++;
+    } else if (first == "icmp") {
+        qual = IP_PROTO_ICMP;
+        pos++;
+    }
+    if (qual >= 0) {
+        c.proto = qual;
+        term.push_back(c);
+        conjoin(alts, term);
+        term.clear();
+        c = Clause();
+    }
+    if (pos == words.size() || is_and(words[pos])) {
+        if (pos == start)
+            return errh->error("empty term");
+        prev.sd = -1;
+        prev.type = "proto";
+        prev.qual = qual;
+        return pos;
+    }
+
+    int sd = SD_OR;
+    bool sd_given = true;
+    if (words[pos] == "src") {
+        if (pos + 2 < words.size() && (words[pos + 1] == "or" || words[pos + 1] == "and")
+            && words[pos + 2] == "dst") {
+            sd = (words[pos + 1] == "or" ? SD_OR : SD_AND);
+            pos += 3;
+        } else {
+            sd = SD_SRC;
+            pos++;
+        }
+    } else if (words[pos] == "dst") {
+        sd = SD_DST;
+        pos++;
+    } else
+        sd_given = false;
+
+    String type;
+    if (pos < words.size() && (words[pos] == "host" || words[pos] == "net"
+                               || words[pos] == "port" || words[pos] == "proto"))
+        type = words[pos++];
+    bool qualified = pos > start;
+
+    // Relational operators, as IPFilter: the positive test is "= N" or
+    // "> N", and the whole term may be negated
+    String op = (pos < words.size() ? words[pos] : String());
+    bool negated = false, greater = false;
+    if (op == "=" || op == "==")
+        pos++;
+    else if (op == "!=" || op == ">" || op == "<" || op == ">=" || op == "<=") {
+        negated = (op == "!=" || op == "<" || op == "<=");
+        greater = (op != "!=");
+        pos++;
+    } else
+        op = String();
+
+    if (pos >= words.size() || is_and(words[pos]))
+        return errh->error("missing data after %<%s%>", words[pos - 1].c_str());
+    const String &data = words[pos++];
+
+    // As in IPFilter, a term without qualifiers inherits those of the
+    // previous term: "src port 1 and 2" tests the source port twice
+    if (!qualified) {
+        int32_t i;
+        if (IntArg().parse(data, i)) {
+            if (prev.type != "port" && prev.type != "proto")
+                return errh->error("specify header field or %<port%>");
+            type = prev.type;
+            qual = prev.qual;
+        }
+        if (prev.sd >= 0)
+            sd = prev.sd;
+    }
+    prev.sd = sd;
+    prev.type = (type ? type : String("host"));
+    prev.qual = qual;
+
+    if (type == "proto") {
+        int32_t p;
+        if (sd_given || op)
+            return errh->error("bad %<proto%> test");
+        prev.sd = -1;
+        if (!NameInfo::query_int(NameInfo::T_IP_PROTO, context, data, &p) || p < 0 || p > 255)
+            return errh->error("bad protocol %<%s%>", data.c_str());
+        c.proto = p;
+        term.push_back(c);
+    } else if (type == "port") {
+        if (qual >= 0 && qual != IP_PROTO_TCP && qual != IP_PROTO_UDP)
+            return errh->error("port tests need TCP or UDP");
+        uint16_t port;
+        if (!IPPortArg(qual >= 0 ? qual : IP_PROTO_TCP).parse(data, port, context)
+            && (qual >= 0 || !IPPortArg(IP_PROTO_UDP).parse(data, port, context)))
+            return errh->error("bad port %<%s%>", data.c_str());
+
+        // Ranges of the positive test
+        uint32_t r[2][2];
+        int nr = 0;
+        uint32_t lo = port, hi = port;
+        if (greater) {
+            if (op == ">" || op == "<=")
+                lo = port + 1;
+            hi = 0xFFFF;
+        }
+        if (!negated) {
+            if (lo <= hi) {
+                r[0][0] = lo;
+                r[0][1] = hi;
+                nr = 1;
+            }
+        } else {
+            // !(src OR dst) == !src AND !dst, and vice versa
+            if (sd == SD_OR)
+                sd = SD_AND;
+            else if (sd == SD_AND)
+                sd = SD_OR;
+            if (lo > 0) {
+                r[nr][0] = 0;
+                r[nr++][1] = lo - 1;
+            }
+            if (hi < 0xFFFF) {
+                r[nr][0] = hi + 1;
+                r[nr++][1] = 0xFFFF;
+            }
+        }
+
+        c.ports = true;
+        for (int p = 0; p < 2; p++) {
+            int proto = (p == 0 ? IP_PROTO_TCP : IP_PROTO_UDP);
+            if (qual >= 0 && qual != proto)
+                continue;
+            c.proto = proto;
+            for (int i = 0; i < nr; i++) {
+                Clause x = c;
+                if (sd == SD_SRC || sd == SD_OR) {
+                    x.sport[0] = r[i][0];
+                    x.sport[1] = r[i][1];
+                    term.push_back(x);
+                }
+                if (sd == SD_DST || sd == SD_OR) {
+                    x = c;
+                    x.dport[0] = r[i][0];
+                    x.dport[1] = r[i][1];
+                    term.push_back(x);
+                }
+                if (sd == SD_AND)
+                    for (int j = 0; j < nr; j++) {
+                        x = c;
+                        x.sport[0] = r[i][0];
+                        x.sport[1] = r[i][1];
+                        x.dport[0] = r[j][0];
+                        x.dport[1] = r[j][1];
+                        term.push_back(x);
+                    }
+            }
+        }
+    } else if (type == "host" || type == "net" || !type) {
+        IPAddress addr, mask = IPAddress::make_broadcast();
+        if (op || negated)
+            return errh->error("only %<=%> is supported for addresses");
+        if (type != "net" && IPAddressArg().parse(data, addr, context))
+            /* host */;
+        else if (type != "host" && IPPrefixArg(true).parse(data, addr, mask, context)) {
+            if (mask.mask_to_prefix_len() < 0)
+                return errh->error("bad netmask %<%s%>", data.c_str());
+        } else if (!type)
+            return errh->error("unknown term %<%s%>", data.c_str());
+        else
+            return errh->error("bad address %<%s%>", data.c_str());
+        uint32_t a = ntohl(addr.addr()) & ntohl(mask.addr()), m = ntohl(mask.addr());
+        if (qual >= 0)
+            c.proto = qual;
+        if (sd == SD_SRC || sd == SD_OR || sd == SD_AND) {
+            c.src = a;
+            c.src_mask = m;
+        }
+        if (sd == SD_OR) {
+            term.push_back(c);
+            c.src = c.src_mask = 0;
+        }
+        if (sd == SD_DST || sd == SD_OR || sd == SD_AND) {
+            c.dst = a;
+            c.dst_mask = m;
+        }
+        term.push_back(c);
+    } else
+        return errh->error("unknown term %<%s%>", data.c_str());
+
+    conjoin(alts, term);
+    return pos;
+}
+
+static int
+parse_pattern(const Vector<String> &words, int action, int priority,
+              Vector<IPACLTable::Rule> &rules, const Element *context,
+              ErrorHandler *errh)
+{
+    Vector<Clause> alts;
+    alts.push_back(Clause());
+    Previous prev;
+
+    int pos = 1;
+    if (words.size() == 2 && (words[1] == "-" || words[1] == "any" || words[1] == "all"))
+        pos = 2;
+    while (pos < words.size()) {
+        pos = parse_term(words, pos, alts, prev, context, errh);
+        if (pos < 0)
+            return -1;
+        if (pos < words.size()) {
+            if (!is_and(words[pos]))
+                return errh->error("garbage after expression at %<%s%>", words[pos].c_str());
+            if (++pos == words.size())
+                return errh->error("missing term after %<%s%>", words[pos - 1].c_str());
+        }
+    }
+
+    for (int i = 0; i < alts.size(); i++) {
+        const Clause &c = alts[i];
+        IPACLTable::Rule r;
+        r.src = c.src;
+        r.src_len = __builtin_popcount(c.src_mask);
+        r.dst = c.dst;
+        r.dst_len = __builtin_popcount(c.dst_mask);
+        r.sport[0] = c.sport[0];
+        r.sport[1] = c.sport[1];
+        r.dport[0] = c.dport[0];
+        r.dport[1] = c.dport[1];
+        r.proto = c.proto;
+        r.ports = c.ports;
+        r.action = action;
+        r.priority = priority;
+        rules.push_back(r);
+    }
+    return 0;
+}
+
+static int
+parse_action(const Vector<String> &words, int noutputs, int &priority,
+             Vector<IPACLTable::Rule> &rules, const Element *context,
+             ErrorHandler *errh)
+{
+    const String &wd = words[0];
+    int action = -1;
+    if (wd == "allow") {
+        action = 0;
+        if (noutputs == 0)
+            return errh->error("%<allow%> is meaningless, element has zero outputs");
+    } else if (wd == "deny" || wd == "drop")
+        /* nada */;
+    else if (IntArg().parse(wd, action)) {
+        if (action < 0 || action >= noutputs)
+            return errh->error("slot %<%d%> out of range", action);
+    } else
+        return errh->error("unknown slot ID %<%s%>", wd.c_str());
+    return parse_pattern(words, action, priority++, rules, context, errh);
+}
+
+int
+IPACLTable::parse_rules(const Vector<String> &conf, int noutputs,
+                        Vector<Rule> &rules, const Element *context,
+                        ErrorHandler *errh)
+{
+    int priority = 0;
+    int before = errh->nerrors();
+
+    for (int argno = 0; argno < conf.size(); argno++) {
+        Vector<String> words;
+        cp_spacevec(cp_unquote(conf[argno]), words);
+        PrefixErrorHandler cerrh(errh, "pattern " + String(argno) + ": ");
+
+        if (words.size() == 0) {
+            cerrh.error("empty pattern");
+            continue;
+        }
+
+        if (words[0] == "file") {
+            if (words.size() != 2) {
+                cerrh.error("file must have a single argument, the filename");
+                continue;
+            }
+            FILE *fp = fopen(words[1].c_str(), "r");
+            if (!fp) {
+                cerrh.error("could not open file %s", words[1].c_str());
+                continue;
+            }
+            char *line = 0;
+            size_t len = 0;
+            int lineno = 0;
+            while (getline(&line, &len, fp) != -1) {
+                lineno++;
+                String s = String(line).trim_space().trim_space_left();
+                if (!s || s[0] == '#')
+                    continue;
+                PrefixErrorHandler lerrh(errh, words[1] + ":" + String(lineno) + ": ");
+                Vector<String> subwords;
+                cp_spacevec(cp_unquote(s), subwords);
+                parse_action(subwords, noutputs, priority, rules, context, &lerrh);
+            }
+            free(line);
+            fclose(fp);
+        } else
+            parse_action(words, noutputs, priority, rules, context, &cerrh);
+    }
+
+    return errh->nerrors() == before ? priority : -EINVAL;
+}
+
+IPACLTable::IPACLTable()
+    : _nentries(0), _default_action(-1)
+{
+}
+
+IPACLTable::~IPACLTable()
+{
+    clear();
+}
+
+void
+IPACLTable::clear()
+{
+    for (int i = 0; i < _tuples.size(); i++)
+        delete[] _tuples[i].entries;
+    _tuples.clear();
+    _nentries = 0;
+}
+
+int
+IPACLTable::tuple_compar(const void *a, const void *b, void *)
+{
+    return reinterpret_cast<const Tuple *>(a)->min_priority
+        - reinterpret_cast<const Tuple *>(b)->min_priority;
+}
+
+void
+IPACLTable::build(const Vector<Rule> &rules, int default_action)
+{
+    clear();
+    _default_action = default_action;
+
+    // Group rules by shape: the lengths of their address prefixes, and
+    // whether they test the protocol and exact ports
+    HashTable<uint32_t, int> shapes(-1);
+    Vector<int> tuple_of(rules.size(), 0);
+    for (int i = 0; i < rules.size(); i++) {
+        const Rule &r = rules[i];
+        bool sport_exact = r.sport[0] == r.sport[1];
+        bool dport_exact = r.dport[0] == r.dport[1];
+        uint32_t shape = r.src_len | (r.dst_len << 6) | (sport_exact << 12)
+            | (dport_exact << 13) | ((r.proto >= 0) << 14) | (r.ports << 15);
+        int t = shapes.get(shape);
+        if (t < 0) {
+            t = _tuples.size();
+            shapes.set(shape, t);
+            Tuple tuple;
+            tuple.mask_a = ((uint64_t) prefix_mask(r.src_len, 32) << 32) | prefix_mask(r.dst_len, 32);
+            tuple.mask_b = (sport_exact ? 0xFFFFULL << 48 : 0)
+                | (dport_exact ? 0xFFFFULL << 32 : 0)
+                | (r.proto >= 0 ? 0xFF00 : 0) | (r.ports ? flag_ports : 0);
+            tuple.min_priority = r.priority;
+            tuple.n = 0;
+            tuple.shape = shape;
+            _tuples.push_back(tuple);
+        }
+        _tuples[t].n++;
+        if (r.priority < _tuples[t].min_priority)
+            _tuples[t].min_priority = r.priority;
+        tuple_of[i] = t;
+    }
+
+    // Open addressing tables, at most half full
+    for (int t = 0; t < _tuples.size(); t++) {
+        uint32_t capacity = 4;
+        while (capacity < 2 * (uint32_t) _tuples[t].n)
+            capacity <<= 1;
+        _tuples[t].capacity_mask = capacity - 1;
+        _tuples[t].entries = new Entry[capacity];
+        for (uint32_t i = 0; i < capacity; i++)
+            _tuples[t].entries[i].priority = -1;
+        _tuples[t].n = 0;
+    }
+
+    // Entries with the same key are probed in insertion order, hence in
+    // priority order, so a lookup can stop at the first match
+    for (int i = 0; i < rules.size(); i++) {
+        const Rule &r = rules[i];
+        Tuple &t = _tuples[tuple_of[i]];
+        uint64_t a = (((uint64_t) r.src << 32) | r.dst) & t.mask_a;
+        uint64_t b = (((uint64_t) r.sport[0] << 48) | ((uint64_t) r.dport[0] << 32)
+                      | ((r.proto & 0xFF) << 8) | (r.ports ? flag_ports : 0)) & t.mask_b;
+        for (uint32_t j = hash(a, b) & t.capacity_mask; ; j = (j + 1) & t.capacity_mask) {
+            Entry &e = t.entries[j];
+            if (e.priority < 0) {
+                e.a = a;
+                e.b = b;
+                e.sport[0] = r.sport[0];
+                e.sport[1] = r.sport[1];
+                e.dport[0] = r.dport[0];
+                e.dport[1] = r.dport[1];
+                e.priority = r.priority;
+                e.action = r.action;
+                t.n++;
+                _nentries++;
+                break;
+            } else if (e.a == a && e.b == b
+                       && e.sport[0] <= r.sport[0] && r.sport[1] <= e.sport[1]
+                       && e.dport[0] <= r.dport[0] && r.dport[1] <= e.dport[1]
+                       && e.priority <= r.priority)
+                // Shadowed by an earlier rule
+                break;
+        }
+    }
+
+    if (_tuples.size() > 1)
+        click_qsort(_tuples.begin(), _tuples.size(), sizeof(Tuple), tuple_compar);
+}
+
+void
+IPACLTable::lookup_batch(const Key *keys, int *actions, int n) const
+{
+    int best[batch_size];
+    uint8_t active[batch_size];
+    uint32_t slot[batch_size];
+    int nactive = n;
+
+    for (int i = 0; i < n; i++) {
+        best[i] = INT_MAX;
+        actions[i] = _default_action;
+        active[i] = i;
+    }
+
+    for (const Tuple *t = _tuples.begin(); t != _tuples.end(); ++t) {
+        // Tuples are sorted by priority: a packet with a better match than
+        // this tuple can hold is done
+        int k = 0;
+        for (int j = 0; j < nactive; j++)
+            if (best[active[j]] > t->min_priority)
+                active[k++] = active[j];
+        nactive = k;
+        if (!nactive)
+            break;
+
+        // Hash all keys first, so that the buckets are fetched in parallel
+        for (int j = 0; j < nactive; j++) {
+            const Key &key = keys[active[j]];
+            slot[j] = hash(key.a & t->mask_a, key.b & t->mask_b) & t->capacity_mask;
+            __builtin_prefetch(&t->entries[slot[j]]);
+        }
+
+        for (int j = 0; j < nactive; j++) {
+            int i = active[j];
+            const Entry *e = t->find(keys[i], slot[j]);
+            if (e && e->priority < best[i]) {
+                best[i] = e->priority;
+                actions[i] = e->action;
+            }
+        }
+    }
+}
+
+String
+IPACLTable::unparse() const
+{
+    StringAccum sa;
+    for (int i = 0; i < _tuples.size(); i++) {
+        const Tuple &t = _tuples[i];
+        sa << "src/" << (t.shape & 63) << " dst/" << ((t.shape >> 6) & 63);
+        if (t.shape & (1 << 12))
+            sa << " sport";
+        if (t.shape & (1 << 13))
+            sa << " dport";
+        if (t.shape & (1 << 14))
+            sa << " proto";
+        if (t.shape & (1 << 15))
+            sa << " ports";
+        sa << ": " << t.n << " entries, priority " << t.min_priority << '\n';
+    }
+    return sa.take_string();
+}
+
+CLICK_ENDDECLS
+ELEMENT_PROVIDES(IPACLTable)
@@ -0,0 +1,186 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+#ifndef CLICK_IPACLTABLE_HH
+#define CLICK_IPACLTABLE_HH
+#include <click/vector.hh>
+#include <click/packet.hh>
+#include <clicknet/ip.h>
+CLICK_DECLS
+class Element;
+class ErrorHandler;
+
+/** @class IPACLTable
+ * @brief Classifies IPv4 packets against a large list of 5-tuple rules.
+ *
+ * The table implements tuple space search. Rules sharing the same source and
+ * destination prefix lengths, and testing the same fields among the
+ * protocol and exact ports, form a tuple: a hash table indexed by the packet
+ * fields masked with the tuple's mask. A lookup probes each tuple once, so
+ * its cost depends on the number of distinct tuples, not on the number of
+ * rules.
+ *
+ * Port ranges are not expanded to prefixes, which would multiply the number
+ * of tuples. They are left out of the hash key, and checked on the entries
+ * of the probed bucket.
+ *
+ * The priority of a rule is its index in the rule list, lower numbers
+ * winning. Tuples are sorted by the best priority they contain, and a lookup
+ * stops as soon as the remaining tuples cannot hold a better match than the
+ * one already found.
+ *
+ * Rules use an IPFilter-compatible syntax restricted to conjunctions of
+ * 5-tuple tests; see IPACLFilter(n).
+ */
+class IPACLTable { public:
+
+    /** @brief A rule. Addresses and ports are in host order. */
+    struct Rule {
+        uint32_t src;
+        uint32_t dst;
+        uint8_t src_len;
+        uint8_t dst_len;
+        uint16_t sport[2];      // inclusive range
+        uint16_t dport[2];
+        int16_t proto;          // -1 means any
+        bool ports;             // needs the ports of a first fragment
+        int action;             // output port, or -1 to drop
+        int priority;           // index of the pattern
+    };
+
+    struct Key {
+        uint64_t a;             // src << 32 | dst
+        uint64_t b;             // sport << 48 | dport << 32 | proto << 8 | flags
+    };
+
+    enum { flag_ports = 1 };
+    enum { batch_size = 64 };
+
+    IPACLTable();
+    ~IPACLTable();
+
+    /** @brief Parse ACTION PATTERN arguments into rules.
+     * @param conf the arguments
+     * @param noutputs number of valid output ports
+     * @param rules the rules are appended here
+     * @return the number of patterns, or a negative error */
+    static int parse_rules(const Vector<String> &conf, int noutputs,
+                           Vector<Rule> &rules, const Element *context,
+                           ErrorHandler *errh);
+
+    /** @brief Build the table from @a rules, replacing its contents.
+     * @param rules rules sorted by priority, as parse_rules() returns them
+     * @param default_action action of packets matching no rule */
+    void build(const Vector<Rule> &rules, int default_action = -1);
+
+    static inline void make_key(const Packet *p, Key &key);
+
+    inline int lookup(const Key &key) const;
+    int lookup(const Packet *p) const {
+        Key key;
+        make_key(p, key);
+        return lookup(key);
+    }
+
+    /** @brief Find the action of @a n keys, @a n <= batch_size. */
+    void lookup_batch(const Key *keys, int *actions, int n) const;
+
+    int ntuples() const {
+        return _tuples.size();
+    }
+    int nentries() const {
+        return _nentries;
+    }
+    String unparse() const;
+
+  private:
+
+    struct Entry {
+        uint64_t a;
+        uint64_t b;
+        uint16_t sport[2];
+        uint16_t dport[2];
+        int priority;           // negative for an empty slot
+        int action;
+    };
+
+    struct Tuple {
+        uint64_t mask_a;
+        uint64_t mask_b;
+        int min_priority;
+        uint32_t capacity_mask;
+        Entry *entries;
+        int n;
+        uint32_t shape;
+
+        inline const Entry *find(const Key &key, uint32_t slot) const;
+    };
+
+    Vector<Tuple> _tuples;
+    int _nentries;
+    int _default_action;
+
+    // The prefixes are in the high bits of the fields, so they must be
+    // mixed down to the low bits used as the index
+    static inline uint32_t hash(uint64_t a, uint64_t b) {
+        uint64_t h = a ^ (b * 0x9E3779B97F4A7C15ULL);
+        h = (h ^ (h >> 33)) * 0xFF51AFD7ED558CCDULL;
+        return h ^ (h >> 33);
+    }
+
+    void clear();
+    static int tuple_compar(const void *a, const void *b, void *);
+
+    IPACLTable(const IPACLTable &);
+    IPACLTable &operator=(const IPACLTable &);
+
+};
+
+inline void
+IPACLTable::make_key(const Packet *p, Key &key)
+{
+    const click_ip *iph = p->ip_header();
+    key.a = ((uint64_t) ntohl(iph->ip_src.s_addr) << 32) | ntohl(iph->ip_dst.s_addr);
+    uint64_t b = (uint64_t) iph->ip_p << 8;
+    if ((iph->ip_p == IP_PROTO_TCP || iph->ip_p == IP_PROTO_UDP)
+        && IP_FIRSTFRAG(iph) && p->transport_length() >= 4) {
+        const uint16_t *ports = reinterpret_cast<const uint16_t *>(p->transport_header());
+        b |= ((uint64_t) ntohs(ports[0]) << 48) | ((uint64_t) ntohs(ports[1]) << 32) | flag_ports;
+    }
+    key.b = b;
+}
+
+inline const IPACLTable::Entry *
+IPACLTable::Tuple::find(const Key &key, uint32_t slot) const
+{
+    uint64_t ka = key.a & mask_a, kb = key.b & mask_b;
+    uint16_t sport = key.b >> 48, dport = key.b >> 32;
+    for (; ; slot = (slot + 1) & capacity_mask) {
+        const Entry *e = &entries[slot];
+        if (e->priority < 0)
+            return 0;
+        if (e->a == ka && e->b == kb
+            && sport >= e->sport[0] && sport <= e->sport[1]
+            && dport >= e->dport[0] && dport <= e->dport[1])
+            return e;
+    }
+}
+
+inline int
+IPACLTable::lookup(const Key &key) const
+{
+    int best = INT_MAX;
+    int action = _default_action;
+    for (const Tuple *t = _tuples.begin(); t != _tuples.end(); ++t) {
+        if (t->min_priority >= best)
+            break;
+        uint32_t slot = hash(key.a & t->mask_a, key.b & t->mask_b) & t->capacity_mask;
+        const Entry *e = t->find(key, slot);
+        if (e && e->priority < best) {
+            best = e->priority;
+            action = e->action;
+        }
+    }
+    return action;
+}
+
+CLICK_ENDDECLS
+#endif
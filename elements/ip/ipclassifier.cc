@@ -21,6 +21,7 @@
 #include <click/glue.hh>
 #include <click/error.hh>
 #include <click/confparse.hh>
+#include <click/args.hh>
 #include <click/router.hh>
 CLICK_DECLS
 
@@ -35,6 +36,14 @@ IPClassifier::~IPClassifier()
 int
 IPClassifier::configure(Vector<String> &conf, ErrorHandler *errh)
 {
+    // keywords are passed as is to IPFilter
+    String caching, jit;
+    if (Args(this, errh).bind(conf)
+	.read("CACHING", AnyArg(), caching)
+	.read("JIT", AnyArg(), jit)
+	.consume() < 0)
+	return -1;
+
     if (conf.size() != noutputs())
 	return errh->error("need %d arguments, one per output port", noutputs());
 
@@ -42,6 +51,10 @@ IPClassifier::configure(Vector<String> &conf, ErrorHandler *errh)
     Vector<String> new_conf;
     for (int i = 0; i < conf.size(); i++)
 	new_conf.push_back(String(i) + " " + conf[i]);
+    if (caching)
+	new_conf.push_back("CACHING " + caching);
+    if (jit)
+	new_conf.push_back("JIT " + jit);
     int r = IPFilter::configure(new_conf, errh);
     if (r >= 0 && !router()->initialized())
 	_zprog.warn_unused_outputs(noutputs(), errh);
@@ -5,7 +5,7 @@ CLICK_DECLS
 
 /*
 =c
-IPClassifier(PATTERN_1, ..., PATTERN_N)
+IPClassifier(PATTERN_1, ..., PATTERN_N [, I<keywords> CACHING, JIT])
 
 =s ip
 classifies IP packets by contents
@@ -198,6 +198,10 @@ Every IPClassifier element has an equivalent corresponding IPFilter element
 and vice versa. Use the element whose syntax is more convenient for your
 needs.
 
+The CACHING and JIT keyword arguments are the same as IPFilter's. They should
+come after the patterns, so that the C<pattern> handlers address the right
+arguments.
+
 =e
 
 For example,
@@ -228,6 +232,9 @@ is using to classify packets. At each step in the program, four bytes
 of packet data are ANDed with a mask and compared against four bytes of
 classifier pattern.
 
+=h jit read-only
+Returns true if the program is running as native code.
+
 =h pattern0 rw
 Returns or sets the element's pattern 0. There are as many C<pattern>
 handlers as there are output ports.
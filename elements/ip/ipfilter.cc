@@ -1198,7 +1198,8 @@ IPFilter::Parser::parse_test(int pos, bool negated)
 void
 IPFilter::parse_program(Classification::Wordwise::CompressedProgram &zprog,
             const Vector<String> &conf, int noutputs,
-            const Element *context, ErrorHandler *errh)
+            const Element *context, ErrorHandler *errh,
+            Classification::Wordwise::Program *prog)
 {
     Vector<Classification::Wordwise::Program> progs;
 
@@ -1271,6 +1272,8 @@ IPFilter::parse_program(Classification::Wordwise::CompressedProgram &zprog,
     // It helps to do another bubblesort for things like ports.
     progs[0].bubble_sort_and_exprs(offset_map, offset_map + 2, Classification::offset_max);
     zprog.compile(progs[0], PERFORM_BINARY_SEARCH, MIN_BINARY_SEARCH);
+    if (prog)
+        *prog = progs[0];
 
     // click_chatter("%s", zprog.unparse().c_str());
 }
@@ -1322,25 +1325,43 @@ IPFilter::add_pattern(Vector<String> &words, PrefixErrorHandler &cerrh,
 int
 IPFilter::configure(Vector<String> &conf, ErrorHandler *errh)
 {
+    bool jit = false;
+
     // Consume key-value argument before parsing the rules
     if (Args(this, errh).bind(conf)
         .read("CACHING", _caching)
+        .read("JIT", jit)
         .consume() < 0)
         return -1;
 
     if (_caching) {
         errh->message("%s::%s: Caching mode enabled", name().c_str(), class_name());
+        if (jit) {
+            errh->warning("JIT is not used with CACHING");
+            jit = false;
+        }
     }
 
     IPFilterProgram zprog;
-    parse_program(zprog, conf, noutputs(), this, errh);
+    Classification::Wordwise::Program prog;
+    parse_program(zprog, conf, noutputs(), this, errh, &prog);
 
-    if (!errh->nerrors()) {
-        _zprog = zprog;
-        return 0;
-    }
+    if (errh->nerrors())
+        return -1;
 
-    return -1;
+    _zprog = zprog;
+#if HAVE_CLASSIFIER_JIT
+    static const int base_offsets[] = { offset_mac, offset_net, offset_transp };
+    if (jit && prog.output_everything() < 0) {
+        if (prog.jit_compile(_jit_code, base_offsets, 3, errh) < 0)
+            errh->warning("falling back to the interpreter");
+    } else
+        _jit_code.disable();
+#else
+    if (jit)
+        errh->warning("JIT needs --enable-classifier-jit, falling back to the interpreter");
+#endif
+    return 0;
 }
 
 String
@@ -1352,6 +1373,13 @@ IPFilter::read_handler(Element *e, void *thunk)
         case H_PROGRAM: {
             return ipf->_zprog.unparse();
         }
+        case H_JIT: {
+#if HAVE_CLASSIFIER_JIT
+            return String(ipf->_jit_code.enabled());
+#else
+            return String(false);
+#endif
+        }
         case H_CACHE_HITS: {
             if (!ipf->_caching){
                 return "-1";
@@ -1400,6 +1428,7 @@ void
 IPFilter::add_handlers()
 {
     add_read_handler("program", read_handler, H_PROGRAM);
+    add_read_handler("jit", read_handler, H_JIT);
     add_read_handler("cache_hits_count", read_handler, H_CACHE_HITS);
     add_read_handler("cache_misses_count", read_handler, H_CACHE_MISSES);
     add_read_handler("cache_total_count", read_handler, H_CACHE_TOTAL);
@@ -1476,9 +1505,47 @@ IPFilter::length_checked_match(const IPFilterProgram &zprog, const Packet *p, in
 }
 
 #if HAVE_BATCH
+# if HAVE_CLASSIFIER_JIT
+/* Classify the batch with the compiled program, ClassifierJIT::batch_size
+ * packets per call, and split it as push_batch does. Each chunk is matched
+ * when its first packet is reached, before the batch is split there. */
+void
+IPFilter::jit_push_batch(PacketBatch *batch)
+{
+    const unsigned char *bases[ClassifierJIT::batch_size * 3];
+    int lengths[ClassifierJIT::batch_size];
+    int outputs[ClassifierJIT::batch_size];
+    int n = 0, i = 0;
+
+    auto next_output = [&](Packet *p) {
+        if (i == n) {
+            for (n = 0; n < ClassifierJIT::batch_size && p; ++n, p = p->next()) {
+                jit_bases(p, bases + n * 3);
+                lengths[n] = packet_length(p);
+            }
+            _jit_code.match_batch(bases, lengths, outputs, n);
+            i = 0;
+        }
+        return outputs[i++];
+    };
+    CLASSIFY_EACH_PACKET(
+        (noutputs() + 1),
+        next_output,
+        batch,
+        checked_output_push_batch
+    );
+}
+# endif
+
 void
 IPFilter::push_batch(int, PacketBatch *batch)
 {
+#if HAVE_CLASSIFIER_JIT
+    if (_jit_code.enabled()) {
+        jit_push_batch(batch);
+        return;
+    }
+#endif
     CLASSIFY_EACH_PACKET(
         (noutputs() + 1),
         match,
@@ -1492,6 +1559,14 @@ IPFilter::push_batch(int, PacketBatch *batch)
 void
 IPFilter::push(int, Packet *p)
 {
+#if HAVE_CLASSIFIER_JIT
+    if (_jit_code.enabled()) {
+        const unsigned char *bases[3];
+        jit_bases(p, bases);
+        checked_output_push(_jit_code.match(bases, packet_length(p)), p);
+        return;
+    }
+#endif
     checked_output_push(match(_zprog, p), p);
 }
 
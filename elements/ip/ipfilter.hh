@@ -4,12 +4,15 @@
 #include <click/batchelement.hh>
 #include <click/ipflowid.hh>
 #include <click/error.hh>
+#if HAVE_CLASSIFIER_JIT
+# include <click/classifierjit.hh>
+#endif
 CLICK_DECLS
 
 /*
 =c
 
-IPFilter([CACHING,] ACTION_1 PATTERN_1, ..., ACTION_N PATTERN_N)
+IPFilter([CACHING, JIT,] ACTION_1 PATTERN_1, ..., ACTION_N PATTERN_N)
 
 =s ip
 
@@ -45,6 +48,15 @@ Arguments:
 
 Boolean. Enables or disables caching. Defaults to false (i.e., no caching).
 
+=item JIT
+
+Boolean. If true, the optimized program is compiled to native code with LLVM,
+at configuration time and on every live reconfiguration, instead of being
+interpreted. Batches are then classified by a single call to the compiled
+code. Needs FastClick to be configured with --enable-classifier-jit, otherwise
+a warning is printed and the program is interpreted. JIT is not used together
+with CACHING. Defaults to false.
+
 =n
 
 Every IPFilter element has an equivalent corresponding IPClassifier element
@@ -116,6 +128,9 @@ is using to classify packets. At each step in the program, four bytes
 of packet data are ANDed with a mask and compared against four bytes of
 classifier pattern.
 
+=h jit read-only
+Returns true if the program is running as native code.
+
 =h cache_hits_count read-only
 If CACHING is enabled, the IPFilter element stores the last rule in a cache.
 This handler returns the number of cache hits (i.e., number of input packets
@@ -181,7 +196,8 @@ class IPFilter : public BatchElement { public:
     typedef Classification::Wordwise::CompressedProgram IPFilterProgram;
     static void parse_program(IPFilterProgram &zprog,
                   const Vector<String> &conf, int noutputs,
-                  const Element *context, ErrorHandler *errh);
+                  const Element *context, ErrorHandler *errh,
+                  Classification::Wordwise::Program *prog = 0);
     inline int match(const IPFilterProgram &zprog, const Packet *p);
     inline int match(Packet *p);
 
@@ -321,11 +337,21 @@ class IPFilter : public BatchElement { public:
     IPFilterProgram _zprog;
     bool _caching;
     IPFilterCache _cache;
+#if HAVE_CLASSIFIER_JIT
+    ClassifierJIT _jit_code;
+
+# if HAVE_BATCH
+    void jit_push_batch(PacketBatch *);
+# endif
+    static inline void jit_bases(const Packet *p, const unsigned char **bases);
+#endif
+
+    static inline int packet_length(const Packet *p);
 
     static String read_handler(Element *e, void *thunk);
 
     enum {
-        H_PROGRAM,
+        H_PROGRAM, H_JIT,
         H_CACHE_HITS, H_CACHE_MISSES, H_CACHE_TOTAL,
         H_CACHE_HITS_RATIO, H_CACHE_MISSES_RATIO
     };
@@ -390,8 +416,11 @@ IPFilter::Primitive::negation_is_simple() const
         return _type == TYPE_HOST || (_type & TYPE_FIELD) || _type == TYPE_IPFRAG;
 }
 
+/** @brief Return the length of @a p in the offset space of programs,
+ * where the network header starts at offset_net and the transport header at
+ * offset_transp. */
 inline int
-IPFilter::match(const IPFilterProgram &zprog, const Packet *p)
+IPFilter::packet_length(const Packet *p)
 {
     int packet_length = p->network_length(),
     network_header_length = p->network_header_length();
@@ -399,6 +428,25 @@ IPFilter::match(const IPFilterProgram &zprog, const Packet *p)
         packet_length += offset_transp - network_header_length;
     else
         packet_length += offset_net;
+    return packet_length;
+}
+
+#if HAVE_CLASSIFIER_JIT
+/** @brief Set the base pointers of @a p for the compiled program, so that
+ * bases[i] + offset is the address of the data at program offset offset. */
+inline void
+IPFilter::jit_bases(const Packet *p, const unsigned char **bases)
+{
+    bases[0] = p->mac_header() - 2;
+    bases[1] = p->network_header() - offset_net;
+    bases[2] = p->transport_header() - offset_transp;
+}
+#endif
+
+inline int
+IPFilter::match(const IPFilterProgram &zprog, const Packet *p)
+{
+    int packet_length = IPFilter::packet_length(p);
 
     if (zprog.output_everything() >= 0) {
         if (_caching) {
@@ -35,7 +35,6 @@
 #include <click/straccum.hh>
 #include <click/error.hh>
 #include <click/algorithm.hh>
-#include <click/heap.hh>
 
 #ifdef CLICK_LINUXMODULE
 #include <click/cxxprotect.h>
@@ -66,6 +65,187 @@ IPMapper::rewrite_flowid(IPRewriterInput *, const IPFlowID &, IPFlowID &,
     return IPRewriterBase::rw_drop;
 }
 
+//
+// IPRewriterHeap
+//
+
+IPRewriterHeap::IPRewriterHeap()
+    : _capacity(0x7FFFFFFF), _use_count(1)
+{
+    for (int which = 0; which < 2; ++which) {
+	Wheel &w = _wheels[which];
+	w.buckets = new IPRewriterFlow *[wheel_due + 1];
+	memset(w.buckets, 0, sizeof(IPRewriterFlow *) * (wheel_due + 1));
+	w.epoch = 0;
+	w.epoch_j = click_jiffies();
+	w.size = 0;
+    }
+}
+
+IPRewriterHeap::~IPRewriterHeap()
+{
+    assert(size() == 0);
+    for (int which = 0; which < 2; ++which)
+	delete[] _wheels[which].buckets;
+}
+
+inline unsigned
+IPRewriterHeap::bucket_of(const Wheel &w, click_jiffies_t expiry_j) const
+{
+    uint64_t e = w.epoch;
+    if (click_jiffies_less(w.epoch_j, expiry_j)) {
+	uint64_t d = expiry_j - w.epoch_j;
+	const uint64_t span = 1ULL << (wheel_levels * wheel_bits);
+	e += d < span ? d : span - 1;
+    }
+    uint64_t x = e ^ w.epoch;
+    int level = x ? (63 - __builtin_clzll(x)) / wheel_bits : 0;
+    // Flows expiring after the current level-3 cycle, at most a span away,
+    // go to the level-3 slot of their expiration in the next cycle. That
+    // slot is cascaded before they expire, and they are placed again then.
+    if (level >= wheel_levels)
+	level = wheel_levels - 1;
+    return level * wheel_slots
+	+ ((e >> (level * wheel_bits)) & (wheel_slots - 1));
+}
+
+inline void
+IPRewriterHeap::link_at(Wheel &w, unsigned b, IPRewriterFlow *f)
+{
+    f->_wheel_bucket = b;
+    IPRewriterFlow *&head = w.buckets[b];
+    if (!head)
+	head = f->_wheel_next = f->_wheel_prev = f;
+    else {
+	f->_wheel_next = head;
+	f->_wheel_prev = head->_wheel_prev;
+	head->_wheel_prev->_wheel_next = f;
+	head->_wheel_prev = f;
+    }
+}
+
+inline void
+IPRewriterHeap::detach(Wheel &w, IPRewriterFlow *f)
+{
+    IPRewriterFlow *&head = w.buckets[f->_wheel_bucket];
+    if (f->_wheel_next == f)
+	head = 0;
+    else {
+	f->_wheel_prev->_wheel_next = f->_wheel_next;
+	f->_wheel_next->_wheel_prev = f->_wheel_prev;
+	if (head == f)
+	    head = f->_wheel_next;
+    }
+}
+
+void
+IPRewriterHeap::link(IPRewriterFlow *f)
+{
+    Wheel &w = _wheels[f->_guaranteed];
+    // An empty wheel may have fallen behind
+    if (!w.size)
+	w.epoch_j = click_jiffies();
+    ++w.size;
+    link_at(w, bucket_of(w, f->_expiry_j), f);
+}
+
+void
+IPRewriterHeap::unlink(IPRewriterFlow *f)
+{
+    Wheel &w = _wheels[f->_guaranteed];
+    detach(w, f);
+    --w.size;
+}
+
+void
+IPRewriterHeap::reschedule(IPRewriterFlow *f, bool guaranteed)
+{
+    if (f->_guaranteed == guaranteed) {
+	Wheel &w = _wheels[guaranteed];
+	unsigned b = bucket_of(w, f->_expiry_j);
+	if (b != f->_wheel_bucket) {
+	    detach(w, f);
+	    link_at(w, b, f);
+	}
+    } else {
+	unlink(f);
+	f->_guaranteed = guaranteed;
+	link(f);
+    }
+}
+
+// Empty slot b: expired flows are due, the others go to lower levels
+void
+IPRewriterHeap::fire(Wheel &w, unsigned b)
+{
+    IPRewriterFlow *f = w.buckets[b];
+    if (!f)
+	return;
+    w.buckets[b] = 0;
+    f->_wheel_prev->_wheel_next = 0;
+    while (f) {
+	IPRewriterFlow *next = f->_wheel_next;
+	if (b < wheel_slots && !click_jiffies_less(w.epoch_j, f->_expiry_j))
+	    link_at(w, wheel_due, f);
+	else
+	    link_at(w, bucket_of(w, f->_expiry_j), f);
+	f = next;
+    }
+}
+
+void
+IPRewriterHeap::expire(int which, click_jiffies_t now_j)
+{
+    Wheel &w = _wheels[which];
+    if (!w.size) {
+	w.epoch_j = now_j;
+	return;
+    }
+
+    while (!click_jiffies_less(now_j, w.epoch_j)) {
+	unsigned digit = w.epoch & (wheel_slots - 1);
+	fire(w, digit);
+	// skip the empty level-0 slots up to now
+	click_jiffies_t lag = now_j - w.epoch_j;
+	unsigned step = 1;
+	while (step <= lag && digit + step < wheel_slots
+	       && !w.buckets[digit + step])
+	    ++step;
+	w.epoch += step;
+	w.epoch_j += step;
+	// cascade the slots of the higher levels that start now
+	for (int level = wheel_levels - 1; level > 0; --level)
+	    if (!(w.epoch & ((1ULL << (level * wheel_bits)) - 1)))
+		fire(w, level * wheel_slots
+		     + ((w.epoch >> (level * wheel_bits)) & (wheel_slots - 1)));
+    }
+
+    // Flows with expired guarantees become best-effort; expired best-effort
+    // flows are destroyed.
+    while (IPRewriterFlow *f = w.buckets[wheel_due]) {
+	if (which == h_guarantee)
+	    f->change_expiry(this, false, f->owner()->owner->best_effort_expiry(f));
+	else
+	    f->destroy(this);
+    }
+}
+
+IPRewriterFlow *
+IPRewriterHeap::first(int which)
+{
+    Wheel &w = _wheels[which];
+    for (int level = 0; level < wheel_levels; ++level) {
+	unsigned digit = (w.epoch >> (level * wheel_bits)) & (wheel_slots - 1);
+	// above level 0, the current slot was cascaded down; the last level
+	// wraps around to the flows of the next cycle
+	unsigned end = level == wheel_levels - 1 ? digit + wheel_slots + 1 : wheel_slots;
+	for (unsigned s = digit + (level > 0); s < end; ++s)
+	    if (IPRewriterFlow *f = w.buckets[level * wheel_slots + (s & (wheel_slots - 1))])
+		return f;
+    }
+    return w.buckets[wheel_due];
+}
+
 //
 // IPRewriterBase
 //
@@ -308,9 +488,9 @@ IPRewriterBase::get_entry(int ip_p, const IPFlowID &flowid, int input)
 
 IPRewriterEntry *
 IPRewriterBase::store_flow(IPRewriterFlow *flow, int input,
-			   Map &map, Map *reply_map_ptr)
+			   IPRewriterMapState &mstate,
+			   IPRewriterMapState *reply_mstate)
 {
-    IPRewriterState &state = *_state;
     IPRewriterBase *reply_element = _input_specs[input].reply_element;
     if ((unsigned) flow->entry(false).output() >= (unsigned) noutputs()
 	|| (unsigned) flow->entry(true).output() >= (unsigned) reply_element->noutputs()) {
@@ -318,9 +498,9 @@ IPRewriterBase::store_flow(IPRewriterFlow *flow, int input,
 	    return 0;
     }
 
-	state.map_lock.write_begin();
-    IPRewriterEntry *old = map.set(&flow->entry(false));
-	state.map_lock.write_end();
+	mstate.map_lock.write_begin();
+    IPRewriterEntry *old = mstate.map.set(&flow->entry(false));
+	mstate.map_lock.write_end();
 	if (old) {
 		if (_handle_migration)
 			return old; //TODO : an old flow is back. Change expiry
@@ -330,18 +510,18 @@ IPRewriterBase::store_flow(IPRewriterFlow *flow, int input,
 
     auto &heap = _heap[click_current_cpu_id()];
 
-    if (!reply_map_ptr)
-	reply_map_ptr = &reply_element->_state->map;
-    old = reply_map_ptr->set(&flow->entry(true));
+    // the reply map belongs to the reply element, so is its lock
+    if (!reply_mstate)
+	reply_mstate = &*reply_element->_state;
+    reply_mstate->map_lock.write_begin();
+    old = reply_mstate->map.set(&flow->entry(true));
+    reply_mstate->map_lock.write_end();
     if (unlikely(old)) {		// Assume every map has the same heap.
 	if (likely(old->flow() != flow))
 		old->flow()->destroy(heap);
     }
 
-    Vector<IPRewriterFlow *> &myheap = heap->_heaps[flow->guaranteed()];
-    myheap.push_back(flow);
-    push_heap(myheap.begin(), myheap.end(),
-	      IPRewriterFlow::heap_less(), IPRewriterFlow::heap_place());
+    heap->link(flow);
     ++_input_specs[input].count;
 
     if (unlikely(heap->size() > heap->capacity())) {
@@ -359,32 +539,9 @@ IPRewriterBase::store_flow(IPRewriterFlow *flow, int input,
 	}
     }
 
-    if (map.unbalanced()) {
-              state.map_lock.write_begin();
-              map.rehash(map.bucket_count() + 1);
-              state.map_lock.write_end();
-    }
-    if (reply_map_ptr != &map && reply_map_ptr->unbalanced()) {
-              state.map_lock.write_begin();
-          reply_map_ptr->rehash(reply_map_ptr->bucket_count() + 1);
-              state.map_lock.write_begin();
-    }
-
     return &flow->entry(false);
 }
 
-void
-IPRewriterBase::shift_heap_best_effort(click_jiffies_t now_j)
-{
-    // Shift flows with expired guarantees to the best-effort heap.
-    Vector<IPRewriterFlow *> &guaranteed_heap = _heap[click_current_cpu_id()]->_heaps[1];
-    while (guaranteed_heap.size() && guaranteed_heap[0]->expired(now_j)) {
-	IPRewriterFlow *mf = guaranteed_heap[0];
-	click_jiffies_t new_expiry = mf->owner()->owner->best_effort_expiry(mf);
-	mf->change_expiry(_heap[click_current_cpu_id()], false, new_expiry);
-    }
-}
-
 int IPRewriterBase::thread_configure(ThreadReconfigurationStage stage, ErrorHandler* errh, Bitvector threads) {
 	if (stage == THREAD_RECONFIGURE_UP_PRE) {
         set_migration(true, threads, _state);
@@ -398,18 +555,19 @@ bool
 IPRewriterBase::shrink_heap_for_new_flow(IPRewriterFlow *flow,
 					 click_jiffies_t now_j)
 {
-    shift_heap_best_effort(now_j);
-    // At this point, all flows in the guarantee heap expire in the future.
+    IPRewriterHeap *heap = _heap[click_current_cpu_id()];
+    heap->expire(IPRewriterHeap::h_guarantee, now_j);
+    // At this point, all flows in the guarantee wheel expire in the future.
     // So remove the next-to-expire best-effort flow, unless there are none.
     // In that case we always remove the current flow to honor previous
     // guarantees (= admission control).
     IPRewriterFlow *deadf;
-    if (_heap[click_current_cpu_id()]->_heaps[0].empty()) {
+    if (!heap->_wheels[IPRewriterHeap::h_best_effort].size) {
 	assert(flow->guaranteed());
 	deadf = flow;
     } else
-	deadf = _heap[click_current_cpu_id()]->_heaps[0][0];
-    deadf->destroy(_heap[click_current_cpu_id()]);
+	deadf = heap->first(IPRewriterHeap::h_best_effort);
+    deadf->destroy(heap);
     return deadf == flow;
 }
 
@@ -417,15 +575,15 @@ void
 IPRewriterBase::shrink_heap(bool clear_all, int thid)
 {
     click_jiffies_t now_j = click_jiffies();
-    shift_heap_best_effort(now_j);
-    Vector<IPRewriterFlow *> &best_effort_heap = _heap[thid]->_heaps[0];
-    while (best_effort_heap.size() && best_effort_heap[0]->expired(now_j))
-	best_effort_heap[0]->destroy(_heap[thid]);
-
-    int32_t capacity = clear_all ? 0 : _heap[thid]->_capacity;
-    while (_heap[thid]->size() > capacity) {
-	IPRewriterFlow *deadf = _heap[thid]->_heaps[_heap[thid]->_heaps[0].empty()][0];
-	deadf->destroy(_heap[thid]);
+    IPRewriterHeap *heap = _heap[thid];
+    heap->expire(IPRewriterHeap::h_guarantee, now_j);
+    heap->expire(IPRewriterHeap::h_best_effort, now_j);
+
+    int32_t capacity = clear_all ? 0 : heap->_capacity;
+    while (heap->size() > capacity) {
+	int which = heap->_wheels[IPRewriterHeap::h_best_effort].size
+	    ? IPRewriterHeap::h_best_effort : IPRewriterHeap::h_guarantee;
+	heap->first(which)->destroy(heap);
     }
 }
 
@@ -530,15 +688,14 @@ IPRewriterBase::pattern_write_handler(const String &str, Element *e, void *user_
     assert(click_current_cpu_id() == 0); //MT to be reviewed
 
 	// remove all existing flows created by this input
-	for (int which_heap = 0; which_heap < 2; ++which_heap) {
-	    Vector<IPRewriterFlow *> &myheap = rw->_heap[click_current_cpu_id()]->_heaps[which_heap]; //TODO : Same comment about MT
-	    for (int i = myheap.size() - 1; i >= 0; --i)
-		if (myheap[i]->owner() == spec) {
-		    myheap[i]->destroy(rw->_heap[click_current_cpu_id()]);  //TODO : Same comment about MT
-		    if (i < myheap.size())
-			++i;
-		}
-	}
+	IPRewriterHeap *heap = rw->_heap[click_current_cpu_id()]; //TODO : Same comment about MT
+	Vector<IPRewriterFlow *> dead;
+	heap->for_each([&](IPRewriterFlow *f) {
+		if (f->owner() == spec)
+		    dead.push_back(f);
+	    });
+	for (int i = 0; i < dead.size(); ++i)
+	    dead[i]->destroy(heap);
 
 	// change pattern
 	if (spec->kind == IPRewriterInput::i_pattern)
@@ -602,6 +759,6 @@ IPRewriterBase::llrpc(unsigned command, void *data)
 	return Element::llrpc(command, data);
 }
 
-ELEMENT_REQUIRES(IPRewriterMapping IPRewriterPattern)
+ELEMENT_REQUIRES(IPRewriterMapping IPRewriterPattern IPRewriterFlowMap)
 ELEMENT_PROVIDES(IPRewriterBase)
 CLICK_ENDDECLS
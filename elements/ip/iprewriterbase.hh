@@ -3,6 +3,7 @@
 #define CLICK_IPREWRITERBASE_HH
 #include <click/timer.hh>
 #include "elements/ip/iprwmapping.hh"
+#include "elements/ip/iprwflowmap.hh"
 #include <click/batchelement.hh>
 #include <click/bitvector.hh>
 #include <click/multithread.hh>
@@ -44,14 +45,21 @@ class IPRewriterInput { public:
 			      Packet *p, int mapid = mapid_default);
 };
 
+/** @class IPRewriterHeap
+ * @brief Expiration schedule of the flows of IPRewriter elements.
+ *
+ * Despite its name, it keeps flows in two hierarchical timing wheels, one for
+ * guaranteed flows and one for best-effort flows. A wheel has four levels of
+ * 256 slots. A level-0 slot holds the flows expiring in one jiffy, and a
+ * level-L slot those expiring in 256 consecutive level-(L-1) slots; as time
+ * advances, higher-level slots are cascaded down. Adding, removing and
+ * rescheduling a flow cost O(1), and a flow whose new expiration falls in the
+ * same slot is not moved. The flows of a slot are evicted in the order they
+ * were scheduled. */
 class IPRewriterHeap { public:
 
-    IPRewriterHeap()
-	: _capacity(0x7FFFFFFF), _use_count(1) {
-    }
-    ~IPRewriterHeap() {
-	assert(size() == 0);
-    }
+    IPRewriterHeap();
+    ~IPRewriterHeap();
 
     void use() {
 	++_use_count;
@@ -62,22 +70,49 @@ class IPRewriterHeap { public:
 	    delete this;
     }
 
-    Vector<IPRewriterFlow *>::size_type size() const {
-	    return _heaps[0].size() + _heaps[1].size();
+    int32_t size() const {
+	return _wheels[0].size + _wheels[1].size;
     }
     int32_t capacity() const {
 	return _capacity;
     }
 
+    /** @brief Call @a f on every flow, in no particular order.
+     *
+     * @a f must not destroy flows or change their expiration. */
+    template <typename F> void for_each(F f) const;
+
   private:
 
     enum {
 	h_best_effort = 0, h_guarantee = 1
     };
-    Vector<IPRewriterFlow *> _heaps[2];
+    enum {
+	wheel_levels = 4, wheel_bits = 8, wheel_slots = 1 << wheel_bits,
+	wheel_due = wheel_levels * wheel_slots // expired flows, during expire()
+    };
+
+    struct Wheel {
+	IPRewriterFlow **buckets;	// circular lists, by head
+	uint64_t epoch;			// current level-0 slot, unwrapped
+	click_jiffies_t epoch_j;	// jiffy of the current level-0 slot
+	int32_t size;
+    };
+
+    Wheel _wheels[2];
     int32_t _capacity;
     uint32_t _use_count;
 
+    inline unsigned bucket_of(const Wheel &w, click_jiffies_t expiry_j) const;
+    inline void link_at(Wheel &w, unsigned b, IPRewriterFlow *f);
+    inline void detach(Wheel &w, IPRewriterFlow *f);
+    void link(IPRewriterFlow *f);
+    void unlink(IPRewriterFlow *f);
+    void reschedule(IPRewriterFlow *f, bool guaranteed);
+    void fire(Wheel &w, unsigned b);
+    void expire(int which, click_jiffies_t now_j);
+    IPRewriterFlow *first(int which);
+
     friend class IPRewriterBase;
     friend class IPRewriterFlow;
 
@@ -88,12 +123,12 @@ class IPRewriterHeap { public:
 /**
  * Base for Rewriter elements
  *
- * Flows are kept in a Map, implemented by y a hashtable. That is for efficient flow lookup.
- * For expiration, flows are kept in a heap.
+ * Flows are kept in a Map, a flat hash table, for efficient flow lookup.
+ * For expiration, flows are kept in the timing wheels of an IPRewriterHeap.
  */
 class IPRewriterBase : public BatchElement { public:
 
-    typedef HashContainer<IPRewriterEntry> Map;
+    typedef IPRewriterFlowMap Map;
     enum {
 	rw_drop = -1, rw_addmap = -2
     };
@@ -125,7 +160,7 @@ class IPRewriterBase : public BatchElement { public:
     IPRewriterBase *reply_element(int input) const {
 	return _input_specs[input].reply_element;
     }
-    virtual HashContainer<IPRewriterEntry> *get_map(int mapid) {
+    virtual Map *get_map(int mapid) {
 	return likely(mapid == IPRewriterInput::mapid_default) ?
                &_state->map : 0;
     }
@@ -134,7 +169,8 @@ class IPRewriterBase : public BatchElement { public:
 	get_entry_check = -1, get_entry_reply = -2
     };
 
-    inline IPRewriterEntry *search_entry(const IPFlowID &flowid);
+    inline IPRewriterEntry *search_entry(const IPFlowID &flowid,
+					 const uint64_t *hash = 0);
 
     //Search a flow, adding it in the map if necessary
     virtual IPRewriterEntry *get_entry(int ip_p, const IPFlowID &flowid,
@@ -186,6 +222,7 @@ class IPRewriterBase : public BatchElement { public:
     bool _handle_migration;
 
     enum {
+	batch_size = 32,		   // packets prefetched together
 	default_timeout = 300,	   // 5 minutes
 	default_guarantee = 5,	   // 5 seconds
 	default_gc_interval = 60 * 15 // 15 minutes
@@ -195,8 +232,25 @@ class IPRewriterBase : public BatchElement { public:
 	return timeouts[1] ? timeouts[1] : timeouts[0];
     }
 
+#if HAVE_BATCH
+    // hashes of the packets of a batch, batch_size at a time
+    struct HashChunk {
+	const Map *maps[batch_size];
+	uint64_t hashes[batch_size];
+	int n;
+	int i;
+	HashChunk()
+	    : n(0), i(0) {
+	}
+    };
+    template <typename F> inline const uint64_t *next_hash(HashChunk &chunk,
+							   Packet *p,
+							   F map_of) const;
+#endif
+
     IPRewriterEntry *store_flow(IPRewriterFlow *flow, int input,
-				Map &map, Map *reply_map_ptr = 0);
+				IPRewriterMapState &mstate,
+				IPRewriterMapState *reply_mstate = 0);
     inline void unmap_flow(IPRewriterFlow *flow,
 			   Map &map, Map *reply_map_ptr = 0);
 
@@ -255,7 +309,7 @@ IPRewriterInput::rewrite_flowid(const IPFlowID &flowid,
 	rewritten_flowid = flowid;
 	return IPRewriterBase::rw_addmap;
     case i_pattern: {
-	HashContainer<IPRewriterEntry> *reply_map;
+	IPRewriterFlowMap *reply_map;
 	if (likely(mapid == mapid_default))
 	    reply_map = &reply_element->_state->map;
 	else
@@ -291,9 +345,65 @@ IPRewriterBase::unmap_flow(IPRewriterFlow *flow, Map &map,
 	reply_map_ptr->erase(it);
 }
 
+template <typename F> void
+IPRewriterHeap::for_each(F f) const
+{
+    for (int which = 0; which < 2; ++which) {
+	if (!_wheels[which].size)
+	    continue;
+	for (int b = 0; b <= wheel_due; ++b)
+	    if (IPRewriterFlow *head = _wheels[which].buckets[b]) {
+		IPRewriterFlow *x = head;
+		do {
+		    f(x);
+		    x = x->_wheel_next;
+		} while (x != head);
+	    }
+    }
+}
+
+#if HAVE_BATCH
+/** @brief Return the hash of the flow of @a p, or null if it has no map.
+ * @param chunk hashes of the current chunk of the batch
+ * @param map_of function returning the map of an IP protocol, or null
+ *
+ * Called on each packet of a batch in order. When @a p starts a new chunk,
+ * the flows of the batch_size packets from @a p are hashed and their buckets
+ * prefetched, then the entries they may match are. The returned hash is
+ * passed to search_entry() or IPRewriterFlowMap::get_hashed(), so each flow
+ * is hashed once. */
+template <typename F> inline const uint64_t *
+IPRewriterBase::next_hash(HashChunk &chunk, Packet *p, F map_of) const
+{
+    if (chunk.i == chunk.n) {
+	int k = 0;
+	for (; k < batch_size && p; ++k, p = p->next()) {
+	    const click_ip *iph = p->ip_header();
+	    chunk.maps[k] = 0;
+	    if (IP_FIRSTFRAG(iph) && p->transport_length() >= 8
+		&& (chunk.maps[k] = map_of(iph->ip_p))) {
+		chunk.hashes[k] = Map::hash(IPFlowID(p));
+		chunk.maps[k]->prefetch(chunk.hashes[k]);
+	    }
+	}
+	for (int i = 0; i < k; ++i)
+	    if (chunk.maps[i])
+		chunk.maps[i]->prefetch_entry(chunk.hashes[i]);
+	chunk.n = k;
+	chunk.i = 0;
+    }
+    int i = chunk.i++;
+    return chunk.maps[i] ? &chunk.hashes[i] : 0;
+}
+#endif
+
+/** @brief Return the entry of @a flowid in the default map, or null.
+ * @param hash hash of @a flowid from next_hash(), or null */
 inline IPRewriterEntry *
-IPRewriterBase::search_entry(const IPFlowID &flowid)
+IPRewriterBase::search_entry(const IPFlowID &flowid, const uint64_t *hash)
 {
+    if (hash)
+	return _state->map.get_hashed(flowid, *hash);
     return _state->map.get(flowid);
 }
 
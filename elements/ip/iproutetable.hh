@@ -58,7 +58,10 @@ The RadixIPLookup, DirectIPLookup, and RangeIPLookup elements are well suited
 for implementing large tables.  We also provide the LinearIPLookup,
 StaticIPLookup, and SortedIPLookup elements; they are simple, but their O(N)
 lookup speed is orders of magnitude slower.  RadixIPLookup or DirectIPLookup
-should be preferred for almost all purposes.
+should be preferred for almost all purposes.  PoptrieIPLookup, which was
+not part of this comparison, looks up batches of packets at once and handles
+route updates without stalling lookups; it is meant for full BGP tables that
+change often.
 
            1500-entry fraction of the ICSI BGP dump
 
@@ -157,8 +160,8 @@ the B<dump_routes> function. Normally hooked up to the `C<table>' handler.
 
 =back
 
-=a RadixIPLookup, DirectIPLookup, RangeIPLookup, StaticIPLookup,
-LinearIPLookup, SortedIPLookup, LinuxIPLookup */
+=a RadixIPLookup, DirectIPLookup, RangeIPLookup, PoptrieIPLookup,
+StaticIPLookup, LinearIPLookup, SortedIPLookup, LinuxIPLookup */
 
 struct IPRoute {
     IPAddress addr;
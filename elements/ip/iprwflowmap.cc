@@ -0,0 +1,113 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * iprwflowmap.{cc,hh} -- flat flow table for IPRewriter
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "iprwflowmap.hh"
+CLICK_DECLS
+
+IPRewriterFlowMap::IPRewriterFlowMap()
+    : _mask(initial_bucket_count - 1), _size(0)
+{
+    _buckets = (Bucket *) CLICK_ALIGNED_ALLOC(sizeof(Bucket) * initial_bucket_count);
+    assert(_buckets);
+    memset(_buckets, 0, sizeof(Bucket) * initial_bucket_count);
+}
+
+IPRewriterFlowMap::~IPRewriterFlowMap()
+{
+    CLICK_ALIGNED_FREE(_buckets, sizeof(Bucket) * (_mask + 1));
+}
+
+void
+IPRewriterFlowMap::insert(IPRewriterEntry *e, uint64_t h)
+{
+    for (uint32_t b = h & _mask; ; b = (b + 1) & _mask) {
+	Bucket &bk = _buckets[b];
+	for (int i = 0; i < slots; ++i)
+	    if (!bk.tags[i]) {
+		bk.tags[i] = tag_of(h);
+		bk.entries[i] = e;
+		return;
+	    }
+	++bk.overflow;
+    }
+}
+
+void
+IPRewriterFlowMap::grow()
+{
+    uint32_t n = (_mask + 1) * 2;
+    Bucket *nb = (Bucket *) CLICK_ALIGNED_ALLOC(sizeof(Bucket) * n);
+    if (!nb)
+	return;
+    memset(nb, 0, sizeof(Bucket) * n);
+
+    Bucket *ob = _buckets;
+    uint32_t on = _mask + 1;
+    _buckets = nb;
+    _mask = n - 1;
+    for (uint32_t b = 0; b < on; ++b)
+	for (int i = 0; i < slots; ++i)
+	    if (ob[b].tags[i]) {
+		IPRewriterEntry *e = ob[b].entries[i];
+		insert(e, hash(e->flowid()));
+	    }
+    CLICK_ALIGNED_FREE(ob, sizeof(Bucket) * on);
+}
+
+IPRewriterEntry *
+IPRewriterFlowMap::set(IPRewriterEntry *e)
+{
+    uint64_t h = hash(e->flowid());
+    uint16_t t = tag_of(h);
+    for (uint32_t b = h & _mask; ; b = (b + 1) & _mask) {
+	Bucket &bk = _buckets[b];
+	for (int i = 0; i < slots; ++i)
+	    if (bk.tags[i] == t && bk.entries[i]->flowid() == e->flowid()) {
+		IPRewriterEntry *old = bk.entries[i];
+		bk.entries[i] = e;
+		return old;
+	    }
+	if (!bk.overflow)
+	    break;
+    }
+
+    size_t nslots = (size_t) (_mask + 1) * slots;
+    if ((_size + 1) * 4 > nslots * 3) {
+	grow();
+	nslots = (size_t) (_mask + 1) * slots;
+    }
+    assert(_size < nslots);
+    insert(e, h);
+    ++_size;
+    return 0;
+}
+
+void
+IPRewriterFlowMap::erase(const iterator &it)
+{
+    assert(it._map == this && it.live());
+    IPRewriterEntry *e = it.get();
+    // undo the overflow counts of the buckets skipped on insertion
+    for (uint32_t b = hash(e->flowid()) & _mask; b != it._b; b = (b + 1) & _mask)
+	--_buckets[b].overflow;
+    Bucket &bk = _buckets[it._b];
+    bk.tags[it._s] = 0;
+    bk.entries[it._s] = 0;
+    --_size;
+}
+
+CLICK_ENDDECLS
+ELEMENT_PROVIDES(IPRewriterFlowMap)
@@ -0,0 +1,239 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+#ifndef CLICK_IPRW_FLOWMAP_HH
+#define CLICK_IPRW_FLOWMAP_HH
+#include <click/glue.hh>
+#include <click/ipflowid.hh>
+#include "iprwmapping.hh"
+CLICK_DECLS
+
+/** @class IPRewriterFlowMap
+ * @brief Open-addressed map from flow IDs to IPRewriter entries.
+ *
+ * The map is an array of buckets of one cache line each. A bucket holds six
+ * entry pointers and the 16-bit tags of their hashes, so that a lookup only
+ * dereferences entries whose tag matches. When its home bucket is full, an
+ * entry goes to the next bucket with a free slot; every bucket passed on the
+ * way counts it in its overflow count, and a lookup stops at the first
+ * bucket with no overflow. Erasing an entry decrements those counts again,
+ * so there are no tombstones.
+ *
+ * The map grows by doubling when it is three quarters full. Unlike
+ * HashContainer, it does not need to be rehashed by its users.
+ *
+ * Lookups can be split in stages so that a burst of packets is resolved with
+ * overlapping cache misses: hash() every flow ID, prefetch() their buckets,
+ * then prefetch_entry() their candidate entries, before the get_hashed()
+ * calls.
+ */
+class IPRewriterFlowMap { public:
+
+    enum { slots = 6, initial_bucket_count = 16 };
+
+    struct Bucket {
+	uint16_t tags[slots];	// 0 is a free slot
+	uint16_t overflow;	// entries stored past this bucket
+	IPRewriterEntry *entries[slots];
+    } CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+
+    class iterator;
+
+    IPRewriterFlowMap();
+    ~IPRewriterFlowMap();
+
+    IPRewriterFlowMap(const IPRewriterFlowMap &) = delete;
+    IPRewriterFlowMap &operator=(const IPRewriterFlowMap &) = delete;
+
+    size_t size() const {
+	return _size;
+    }
+    bool empty() const {
+	return _size == 0;
+    }
+    uint32_t bucket_count() const {
+	return _mask + 1;
+    }
+
+    /** @brief Hash a flow ID, for the *_hashed and prefetch functions. */
+    static inline uint64_t hash(const IPFlowID &flowid);
+
+    /** @brief Prefetch the home bucket of a hashed flow ID. */
+    inline void prefetch(uint64_t h) const {
+	__builtin_prefetch(&_buckets[h & _mask]);
+    }
+    /** @brief Prefetch the entry that may match a hashed flow ID.
+     *
+     * Only the home bucket is checked. Meant as a second stage, once the
+     * bucket is in cache. */
+    inline void prefetch_entry(uint64_t h) const;
+
+    /** @brief Return the entry for @a flowid, or null. */
+    inline IPRewriterEntry *get_hashed(const IPFlowID &flowid, uint64_t h) const;
+    inline IPRewriterEntry *get(const IPFlowID &flowid) const {
+	return get_hashed(flowid, hash(flowid));
+    }
+
+    inline iterator find(const IPFlowID &flowid) const;
+
+    /** @brief Insert @a e, replacing any entry with the same flow ID.
+     * @return the replaced entry, or null */
+    IPRewriterEntry *set(IPRewriterEntry *e);
+
+    /** @brief Remove the entry pointed to by @a it. */
+    void erase(const iterator &it);
+
+    inline iterator begin() const;
+    inline iterator end() const;
+
+    class iterator { public:
+
+	typedef bool (iterator::*unspecified_bool_type)() const;
+
+	iterator()
+	    : _map(0), _b(0), _s(0) {
+	}
+
+	bool live() const {
+	    return _map && _b <= _map->_mask;
+	}
+	operator unspecified_bool_type() const {
+	    return live() ? &iterator::live : 0;
+	}
+
+	IPRewriterEntry *get() const {
+	    return live() ? _map->_buckets[_b].entries[_s] : 0;
+	}
+	IPRewriterEntry *operator->() const {
+	    return _map->_buckets[_b].entries[_s];
+	}
+	IPRewriterEntry &operator*() const {
+	    return *_map->_buckets[_b].entries[_s];
+	}
+
+	void operator++() {
+	    ++_s;
+	    settle();
+	}
+	void operator++(int) {
+	    ++*this;
+	}
+
+	bool operator==(const iterator &x) const {
+	    return _b == x._b && _s == x._s;
+	}
+	bool operator!=(const iterator &x) const {
+	    return !(*this == x);
+	}
+
+      private:
+
+	const IPRewriterFlowMap *_map;
+	uint32_t _b;
+	int _s;
+
+	iterator(const IPRewriterFlowMap *map, uint32_t b, int s)
+	    : _map(map), _b(b), _s(s) {
+	}
+
+	// move to the first used slot at or after the current one
+	void settle() {
+	    for (; _b <= _map->_mask; ++_b, _s = 0)
+		for (; _s < slots; ++_s)
+		    if (_map->_buckets[_b].tags[_s])
+			return;
+	}
+
+	friend class IPRewriterFlowMap;
+
+    };
+
+  private:
+
+    Bucket *_buckets;
+    uint32_t _mask;
+    size_t _size;
+
+    static inline uint16_t tag_of(uint64_t h) {
+	uint16_t t = h >> 48;
+	return t ? t : 1;
+    }
+    void insert(IPRewriterEntry *e, uint64_t h);
+    void grow();
+
+};
+
+inline uint64_t
+IPRewriterFlowMap::hash(const IPFlowID &flowid)
+{
+    uint64_t h = (((uint64_t) flowid.saddr().addr() << 32)
+		  | flowid.daddr().addr()) * 0x9E3779B97F4A7C15ULL;
+    h ^= ((uint32_t) flowid.sport() << 16) | flowid.dport();
+    // finalizer of MurmurHash3
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+inline void
+IPRewriterFlowMap::prefetch_entry(uint64_t h) const
+{
+    const Bucket &bk = _buckets[h & _mask];
+    uint16_t t = tag_of(h);
+    for (int i = 0; i < slots; ++i)
+	if (bk.tags[i] == t) {
+	    // the entry may be the second of its flow, whose first one is
+	    // read when rewriting the packet
+	    const char *x = reinterpret_cast<const char *>(bk.entries[i] - 1);
+	    __builtin_prefetch(x);
+	    __builtin_prefetch(x + CLICK_CACHE_LINE_SIZE);
+	    return;
+	}
+}
+
+inline IPRewriterEntry *
+IPRewriterFlowMap::get_hashed(const IPFlowID &flowid, uint64_t h) const
+{
+    uint16_t t = tag_of(h);
+    for (uint32_t b = h & _mask; ; b = (b + 1) & _mask) {
+	const Bucket &bk = _buckets[b];
+	for (int i = 0; i < slots; ++i)
+	    if (bk.tags[i] == t && bk.entries[i]->flowid() == flowid)
+		return bk.entries[i];
+	if (!bk.overflow)
+	    return 0;
+    }
+}
+
+inline IPRewriterFlowMap::iterator
+IPRewriterFlowMap::find(const IPFlowID &flowid) const
+{
+    uint64_t h = hash(flowid);
+    uint16_t t = tag_of(h);
+    for (uint32_t b = h & _mask; ; b = (b + 1) & _mask) {
+	const Bucket &bk = _buckets[b];
+	for (int i = 0; i < slots; ++i)
+	    if (bk.tags[i] == t && bk.entries[i]->flowid() == flowid)
+		return iterator(this, b, i);
+	if (!bk.overflow)
+	    return end();
+    }
+}
+
+inline IPRewriterFlowMap::iterator
+IPRewriterFlowMap::begin() const
+{
+    iterator it(this, 0, 0);
+    it.settle();
+    return it;
+}
+
+inline IPRewriterFlowMap::iterator
+IPRewriterFlowMap::end() const
+{
+    return iterator(this, _mask + 1, 0);
+}
+
+CLICK_ENDDECLS
+#endif
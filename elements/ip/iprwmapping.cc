@@ -29,7 +29,6 @@
 #include <click/straccum.hh>
 #include <click/error.hh>
 #include <click/algorithm.hh>
-#include <click/heap.hh>
 CLICK_DECLS
 
 IPRewriterFlow::IPRewriterFlow(IPRewriterInput *owner, const IPFlowID &flowid,
@@ -96,32 +95,14 @@ void
 IPRewriterFlow::change_expiry(IPRewriterHeap *h, bool guaranteed,
 			      click_jiffies_t expiry_j)
 {
-    Vector<IPRewriterFlow *> &current_heap = h->_heaps[_guaranteed];
-    assert(current_heap[_place] == this);
     _expiry_j = expiry_j;
-    if (_guaranteed != guaranteed) {
-	remove_heap(current_heap.begin(), current_heap.end(),
-		    current_heap.begin() + _place,
-		    heap_less(), heap_place());
-	current_heap.pop_back();
-	_guaranteed = guaranteed;
-	Vector<IPRewriterFlow *> &new_heap = h->_heaps[_guaranteed];
-	new_heap.push_back(this);
-	push_heap(new_heap.begin(), new_heap.end(),
-		  heap_less(), heap_place());
-    } else
-	change_heap(current_heap.begin(), current_heap.end(),
-		    current_heap.begin() + _place,
-		    heap_less(), heap_place());
+    h->reschedule(this, guaranteed);
 }
 
 void
 IPRewriterFlow::destroy(IPRewriterHeap *heap)
 {
-    Vector<IPRewriterFlow *> &myheap = heap->_heaps[_guaranteed];
-    remove_heap(myheap.begin(), myheap.end(), myheap.begin() + _place,
-		heap_less(), heap_place());
-    myheap.pop_back();
+    heap->unlink(this);
     --_owner->count;
     _owner->owner->destroy_flow(this);
 }
@@ -26,7 +26,6 @@ class IPRewriterEntry { public:
 		_flowid = flowid;
 		_output = output;
 		_direction = direction;
-		_hashnext = 0;
     }
 
     const IPFlowID &flowid() const {
@@ -58,9 +57,6 @@ class IPRewriterEntry { public:
     IPFlowID _flowid;
     uint32_t _output : 24;
     uint8_t _direction;
-    IPRewriterEntry *_hashnext;
-
-    friend class HashContainer_adapter<IPRewriterEntry>;
 
 };
 
@@ -148,24 +144,15 @@ class IPRewriterFlow { public:
     void unparse(StringAccum &sa, bool direction, click_jiffies_t now) const;
     void unparse_ports(StringAccum &sa, bool direction, click_jiffies_t now) const;
 
-    struct heap_less {
-	inline bool operator()(IPRewriterFlow *a, IPRewriterFlow *b) {
-	    return click_jiffies_less(a->expiry(), b->expiry());
-	}
-    };
-    struct heap_place {
-	inline void operator()(IPRewriterFlow **begin, IPRewriterFlow **it) {
-	    (*it)->_place = it - begin;
-	}
-    };
-
   protected:
 
     IPRewriterEntry _e[2];
     uint16_t _ip_csum_delta;
     uint16_t _udp_csum_delta;
     click_jiffies_t _expiry_j;
-    size_t _place : 32;
+    IPRewriterFlow *_wheel_next;
+    IPRewriterFlow *_wheel_prev;
+    uint16_t _wheel_bucket;
     uint8_t _ip_p;
     uint8_t _tflags;
     bool _guaranteed;
@@ -176,6 +163,7 @@ class IPRewriterFlow { public:
 
     friend class IPRewriterBase;
     friend class IPRewriterEntry;
+    friend class IPRewriterHeap;
 
   private:
 
@@ -22,6 +22,7 @@
 #include <click/config.h>
 #include "iprwpattern.hh"
 #include "elements/ip/iprwmapping.hh"
+#include "elements/ip/iprwflowmap.hh"
 #include "elements/ip/iprwpatterns.hh"
 #include <clicknet/ip.h>
 #include <clicknet/tcp.h>
@@ -220,7 +221,7 @@ IPRewriterPattern::parse_with_ports(const String &conf, IPRewriterInput *input,
 int
 IPRewriterPattern::rewrite_flowid(const IPFlowID &flowid,
 				  IPFlowID &rewritten_flowid,
-				  const HashContainer<IPRewriterEntry> &reply_map)
+				  const IPRewriterFlowMap &reply_map)
 {
     rewritten_flowid = flowid;
     if (_saddr)
@@ -241,7 +242,7 @@ IPRewriterPattern::rewrite_flowid(const IPFlowID &flowid,
 	if (_same_first
 	    && (val = ntohs(flowid.sport()) - base) <= _variation_top) {
 	    lookup.set_dport(flowid.sport());
-	    if (!reply_map.find(lookup))
+	    if (!reply_map.get(lookup))
 		goto found_variation;
 	}
 
@@ -258,7 +259,7 @@ IPRewriterPattern::rewrite_flowid(const IPFlowID &flowid,
 	    else
 		lookup.set_daddr(htonl(base + val));
         //Verify that the new variation is not already in the map
-	    if (!reply_map.find(lookup))
+	    if (!reply_map.get(lookup))
 		goto found_variation;
 	}
 
@@ -2,11 +2,11 @@
 #ifndef CLICK_IPRW_PATTERN_HH
 #define CLICK_IPRW_PATTERN_HH
 #include <click/element.hh>
-#include <click/hashcontainer.hh>
 #include <click/ipflowid.hh>
 CLICK_DECLS
 class IPRewriterFlow;
 class IPRewriterEntry;
+class IPRewriterFlowMap;
 class IPRewriterInput;
 
 class IPRewriterPattern { public:
@@ -38,7 +38,7 @@ class IPRewriterPattern { public:
     }
 
     int rewrite_flowid(const IPFlowID &flowid, IPFlowID &rewritten_flowid,
-		       const HashContainer<IPRewriterEntry> &reply_map);
+		       const IPRewriterFlowMap &reply_map);
 
     String unparse() const;
 
@@ -0,0 +1,527 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * poptrieiplookup.{cc,hh} -- looks up next-hop address in a compressed
+ * multibit trie
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/ipaddress.hh>
+#include <click/error.hh>
+#include <click/glue.hh>
+#include <click/straccum.hh>
+#include "poptrieiplookup.hh"
+CLICK_DECLS
+
+static inline uint32_t
+prefix_mask(int len)
+{
+    return len ? 0xFFFFFFFFU << (32 - len) : 0;
+}
+
+PoptrieIPLookup::PoptrieIPLookup()
+    : _nexthops(0), _long(0), _dirty_map(0), _deferred(false),
+      _nroutes(0), _ntries(0), _trie_bytes(0)
+{
+    _dir.initialize(0);
+}
+
+PoptrieIPLookup::~PoptrieIPLookup()
+{
+}
+
+int
+PoptrieIPLookup::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    uintptr_t *dir = new uintptr_t[dir_size];
+    for (int i = 0; i < dir_size; ++i)
+	dir[i] = 1;
+    _dir.initialize(dir);
+    _nexthops = new Nexthop[nexthop_capacity];
+    _nexthops[0].gw = IPAddress();
+    _nexthops[0].port = -1;
+    _nexthop_refs.push_back(1);	// never freed
+    _long = new Vector<Route>[dir_size];
+    _dirty_map = new uint8_t[dir_size];
+    memset(_dirty_map, 0, dir_size);
+
+    _deferred = true;
+    int r = IPRouteTable::configure(conf, errh);
+    _deferred = false;
+    if (r < 0)
+	return r;
+    return commit();
+}
+
+void
+PoptrieIPLookup::cleanup(CleanupStage)
+{
+    reclaim(true);
+    if (uintptr_t *dir = _dir.read()) {
+	for (int i = 0; i < dir_size; ++i)
+	    if (!(dir[i] & 1))
+		delete[] reinterpret_cast<uint64_t *>(dir[i]);
+	delete[] dir;
+	_dir.initialize(0);
+    }
+    delete[] _nexthops;
+    delete[] _long;
+    delete[] _dirty_map;
+    _nexthops = 0;
+    _long = 0;
+    _dirty_map = 0;
+}
+
+void
+PoptrieIPLookup::push(int, Packet *p)
+{
+    uint16_t nh = lookup_nexthop(_dir.read(), ntohl(p->dst_ip_anno().addr()));
+    const Nexthop &h = _nexthops[nh];
+    if (h.port >= 0) {
+	if (h.gw)
+	    p->set_dst_ip_anno(h.gw);
+	output(h.port).push(p);
+    } else
+	p->kill();
+}
+
+#if HAVE_BATCH
+void
+PoptrieIPLookup::push_batch(int, PacketBatch *batch)
+{
+    const uintptr_t *dir = _dir.read();
+    uint16_t hops[batch_size];
+    uint32_t addrs[batch_size];
+    int n = 0, j = 0;
+
+    // Each chunk is looked up when its first packet is reached, in three
+    // passes, so that the memory accesses of a packet overlap those of the
+    // others: prefetch the direct table entries, then the trie roots, then
+    // walk the tries
+    auto route = [&](Packet *p) -> int {
+	if (j == n) {
+	    Packet *q = p;
+	    for (n = 0; n < batch_size && q; ++n, q = q->next()) {
+		addrs[n] = ntohl(q->dst_ip_anno().addr());
+		__builtin_prefetch(&dir[addrs[n] >> 16]);
+	    }
+	    for (int i = 0; i < n; ++i) {
+		uintptr_t d = dir[addrs[i] >> 16];
+		if (!(d & 1))
+		    __builtin_prefetch(reinterpret_cast<const void *>(d));
+	    }
+	    for (int i = 0; i < n; ++i)
+		hops[i] = lookup_nexthop(dir, addrs[i]);
+	    j = 0;
+	}
+	const Nexthop &h = _nexthops[hops[j++]];
+	if (h.gw)
+	    p->set_dst_ip_anno(h.gw);
+	return h.port;
+    };
+    CLASSIFY_EACH_PACKET(noutputs() + 1, route, batch, checked_output_push_batch);
+}
+#endif
+
+int
+PoptrieIPLookup::lookup_route(IPAddress addr, IPAddress &gw) const
+{
+    uint16_t nh = lookup_nexthop(_dir.read(), ntohl(addr.addr()));
+    gw = _nexthops[nh].gw;
+    return _nexthops[nh].port;
+}
+
+int
+PoptrieIPLookup::find_nexthop(IPAddress gw, int port)
+{
+    uint64_t key = ((uint64_t) gw.addr() << 32) | (uint32_t) port;
+    if (uint16_t *nh = _nexthop_index.get_pointer(key)) {
+	++_nexthop_refs[*nh];
+	return *nh;
+    }
+
+    int nh;
+    if (_nexthop_free.size()) {
+	nh = _nexthop_free.back();
+	_nexthop_free.pop_back();
+    } else if (_nexthop_refs.size() < nexthop_capacity) {
+	nh = _nexthop_refs.size();
+	_nexthop_refs.push_back(0);
+    } else
+	return 0;
+    _nexthops[nh].gw = gw;
+    _nexthops[nh].port = port;
+    _nexthop_refs[nh] = 1;
+    _nexthop_index.set(key, nh);
+    return nh;
+}
+
+void
+PoptrieIPLookup::unref_nexthop(uint16_t nh)
+{
+    if (--_nexthop_refs[nh] == 0) {
+	const Nexthop &h = _nexthops[nh];
+	_nexthop_index.erase(((uint64_t) h.gw.addr() << 32) | (uint32_t) h.port);
+	// The published table may still use it
+	_nexthop_unused.push_back(nh);
+    }
+}
+
+uint16_t *
+PoptrieIPLookup::find_route(uint32_t addr, int len)
+{
+    if (len <= dir_bits)
+	return _short[len].get_pointer(addr);
+    Vector<Route> &v = _long[addr >> 16];
+    for (Route *r = v.begin(); r != v.end(); ++r)
+	if (r->addr == addr && r->len == len)
+	    return &r->nexthop;
+    return 0;
+}
+
+int
+PoptrieIPLookup::add_route(const IPRoute &route, bool set, IPRoute *old_route, ErrorHandler *errh)
+{
+    int len = route.prefix_len();
+    if (len < 0)
+	return errh->error("mask %s is not a prefix", route.mask.unparse().c_str());
+    uint32_t addr = ntohl(route.addr.addr()) & prefix_mask(len);
+
+    uint16_t *found = find_route(addr, len);
+    if (found && old_route)
+	*old_route = IPRoute(IPAddress(htonl(addr)), IPAddress::make_prefix(len),
+			     _nexthops[*found].gw, _nexthops[*found].port);
+    if (found && !set)
+	return -EEXIST;
+
+    int nh = find_nexthop(route.gw, route.port);
+    if (!nh)
+	return errh->error("too many different gateways and outputs");
+    if (found) {
+	unref_nexthop(*found);
+	*found = nh;
+    } else {
+	if (len <= dir_bits)
+	    _short[len].set(addr, nh);
+	else {
+	    Route r = {addr, (uint16_t) nh, (uint8_t) len};
+	    _long[addr >> 16].push_back(r);
+	}
+	++_nroutes;
+    }
+
+    mark_dirty(addr, len);
+    return _deferred ? 0 : commit();
+}
+
+int
+PoptrieIPLookup::remove_route(const IPRoute &route, IPRoute *old_route, ErrorHandler *)
+{
+    int len = route.prefix_len();
+    if (len < 0)
+	return -ENOENT;
+    uint32_t addr = ntohl(route.addr.addr()) & prefix_mask(len);
+
+    uint16_t *found = find_route(addr, len);
+    if (!found)
+	return -ENOENT;
+    IPRoute old(IPAddress(htonl(addr)), IPAddress::make_prefix(len),
+		_nexthops[*found].gw, _nexthops[*found].port);
+    if (old_route)
+	*old_route = old;
+    if (!route.match(old))
+	return -ENOENT;
+
+    unref_nexthop(*found);
+    if (len <= dir_bits)
+	_short[len].erase(addr);
+    else {
+	Vector<Route> &v = _long[addr >> 16];
+	for (Route *r = v.begin(); r != v.end(); ++r)
+	    if (&r->nexthop == found) {
+		*r = v.back();
+		v.pop_back();
+		break;
+	    }
+    }
+    --_nroutes;
+
+    mark_dirty(addr, len);
+    return _deferred ? 0 : commit();
+}
+
+void
+PoptrieIPLookup::mark_dirty(uint32_t addr, int len)
+{
+    // Bit 1 means the routes of the /16 changed, bit 2 that only the
+    // enclosing shorter routes did
+    uint32_t first = addr >> 16;
+    uint32_t count = len > dir_bits ? 1 : 1U << (dir_bits - len);
+    uint8_t flag = len > dir_bits ? 1 : 2;
+    for (uint32_t i = first; i < first + count; ++i) {
+	if (!_dirty_map[i])
+	    _dirty.push_back(i);
+	_dirty_map[i] |= flag;
+    }
+}
+
+uint16_t
+PoptrieIPLookup::best_short(uint32_t index) const
+{
+    uint32_t addr = index << 16;
+    for (int len = dir_bits; len >= 0; --len)
+	if (const uint16_t *nh = _short[len].get_pointer(addr & prefix_mask(len)))
+	    return *nh;
+    return 0;
+}
+
+int
+PoptrieIPLookup::route_compar(const void *a, const void *b, void *)
+{
+    return static_cast<const Route *>(a)->len - static_cast<const Route *>(b)->len;
+}
+
+void
+PoptrieIPLookup::build_node(Vector<Node> &nodes, Vector<uint16_t> &leaves, int ni,
+			    int depth, const Vector<Route> &routes, uint16_t def)
+{
+    int stride = depth + 6 < 32 ? 6 : 32 - depth;
+    int shift = 32 - depth - stride;
+    unsigned nslots = 1U << stride;
+
+    // Routes are sorted by length, so that longer ones overwrite the
+    // slots of the shorter ones they are part of
+    uint16_t hop[64];
+    uint64_t vector = 0;
+    for (unsigned s = 0; s < nslots; ++s)
+	hop[s] = def;
+    for (const Route *r = routes.begin(); r != routes.end(); ++r) {
+	unsigned s = (r->addr >> shift) & (nslots - 1);
+	if (r->len <= depth + stride)
+	    for (unsigned i = 0; i < 1U << (depth + stride - r->len); ++i)
+		hop[s + i] = r->nexthop;
+	else
+	    vector |= 1ULL << s;
+    }
+
+    uint64_t leafvec = 0;
+    uint32_t base0 = leaves.size();
+    for (unsigned s = 0; s < nslots; ++s)
+	if (!(vector & (1ULL << s))
+	    && (leaves.size() == (int) base0 || leaves.back() != hop[s])) {
+	    leafvec |= 1ULL << s;
+	    leaves.push_back(hop[s]);
+	}
+
+    uint32_t base1 = nodes.size();
+    nodes.resize(base1 + __builtin_popcountll(vector));
+    Node &n = nodes[ni];
+    n.vector = vector;
+    n.leafvec = leafvec;
+    n.base0 = base0;
+    n.base1 = base1;
+
+    int child = base1;
+    for (unsigned s = 0; s < nslots; ++s)
+	if (vector & (1ULL << s)) {
+	    Vector<Route> sub;
+	    for (const Route *r = routes.begin(); r != routes.end(); ++r)
+		if (r->len > depth + stride
+		    && ((r->addr >> shift) & (nslots - 1)) == s)
+		    sub.push_back(*r);
+	    build_node(nodes, leaves, child, depth + stride, sub, hop[s]);
+	    ++child;
+	}
+}
+
+PoptrieIPLookup::Trie *
+PoptrieIPLookup::build_trie(uint32_t index, uint16_t def)
+{
+    Vector<Route> routes(_long[index]);
+    click_qsort(routes.begin(), routes.size(), sizeof(Route), route_compar);
+
+    Vector<Node> nodes;
+    Vector<uint16_t> leaves;
+    nodes.resize(1);
+    build_node(nodes, leaves, 0, dir_bits, routes, def);
+
+    size_t size = Trie::size(nodes.size(), leaves.size());
+    Trie *t = reinterpret_cast<Trie *>(new uint64_t[(size + 7) / 8]);
+    t->nnodes = nodes.size();
+    t->nleaves = leaves.size();
+    t->nexthop = def;
+    memcpy(const_cast<Node *>(t->nodes()), nodes.begin(), nodes.size() * sizeof(Node));
+    memcpy(const_cast<uint16_t *>(t->leaves()), leaves.begin(), leaves.size() * sizeof(uint16_t));
+    return t;
+}
+
+int
+PoptrieIPLookup::commit()
+{
+    reclaim(false);
+    if (!_dirty.size() && !_nexthop_unused.size())
+	return 0;
+
+    // Copy the direct table, point the changed entries to new tries, and
+    // publish the copy. The old table and tries are kept until no lookup
+    // can be using them.
+    uintptr_t *&next = _dir.write_begin();
+    uintptr_t *old = next;
+    uintptr_t *dir = new uintptr_t[dir_size];
+    memcpy(dir, old, dir_size * sizeof(uintptr_t));
+
+    Retired retired;
+    retired.dir = old;
+    for (uint32_t *it = _dirty.begin(); it != _dirty.end(); ++it) {
+	uint32_t i = *it;
+	uint8_t flags = _dirty_map[i];
+	_dirty_map[i] = 0;
+
+	uint16_t def = best_short(i);
+	uintptr_t ov = old[i];
+	const Trie *ot = (ov & 1) ? 0 : reinterpret_cast<const Trie *>(ov);
+	if (!(flags & 1) && (ot ? ot->nexthop : ov >> 1) == def)
+	    continue;
+
+	if (_long[i].size()) {
+	    Trie *t = build_trie(i, def);
+	    dir[i] = reinterpret_cast<uintptr_t>(t);
+	    _trie_bytes += Trie::size(t->nnodes, t->nleaves);
+	    ++_ntries;
+	} else
+	    dir[i] = ((uintptr_t) def << 1) | 1;
+	if (ot) {
+	    retired.tries.push_back(const_cast<Trie *>(ot));
+	    _trie_bytes -= Trie::size(ot->nnodes, ot->nleaves);
+	    --_ntries;
+	}
+    }
+    _dirty.clear();
+
+    next = dir;
+    _dir.write_commit();
+
+    retired.nexthops.swap(_nexthop_unused);
+    retired.when = Timestamp::now_steady();
+    _retired.push_back(retired);
+    return 0;
+}
+
+void
+PoptrieIPLookup::reclaim(bool all)
+{
+    // Lookups hold a direct table only for the duration of a batch, which
+    // is assumed over by the next update, as with unprotected_rcu. The
+    // grace period makes updates in quick succession safe too.
+    Timestamp limit = Timestamp::now_steady() - Timestamp::make_msec(grace_msec);
+    int n = 0;
+    while (n < _retired.size() && (all || _retired[n].when <= limit))
+	++n;
+    for (int i = 0; i < n; ++i) {
+	Retired &r = _retired[i];
+	delete[] r.dir;
+	for (Trie **t = r.tries.begin(); t != r.tries.end(); ++t)
+	    delete[] reinterpret_cast<uint64_t *>(*t);
+	for (uint16_t *nh = r.nexthops.begin(); nh != r.nexthops.end(); ++nh)
+	    _nexthop_free.push_back(*nh);
+    }
+    _retired.erase(_retired.begin(), _retired.begin() + n);
+}
+
+void
+PoptrieIPLookup::flush()
+{
+    for (int len = 0; len <= dir_bits; ++len)
+	_short[len].clear();
+    for (int i = 0; i < dir_size; ++i)
+	_long[i].clear();
+    for (int nh = 1; nh < _nexthop_refs.size(); ++nh)
+	if (_nexthop_refs[nh]) {
+	    _nexthop_refs[nh] = 1;
+	    unref_nexthop(nh);
+	}
+    _nroutes = 0;
+    _dirty.clear();
+    for (int i = 0; i < dir_size; ++i) {
+	_dirty.push_back(i);
+	_dirty_map[i] = 1;
+    }
+}
+
+String
+PoptrieIPLookup::dump_routes()
+{
+    StringAccum sa;
+    for (int len = 0; len <= dir_bits; ++len)
+	for (HashTable<uint32_t, uint16_t>::iterator it = _short[len].begin(); it; ++it) {
+	    const Nexthop &h = _nexthops[it.value()];
+	    IPRoute(IPAddress(htonl(it.key())), IPAddress::make_prefix(len), h.gw, h.port).unparse(sa, true) << '\n';
+	}
+    for (int i = 0; i < dir_size; ++i)
+	for (const Route *r = _long[i].begin(); r != _long[i].end(); ++r) {
+	    const Nexthop &h = _nexthops[r->nexthop];
+	    IPRoute(IPAddress(htonl(r->addr)), IPAddress::make_prefix(r->len), h.gw, h.port).unparse(sa, true) << '\n';
+	}
+    return sa.take_string();
+}
+
+int
+PoptrieIPLookup::ctrl_handler(const String &conf, Element *e, void *thunk, ErrorHandler *errh)
+{
+    PoptrieIPLookup *t = static_cast<PoptrieIPLookup *>(e);
+    t->_deferred = true;
+    int r = IPRouteTable::ctrl_handler(conf, e, thunk, errh);
+    t->_deferred = false;
+    int r2 = t->commit();
+    return r < 0 ? r : r2;
+}
+
+int
+PoptrieIPLookup::flush_handler(const String &, Element *e, void *, ErrorHandler *)
+{
+    PoptrieIPLookup *t = static_cast<PoptrieIPLookup *>(e);
+    t->flush();
+    return t->commit();
+}
+
+String
+PoptrieIPLookup::read_handler(Element *e, void *thunk)
+{
+    PoptrieIPLookup *t = static_cast<PoptrieIPLookup *>(e);
+    switch ((intptr_t) thunk) {
+    case h_routes:
+	return String(t->_nroutes);
+    case h_tries:
+	return String(t->_ntries);
+    case h_memory:
+	return String(dir_size * sizeof(uintptr_t) + t->_trie_bytes
+		      + t->_nexthop_refs.size() * sizeof(Nexthop));
+    default:
+	return String();
+    }
+}
+
+void
+PoptrieIPLookup::add_handlers()
+{
+    IPRouteTable::add_handlers();
+    add_write_handler("ctrl", ctrl_handler);
+    add_write_handler("flush", flush_handler, 0, Handler::BUTTON);
+    add_read_handler("routes", read_handler, h_routes);
+    add_read_handler("tries", read_handler, h_tries);
+    add_read_handler("memory", read_handler, h_memory);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(IPRouteTable userlevel)
+EXPORT_ELEMENT(PoptrieIPLookup)
+ELEMENT_MT_SAFE(PoptrieIPLookup)
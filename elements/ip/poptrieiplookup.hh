@@ -0,0 +1,248 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_POPTRIEIPLOOKUP_HH
+#define CLICK_POPTRIEIPLOOKUP_HH
+#include <click/hashtable.hh>
+#include <click/multithread.hh>
+#include <click/timestamp.hh>
+#include "iproutetable.hh"
+CLICK_DECLS
+
+/*
+=c
+
+PoptrieIPLookup(ADDR1/MASK1 [GW1] OUT1, ADDR2/MASK2 [GW2] OUT2, ...)
+
+=s iproute
+
+IP routing lookup using a compressed multibit trie
+
+=d
+
+Expects a destination IP address annotation with each packet. Looks up that
+address in its routing table, using longest-prefix-match, sets the destination
+annotation to the corresponding GW (if specified), and emits the packet on the
+indicated OUTput port.
+
+Each argument is a route, specifying a destination and mask, an optional
+gateway IP address, and an output port.  No destination-mask pair should occur
+more than once.
+
+PoptrieIPLookup is meant for full BGP tables with frequent updates. The first
+16 bits of the address index a direct table, whose entries hold either a
+next hop or a trie for the /16. The tries use strides of 6, 6 and 4 bits, and
+are compressed as in Poptrie: a node stores a 64-bit vector marking the
+slots that have children, and another marking where runs of identical next
+hops start, so that children and next hops are found with a population
+count. A lookup costs at most five memory accesses, and a full table takes
+a few tens of megabytes.
+
+Batches are looked up in a pipeline: the direct table entries of all the
+packets are prefetched, then the trie roots, before the lookups proper.
+
+Routes can be added and removed while packets flow. An update only rebuilds
+the tries of the /16s it touches, in new memory, and publishes a new
+direct table at once; packets are never looked up in a half-updated table.
+The `C<ctrl>' handler applies all its commands in a single update, which is
+the efficient way to load many changes. Replaced memory is freed on a later
+update.
+
+=h table read-only
+
+Outputs a human-readable version of the current routing table.
+
+=h lookup read-only, requires parameters
+
+Reports the OUTput port and GW corresponding to an address.
+
+=h add write-only
+
+Adds a route to the table. Format should be `C<ADDR/MASK [GW] OUT>'.
+Fails if a route for C<ADDR/MASK> already exists.
+
+=h set write-only
+
+Sets a route, whether or not a route for the same prefix already exists.
+
+=h remove write-only
+
+Removes a route from the table. Format should be `C<ADDR/MASK>'.
+
+=h ctrl write-only
+
+Adds or removes a group of routes. Write `C<add>/C<set ADDR/MASK [GW] OUT>' to
+add a route, and `C<remove ADDR/MASK>' to remove a route. You can supply
+multiple commands, one per line; all commands are executed as one atomic
+operation.
+
+=h flush write-only
+
+Clears the entire routing table in a single atomic operation.
+
+=h routes read-only
+
+Returns the number of routes.
+
+=h tries read-only
+
+Returns the number of /16s that need a trie.
+
+=h memory read-only
+
+Returns the number of bytes used by the lookup structures.
+
+=n
+
+Masks must be contiguous. At most 65535 different GW and OUT pairs can be
+used at once.
+
+=a IPRouteTable, DirectIPLookup, RadixIPLookup, RangeIPLookup
+
+Hirochika Asai and Yasuhiro Ohara.  "Poptrie: A Compressed Trie with
+Population Count for Fast and Scalable Software IP Routing Table Lookup".
+In Proc. ACM SIGCOMM 2015, pp. 57-70.
+*/
+
+class PoptrieIPLookup : public IPRouteTable { public:
+
+    PoptrieIPLookup() CLICK_COLD;
+    ~PoptrieIPLookup() CLICK_COLD;
+
+    const char *class_name() const override	{ return "PoptrieIPLookup"; }
+    const char *port_count() const override	{ return "1/-"; }
+    const char *processing() const override	{ return PUSH; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    void cleanup(CleanupStage stage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int port, Packet *p);
+#if HAVE_BATCH
+    void push_batch(int port, PacketBatch *batch);
+#endif
+
+    int add_route(const IPRoute&, bool, IPRoute*, ErrorHandler *);
+    int remove_route(const IPRoute&, IPRoute*, ErrorHandler *);
+    int lookup_route(IPAddress, IPAddress&) const;
+    String dump_routes();
+
+    enum {
+	batch_size = 32,
+	nexthop_capacity = 65536,
+	dir_bits = 16,
+	dir_size = 1 << dir_bits,
+	grace_msec = 10
+    };
+
+  private:
+
+    struct Node {
+	uint64_t vector;	// slots with a child
+	uint64_t leafvec;	// slots starting a run of leaves
+	uint32_t base0;		// first leaf
+	uint32_t base1;		// first child
+    };
+
+    // A /16 trie: a header, the nodes, then the leaves, in one block
+    struct Trie {
+	uint32_t nnodes;
+	uint32_t nleaves;
+	uint32_t nexthop;	// of the /16 outside longer routes
+	uint32_t padding;
+
+	const Node *nodes() const {
+	    return reinterpret_cast<const Node *>(this + 1);
+	}
+	const uint16_t *leaves() const {
+	    return reinterpret_cast<const uint16_t *>(nodes() + nnodes);
+	}
+	static size_t size(uint32_t nnodes, uint32_t nleaves) {
+	    return sizeof(Trie) + nnodes * sizeof(Node) + nleaves * sizeof(uint16_t);
+	}
+    };
+
+    struct Nexthop {
+	IPAddress gw;
+	int port;
+    };
+
+    // Routes longer than /16 are kept with the /16 they belong to
+    struct Route {
+	uint32_t addr;
+	uint16_t nexthop;
+	uint8_t len;
+    };
+
+    struct Retired {
+	uintptr_t *dir;
+	Vector<Trie *> tries;
+	Vector<uint16_t> nexthops;
+	Timestamp when;
+    };
+
+    // Direct table entries are a next hop index shifted left by one, with
+    // the low bit set, or a pointer to a Trie
+    unprotected_rcu<uintptr_t *, 2> _dir;
+    Nexthop *_nexthops;
+
+    // Control plane
+    HashTable<uint32_t, uint16_t> _short[dir_bits + 1];
+    Vector<Route> *_long;
+    HashTable<uint64_t, uint16_t> _nexthop_index;
+    Vector<uint32_t> _nexthop_refs;
+    Vector<uint16_t> _nexthop_free;
+    Vector<uint16_t> _nexthop_unused;
+    Vector<uint32_t> _dirty;
+    uint8_t *_dirty_map;
+    Vector<Retired> _retired;
+    bool _deferred;
+    int _nroutes;
+    int _ntries;
+    size_t _trie_bytes;
+
+    static inline unsigned slot_rank(uint64_t v, unsigned slot) {
+	return __builtin_popcountll(v & ((2ULL << slot) - 1));
+    }
+    static inline uint16_t lookup_nexthop(const uintptr_t *dir, uint32_t addr);
+
+    int find_nexthop(IPAddress gw, int port);
+    void unref_nexthop(uint16_t nh);
+    uint16_t *find_route(uint32_t addr, int len);
+    void mark_dirty(uint32_t addr, int len);
+    uint16_t best_short(uint32_t index) const;
+    static int route_compar(const void *, const void *, void *);
+    static void build_node(Vector<Node> &nodes, Vector<uint16_t> &leaves, int ni,
+			   int depth, const Vector<Route> &routes, uint16_t def);
+    Trie *build_trie(uint32_t index, uint16_t def);
+    int commit();
+    void reclaim(bool all);
+    void flush();
+
+    static int ctrl_handler(const String &, Element *, void *, ErrorHandler *);
+    static int flush_handler(const String &, Element *, void *, ErrorHandler *);
+    enum { h_routes, h_tries, h_memory };
+    static String read_handler(Element *, void *);
+
+};
+
+inline uint16_t
+PoptrieIPLookup::lookup_nexthop(const uintptr_t *dir, uint32_t addr)
+{
+    uintptr_t d = dir[addr >> 16];
+    if (d & 1)
+	return d >> 1;
+    const Trie *t = reinterpret_cast<const Trie *>(d);
+    const Node *n = t->nodes();
+    unsigned slot = (addr >> 10) & 63;
+    if (n->vector & (1ULL << slot)) {
+	n = t->nodes() + n->base1 + slot_rank(n->vector, slot) - 1;
+	slot = (addr >> 4) & 63;
+	if (n->vector & (1ULL << slot)) {
+	    n = t->nodes() + n->base1 + slot_rank(n->vector, slot) - 1;
+	    slot = addr & 15;
+	}
+    }
+    return t->leaves()[n->base0 + slot_rank(n->leafvec, slot) - 1];
+}
+
+CLICK_ENDDECLS
+#endif
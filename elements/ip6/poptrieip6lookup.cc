@@ -0,0 +1,715 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * poptrieip6lookup.{cc,hh} -- looks up next-hop IPv6 address in a
+ * compressed multibit trie
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/glue.hh>
+#include <click/straccum.hh>
+#include "poptrieip6lookup.hh"
+CLICK_DECLS
+
+static inline uint32_t
+prefix_mask16(int len)
+{
+    return len ? (0xFFFFU << (16 - len)) & 0xFFFFU : 0;
+}
+
+template <typename T> static void
+insert_at(Vector<T> &v, int pos, const T &x)
+{
+    v.push_back(x);
+    for (int i = v.size() - 1; i > pos; --i)
+	v[i] = v[i - 1];
+    v[pos] = x;
+}
+
+template <typename T> static void
+remove_at(Vector<T> &v, int pos)
+{
+    for (int i = pos; i < v.size() - 1; ++i)
+	v[i] = v[i + 1];
+    v.pop_back();
+}
+
+PoptrieIP6Lookup::PoptrieIP6Lookup()
+    : _dir(0), _nexthops(0), _roots(0), _dirty_map(0), _deferred(false),
+      _nroutes(0), _nnodes(0), _dp_bytes(0)
+{
+}
+
+PoptrieIP6Lookup::~PoptrieIP6Lookup()
+{
+}
+
+int
+PoptrieIP6Lookup::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    _dir = new uintptr_t[dir_size];
+    for (int i = 0; i < dir_size; ++i)
+	_dir[i] = 1;
+    _roots = new CNode *[dir_size];
+    memset(_roots, 0, dir_size * sizeof(CNode *));
+    _dirty_map = new uint8_t[dir_size];
+    memset(_dirty_map, 0, dir_size);
+    _nexthops = new Nexthop[nexthop_capacity];
+    _nexthops[0].port = -1;
+    _nexthop_refs.push_back(1);	// never freed
+
+    // Encode the tries once all the routes are known
+    int r = 0;
+    _deferred = true;
+    for (int i = 0; i < conf.size(); ++i) {
+	PrefixErrorHandler cerrh(errh, "argument " + String(i + 1) + ": ");
+	if (add_route_handler(conf[i], this, 0, &cerrh) < 0)
+	    r = -EINVAL;
+    }
+    _deferred = false;
+    commit();
+    return r;
+}
+
+void
+PoptrieIP6Lookup::cleanup(CleanupStage)
+{
+    if (_dir) {
+	for (int i = 0; i < dir_size; ++i) {
+	    if (!(_dir[i] & 1))
+		retire(reinterpret_cast<const Node *>(_dir[i]), 1);
+	    if (_roots[i])
+		destroy(_roots[i]);
+	}
+	_retired.push_back(_retiring);
+	reclaim(true);
+    }
+    delete[] _dir;
+    delete[] _roots;
+    delete[] _dirty_map;
+    delete[] _nexthops;
+    _dir = 0;
+    _roots = 0;
+    _dirty_map = 0;
+    _nexthops = 0;
+}
+
+void
+PoptrieIP6Lookup::push(int, Packet *p)
+{
+    uint64_t w[2];
+    load(DST_IP6_ANNO(p), w);
+    const Nexthop &h = _nexthops[lookup_nexthop(w)];
+    if (h.port >= 0) {
+	if (h.gw)
+	    SET_DST_IP6_ANNO(p, h.gw);
+	output(h.port).push(p);
+    } else
+	p->kill();
+}
+
+#if HAVE_BATCH
+/* Look up the next hops of up to batch_size packets from p. Packets go down
+ * the tries one level at a time, so that the memory accesses of a packet
+ * overlap those of the others: each step prefetches what the next one
+ * reads. */
+int
+PoptrieIP6Lookup::lookup_chunk(Packet *p, uint16_t *hops) const
+{
+    uint64_t w[batch_size][2];
+    const Node *node[batch_size];
+    const uint16_t *leaf[batch_size];
+    uint8_t depth[batch_size];
+    uint8_t active[batch_size];
+
+    int k = 0;
+    for (; k < batch_size && p; ++k, p = p->next()) {
+	load(DST_IP6_ANNO(p), w[k]);
+	__builtin_prefetch(&_dir[w[k][0] >> 48]);
+    }
+
+    int nactive = 0;
+    for (int i = 0; i < k; ++i) {
+	uintptr_t d = _dir[w[i][0] >> 48];
+	leaf[i] = 0;
+	if (d & 1)
+	    hops[i] = d >> 1;
+	else {
+	    node[i] = reinterpret_cast<const Node *>(d);
+	    depth[i] = dir_bits;
+	    __builtin_prefetch(node[i]);
+	    active[nactive++] = i;
+	}
+    }
+
+    while (nactive) {
+	int nleft = 0;
+	for (int a = 0; a < nactive; ++a) {
+	    int i = active[a];
+	    const Node *x = node[i];
+	    unsigned s = slot_of(w[i], depth[i]);
+	    if (x->vector & (1ULL << s)) {
+		node[i] = x->children + slot_rank(x->vector, s) - 1;
+		depth[i] += 6;
+		__builtin_prefetch(node[i]);
+		active[nleft++] = i;
+	    } else {
+		leaf[i] = x->leaves + slot_rank(x->leafvec, s) - 1;
+		__builtin_prefetch(leaf[i]);
+	    }
+	}
+	nactive = nleft;
+    }
+
+    for (int i = 0; i < k; ++i)
+	if (leaf[i])
+	    hops[i] = *leaf[i];
+    return k;
+}
+
+void
+PoptrieIP6Lookup::push_batch(int, PacketBatch *batch)
+{
+    uint16_t hops[batch_size];
+    int n = 0, i = 0;
+
+    // Each chunk is looked up when its first packet is reached, before the
+    // batch is split there
+    auto route = [&](Packet *p) -> int {
+	if (i == n) {
+	    n = lookup_chunk(p, hops);
+	    i = 0;
+	}
+	const Nexthop &h = _nexthops[hops[i++]];
+	if (h.gw)
+	    SET_DST_IP6_ANNO(p, h.gw);
+	return h.port;
+    };
+    CLASSIFY_EACH_PACKET(noutputs() + 1, route, batch, checked_output_push_batch);
+}
+#endif
+
+int
+PoptrieIP6Lookup::lookup_route(const IP6Address &addr, IP6Address &gw) const
+{
+    uint64_t w[2];
+    load(addr, w);
+    const Nexthop &h = _nexthops[lookup_nexthop(w)];
+    gw = h.gw;
+    return h.port;
+}
+
+int
+PoptrieIP6Lookup::find_nexthop(const IP6Address &gw, int port)
+{
+    Pair<IP6Address, int> key(gw, port);
+    if (uint16_t *nh = _nexthop_index.get_pointer(key)) {
+	++_nexthop_refs[*nh];
+	return *nh;
+    }
+
+    int nh;
+    if (_nexthop_free.size()) {
+	nh = _nexthop_free.back();
+	_nexthop_free.pop_back();
+    } else if (_nexthop_refs.size() < nexthop_capacity) {
+	nh = _nexthop_refs.size();
+	_nexthop_refs.push_back(0);
+    } else
+	return 0;
+    _nexthops[nh].gw = gw;
+    _nexthops[nh].port = port;
+    _nexthop_refs[nh] = 1;
+    _nexthop_index.set(key, nh);
+    return nh;
+}
+
+void
+PoptrieIP6Lookup::unref_nexthop(uint16_t nh)
+{
+    if (--_nexthop_refs[nh] == 0) {
+	_nexthop_index.erase(Pair<IP6Address, int>(_nexthops[nh].gw, _nexthops[nh].port));
+	// The published tries may still use it
+	_retiring.nexthops.push_back(nh);
+    }
+}
+
+int
+PoptrieIP6Lookup::add_route(IP6Address addr, IP6Address mask, IP6Address gw,
+			    int port, ErrorHandler *errh)
+{
+    int len = mask.mask_to_prefix_len();
+    if (len < 0)
+	return errh->error("mask %s is not a prefix", mask.unparse().c_str());
+    uint64_t w[2];
+    load(addr & mask, w);
+    uint32_t index = w[0] >> 48;
+
+    int nh = find_nexthop(gw, port);
+    if (!nh)
+	return errh->error("too many different gateways and outputs");
+
+    uint16_t *found;
+    if (len <= dir_bits) {
+	found = _short[len].get_pointer(index);
+	if (!found)
+	    _short[len].set(index, nh);
+	mark_dirty(index, 1U << (dir_bits - len));
+    } else {
+	if (!_roots[index]) {
+	    _roots[index] = new CNode;
+	    _roots[index]->depth = dir_bits;
+	    ++_nnodes;
+	}
+
+	// Find or create the node holding the route, marking the path for
+	// re-encoding
+	CNode *c = _roots[index];
+	int depth = dir_bits;
+	while (1) {
+	    c->dirty = true;
+	    if (len <= depth + stride(depth))
+		break;
+	    unsigned s = slot_of(w, depth);
+	    int i = 0;
+	    while (i < c->children.size() && c->children[i]->slot < s)
+		++i;
+	    if (i == c->children.size() || c->children[i]->slot != s) {
+		CNode *child = new CNode;
+		child->depth = depth + stride(depth);
+		child->slot = s;
+		insert_at(c->children, i, child);
+		++_nnodes;
+	    }
+	    c = c->children[i];
+	    depth += stride(depth);
+	}
+
+	Route r = {(uint8_t) slot_of(w, depth), (uint8_t) len, (uint16_t) nh};
+	found = 0;
+	int i = 0;
+	for (; i < c->routes.size() && c->routes[i].len <= len; ++i)
+	    if (c->routes[i].len == len && c->routes[i].slot == r.slot) {
+		found = &c->routes[i].nexthop;
+		break;
+	    }
+	if (!found)
+	    insert_at(c->routes, i, r);
+	mark_dirty(index, 1);
+    }
+
+    if (found) {
+	unref_nexthop(*found);
+	*found = nh;
+    } else
+	++_nroutes;
+    if (!_deferred)
+	commit();
+    return 0;
+}
+
+int
+PoptrieIP6Lookup::remove_route(IP6Address addr, IP6Address mask, ErrorHandler *errh)
+{
+    int len = mask.mask_to_prefix_len();
+    uint64_t w[2];
+    load(addr & mask, w);
+    uint32_t index = w[0] >> 48;
+
+    if (len >= 0 && len <= dir_bits) {
+	if (uint16_t *found = _short[len].get_pointer(index)) {
+	    unref_nexthop(*found);
+	    _short[len].erase(index);
+	    --_nroutes;
+	    mark_dirty(index, 1U << (dir_bits - len));
+	    commit();
+	    return 0;
+	}
+    } else if (len > dir_bits) {
+	CNode *path[(128 - dir_bits) / 6 + 2];
+	int npath = 0;
+	CNode *c = _roots[index];
+	int depth = dir_bits;
+	while (c) {
+	    path[npath++] = c;
+	    if (len <= depth + stride(depth))
+		break;
+	    unsigned s = slot_of(w, depth);
+	    CNode **it = c->children.begin();
+	    while (it != c->children.end() && (*it)->slot < s)
+		++it;
+	    c = (it != c->children.end() && (*it)->slot == s ? *it : 0);
+	    depth += stride(depth);
+	}
+
+	unsigned s = c ? slot_of(w, depth) : 0;
+	for (int i = 0; c && i < c->routes.size() && c->routes[i].len <= len; ++i)
+	    if (c->routes[i].len == len && c->routes[i].slot == s) {
+		unref_nexthop(c->routes[i].nexthop);
+		remove_at(c->routes, i);
+		--_nroutes;
+
+		// Remove the nodes left empty, then re-encode the path
+		int k = npath - 1;
+		for (; k >= 0 && !path[k]->routes.size() && !path[k]->children.size(); --k) {
+		    if (k) {
+			Vector<CNode *> &v = path[k - 1]->children;
+			for (int j = 0; j < v.size(); ++j)
+			    if (v[j] == path[k]) {
+				remove_at(v, j);
+				break;
+			    }
+		    } else
+			_roots[index] = 0;
+		    destroy(path[k]);
+		}
+		for (; k >= 0; --k)
+		    path[k]->dirty = true;
+		mark_dirty(index, 1);
+		commit();
+		return 0;
+	    }
+    }
+
+    return errh->error("route %s/%d not found", addr.unparse().c_str(), len);
+}
+
+void
+PoptrieIP6Lookup::mark_dirty(uint32_t first, uint32_t count)
+{
+    for (uint32_t i = first; i < first + count; ++i)
+	if (!_dirty_map[i]) {
+	    _dirty_map[i] = 1;
+	    _dirty.push_back(i);
+	}
+}
+
+uint16_t
+PoptrieIP6Lookup::best_short(uint32_t index) const
+{
+    for (int len = dir_bits; len >= 0; --len)
+	if (const uint16_t *nh = _short[len].get_pointer(index & prefix_mask16(len)))
+	    return *nh;
+    return 0;
+}
+
+void
+PoptrieIP6Lookup::encode(CNode *c, uint16_t def)
+{
+    int s = stride(c->depth);
+    unsigned nslots = 1U << s;
+
+    // Routes are sorted by length, so that longer ones overwrite the
+    // slots of the shorter ones they are part of
+    uint16_t hop[64];
+    for (unsigned i = 0; i < nslots; ++i)
+	hop[i] = def;
+    for (const Route *r = c->routes.begin(); r != c->routes.end(); ++r)
+	for (unsigned i = 0; i < 1U << (c->depth + s - r->len); ++i)
+	    hop[r->slot + i] = r->nexthop;
+
+    // Children whose inherited next hop changed are re-encoded too
+    uint64_t vector = 0;
+    bool children_changed = c->dirty;
+    for (CNode **it = c->children.begin(); it != c->children.end(); ++it) {
+	CNode *ch = *it;
+	vector |= 1ULL << ch->slot;
+	if (ch->dirty || ch->def != hop[ch->slot]) {
+	    encode(ch, hop[ch->slot]);
+	    children_changed = true;
+	}
+    }
+
+    uint64_t leafvec = 0;
+    uint16_t leaves[64];
+    int nleaves = 0;
+    for (unsigned i = 0; i < nslots; ++i)
+	if (!(vector & (1ULL << i))
+	    && (!nleaves || leaves[nleaves - 1] != hop[i])) {
+	    leafvec |= 1ULL << i;
+	    leaves[nleaves++] = hop[i];
+	}
+
+    const uint16_t *lv = c->dp.leaves;
+    if (c->nleaves != nleaves
+	|| (nleaves && memcmp(lv, leaves, nleaves * sizeof(uint16_t)) != 0)) {
+	uint16_t *nl = nleaves ? new uint16_t[nleaves] : 0;
+	memcpy(nl, leaves, nleaves * sizeof(uint16_t));
+	_dp_bytes += nleaves * sizeof(uint16_t);
+	retire(lv, c->nleaves);
+	lv = nl;
+	c->nleaves = nleaves;
+    }
+
+    const Node *cv = c->dp.children;
+    if (children_changed) {
+	int nc = c->children.size();
+	Node *nn = nc ? new Node[nc] : 0;
+	for (int i = 0; i < nc; ++i)
+	    nn[i] = c->children[i]->dp;
+	_dp_bytes += nc * sizeof(Node);
+	retire(cv, __builtin_popcountll(c->dp.vector));
+	cv = nn;
+    }
+
+    c->dp.vector = vector;
+    c->dp.leafvec = leafvec;
+    c->dp.children = cv;
+    c->dp.leaves = lv;
+    c->def = def;
+    c->dirty = false;
+}
+
+void
+PoptrieIP6Lookup::update_dir(uint32_t index)
+{
+    uint16_t def = best_short(index);
+    CNode *root = _roots[index];
+    uintptr_t old = _dir[index], nv;
+    if (root) {
+	if (!root->dirty && root->def == def)
+	    return;
+	encode(root, def);
+	Node *n = new Node[1];
+	*n = root->dp;
+	_dp_bytes += sizeof(Node);
+	nv = reinterpret_cast<uintptr_t>(n);
+    } else
+	nv = ((uintptr_t) def << 1) | 1;
+
+    if (nv != old) {
+	click_write_fence();
+	_dir[index] = nv;
+	if (!(old & 1))
+	    retire(reinterpret_cast<const Node *>(old), 1);
+    }
+}
+
+void
+PoptrieIP6Lookup::destroy(CNode *c)
+{
+    for (CNode **it = c->children.begin(); it != c->children.end(); ++it)
+	destroy(*it);
+    retire(c->dp.children, __builtin_popcountll(c->dp.vector));
+    retire(c->dp.leaves, c->nleaves);
+    delete c;
+    --_nnodes;
+}
+
+void
+PoptrieIP6Lookup::retire(const Node *nodes, int n)
+{
+    if (nodes) {
+	_retiring.nodes.push_back(nodes);
+	_dp_bytes -= n * sizeof(Node);
+    }
+}
+
+void
+PoptrieIP6Lookup::retire(const uint16_t *leaves, int n)
+{
+    if (leaves) {
+	_retiring.leaves.push_back(leaves);
+	_dp_bytes -= n * sizeof(uint16_t);
+    }
+}
+
+void
+PoptrieIP6Lookup::commit()
+{
+    for (uint32_t *it = _dirty.begin(); it != _dirty.end(); ++it) {
+	_dirty_map[*it] = 0;
+	update_dir(*it);
+    }
+    _dirty.clear();
+
+    reclaim(false);
+    if (_retiring.nodes.size() || _retiring.leaves.size() || _retiring.nexthops.size()) {
+	_retiring.when = Timestamp::now_steady();
+	_retired.push_back(_retiring);
+	_retiring = Retired();
+    }
+}
+
+void
+PoptrieIP6Lookup::reclaim(bool all)
+{
+    // Lookups hold a node only for the duration of a batch, which is
+    // assumed over once the grace period has passed
+    Timestamp limit = Timestamp::now_steady() - Timestamp::make_msec(grace_msec);
+    int n = 0;
+    while (n < _retired.size() && (all || _retired[n].when <= limit))
+	++n;
+    for (int i = 0; i < n; ++i) {
+	Retired &r = _retired[i];
+	for (const Node **x = r.nodes.begin(); x != r.nodes.end(); ++x)
+	    delete[] *x;
+	for (const uint16_t **x = r.leaves.begin(); x != r.leaves.end(); ++x)
+	    delete[] *x;
+	for (uint16_t *nh = r.nexthops.begin(); nh != r.nexthops.end(); ++nh)
+	    _nexthop_free.push_back(*nh);
+    }
+    _retired.erase(_retired.begin(), _retired.begin() + n);
+}
+
+void
+PoptrieIP6Lookup::flush()
+{
+    for (int len = 0; len <= dir_bits; ++len)
+	_short[len].clear();
+    for (int i = 0; i < dir_size; ++i)
+	if (_roots[i]) {
+	    destroy(_roots[i]);
+	    _roots[i] = 0;
+	}
+    for (int nh = 1; nh < _nexthop_refs.size(); ++nh)
+	if (_nexthop_refs[nh]) {
+	    _nexthop_refs[nh] = 1;
+	    unref_nexthop(nh);
+	}
+    _nroutes = 0;
+    mark_dirty(0, dir_size);
+    commit();
+}
+
+static void
+unparse_route(StringAccum &sa, const uint64_t *w, int len, const IP6Address &gw, int port)
+{
+    IP6Address a;
+    uint32_t *x = a.data32();
+    x[0] = htonl(w[0] >> 32);
+    x[1] = htonl(w[0]);
+    x[2] = htonl(w[1] >> 32);
+    x[3] = htonl(w[1]);
+    sa << a << '/' << len << '\t' << gw << '\t' << port << '\n';
+}
+
+void
+PoptrieIP6Lookup::dump_node(StringAccum &sa, const CNode *c, const uint64_t *w) const
+{
+    int s = stride(c->depth);
+    int shift = 64 - (c->depth & 63) - s;
+    for (const Route *r = c->routes.begin(); r != c->routes.end(); ++r) {
+	uint64_t x[2] = {w[0], w[1]};
+	x[c->depth >> 6] |= (uint64_t) r->slot << shift;
+	const Nexthop &h = _nexthops[r->nexthop];
+	unparse_route(sa, x, r->len, h.gw, h.port);
+    }
+    for (CNode * const *it = c->children.begin(); it != c->children.end(); ++it) {
+	uint64_t x[2] = {w[0], w[1]};
+	x[c->depth >> 6] |= (uint64_t) (*it)->slot << shift;
+	dump_node(sa, *it, x);
+    }
+}
+
+String
+PoptrieIP6Lookup::dump_routes()
+{
+    StringAccum sa;
+    if (_nroutes)
+	sa << "# Active routes\n";
+    for (int len = 0; len <= dir_bits; ++len)
+	for (HashTable<uint32_t, uint16_t>::iterator it = _short[len].begin(); it; ++it) {
+	    uint64_t w[2] = {(uint64_t) it->first << 48, 0};
+	    const Nexthop &h = _nexthops[it.value()];
+	    unparse_route(sa, w, len, h.gw, h.port);
+	}
+    for (int i = 0; i < dir_size; ++i)
+	if (_roots[i]) {
+	    uint64_t w[2] = {(uint64_t) i << 48, 0};
+	    dump_node(sa, _roots[i], w);
+	}
+    return sa.take_string();
+}
+
+size_t
+PoptrieIP6Lookup::control_memory(const CNode *c) const
+{
+    size_t size = sizeof(CNode) + c->routes.capacity() * sizeof(Route)
+	+ c->children.capacity() * sizeof(CNode *);
+    for (CNode * const *it = c->children.begin(); it != c->children.end(); ++it)
+	size += control_memory(*it);
+    return size;
+}
+
+int
+PoptrieIP6Lookup::flush_handler(const String &, Element *e, void *, ErrorHandler *)
+{
+    static_cast<PoptrieIP6Lookup *>(e)->flush();
+    return 0;
+}
+
+int
+PoptrieIP6Lookup::lookup_handler(int, String &s, Element *e, const Handler *, ErrorHandler *errh)
+{
+    PoptrieIP6Lookup *t = static_cast<PoptrieIP6Lookup *>(e);
+    IP6Address a;
+    if (!IP6AddressArg().parse(s, a, t))
+	return errh->error("expected IPv6 address");
+    IP6Address gw;
+    int port = t->lookup_route(a, gw);
+    if (gw)
+	s = String(port) + " " + gw.unparse();
+    else
+	s = String(port);
+    return 0;
+}
+
+String
+PoptrieIP6Lookup::read_handler(Element *e, void *thunk)
+{
+    PoptrieIP6Lookup *t = static_cast<PoptrieIP6Lookup *>(e);
+    switch ((intptr_t) thunk) {
+    case h_routes:
+	return String(t->_nroutes);
+    case h_nodes:
+	return String(t->_nnodes);
+    case h_memory:
+	return String(dir_size * sizeof(uintptr_t) + t->_dp_bytes
+		      + t->_nexthop_refs.size() * sizeof(Nexthop));
+    case h_control_memory: {
+	size_t size = dir_size * (sizeof(CNode *) + sizeof(uint8_t))
+	    + t->_nexthop_refs.size() * sizeof(uint32_t)
+	    + t->_nexthop_index.size() * (sizeof(Pair<IP6Address, int>) + 2 * sizeof(void *));
+	for (int len = 0; len <= dir_bits; ++len)
+	    size += t->_short[len].size() * (sizeof(Pair<uint32_t, uint16_t>) + sizeof(void *));
+	for (int i = 0; i < dir_size; ++i)
+	    if (t->_roots[i])
+		size += t->control_memory(t->_roots[i]);
+	return String(size);
+    }
+    default:
+	return String();
+    }
+}
+
+void
+PoptrieIP6Lookup::add_handlers()
+{
+    add_write_handler("add", add_route_handler, 0);
+    add_write_handler("remove", remove_route_handler, 0);
+    add_write_handler("ctrl", ctrl_handler, 0);
+    add_write_handler("flush", flush_handler, 0, Handler::BUTTON);
+    add_read_handler("table", table_handler, 0, Handler::f_expensive);
+    set_handler("lookup", Handler::f_read | Handler::f_read_param, lookup_handler);
+    add_read_handler("routes", read_handler, h_routes);
+    add_read_handler("nodes", read_handler, h_nodes);
+    add_read_handler("memory", read_handler, h_memory);
+    add_read_handler("control_memory", read_handler, h_control_memory);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(IP6RouteTable userlevel)
+EXPORT_ELEMENT(PoptrieIP6Lookup)
+ELEMENT_MT_SAFE(PoptrieIP6Lookup)
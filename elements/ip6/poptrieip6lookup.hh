@@ -0,0 +1,265 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_POPTRIEIP6LOOKUP_HH
+#define CLICK_POPTRIEIP6LOOKUP_HH
+#include <click/hashtable.hh>
+#include <click/ip6address.hh>
+#include <click/timestamp.hh>
+#include "ip6routetable.hh"
+CLICK_DECLS
+
+/*
+=c
+
+PoptrieIP6Lookup(ADDR1/MASK1 [GW1] OUT1, ADDR2/MASK2 [GW2] OUT2, ...)
+
+=s ip6
+
+IPv6 routing lookup using a compressed multibit trie
+
+=d
+
+Expects a destination IPv6 address annotation with each packet. Looks up that
+address in its routing table, using longest-prefix-match, sets the
+destination annotation to the corresponding GW (if specified), and emits the
+packet on the indicated OUTput port. Packets without a route are dropped.
+
+Each argument is a route, specifying a destination and mask, an optional
+gateway IPv6 address, and an output port.
+
+PoptrieIP6Lookup is the IPv6 counterpart of PoptrieIPLookup, and is much
+faster than LookupIP6Route on large tables. The first 16 bits of the address
+index a direct table, whose entries hold either a next hop or a trie. The
+tries use 6-bit strides (4 bits for the last one), with Poptrie nodes: a node
+stores a 64-bit vector marking the slots that have children, and another
+marking where runs of identical next hops start, so that children and next
+hops are found with a population count. Looking up an address covered by a
+/48 takes 8 memory accesses.
+
+Batches are looked up one trie level at a time for all their packets, each
+step prefetching the nodes of the next one.
+
+Routes can be added and removed while packets flow. An update re-encodes the
+trie nodes on the path to the changed route, and the nodes below it whose
+inherited next hop changed, in new memory; the new path is then published
+with a single pointer store in the direct table. Replaced memory is freed on
+a later update.
+
+=h table read-only
+
+Outputs a human-readable version of the current routing table.
+
+=h lookup read-only, requires parameters
+
+Reports the OUTput port and GW corresponding to an address.
+
+=h add write-only
+
+Adds a route to the table, replacing any route for the same prefix. Format
+should be `C<ADDR/MASK [GW] OUT>'.
+
+=h remove write-only
+
+Removes a route from the table. Format should be `C<ADDR/MASK>'.
+
+=h ctrl write-only
+
+Write `C<add ADDR/MASK [GW] OUT>' to add a route, or `C<remove ADDR/MASK>'
+to remove one.
+
+=h flush write-only
+
+Clears the entire routing table.
+
+=h routes read-only
+
+Returns the number of routes.
+
+=h nodes read-only
+
+Returns the number of trie nodes.
+
+=h memory read-only
+
+Returns the number of bytes used by the lookup structures.
+
+=h control_memory read-only
+
+Returns an estimate of the number of bytes used to maintain the lookup
+structures on updates.
+
+=n
+
+Masks must be contiguous. At most 65535 different GW and OUT pairs can be
+used at once.
+
+=e
+
+  ... -> GetIP6Address(24) -> rt;
+  rt :: PoptrieIP6Lookup(2001:db8::/32 1,
+                         2001:db8:1::/48 fe80::1 2,
+                         ::/0 2001:db8::1 0);
+
+=a LookupIP6Route, PoptrieIPLookup, GetIP6Address
+
+Hirochika Asai and Yasuhiro Ohara.  "Poptrie: A Compressed Trie with
+Population Count for Fast and Scalable Software IP Routing Table Lookup".
+In Proc. ACM SIGCOMM 2015, pp. 57-70.
+*/
+
+class PoptrieIP6Lookup : public IP6RouteTable { public:
+
+    PoptrieIP6Lookup() CLICK_COLD;
+    ~PoptrieIP6Lookup() CLICK_COLD;
+
+    const char *class_name() const override	{ return "PoptrieIP6Lookup"; }
+    const char *port_count() const override	{ return "1/-"; }
+    const char *processing() const override	{ return PUSH; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) override CLICK_COLD;
+    void cleanup(CleanupStage stage) override CLICK_COLD;
+    void add_handlers() override CLICK_COLD;
+
+    void push(int port, Packet *p) override;
+#if HAVE_BATCH
+    void push_batch(int port, PacketBatch *batch) override;
+#endif
+
+    int add_route(IP6Address, IP6Address, IP6Address, int, ErrorHandler *) override;
+    int remove_route(IP6Address, IP6Address, ErrorHandler *) override;
+    String dump_routes() override;
+
+    int lookup_route(const IP6Address &addr, IP6Address &gw) const;
+
+    enum {
+	batch_size = 32,
+	nexthop_capacity = 65536,
+	dir_bits = 16,
+	dir_size = 1 << dir_bits,
+	grace_msec = 10
+    };
+
+  private:
+
+    struct Node {
+	uint64_t vector;	// slots with a child
+	uint64_t leafvec;	// slots starting a run of leaves
+	const Node *children;
+	const uint16_t *leaves;
+    };
+
+    struct Nexthop {
+	IP6Address gw;
+	int port;
+    };
+
+    // A route longer than /16, in the node whose slots it covers
+    struct Route {
+	uint8_t slot;
+	uint8_t len;
+	uint16_t nexthop;
+    };
+
+    // Control plane version of a trie node, with its routes. Its published
+    // Node is dp, which is copied in the children array of its parent.
+    struct CNode {
+	Vector<Route> routes;		// sorted by length
+	Vector<CNode *> children;	// sorted by slot
+	Node dp;
+	int def;			// next hop dp was encoded with
+	uint8_t depth;
+	uint8_t slot;
+	uint8_t nleaves;
+	bool dirty;
+
+	CNode()
+	    : def(-1), depth(0), slot(0), nleaves(0), dirty(true) {
+	    memset(&dp, 0, sizeof(dp));
+	}
+    };
+
+    struct Retired {
+	Vector<const Node *> nodes;
+	Vector<const uint16_t *> leaves;
+	Vector<uint16_t> nexthops;
+	Timestamp when;
+    };
+
+    // Direct table entries are a next hop index shifted left by one, with
+    // the low bit set, or a pointer to the root Node of a trie
+    uintptr_t *_dir;
+    Nexthop *_nexthops;
+
+    // Control plane
+    HashTable<uint32_t, uint16_t> _short[dir_bits + 1];
+    CNode **_roots;
+    HashTable<Pair<IP6Address, int>, uint16_t> _nexthop_index;
+    Vector<uint32_t> _nexthop_refs;
+    Vector<uint16_t> _nexthop_free;
+    Vector<uint32_t> _dirty;
+    uint8_t *_dirty_map;
+    Retired _retiring;
+    Vector<Retired> _retired;
+    bool _deferred;
+    int _nroutes;
+    int _nnodes;
+    size_t _dp_bytes;
+
+    static inline void load(const IP6Address &a, uint64_t *w) {
+	const uint32_t *x = a.data32();
+	w[0] = ((uint64_t) ntohl(x[0]) << 32) | ntohl(x[1]);
+	w[1] = ((uint64_t) ntohl(x[2]) << 32) | ntohl(x[3]);
+    }
+    static inline int stride(int depth) {
+	return depth == 124 ? 4 : 6;
+    }
+    static inline unsigned slot_of(const uint64_t *w, int depth) {
+	int s = stride(depth);
+	return (w[depth >> 6] >> (64 - (depth & 63) - s)) & ((1U << s) - 1);
+    }
+    static inline unsigned slot_rank(uint64_t v, unsigned slot) {
+	return __builtin_popcountll(v & ((2ULL << slot) - 1));
+    }
+    inline uint16_t lookup_nexthop(const uint64_t *w) const;
+#if HAVE_BATCH
+    int lookup_chunk(Packet *p, uint16_t *hops) const;
+#endif
+
+    int find_nexthop(const IP6Address &gw, int port);
+    void unref_nexthop(uint16_t nh);
+    void mark_dirty(uint32_t first, uint32_t count);
+    uint16_t best_short(uint32_t index) const;
+    void update_dir(uint32_t index);
+    void encode(CNode *c, uint16_t def);
+    void destroy(CNode *c);
+    void retire(const Node *nodes, int n);
+    void retire(const uint16_t *leaves, int n);
+    void commit();
+    void reclaim(bool all);
+    void flush();
+    void dump_node(StringAccum &sa, const CNode *c, const uint64_t *w) const;
+    size_t control_memory(const CNode *c) const;
+
+    static int flush_handler(const String &, Element *, void *, ErrorHandler *);
+    static int lookup_handler(int, String &, Element *, const Handler *, ErrorHandler *);
+    enum { h_routes, h_nodes, h_memory, h_control_memory };
+    static String read_handler(Element *, void *);
+
+};
+
+inline uint16_t
+PoptrieIP6Lookup::lookup_nexthop(const uint64_t *w) const
+{
+    uintptr_t d = _dir[w[0] >> 48];
+    if (d & 1)
+	return d >> 1;
+    const Node *n = reinterpret_cast<const Node *>(d);
+    for (int depth = dir_bits; ; depth += 6) {
+	unsigned s = slot_of(w, depth);
+	if (!(n->vector & (1ULL << s)))
+	    return n->leaves[slot_rank(n->leafvec, s) - 1];
+	n = n->children + slot_rank(n->vector, s) - 1;
+    }
+}
+
+CLICK_ENDDECLS
+#endif
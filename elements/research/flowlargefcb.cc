@@ -78,7 +78,7 @@ void FlowLargeFCB::prefetch_fcb(int line_idx, LargeFCBState* flowdata){
         return;
 
     for (int i = 0; i < _size; i+=32){
-        rte_prefetch0((flowdata->iarray)+i);
+        __builtin_prefetch((flowdata->iarray)+i);
     }
 /*
     for (int i = 0; i< ((_size/16)+1) && i < _prefetch; i++){
@@ -23,6 +23,9 @@
 #include <click/error.hh>
 #include <click/straccum.hh>
 #include <click/standard/alignmentinfo.hh>
+#if HAVE_CLASSIFIER_JIT
+# include <click/classifierjit.hh>
+#endif
 CLICK_DECLS
 namespace Classification {
 namespace Wordwise {
@@ -1176,6 +1179,33 @@ Program::length_checked_match(const Packet *p)
     return -pos;
 }
 
+#if HAVE_CLASSIFIER_JIT
+int
+Program::jit_compile(ClassifierJIT &jit, const int *base_offsets, int nbases,
+		     ErrorHandler *errh) const
+{
+    // Compiled code sees offsets and lengths as length_checked_match does,
+    // relative to 'data - _align_offset'.
+    Vector<ClassifierJIT::Test> tests;
+    for (const Insn *in = begin(); in != end(); ++in) {
+	ClassifierJIT::Test t;
+	int b = nbases - 1;
+	while (b > 0 && in->offset < base_offsets[b])
+	    --b;
+	t.offset = in->offset;
+	t.mask = in->mask.u;
+	t.value = in->value.u;
+	t.j[0] = in->j[0];
+	t.j[1] = in->j[1];
+	t.required_length = in->required_length();
+	t.base = b;
+	t.short_output = in->short_output;
+	tests.push_back(t);
+    }
+    return jit.compile(tests, nbases, _safe_length + _align_offset, errh);
+}
+#endif
+
 }}
 CLICK_ENDDECLS
 ELEMENT_PROVIDES(Classification)
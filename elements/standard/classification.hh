@@ -5,6 +5,7 @@
 #include <click/vector.hh>
 CLICK_DECLS
 class ErrorHandler;
+class ClassifierJIT;
 namespace Classification {
 
 enum Jumps {
@@ -215,6 +216,18 @@ class Program { public:
 
     int match(const Packet *p);
 
+#if HAVE_CLASSIFIER_JIT
+    /** @brief Compile this program to native code.
+     * @param base_offsets first offset read from each base pointer, in
+     *   increasing order
+     *
+     * An instruction at offset O reads from the last base pointer whose
+     * base offset is <= O. The pointer passed to the compiled code for that
+     * base must be such that pointer + O is the address of the data. */
+    int jit_compile(ClassifierJIT &jit, const int *base_offsets, int nbases,
+                    ErrorHandler *errh) const;
+#endif
+
     String unparse() const;
 
   private:
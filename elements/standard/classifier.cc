@@ -24,6 +24,7 @@
 #include <click/error.hh>
 #include <click/confparse.hh>
 #include <click/straccum.hh>
+#include <click/args.hh>
 #if !HAVE_INDIFFERENT_ALIGNMENT
 #include <click/router.hh>
 #endif
@@ -222,18 +223,37 @@ Classifier::parse_program(Classification::Wordwise::Program &prog,
 int
 Classifier::configure(Vector<String> &conf, ErrorHandler *errh)
 {
+    bool jit = false;
+    if (Args(this, errh).bind(conf)
+	.read("JIT", jit)
+	.consume() < 0)
+	return -1;
+
     if (conf.size() != noutputs())
 	return errh->error("need %d arguments, one per output port", noutputs());
 
     Classification::Wordwise::Program prog = empty_program(errh);
     parse_program(prog, conf, errh);
 
-    if (!errh->nerrors()) {
-	prog.warn_unused_outputs(noutputs(), errh);
-	_prog = prog;
-	return 0;
-    } else
+    if (errh->nerrors())
 	return -1;
+
+    prog.warn_unused_outputs(noutputs(), errh);
+    _prog = prog;
+#if HAVE_CLASSIFIER_JIT
+    // Packets are read relative to 'data - align_offset', as in
+    // Program::match.
+    static const int base_offsets[] = { 0 };
+    if (jit && _prog.output_everything() < 0) {
+	if (_prog.jit_compile(_jit_code, base_offsets, 1, errh) < 0)
+	    errh->warning("falling back to the interpreter");
+    } else
+	_jit_code.disable();
+#else
+    if (jit)
+	errh->warning("JIT needs --enable-classifier-jit, falling back to the interpreter");
+#endif
+    return 0;
 }
 
 String
@@ -243,16 +263,66 @@ Classifier::program_string(Element *element, void *)
     return c->_prog.unparse();
 }
 
+String
+Classifier::jit_handler(Element *element, void *)
+{
+    Classifier *c = static_cast<Classifier *>(element);
+#if HAVE_CLASSIFIER_JIT
+    return String(c->_jit_code.enabled());
+#else
+    (void) c;
+    return String(false);
+#endif
+}
+
 void
 Classifier::add_handlers()
 {
     add_read_handler("program", Classifier::program_string, 0, Handler::CALM);
+    add_read_handler("jit", Classifier::jit_handler, 0);
 }
 
 #if HAVE_BATCH
+# if HAVE_CLASSIFIER_JIT
+/* Classify the batch with the compiled program, ClassifierJIT::batch_size
+ * packets per call, and split it as push_batch does. Each chunk is matched
+ * when its first packet is reached, before the batch is split there. */
+void
+Classifier::jit_push_batch(PacketBatch *batch)
+{
+    const int align = _prog.align_offset();
+    const unsigned char *bases[ClassifierJIT::batch_size];
+    int lengths[ClassifierJIT::batch_size];
+    int outputs[ClassifierJIT::batch_size];
+    int n = 0, i = 0;
+
+    auto next_output = [&](Packet *p) {
+	if (i == n) {
+	    for (n = 0; n < ClassifierJIT::batch_size && p; ++n, p = p->next()) {
+		bases[n] = p->data() - align;
+		lengths[n] = p->length() + align;
+	    }
+	    _jit_code.match_batch(bases, lengths, outputs, n);
+	    i = 0;
+	}
+	return outputs[i++];
+    };
+    CLASSIFY_EACH_PACKET((noutputs() + 1),
+			 next_output,
+			 batch,
+			 checked_output_push_batch);
+}
+# endif
+
 void
 Classifier::push_batch(int, PacketBatch * batch)
 {
+#if HAVE_CLASSIFIER_JIT
+    if (_jit_code.enabled()) {
+	jit_push_batch(batch);
+	return;
+    }
+#endif
 	CLASSIFY_EACH_PACKET(	(noutputs() + 1),
 							_prog.match,
 							batch,
@@ -264,6 +334,13 @@ Classifier::push_batch(int, PacketBatch * batch)
 inline void
 Classifier::push(int, Packet *p)
 {
+#if HAVE_CLASSIFIER_JIT
+    if (_jit_code.enabled()) {
+	const unsigned char *base = p->data() - _prog.align_offset();
+	checked_output_push(_jit_code.match(&base, p->length() + _prog.align_offset()), p);
+	return;
+    }
+#endif
     checked_output_push(_prog.match(p), p);
 }
 
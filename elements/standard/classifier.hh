@@ -3,11 +3,14 @@
 #include <click/element.hh>
 #include <click/batchelement.hh>
 #include "classification.hh"
+#if HAVE_CLASSIFIER_JIT
+# include <click/classifierjit.hh>
+#endif
 CLICK_DECLS
 
 /*
  * =c
- * Classifier(pattern1, ..., patternN)
+ * Classifier(pattern1, ..., patternN [, I<keywords> JIT])
  * =s classification
  * classifies packets by contents
  * =d
@@ -38,6 +41,21 @@ CLICK_DECLS
  * could ever match a pattern. Usually, this is because an earlier pattern is
  * more general, or because your pattern is contradictory (`12/0806 12/0800').
  *
+ * Keyword arguments are:
+ *
+ * =over 8
+ *
+ * =item JIT
+ *
+ * Boolean. If true, the optimized program is compiled to native code with
+ * LLVM, at configuration time and on every live reconfiguration, instead of
+ * being interpreted. Batches are then classified by a single call to the
+ * compiled code. Needs FastClick to be configured with
+ * --enable-classifier-jit, otherwise a warning is printed and the program is
+ * interpreted. Default is false.
+ *
+ * =back
+ *
  * =n
  *
  * The IPClassifier and IPFilter elements have a friendlier syntax if you are
@@ -71,6 +89,9 @@ CLICK_DECLS
  *   safe length 22
  *   alignment offset 0
  *
+ * =h jit read-only
+ * Returns true if the program is running as native code.
+ *
  * =a IPClassifier, IPFilter */
 
 class Classifier : public BatchElement { public:
@@ -99,8 +120,16 @@ class Classifier : public BatchElement { public:
   protected:
 
     Classification::Wordwise::Program _prog;
+#if HAVE_CLASSIFIER_JIT
+    ClassifierJIT _jit_code;
+
+# if HAVE_BATCH
+    void jit_push_batch(PacketBatch *);
+# endif
+#endif
 
     static String program_string(Element *, void *);
+    static String jit_handler(Element *, void *);
 
 };
 
@@ -150,11 +150,11 @@ IPRewriter::add_flow(int ip_p, const IPFlowID &flowid,
 	 !!_ipstate->_udp_timeouts[1],
          click_jiffies() + relevant_timeout(_ipstate->_udp_timeouts), input);
 
-    return store_flow(flow, input, _ipstate->map, &reply_udp_map(rwinput));
+    return store_flow(flow, input, *_ipstate, &reply_udp_state(rwinput));
 }
 
 int
-IPRewriter::process(int port, Packet *p_in)
+IPRewriter::process(int port, Packet *p_in, const uint64_t *hash)
 {
     WritablePacket *p = p_in->uniqueify();
     click_ip *iph = p->ip_header();
@@ -172,13 +172,13 @@ IPRewriter::process(int port, Packet *p_in)
     }
 
     IPFlowID flowid(p);
-    HashContainer<IPRewriterEntry> *map = (iph->ip_p == IP_PROTO_TCP ?
+    Map *map = (iph->ip_p == IP_PROTO_TCP ?
         &_state->map : &state.map);
     if ( !map ) {
         click_chatter("[%s] [Core %d]: UDP Map is NULL", class_name(), click_current_cpu_id());
     }
     //No lock access because we are the only writer
-    IPRewriterEntry *m = map->get(flowid);
+    IPRewriterEntry *m = hash ? map->get_hashed(flowid, *hash) : map->get(flowid);
 
     if (!m) {			// create new mapping
 	IPRewriterInput &is = _input_specs.unchecked_at(port);
@@ -233,7 +233,18 @@ IPRewriter::push(int port, Packet *p)
 void
 IPRewriter::push_batch(int port, PacketBatch *batch)
 {
-    auto fnt = [this,port](Packet*p){return process(port,p);};
+    auto map_of = [this](uint8_t ip_p) -> const Map * {
+	if (ip_p == IP_PROTO_TCP)
+	    return &_state->map;
+	else if (ip_p == IP_PROTO_UDP)
+	    return &_ipstate->map;
+	else
+	    return 0;
+    };
+    HashChunk chunk;
+    auto fnt = [this,port,&chunk,&map_of](Packet*p){
+	return process(port, p, next_hash(chunk, p, map_of));
+    };
     CLASSIFY_EACH_PACKET(noutputs() + 1,fnt,batch,checked_output_push_batch);
 }
 #endif
@@ -111,6 +111,13 @@ packets, and second and subsequent fragments, are dropped unless they arrive
 on a 'pass' input port.  IPRewriter changes IP packet data and, optionally,
 destination IP address annotations; see the DST_ANNO keyword argument below.
 
+Mappings are kept in flat hash tables with one cache line per bucket, which
+grow as needed. Batches are looked up 32 packets at a time: the flows are
+hashed and their table entries prefetched together, so that the cache misses
+overlap, then each lookup reuses its flow's hash. When the
+rewriter is full, the mapping closest to expiring is removed first; a
+mapping's expiration time is tracked to the jiffy.
+
 Keyword arguments determine how often stale mappings should be removed.
 
 =over 5
@@ -232,7 +239,7 @@ class IPRewriter : public TCPRewriter { public:
     int thread_configure(ThreadReconfigurationStage stage, ErrorHandler* errh, Bitvector threads) override;
 
     virtual IPRewriterEntry *get_entry(int ip_p, const IPFlowID &flowid, int input) override;
-    HashContainer<IPRewriterEntry> *get_map(int mapid) {
+    Map *get_map(int mapid) {
 	if (mapid == IPRewriterInput::mapid_default)
 	    return &(_state->map);
 	else if (mapid == IPRewriterInput::mapid_iprewriter_udp)
@@ -269,7 +276,7 @@ class IPRewriter : public TCPRewriter { public:
 
     per_thread<IPState> _ipstate;
 
-    int process(int port, Packet *p_in);
+    int process(int port, Packet *p_in, const uint64_t *hash = 0);
 
     int udp_flow_timeout(const UDPFlow *mf, IPState& state) const {
 	if (mf->streaming())
@@ -278,9 +285,12 @@ class IPRewriter : public TCPRewriter { public:
 	    return state._udp_timeouts[0];
     }
 
-    static inline Map &reply_udp_map(IPRewriterInput *rwinput) {
+    static inline IPState &reply_udp_state(IPRewriterInput *rwinput) {
 	IPRewriter *x = static_cast<IPRewriter *>(rwinput->reply_element);
-	return x->_ipstate->map;
+	return *x->_ipstate;
+    }
+    static inline Map &reply_udp_map(IPRewriterInput *rwinput) {
+	return reply_udp_state(rwinput).map;
     }
     static String udp_mappings_handler(Element *e, void *user_data);
 
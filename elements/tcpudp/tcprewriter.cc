@@ -310,11 +310,11 @@ TCPRewriter::add_flow(int /*ip_p*/, const IPFlowID &flowid,
 	 !!_timeouts[click_current_cpu_id()][1], click_jiffies() +
          relevant_timeout(_timeouts[click_current_cpu_id()]), input);
 
-    return store_flow(flow, input, _state->map);
+    return store_flow(flow, input, *_state);
 }
 
 int
-TCPRewriter::process(int port, Packet *p_in)
+TCPRewriter::process(int port, Packet *p_in, const uint64_t *hash)
 {
     WritablePacket *p = p_in->uniqueify();
     if (!p) {
@@ -335,7 +335,7 @@ TCPRewriter::process(int port, Packet *p_in)
     }
 
     IPFlowID flowid(p);
-    IPRewriterEntry *m = search_entry(flowid);
+    IPRewriterEntry *m = search_entry(flowid, hash);
 
     if (!m) {			// create new mapping
 
@@ -393,7 +393,13 @@ TCPRewriter::push(int port, Packet *p)
 void
 TCPRewriter::push_batch(int port, PacketBatch *batch)
 {
-    auto fnt = [this,port](Packet*p){return process(port,p);};
+    auto map_of = [this](uint8_t ip_p) -> const Map * {
+	return ip_p == IP_PROTO_TCP ? &_state->map : 0;
+    };
+    HashChunk chunk;
+    auto fnt = [this,port,&chunk,&map_of](Packet*p){
+	return process(port, p, next_hash(chunk, p, map_of));
+    };
     CLASSIFY_EACH_PACKET(noutputs() + 1,fnt,batch,checked_output_push_batch);
 }
 #endif
@@ -427,7 +433,7 @@ TCPRewriter::tcp_lookup_handler(int, String &str, Element *e, const Handler *, E
 	.complete() < 0)
 	return -1;
 
-    HashContainer<IPRewriterEntry> *map = rw->get_map(IPRewriterInput::mapid_default);
+    Map *map = rw->get_map(IPRewriterInput::mapid_default);
     if (!map)
 	return errh->error("no map!");
 
@@ -188,7 +188,7 @@ class TCPRewriter : public IPRewriterBase { public:
      * The actual processing of this element is abstracted from the push operation.
      * This allows both push and push_batch to exploit the same logic.
      */
-    int process(int port, Packet *p_in);
+    int process(int port, Packet *p_in, const uint64_t *hash = 0);
 
     int tcp_flow_timeout(const TCPFlow *mf) const {
 	if (mf->both_done())
@@ -143,11 +143,11 @@ UDPRewriter::add_flow(int ip_p, const IPFlowID &flowid,
 	 !!_timeouts[click_current_cpu_id()][1], click_jiffies() +
          relevant_timeout(_timeouts[click_current_cpu_id()]), input);
 
-    return store_flow(flow, input, _state->map);
+    return store_flow(flow, input, *_state);
 }
 
 int
-UDPRewriter::process(int port, Packet *p_in)
+UDPRewriter::process(int port, Packet *p_in, const uint64_t *hash)
 {
     WritablePacket *p = p_in->uniqueify();
     if (!p) {
@@ -170,7 +170,7 @@ UDPRewriter::process(int port, Packet *p_in)
 
     IPFlowID flowid(p);
 
-    IPRewriterEntry *m = search_entry(flowid);
+    IPRewriterEntry *m = search_entry(flowid, hash);
 
     if (!m) {			// create new mapping
         IPRewriterInput &is = _input_specs.unchecked_at(port);
@@ -229,7 +229,14 @@ UDPRewriter::push(int port, Packet *p)
 void
 UDPRewriter::push_batch(int port, PacketBatch *batch)
 {
-    auto fnt = [this,port](Packet*p){return process(port,p);};
+    auto map_of = [this](uint8_t ip_p) -> const Map * {
+	return ip_p == IP_PROTO_TCP || ip_p == IP_PROTO_UDP
+	    || ip_p == IP_PROTO_DCCP ? &_state->map : 0;
+    };
+    HashChunk chunk;
+    auto fnt = [this,port,&chunk,&map_of](Packet*p){
+	return process(port, p, next_hash(chunk, p, map_of));
+    };
     CLASSIFY_EACH_PACKET(noutputs() + 1,fnt,batch,checked_output_push_batch);
 }
 #endif
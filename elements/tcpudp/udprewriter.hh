@@ -213,7 +213,7 @@ class UDPRewriter : public IPRewriterBase { public:
     unsigned _annos;
     uint32_t _udp_streaming_timeout;
 
-    int process(int port, Packet *p_in);
+    int process(int port, Packet *p_in, const uint64_t *hash = 0);
 
     int udp_flow_timeout(const UDPFlow *mf) const {
 	if (mf->streaming())
@@ -0,0 +1,109 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * calendarqueuetest.{cc,hh} -- regression test element for CalendarQueue
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "calendarqueuetest.hh"
+#include <click/calendarqueue.hh>
+#include <click/error.hh>
+CLICK_DECLS
+
+CalendarQueueTest::CalendarQueueTest()
+{
+}
+
+#define CHECK(x) if (!(x)) return errh->error("%s:%d: test %<%s%> failed", __FILE__, __LINE__, #x);
+
+int
+CalendarQueueTest::initialize(ErrorHandler *errh)
+{
+    CalendarQueue<int> q;
+    int v;
+
+    // One key per bucket
+    q.initialize(16, 0);
+    CHECK(q.pop(v) == false);
+    q.insert(5, 5);
+    q.insert(3, 3);
+    q.insert(9, 9);
+    CHECK(q.size() == 3);
+    CHECK(q.pop(v) && v == 3);
+    CHECK(q.pop(v) && v == 5);
+    CHECK(q.pop(v) && v == 9);
+    CHECK(q.empty());
+
+    // Flow ages in microseconds, with a window sized for a 1 ms delay:
+    // flows seen seconds ago are still ordered
+    CalendarQueue<int> ages;
+    ages.initialize(16, CalendarQueue<int>::shift_for_range(2 * 1000));
+    ages.insert(50, 1);
+    ages.insert(2000000, 5);
+    ages.insert(800, 2);
+    ages.insert(60000000, 6);
+    ages.insert(5000, 3);
+    ages.insert(120000, 4);
+    for (int i = 1; i <= 6; i++)
+        CHECK(ages.pop(v) && v == i);
+    CHECK(ages.empty());
+
+    // Negated packet counts, one packet per bucket
+    q.insert(0, 4);
+    q.insert(-1000, 1);
+    q.insert(-600, 2);
+    q.insert(-2, 3);
+    for (int i = 1; i <= 4; i++)
+        CHECK(q.pop(v) && v == i);
+
+    // Once empty, the queue is back to one key per bucket
+    q.insert(2, 2);
+    q.insert(1, 1);
+    CHECK(q.pop(v) && v == 1);
+    CHECK(q.pop(v) && v == 2);
+
+    // Keys of the same bucket leave in insertion order
+    CalendarQueue<int> wide;
+    wide.initialize(16, 4);
+    wide.insert(0, 1);
+    wide.insert(100, 4);
+    wide.insert(15, 2);
+    wide.insert(5, 3);
+    for (int i = 1; i <= 4; i++)
+        CHECK(wide.pop(v) && v == i);
+
+    // Insertions between pops, out of the window
+    q.insert(10, 10);
+    q.insert(20000, 20000);
+    CHECK(q.pop(v) && v == 10);
+    q.insert(1000000, 1000000);
+    q.insert(15000, 15000);
+    q.insert(-1000000, -1000000);
+    CHECK(q.pop(v) && v == -1000000);
+    CHECK(q.pop(v) && v == 15000);
+    CHECK(q.pop(v) && v == 20000);
+    CHECK(q.pop(v) && v == 1000000);
+    CHECK(q.empty());
+
+    // Many keys far apart, inserted out of order
+    for (int i = 0; i < 100; i++)
+        q.insert((int64_t) ((i * 37) % 100) * 1000000, (i * 37) % 100);
+    for (int i = 0; i < 100; i++)
+        CHECK(q.pop(v) && v == i);
+    CHECK(q.empty());
+
+    errh->message("All tests pass!");
+    return 0;
+}
+
+EXPORT_ELEMENT(CalendarQueueTest)
+CLICK_ENDDECLS
@@ -0,0 +1,34 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_CALENDARQUEUETEST_HH
+#define CLICK_CALENDARQUEUETEST_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+CalendarQueueTest()
+
+=s test
+
+runs regression tests for CalendarQueue
+
+=d
+
+CalendarQueueTest runs CalendarQueue regression tests at initialization time.
+It does not route packets.
+
+*/
+
+class CalendarQueueTest : public Element { public:
+
+    CalendarQueueTest() CLICK_COLD;
+
+    const char *class_name() const override		{ return "CalendarQueueTest"; }
+
+    int initialize(ErrorHandler *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
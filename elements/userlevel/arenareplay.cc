@@ -0,0 +1,475 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * arenareplay.{cc,hh} -- replays a preloaded tcpdump file from multiple
+ * threads
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/router.hh>
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/master.hh>
+#include <click/fromfile.hh>
+#include "arenareplay.hh"
+#include "fromdump.hh"
+#include "fakepcap.hh"
+#include <sys/mman.h>
+#include <unistd.h>
+CLICK_DECLS
+
+#define	SWAPLONG(y) \
+	((((y)&0xff)<<24) | (((y)&0xff00)<<8) | (((y)&0xff0000)>>8) | (((y)>>24)&0xff))
+#define	SWAPSHORT(y) \
+	( (((y)&0xff)<<8) | ((u_short)((y)&0xff00)>>8) )
+
+#define HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+ArenaReplay::ArenaReplay() : _arena(0), _arena_size(0)
+{
+    in_batch_mode = BATCH_MODE_YES;
+}
+
+ArenaReplay::~ArenaReplay()
+{
+}
+
+int
+ArenaReplay::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    _nthreads = 1;
+    _burst = 32;
+    _stop = 1;
+    _timing = 0;
+    _rate = 0;
+    _hugepages = true;
+    _active = true;
+
+    if (Args(conf, this, errh)
+        .read_mp("FILENAME", FilenameArg(), _filename)
+        .read("THREADS", _nthreads)
+        .read("BURST", _burst)
+        .read("STOP", _stop)
+        .read("TIMING", _timing)
+        .read("RATE", _rate)
+        .read("HUGEPAGES", _hugepages)
+        .read("ACTIVE", _active)
+        .complete() < 0)
+        return -1;
+
+    if (_nthreads <= 0)
+        return errh->error("THREADS must be positive");
+    if (_burst <= 0)
+        return errh->error("BURST must be positive");
+    if (_stop == 0)
+        return errh->error("STOP must be positive or -1");
+    if (_timing && _rate)
+        return errh->error("TIMING and RATE cannot be used together");
+    return 0;
+}
+
+/**
+ * Read all packets of the file, then copy the packets of each thread to
+ * its own part of the arena, after the array of slots describing them.
+ */
+int
+ArenaReplay::load(ErrorHandler *errh)
+{
+    FromFile ff;
+    ff.filename() = _filename;
+    if (ff.initialize(errh) < 0)
+        return -1;
+
+    fake_pcap_file_header swapped_fh;
+    const fake_pcap_file_header *fh = (const fake_pcap_file_header *)ff.get_aligned(sizeof(fake_pcap_file_header), &swapped_fh);
+    if (!fh)
+        return ff.error(errh, "not a tcpdump file (too short)");
+    bool swapped = false;
+    if (fh->magic != FAKE_PCAP_MAGIC && fh->magic != FAKE_PCAP_MAGIC_NANO && fh->magic != FAKE_MODIFIED_PCAP_MAGIC) {
+        swapped_fh.magic = SWAPLONG(fh->magic);
+        swapped_fh.version_major = SWAPSHORT(fh->version_major);
+        swapped_fh.version_minor = SWAPSHORT(fh->version_minor);
+        swapped_fh.linktype = SWAPLONG(fh->linktype);
+        fh = &swapped_fh;
+        swapped = true;
+    }
+    if (fh->magic != FAKE_PCAP_MAGIC && fh->magic != FAKE_PCAP_MAGIC_NANO && fh->magic != FAKE_MODIFIED_PCAP_MAGIC)
+        return ff.error(errh, "not a tcpdump file (bad magic number)");
+    if (fh->version_major != FAKE_PCAP_VERSION_MAJOR)
+        return ff.error(errh, "unknown major version %d", fh->version_major);
+    unsigned extra = 0;
+    if (fh->magic == FAKE_MODIFIED_PCAP_MAGIC)
+        extra = sizeof(fake_modified_pcap_pkthdr) - sizeof(fake_pcap_pkthdr);
+    bool nano = fh->magic == FAKE_PCAP_MAGIC_NANO;
+    int minor_version = fh->version_minor;
+    int linktype = fake_pcap_canonical_dlt(fh->linktype, true);
+
+    struct Record {
+        size_t offset;
+        uint32_t length;
+        uint32_t thread;
+        Timestamp ts;
+    };
+    Vector<Record> records;
+    Vector<uint32_t> npackets(_nthreads, 0);
+    Vector<size_t> sizes(_nthreads, 0);
+    unsigned char *raw = 0;
+    size_t raw_length = 0, raw_capacity = 0;
+    int ret = 0;
+
+    while (1) {
+        fake_pcap_pkthdr swapped_ph;
+        const fake_pcap_pkthdr *ph = reinterpret_cast<const fake_pcap_pkthdr *>(ff.get_aligned(sizeof(*ph), &swapped_ph));
+        if (!ph)
+            break;
+        if (swapped) {
+            swapped_ph.ts.tv.tv_sec = SWAPLONG(ph->ts.tv.tv_sec);
+            swapped_ph.ts.tv.tv_usec = SWAPLONG(ph->ts.tv.tv_usec);
+            swapped_ph.caplen = SWAPLONG(ph->caplen);
+            swapped_ph.len = SWAPLONG(ph->len);
+            ph = &swapped_ph;
+        }
+
+        // may need to swap 'caplen' and 'len' fields at or before version 2.3
+        uint32_t len, caplen, skiplen = 0;
+        if (minor_version > 3 || (minor_version == 3 && ph->caplen <= ph->len)) {
+            len = ph->len;
+            caplen = ph->caplen;
+        } else {
+            len = ph->caplen;
+            caplen = ph->len;
+        }
+        if (caplen > 65535) {
+            ret = ff.error(errh, "bad packet header");
+            goto out;
+        } else if (caplen > len) {
+            skiplen = caplen - len;
+            caplen = len;
+        }
+        Timestamp ts = fake_bpf_timeval_union::make_timestamp(&ph->ts, nano);
+        ff.shift_pos(extra);
+
+        if (raw_length + caplen > raw_capacity) {
+            size_t capacity = raw_capacity ? raw_capacity * 2 : 1 << 20;
+            unsigned char *n = (unsigned char *) realloc(raw, capacity);
+            if (!n) {
+                ret = errh->error("out of memory");
+                goto out;
+            }
+            raw = n;
+            raw_capacity = capacity;
+        }
+        if (ff.read(raw + raw_length, caplen, errh) != (int) caplen)
+            break;
+        ff.shift_pos(skiplen);
+
+        Record r;
+        r.offset = raw_length;
+        r.length = caplen;
+        r.thread = FromDump::flow_hash(raw + raw_length, caplen, linktype) % _nthreads;
+        r.ts = ts;
+        records.push_back(r);
+        npackets[r.thread]++;
+        sizes[r.thread] += (caplen + SLOT_ALIGN - 1) & ~(SLOT_ALIGN - 1);
+        raw_length += caplen;
+    }
+
+    if (records.empty()) {
+        ret = ff.error(errh, "no packets");
+        goto out;
+    }
+
+    {
+        Vector<size_t> region(_nthreads, 0);
+        size_t total = 0;
+        for (int i = 0; i < _nthreads; i++) {
+            region[i] = total;
+            size_t slots = npackets[i] * sizeof(Slot);
+            total += ((slots + SLOT_ALIGN - 1) & ~(SLOT_ALIGN - 1)) + sizes[i];
+        }
+
+        void *arena = MAP_FAILED;
+#ifdef MAP_HUGETLB
+        if (_hugepages) {
+            _arena_size = (total + HUGEPAGE_SIZE - 1) & ~((size_t) HUGEPAGE_SIZE - 1);
+            arena = mmap(0, _arena_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        }
+#endif
+        if (arena == MAP_FAILED) {
+            size_t page = sysconf(_SC_PAGESIZE);
+            _arena_size = (total + page - 1) & ~(page - 1);
+            arena = mmap(0, _arena_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (arena == MAP_FAILED) {
+                _arena_size = 0;
+                ret = errh->error("could not allocate %lu bytes: %s", (unsigned long) total, strerror(errno));
+                goto out;
+            }
+#ifdef MADV_HUGEPAGE
+            if (_hugepages)
+                madvise(arena, _arena_size, MADV_HUGEPAGE);
+#endif
+            _hugepages = false;
+        }
+        _arena = (unsigned char *) arena;
+
+        //With TIMING, the offsets are relative to the first packet of the
+        //trace so all threads follow the same timeline
+        double cycles_per_nsec = 0;
+        if (_timing) {
+            cycles_per_nsec = (double) cycles_hz() / 1000000000 * 100 / _timing;
+            int64_t span = (records.back().ts - records[0].ts).nsecval();
+            if (span < 0)
+                span = 0;
+            if (records.size() > 1)
+                span += span / (records.size() - 1);
+            _loop_cycles = span * cycles_per_nsec;
+        } else
+            _loop_cycles = 0;
+
+        Vector<size_t> data_pos(_nthreads, 0);
+        for (int i = 0; i < _nthreads; i++) {
+            ThreadState &s = _state.get_value_for_thread(i);
+            s.slots = reinterpret_cast<Slot *>(_arena + region[i]);
+            s.n = 0;
+            size_t slots = npackets[i] * sizeof(Slot);
+            data_pos[i] = region[i] + ((slots + SLOT_ALIGN - 1) & ~(SLOT_ALIGN - 1));
+            if (_rate) {
+                uint64_t rate = _rate * npackets[i] / records.size();
+                s.interval = ((uint64_t) cycles_hz() << RATE_SHIFT) / (rate ? rate : 1);
+            }
+        }
+
+        for (int j = 0; j < records.size(); j++) {
+            Record &r = records[j];
+            ThreadState &s = _state.get_value_for_thread(r.thread);
+            Slot &slot = s.slots[s.n++];
+            slot.data = _arena + data_pos[r.thread];
+            slot.length = r.length;
+            slot.ts = r.ts;
+            int64_t offset = (r.ts - records[0].ts).nsecval();
+            slot.offset = offset > 0 ? offset * cycles_per_nsec : 0;
+            memcpy(slot.data, raw + r.offset, r.length);
+            data_pos[r.thread] += (r.length + SLOT_ALIGN - 1) & ~(SLOT_ALIGN - 1);
+        }
+
+        for (int i = 0; i < _nthreads; i++) {
+            ThreadState &s = _state.get_value_for_thread(i);
+            if (!s.n)
+                continue;
+            unsigned char *begin = s.slots[0].data;
+            s.area = Packet::make(begin, _arena + data_pos[i] - begin, Packet::empty_destructor, 0);
+            if (!s.area) {
+                ret = errh->error("out of memory");
+                goto out;
+            }
+        }
+    }
+
+  out:
+    free(raw);
+    ff.cleanup();
+    return ret;
+}
+
+int
+ArenaReplay::initialize(ErrorHandler *errh)
+{
+    if (_nthreads > master()->nthreads())
+        return errh->error("THREADS is %d but Click only has %d threads", _nthreads, master()->nthreads());
+    if ((_timing || _rate) && cycles_hz() == 0)
+        return errh->error("TIMING and RATE need the frequency of the cycle counter");
+
+    for (int i = 0; i < _nthreads; i++)
+        _state.get_value_for_thread(i).area = 0;
+    if (load(errh) < 0)
+        return -1;
+
+    _tasks.resize(_nthreads);
+    for (int i = 0; i < _nthreads; i++) {
+        _tasks[i] = new Task(this);
+        _tasks[i]->initialize(this, false);
+        _tasks[i]->move_thread(i);
+    }
+    reset();
+    return 0;
+}
+
+void
+ArenaReplay::cleanup(CleanupStage)
+{
+    for (int i = 0; i < _tasks.size(); i++)
+        delete _tasks[i];
+    _tasks.clear();
+    for (int i = 0; i < _nthreads; i++) {
+        ThreadState &s = _state.get_value_for_thread(i);
+        if (s.area)
+            s.area->kill();
+        s.area = 0;
+    }
+    if (_arena)
+        munmap(_arena, _arena_size);
+    _arena = 0;
+}
+
+bool
+ArenaReplay::get_spawning_threads(Bitvector& b, bool, int)
+{
+    for (int i = 0; i < _nthreads && i < b.size(); i++)
+        b[i] = 1;
+    return true;
+}
+
+bool
+ArenaReplay::run_task(Task *t)
+{
+    if (!_active)
+        return false;
+    ThreadState &s = *_state;
+    if (s.done)
+        return false;
+
+    click_cycles_t now = click_get_cycles();
+    if (unlikely(s.start == 0)) {
+        s.start = now;
+        s.next = (uint64_t) now << RATE_SHIFT;
+    }
+
+    Packet* head = 0;
+    Packet* last = 0;
+    int count = 0;
+    while (count < _burst) {
+        Slot &slot = s.slots[s.index];
+        if (_timing) {
+            if (s.start + slot.offset > now)
+                break;
+        } else if (_rate) {
+            if ((s.next >> RATE_SHIFT) > now)
+                break;
+        }
+
+        //A clone is shared, so writers downstream copy it
+        Packet* p = s.area->clone();
+        if (!p)
+            break;
+        p->pull(slot.data - p->data());
+        p->take(p->length() - slot.length);
+        p->set_timestamp_anno(slot.ts);
+        if (last)
+            last->set_next(p);
+        else
+            head = p;
+        last = p;
+        count++;
+        s.next += s.interval;
+
+        if (++s.index == s.n) {
+            s.index = 0;
+            s.start += _loop_cycles;
+            if (_stop > 0 && ++s.loops >= _stop) {
+                s.done = true;
+                break;
+            }
+        }
+    }
+
+    if (head) {
+        output_push_batch(0, PacketBatch::start_head(head)->make_tail(last, count));
+        s.count += count;
+    }
+
+    if (s.done) {
+        if (_running.dec_and_test())
+            router()->please_stop_driver();
+    } else
+        t->fast_reschedule();
+    return count > 0;
+}
+
+void
+ArenaReplay::reset()
+{
+    _running = 0;
+    for (int i = 0; i < _nthreads; i++) {
+        ThreadState &s = _state.get_value_for_thread(i);
+        s.index = 0;
+        s.loops = 0;
+        s.count = 0;
+        s.start = 0;
+        s.next = 0;
+        if (!_rate)
+            s.interval = 0;
+        s.done = s.n == 0;
+        if (!s.done) {
+            _running++;
+            if (_active)
+                _tasks[i]->reschedule();
+        }
+    }
+}
+
+String
+ArenaReplay::read_handler(Element *e, void *thunk)
+{
+    ArenaReplay *ar = static_cast<ArenaReplay *>(e);
+    switch ((intptr_t)thunk) {
+    case h_count: {
+        uint64_t count = 0;
+        for (int i = 0; i < ar->_nthreads; i++)
+            count += ar->_state.get_value_for_thread(i).count;
+        return String(count);
+    }
+    case h_hugepages:
+        return String(ar->_hugepages);
+    case h_active:
+        return String(ar->_active);
+    default:
+        return "<error>";
+    }
+}
+
+int
+ArenaReplay::write_handler(const String &s, Element *e, void *thunk, ErrorHandler *errh)
+{
+    ArenaReplay *ar = static_cast<ArenaReplay *>(e);
+    switch ((intptr_t)thunk) {
+    case h_reset:
+        ar->reset();
+        return 0;
+    case h_active: {
+        bool active;
+        if (!BoolArg().parse(s, active))
+            return errh->error("syntax error");
+        ar->_active = active;
+        if (active)
+            for (int i = 0; i < ar->_tasks.size(); i++)
+                ar->_tasks[i]->reschedule();
+        return 0;
+    }
+    default:
+        return -1;
+    }
+}
+
+void
+ArenaReplay::add_handlers()
+{
+    add_read_handler("count", read_handler, h_count);
+    add_read_handler("hugepages", read_handler, h_hugepages);
+    add_read_handler("active", read_handler, h_active, Handler::f_checkbox);
+    add_write_handler("active", write_handler, h_active);
+    add_write_handler("reset", write_handler, h_reset, Handler::f_button);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel batch !dpdk-packet FromDump FakePcap)
+EXPORT_ELEMENT(ArenaReplay)
+ELEMENT_MT_SAFE(ArenaReplay)
@@ -0,0 +1,185 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+#ifndef CLICK_ARENAREPLAY_HH
+#define CLICK_ARENAREPLAY_HH
+#include <click/batchelement.hh>
+#include <click/task.hh>
+#include <click/vector.hh>
+#include <click/multithread.hh>
+#include <click/timestamp.hh>
+CLICK_DECLS
+
+/*
+=c
+
+ArenaReplay(FILENAME [, I<keywords> THREADS, BURST, STOP, TIMING, RATE, HUGEPAGES, ACTIVE])
+
+=s traces
+
+replays a tcpdump file preloaded in memory from multiple threads
+
+=d
+
+Loads all the packets of the tcpdump file FILENAME once, and replays them
+as fast as possible or at a controlled pace, from THREADS threads. It is
+meant to be a software load source fast enough to stress the elements
+downstream, where Replay and MultiReplay would be the bottleneck.
+
+Packets are shared among the threads following a symmetric hash of their
+flow, as with the SHARD argument of FromDump, so all packets of a flow are
+sent by the same thread, in order. The packets of each thread are copied in
+a contiguous area of a single arena backed by hugepages if possible, next to
+an array describing them.
+
+Replaying a packet does not copy it: the pushed packets are clones of a
+packet spanning the part of the arena of the thread, and point directly to
+it. As they are shared, elements modifying packets copy them first, and the
+trace is left intact for the next loops.
+
+Each thread paces its packets independently using the cycle counter. With
+TIMING, packets are sent at their original time relative to the first
+packet of the trace, and all threads share the same timeline. With RATE,
+packets are sent regularly, each thread taking a part of the rate
+proportional to its number of packets.
+
+Keyword arguments are:
+
+=over 8
+
+=item FILENAME
+
+String. Filename of the tcpdump file, possibly compressed.
+
+=item THREADS
+
+Integer. Number of threads sending packets, from thread 0. Default is 1.
+
+=item BURST
+
+Integer. Maximal number of packets pushed at once by a thread. Default is 32.
+
+=item STOP
+
+Integer. Number of times each thread replays its packets, -1 to loop
+forever. When all threads are done, the driver is stopped. Default is 1.
+
+=item TIMING
+
+Integer. Speed of the replay in percent of the original one, 0 to disable.
+Default is 0.
+
+=item RATE
+
+Integer. Number of packets per second sent by all threads, 0 to disable.
+Cannot be used with TIMING. Default is 0.
+
+=item HUGEPAGES
+
+Boolean. Whether to allocate the arena in hugepages. If none are available,
+transparent hugepages are asked for. Default is true.
+
+=item ACTIVE
+
+Boolean. Whether packets are sent. Default is true.
+
+=back
+
+=h count read-only
+
+Number of packets sent by all threads.
+
+=h hugepages read-only
+
+Whether the arena is backed by hugepages.
+
+=h active read/write
+
+Same as the ACTIVE argument.
+
+=h reset write-only
+
+Resets the count and restarts the replay from the beginning.
+
+=e
+
+  ArenaReplay(trace.pcap, THREADS 4, STOP -1, RATE 20000000)
+    -> ToDPDKDevice(0);
+
+=a Replay, MultiReplay, FromDump
+*/
+
+class ArenaReplay : public BatchElement { public:
+
+    ArenaReplay() CLICK_COLD;
+    ~ArenaReplay() CLICK_COLD;
+
+    const char *class_name() const override  { return "ArenaReplay"; }
+    const char *port_count() const override  { return PORTS_0_1; }
+    const char *processing() const override  { return PUSH; }
+
+    int configure(Vector<String> &, ErrorHandler *) override CLICK_COLD;
+    int initialize(ErrorHandler *) override CLICK_COLD;
+    void cleanup(CleanupStage) override CLICK_COLD;
+    void add_handlers() override CLICK_COLD;
+
+    bool get_spawning_threads(Bitvector& b, bool isoutput, int port) override;
+
+    bool run_task(Task *) override;
+
+  private:
+
+    //Describes a packet of the arena
+    struct Slot {
+        unsigned char* data;
+        uint32_t length;
+        //Cycles since the beginning of the loop when TIMING is set
+        uint64_t offset;
+        Timestamp ts;
+    };
+
+    struct ThreadState {
+        Slot* slots;
+        //Read-only packet spanning the data of the slots, cloned for each
+        //packet sent
+        Packet* area;
+        uint32_t n;
+        uint32_t index;
+        int loops;
+        bool done;
+        uint64_t count;
+        //Cycle at which the current loop started
+        click_cycles_t start;
+        //Cycle at which the next packet is due and cycles between two
+        //packets with RATE, shifted by RATE_SHIFT
+        uint64_t next;
+        uint64_t interval;
+    };
+
+    enum { RATE_SHIFT = 10, SLOT_ALIGN = 64 };
+
+    per_thread<ThreadState> _state;
+    Vector<Task*> _tasks;
+
+    String _filename;
+    unsigned char* _arena;
+    size_t _arena_size;
+    bool _hugepages;
+    int _nthreads;
+    int _burst;
+    int _stop;
+    unsigned _timing;
+    uint64_t _rate;
+    bool _active;
+    atomic_uint32_t _running;
+    //Duration of a loop of the trace in cycles, with TIMING
+    uint64_t _loop_cycles;
+
+    int load(ErrorHandler *) CLICK_COLD;
+    void reset() CLICK_COLD;
+
+    enum { h_count, h_hugepages, h_active, h_reset };
+    static String read_handler(Element *e, void *thunk) CLICK_COLD;
+    static int write_handler(const String &, Element *e, void *thunk, ErrorHandler *errh) CLICK_COLD;
+};
+
+CLICK_ENDDECLS
+#endif
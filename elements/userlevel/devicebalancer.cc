@@ -231,6 +231,9 @@ DeviceBalancer::initialize(ErrorHandler *errh) {
                     _manager->init_assignment(method->_table.data(), method->_table.size());
                     return 0;
             });
+        } else if (method != 0) {
+            //Per-core flow managers allocate their groups at configure time
+            _manager->init_assignment(method->_table.data(), method->_table.size());
         }
     }
     for (int i = 0; i < startwith; i++) {
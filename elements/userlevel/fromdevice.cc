@@ -56,6 +56,7 @@
 # include <net/if.h>
 # include <features.h>
 # include <linux/if_packet.h>
+# include <sys/mman.h>
 # if HAVE_DPDK
 #  define ether_addr ether_addr_undefined
 # endif
@@ -104,6 +105,12 @@ FromDevice::FromDevice()
 #if FROMDEVICE_ALLOW_LINUX || FROMDEVICE_ALLOW_PCAP
     _fd = -1;
 #endif
+#if FROMDEVICE_ALLOW_LINUX
+    _fanout = -1;
+#endif
+#if FROMDEVICE_ALLOW_MMAP
+    _ring = 0;
+#endif
 #if HAVE_BATCH
     in_batch_mode = BATCH_MODE_YES;
 #endif
@@ -125,8 +132,10 @@ FromDevice::configure(Vector<String> &conf, ErrorHandler *errh)
     _headroom += (4 - (_headroom + 2) % 4) % 4; // default 4/2 alignment
     _force_ip = false;
     _burst = 1;
-    String bpf_filter, capture, encap_type;
-    bool has_encap;
+    String bpf_filter, capture, encap_type, fanout_mode = "HASH";
+    bool has_encap, has_burst;
+    int fanout = -1;
+    unsigned nblocks = 32, block_size = 1 << 20, block_timeout = 0;
     if (Args(conf, this, errh)
         .read_mp("DEVNAME", _ifname)
         .read_p("PROMISC", promisc)
@@ -140,7 +149,12 @@ FromDevice::configure(Vector<String> &conf, ErrorHandler *errh)
         .read("OUTBOUND", outbound)
         .read("HEADROOM", _headroom)
         .read("ENCAP", WordArg(), encap_type).read_status(has_encap)
-        .read("BURST", _burst)
+        .read("BURST", _burst).read_status(has_burst)
+        .read("FANOUT", fanout)
+        .read("FANOUT_MODE", WordArg(), fanout_mode)
+        .read("BLOCKS", nblocks)
+        .read("BLOCK_SIZE", block_size)
+        .read("BLOCK_TIMEOUT", block_timeout)
         .read("TIMESTAMP", timestamp)
 		.read("ACTIVE", active)
         .complete() < 0)
@@ -163,7 +177,15 @@ FromDevice::configure(Vector<String> &conf, ErrorHandler *errh)
 #endif
 
     // set _method
-    if (capture == "") {
+    if (capture == "" && fanout >= 0 && !bpf_filter) {
+#if FROMDEVICE_ALLOW_MMAP
+        _method = method_mmap;
+#elif FROMDEVICE_ALLOW_LINUX
+        _method = method_linux;
+#else
+        return errh->error("FANOUT is not supported on this platform");
+#endif
+    } else if (capture == "") {
 #if FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_LINUX
 # if FROMDEVICE_ALLOW_PCAP
         _method = _bpf_filter ? method_pcap : method_default;
@@ -178,6 +200,10 @@ FromDevice::configure(Vector<String> &conf, ErrorHandler *errh)
     else if (capture == "LINUX")
         _method = method_linux;
 #endif
+#if FROMDEVICE_ALLOW_MMAP
+    else if (capture == "MMAP")
+        _method = method_mmap;
+#endif
 #if FROMDEVICE_ALLOW_PCAP
     else if (capture == "PCAP")
         _method = method_pcap;
@@ -188,6 +214,47 @@ FromDevice::configure(Vector<String> &conf, ErrorHandler *errh)
     if (bpf_filter && _method != method_pcap)
         errh->warning("not using METHOD PCAP, BPF filter ignored");
 
+#if FROMDEVICE_ALLOW_LINUX
+    if (fanout >= 0) {
+        if (_method != method_linux && _method != method_mmap)
+            return errh->error("FANOUT requires METHOD LINUX or MMAP");
+        if (fanout > 0xFFFF)
+            return errh->error("FANOUT out of range");
+        if (fanout_mode == "HASH")
+            _fanout_mode = PACKET_FANOUT_HASH;
+        else if (fanout_mode == "LB")
+            _fanout_mode = PACKET_FANOUT_LB;
+        else if (fanout_mode == "CPU")
+            _fanout_mode = PACKET_FANOUT_CPU;
+        else if (fanout_mode == "QM")
+            _fanout_mode = PACKET_FANOUT_QM;
+        else if (fanout_mode == "RND")
+            _fanout_mode = PACKET_FANOUT_RND;
+        else if (fanout_mode == "ROLLOVER")
+            _fanout_mode = PACKET_FANOUT_ROLLOVER;
+        else
+            return errh->error("bad FANOUT_MODE");
+    }
+    _fanout = fanout;
+#endif
+#if FROMDEVICE_ALLOW_MMAP
+    if (_method == method_mmap) {
+        if (nblocks == 0)
+            return errh->error("BLOCKS out of range");
+        if (block_size == 0 || block_size % getpagesize() != 0)
+            return errh->error("BLOCK_SIZE must be a multiple of the page size");
+        if (block_size < (unsigned)_snaplen + _headroom + 128)
+            return errh->error("BLOCK_SIZE too small for SNAPLEN");
+        if (!has_burst)
+            _burst = 32;
+    }
+    _nblocks = nblocks;
+    _block_size = block_size;
+    _block_timeout = block_timeout;
+#else
+    (void) has_burst;
+#endif
+
     _sniffer = sniffer;
     _promisc = promisc;
     _outbound = outbound;
@@ -208,9 +275,11 @@ FromDevice::cast(const char *n)
 
 #if FROMDEVICE_ALLOW_LINUX
 int
-FromDevice::open_packet_socket(String ifname, ErrorHandler *errh)
+FromDevice::open_packet_socket(String ifname, ErrorHandler *errh, bool receive)
 {
-    int fd = socket(PF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+    // a socket with no protocol receives nothing, which is what senders want
+    int protocol = receive ? htons(ETH_P_ALL) : 0;
+    int fd = socket(PF_PACKET, SOCK_RAW, protocol);
     if (fd == -1)
         return errh->error("%s: socket: %s", ifname.c_str(), strerror(errno));
 
@@ -231,7 +300,7 @@ FromDevice::open_packet_socket(String ifname, ErrorHandler *errh)
     sockaddr_ll sa;
     memset(&sa, 0, sizeof(sa));
     sa.sll_family = AF_PACKET;
-    sa.sll_protocol = htons(ETH_P_ALL);
+    sa.sll_protocol = protocol;
     sa.sll_ifindex = ifindex;
     res = bind(fd, (struct sockaddr *)&sa, sizeof(sa));
     if (res != 0) {
@@ -278,6 +347,119 @@ FromDevice::set_promiscuous(int fd, String ifname, bool promisc)
 }
 #endif /* FROMDEVICE_ALLOW_LINUX */
 
+#if FROMDEVICE_ALLOW_MMAP
+unsigned char *
+FromDevice::map_ring(int fd, int version, int optname, struct tpacket_req3 *req,
+                     size_t &size, ErrorHandler *errh)
+{
+    if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+        errh->error("PACKET_VERSION: %s", strerror(errno));
+        return 0;
+    }
+    if (setsockopt(fd, SOL_PACKET, optname, req, sizeof(*req)) < 0) {
+        errh->error("%s: %s", optname == PACKET_RX_RING ? "PACKET_RX_RING" : "PACKET_TX_RING", strerror(errno));
+        return 0;
+    }
+    size = (size_t) req->tp_block_size * req->tp_block_nr;
+    void *map = ::mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED | MAP_POPULATE, fd, 0);
+    if (map == MAP_FAILED)
+        map = ::mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        errh->error("mmap: %s", strerror(errno));
+        return 0;
+    }
+    return (unsigned char *) map;
+}
+
+TPacketRing *
+TPacketRing::make(int fd, unsigned nblocks, unsigned block_size,
+                  unsigned timeout, ErrorHandler *errh)
+{
+    struct tpacket_req3 req;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = block_size;
+    req.tp_block_nr = nblocks;
+    req.tp_frame_size = TPACKET_ALIGNMENT << 7;
+    req.tp_frame_nr = (block_size / req.tp_frame_size) * nblocks;
+    req.tp_retire_blk_tov = timeout;
+
+    size_t size;
+    unsigned char *map = FromDevice::map_ring(fd, TPACKET_V3, PACKET_RX_RING, &req, size, errh);
+    if (!map)
+        return 0;
+
+    TPacketRing *r = new TPacketRing();
+    r->_map = map;
+    r->_map_size = size;
+    r->_nblocks = nblocks;
+    r->_cur = 0;
+    r->_refs = 1;
+    r->_blocks = new Block[nblocks];
+    for (unsigned i = 0; i < nblocks; i++) {
+        r->_blocks[i].ring = r;
+        r->_blocks[i].desc = (struct tpacket_block_desc *) (map + (size_t) i * block_size);
+        r->_blocks[i].refs = 0;
+    }
+    return r;
+}
+
+TPacketRing::~TPacketRing()
+{
+    munmap(_map, _map_size);
+    delete[] _blocks;
+}
+
+/**
+ * Whether the kernel handed the block, and all the packets we built over it
+ * the last time were destroyed
+ */
+bool
+TPacketRing::ready(Block *b) const
+{
+    return b->refs.value() == 0
+        && (__atomic_load_n(&b->desc->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER);
+}
+
+/**
+ * Take a reference on a block handed by the kernel, released by put()
+ */
+void
+TPacketRing::hold(Block *b)
+{
+    b->refs = 1;
+    ++_refs;
+}
+
+void
+TPacketRing::put(Block *b)
+{
+    if (b->refs.dec_and_test()) {
+        __atomic_store_n(&b->desc->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        unref();
+    }
+}
+
+void
+TPacketRing::unref()
+{
+    if (_refs.dec_and_test())
+        delete this;
+}
+
+void
+TPacketRing::close()
+{
+    unref();
+}
+
+void
+TPacketRing::frame_destructor(unsigned char *, size_t, void *arg)
+{
+    Block *b = static_cast<Block *>(arg);
+    b->ring->put(b);
+}
+#endif /* FROMDEVICE_ALLOW_MMAP */
+
 #if FROMDEVICE_ALLOW_PCAP
 const char*
 FromDevice::fetch_pcap_error(pcap_t* pcap, const char *ebuf)
@@ -430,7 +612,7 @@ FromDevice::initialize(ErrorHandler *errh)
 
 
 #if FROMDEVICE_ALLOW_LINUX
-    if (_method == method_default || _method == method_linux) {
+    if (_method == method_default || _method == method_linux || _method == method_mmap) {
         _fd = open_packet_socket(_ifname, errh);
         if (_fd < 0)
             return -1;
@@ -444,7 +626,23 @@ FromDevice::initialize(ErrorHandler *errh)
             _was_promisc = promisc_ok;
 
         _datalink = FAKE_DLT_EN10MB;
+# if FROMDEVICE_ALLOW_MMAP
+        if (_method == method_mmap) {
+            int reserve = _headroom;
+            if (setsockopt(_fd, SOL_PACKET, PACKET_RESERVE, &reserve, sizeof(reserve)) < 0)
+                return errh->error("%s: PACKET_RESERVE: %s", _ifname.c_str(), strerror(errno));
+            _ring = TPacketRing::make(_fd, _nblocks, _block_size, _block_timeout, errh);
+            if (!_ring)
+                return -1;
+        } else
+# endif
         _method = method_linux;
+
+        if (_fanout >= 0) {
+            int arg = _fanout | (_fanout_mode << 16);
+            if (setsockopt(_fd, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg)) < 0)
+                return errh->error("%s: PACKET_FANOUT: %s", _ifname.c_str(), strerror(errno));
+        }
     }
 #endif
 
@@ -480,12 +678,17 @@ FromDevice::cleanup(CleanupStage stage)
 #endif
     }
 #if FROMDEVICE_ALLOW_LINUX
-    if (_fd >= 0 && _method == method_linux) {
+    if (_fd >= 0 && (_method == method_linux || _method == method_mmap)) {
         if (_was_promisc >= 0)
             set_promiscuous(_fd, _ifname, _was_promisc);
         close(_fd);
     }
 #endif
+#if FROMDEVICE_ALLOW_MMAP
+    if (_ring)
+        _ring->close();
+    _ring = 0;
+#endif
 #if FROMDEVICE_ALLOW_PCAP
     if (_pcap)
         pcap_close(_pcap);
@@ -555,6 +758,88 @@ FromDevice_get_packet(u_char* clientdata,
 CLICK_DECLS
 #endif
 
+#if FROMDEVICE_ALLOW_MMAP
+/**
+ * Push the packets of the current block of the ring, in batches of at most
+ * _burst packets. The packets point into the block, which the kernel gets
+ * back when the last one is destroyed.
+ */
+void
+FromDevice::receive_mmap()
+{
+    TPacketRing::Block *b = _ring->current();
+    if (!_ring->ready(b))
+        return;
+    _ring->hold(b);
+    _ring->advance();
+
+    struct tpacket_block_desc *bd = b->desc;
+    uint32_t n = bd->hdr.bh1.num_pkts;
+    unsigned char *h = (unsigned char *) bd + bd->hdr.bh1.offset_to_first_pkt;
+# if HAVE_BATCH
+    BATCH_CREATE_INIT(batch);
+    BATCH_CREATE_INIT(batch_err);
+# endif
+    for (uint32_t i = 0; i < n; i++) {
+        struct tpacket3_hdr *th = (struct tpacket3_hdr *) h;
+        struct sockaddr_ll *sa = (struct sockaddr_ll *) (h + TPACKET_ALIGN(sizeof(*th)));
+        h += th->tp_next_offset;
+        if ((sa->sll_pkttype == PACKET_OUTGOING && !_outbound)
+            || (_protocol != 0 && _protocol != sa->sll_protocol))
+            continue;
+
+        uint32_t len = th->tp_snaplen;
+        if (len > (uint32_t) _snaplen)
+            len = _snaplen;
+        ++b->refs;
+        WritablePacket *p = Packet::make((unsigned char *) th + th->tp_mac, len,
+                                         TPacketRing::frame_destructor, b,
+                                         th->tp_mac - TPACKET3_HDRLEN, 0);
+        if (!p) {
+            _ring->put(b);
+            continue;
+        }
+        SET_EXTRA_LENGTH_ANNO(p, th->tp_len - len);
+        p->set_packet_type_anno((Packet::PacketType)sa->sll_pkttype);
+        if (_timestamp)
+            p->timestamp_anno() = Timestamp::make_nsec(th->tp_sec, th->tp_nsec);
+        p->set_mac_header(p->data());
+        ++_count;
+# if HAVE_BATCH
+        if (!_force_ip || fake_pcap_force_ip(p, _datalink)) {
+            BATCH_CREATE_APPEND(batch, p);
+        } else {
+            BATCH_CREATE_APPEND(batch_err, p);
+        }
+        if (batchcount + batch_errcount == _burst) {
+            BATCH_CREATE_FINISH(batch);
+            BATCH_CREATE_FINISH(batch_err);
+            if (batch)
+                output(0).push_batch(batch);
+            if (batch_err)
+                checked_output_push_batch(1, batch_err);
+            batch = batch_err = 0;
+            batchcount = batch_errcount = 0;
+        }
+# else
+        if (!_force_ip || fake_pcap_force_ip(p, _datalink))
+            output(0).push(p);
+        else
+            checked_output_push(1, p);
+# endif
+    }
+# if HAVE_BATCH
+    BATCH_CREATE_FINISH(batch);
+    BATCH_CREATE_FINISH(batch_err);
+    if (batch)
+        output(0).push_batch(batch);
+    if (batch_err)
+        checked_output_push_batch(1, batch_err);
+# endif
+    _ring->put(b);
+}
+#endif
+
 void
 FromDevice::selected(int, int)
 {
@@ -633,6 +918,10 @@ FromDevice::selected(int, int)
 # endif
     }
 #endif
+#if FROMDEVICE_ALLOW_MMAP
+    if (_method == method_mmap)
+        receive_mmap();
+#endif
 }
 
 #if FROMDEVICE_ALLOW_PCAP
@@ -686,6 +975,14 @@ FromDevice::kernel_drops(bool& known, int& max_drops) const
             known = true, max_drops = stats.tp_drops;
     }
 #endif
+#if FROMDEVICE_ALLOW_MMAP
+    if (_method == method_mmap) {
+        struct tpacket_stats_v3 stats;
+        socklen_t statsize = sizeof(stats);
+        if (getsockopt(_fd, SOL_PACKET, PACKET_STATISTICS, &stats, &statsize) >= 0)
+            known = true, max_drops = stats.tp_drops;
+    }
+#endif
 }
 
 
@@ -1,6 +1,7 @@
 #ifndef CLICK_FROMDEVICE_USERLEVEL_HH
 #define CLICK_FROMDEVICE_USERLEVEL_HH
 #include <click/batchelement.hh>
+#include <click/atomic.hh>
 #include "../../vendor/nicscheduler/ethernetdevice.hh"
 #include "elements/userlevel/kernelfilter.hh"
 
@@ -17,6 +18,9 @@ struct bpf_program {
 
 #ifdef __linux__
 # define FROMDEVICE_ALLOW_LINUX 1
+# if !CLICK_PACKET_USE_DPDK
+#  define FROMDEVICE_ALLOW_MMAP 1
+# endif
 #endif
 
 #if HAVE_PCAP
@@ -39,6 +43,59 @@ void FromDevice_get_packet(u_char*, const struct pcap_pkthdr*, const u_char*);
 
 CLICK_DECLS
 
+#if FROMDEVICE_ALLOW_MMAP
+struct tpacket_block_desc;
+struct tpacket_req3;
+
+/**
+ * RX ring of a TPACKET_V3 packet socket. Packets are built over the frames
+ * of a block, and the block goes back to the kernel when all its packets are
+ * destroyed. As packets may outlive the element, the ring is only unmapped
+ * when the element and all blocks have released it.
+ */
+class TPacketRing { public:
+
+    struct Block {
+        TPacketRing *ring;
+        struct tpacket_block_desc *desc;
+        atomic_uint32_t refs;
+    };
+
+    static TPacketRing *make(int fd, unsigned nblocks, unsigned block_size,
+                             unsigned timeout, ErrorHandler *errh);
+
+    inline Block *current() const {
+        return &_blocks[_cur];
+    }
+
+    inline void advance() {
+        if (++_cur == _nblocks)
+            _cur = 0;
+    }
+
+    bool ready(Block *b) const;
+    void hold(Block *b);
+    void put(Block *b);
+    void close();
+
+    static void frame_destructor(unsigned char *, size_t, void *arg);
+
+  private:
+
+    unsigned char *_map;
+    size_t _map_size;
+    Block *_blocks;
+    unsigned _nblocks;
+    unsigned _cur;
+    atomic_uint32_t _refs;
+
+    TPacketRing() { }
+    ~TPacketRing();
+    void unref();
+
+};
+#endif
+
 /*
 =title FromDevice.u
 
@@ -102,8 +159,43 @@ but the IP header annotation has been set appropriately.) Default is false.
 =item METHOD
 
 Word.  Defines the capture method FromDevice will use to read packets from the
-device.  Linux targets generally support PCAP and LINUX; other targets support
-only PCAP.  Defaults to PCAP.
+device.  Linux targets generally support PCAP, LINUX and MMAP; other targets
+support only PCAP.  Defaults to PCAP.
+
+MMAP reads packets from a TPACKET_V3 ring shared with the kernel. The kernel
+fills blocks of packets, and FromDevice builds packets directly over the ring
+without copy. A block goes back to the kernel once all its packets are
+destroyed, so packets should not be stored for long, eg. in a Queue, or the
+kernel will drop packets when it runs out of blocks.
+
+=item FANOUT
+
+Integer.  If set, join the packet fanout group with this identifier. The
+kernel spreads the packets of the device among the sockets of the group, so
+several FromDevice elements on the same device, running on different threads,
+each receive a part of the traffic. Only affects METHOD LINUX and MMAP, and
+sets the default METHOD to MMAP.
+
+=item FANOUT_MODE
+
+Word.  How packets are spread in the fanout group: HASH (per flow), LB (round
+robin), CPU (per receiving CPU), QM (per receive queue), RND (random) or
+ROLLOVER.  Defaults to HASH.
+
+=item BLOCKS
+
+Unsigned.  Number of blocks of the ring for METHOD MMAP.  Defaults to 32.
+
+=item BLOCK_SIZE
+
+Unsigned.  Size of the blocks of the ring for METHOD MMAP, a multiple of the
+page size.  Defaults to 1 MB.
+
+=item BLOCK_TIMEOUT
+
+Unsigned.  Milliseconds after which the kernel gives a block that is not full
+to FromDevice, for METHOD MMAP.  Defaults to 0, which lets the kernel choose
+from the speed of the device.
 
 =item BPF_FILTER
 
@@ -134,7 +226,9 @@ to roughly 28.
 
 =item BURST
 
-Integer. Maximum number of packets to read per scheduling. Defaults to 1.
+Integer. Maximum number of packets to read per scheduling. With METHOD MMAP,
+maximum number of packets per batch, a block being pushed as several batches.
+Defaults to 1, or 32 with METHOD MMAP.
 
 =item TIMESTAMP
 
@@ -206,9 +300,15 @@ class FromDevice : public BatchElement, public EthernetDevice { public:
 
 #if FROMDEVICE_ALLOW_LINUX
     int linux_fd() const		{ return _method == method_linux ? _fd : -1; }
-    static int open_packet_socket(String, ErrorHandler *);
+    static int open_packet_socket(String, ErrorHandler *, bool receive = true);
     static int set_promiscuous(int, String, bool);
 #endif
+#if FROMDEVICE_ALLOW_MMAP
+    bool uses_mmap() const		{ return _method == method_mmap; }
+    static unsigned char *map_ring(int fd, int version, int optname,
+                                   struct tpacket_req3 *req, size_t &size,
+                                   ErrorHandler *errh);
+#endif
 
 #if FROMDEVICE_ALLOW_PCAP
     bool run_task(Task *task);
@@ -256,8 +356,20 @@ class FromDevice : public BatchElement, public EthernetDevice { public:
     int _snaplen;
     uint16_t _protocol;
     unsigned _headroom;
-    enum { method_default, method_pcap, method_linux };
+    enum { method_default, method_pcap, method_linux, method_mmap };
     int _method;
+#if FROMDEVICE_ALLOW_LINUX
+    int _fanout;
+    int _fanout_mode;
+#endif
+#if FROMDEVICE_ALLOW_MMAP
+    TPacketRing *_ring;
+    unsigned _nblocks;
+    unsigned _block_size;
+    unsigned _block_timeout;
+
+    void receive_mmap();
+#endif
 #if FROMDEVICE_ALLOW_PCAP
     String _bpf_filter;
 #endif
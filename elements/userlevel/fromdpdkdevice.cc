@@ -36,6 +36,10 @@
 #if HAVE_FLOW_API
     #include <click/flowrulemanager.hh>
 #endif
+#if RTE_VERSION >= RTE_VERSION_NUM(22,11,0,0)
+    #include <rte_cpuflags.h>
+    #include <rte_power_intrinsics.h>
+#endif
 
 #if RTE_VERSION >= RTE_VERSION_NUM(22,07,0,0)
 #define DEV_RX_OFFLOAD_IPV4_CKSUM RTE_ETH_RX_OFFLOAD_IPV4_CKSUM
@@ -50,10 +54,8 @@ CLICK_DECLS
 #define LOAD_UNIT 10
 
 FromDPDKDevice::FromDPDKDevice() :
-    _dev(0), _tco(false), _uco(false), _ipco(false)
-#if HAVE_DPDK_INTERRUPT
-    ,_rx_intr(-1)
-#endif
+    _dev(0), _rx_intr(-1), _tco(false), _uco(false), _ipco(false),
+    _adaptive(false), _power_monitor(false), _backoff_min(0)
 {
 #if HAVE_BATCH
     in_batch_mode = BATCH_MODE_YES;
@@ -111,9 +113,12 @@ int FromDPDKDevice::configure(Vector<String> &conf, ErrorHandler *errh)
         .read_all("VF_VLAN", vf_vlan)
         .read("MINQUEUES",minqueues)
         .read("MAXQUEUES",maxqueues)
-#if HAVE_DPDK_INTERRUPT
         .read("RX_INTR", _rx_intr)
-#endif
+        .read("ADAPTIVE", _adaptive)
+        .read_or_set("MIN_BURST", _min_burst, 8)
+        .read_or_set("MAX_BURST", _max_burst, 256)
+        .read_or_set("IDLE_POLLS", _idle_polls, 64)
+        .read_or_set("SLEEP_POLLS", _sleep_polls, 1024)
         .read("MAX_RSS", max_rss).read_status(has_rss)
         .read("RETA_SIZE", reta_size).read_status(has_reta_size)
         .read("TIMESTAMP", set_timestamp)
@@ -130,6 +135,17 @@ int FromDPDKDevice::configure(Vector<String> &conf, ErrorHandler *errh)
         .complete() < 0)
         return -1;
 
+    if (_adaptive) {
+        if (_min_burst <= 0 || _min_burst > _max_burst)
+            return errh->error("MIN_BURST must be positive and smaller than MAX_BURST");
+        if (_burst < _min_burst)
+            _burst = _min_burst;
+        else if (_burst > _max_burst)
+            _burst = _max_burst;
+        if (_sleep_polls < _idle_polls)
+            _sleep_polls = _idle_polls;
+    }
+
     if (!DPDKDeviceArg::parse(dev, _dev)) {
         if (allow_nonexistent)
             return 0;
@@ -167,6 +183,14 @@ int FromDPDKDevice::configure(Vector<String> &conf, ErrorHandler *errh)
     if (has_mtu)
         _dev->set_init_mtu(mtu);
 
+#if HAVE_DPDK_INTERRUPT
+    if (_rx_intr >= 0)
+        _dev->set_init_rx_intr(true);
+#else
+    if (_rx_intr >= 0)
+        return errh->error("RX_INTR is not supported on this platform");
+#endif
+
     if (fc_mode != FC_UNSET)
         _dev->set_init_fc_mode(fc_mode);
 
@@ -264,11 +288,18 @@ int FromDPDKDevice::initialize(ErrorHandler *errh)
     }
 
 
-    if (queue_per_threads > 1
-#if HAVE_DPDK_INTERRUPT
-     || _rx_intr
+    if (_adaptive) {
+        _bursts.resize(lastqueue - firstqueue + 1);
+        for (int i = 0; i < _bursts.size(); i++)
+            _bursts[i].burst = _burst;
+        _backoff_min = cycles_hz() / 1000000;
+#if RTE_VERSION >= RTE_VERSION_NUM(22,11,0,0)
+        struct rte_cpu_intrinsics intrinsics;
+        rte_cpu_get_intrinsics_support(&intrinsics);
+        _power_monitor = intrinsics.power_monitor;
 #endif
-     )
+        ret = initialize_tasks(_active, errh, adaptive_run_task);
+    } else if (queue_per_threads > 1 || _rx_intr >= 0)
         ret = initialize_tasks(_active, errh, multi_run_task);
     else
         ret = initialize_tasks(_active, errh);
@@ -301,23 +332,6 @@ int FromDPDKDevice::initialize(ErrorHandler *errh)
 #endif
     }
 
-#if HAVE_DPDK_INTERRUPT
-    if (_rx_intr >= 0) {
-        for (int i = firstqueue; i <= lastqueue; i++) {
-            uint64_t data = _dev->port_id << CHAR_BIT | i;
-            ret = rte_eth_dev_rx_intr_ctl_q(_dev->port_id, i,
-                                            RTE_EPOLL_PER_THREAD,
-                                            RTE_INTR_EVENT_ADD,
-                                            (void *)((uintptr_t)data));
-            if (ret != 0) {
-                return errh->error(
-                    "Cannot initialize RX interrupt on this device"
-                );
-            }
-        }
-    }
-#endif
-
     return ret;
 }
 
@@ -352,10 +366,10 @@ extern "C" {
 }
 #endif
 
-inline CLICK_ALWAYS_INLINE bool
-FromDPDKDevice::_run_task(int iqueue)
+inline CLICK_ALWAYS_INLINE unsigned
+FromDPDKDevice::_run_task(int iqueue, unsigned burst)
 {
-    struct rte_mbuf *pkts[_burst];
+    struct rte_mbuf *pkts[burst];
 
 #if HAVE_BATCH
   PacketBatch *head = 0;
@@ -363,9 +377,9 @@ FromDPDKDevice::_run_task(int iqueue)
 #endif
 
 #ifdef DPDK_USE_XCHG
- unsigned n = rte_mlx5_rx_burst_xchg(_dev->port_id, iqueue, (struct xchg**)pkts, _burst);
+ unsigned n = rte_mlx5_rx_burst_xchg(_dev->port_id, iqueue, (struct xchg**)pkts, burst);
 #else
- unsigned n = rte_eth_rx_burst(_dev->port_id, iqueue, pkts, _burst);
+ unsigned n = rte_eth_rx_burst(_dev->port_id, iqueue, pkts, burst);
 #endif
 
 for (unsigned i = 0; i < n; ++i) {
@@ -442,31 +456,12 @@ bool FromDPDKDevice::multi_run_task(Task *t, void* e) {
     bool ret = false;
 
     for (int  iqueue = fd->queue_for_thisthread_begin(); iqueue <= fd->queue_for_thisthread_end(); iqueue++) {
-        ret |= fd->_run_task(iqueue);
+        ret |= fd->_run_task(iqueue, fd->_burst);
     }
 
-    #if HAVE_DPDK_INTERRUPT
-     if (!ret && _rx_intr >= 0) {
-           for (int iqueue = queue_for_thisthread_begin();
-                iqueue<=queue_for_thisthread_end(); iqueue++) {
-               if (rte_eth_dev_rx_intr_enable(_dev->port_id, iqueue) != 0) {
-                   click_chatter("Could not enable interrupts");
-                   t->fast_reschedule();
-                   return false;
-               }
-           }
-           struct rte_epoll_event event[queue_per_threads];
-           int n, i;
-           uint8_t port_id, queue_id;
-           void *data;
-           n = rte_epoll_wait(RTE_EPOLL_PER_THREAD, event, queue_per_threads, -1);
-           for (i = 0; i < n; i++) {
-                   data = event[i].epdata.data;
-                   port_id = ((uintptr_t)data) >> CHAR_BIT;
-                   assert(port_id == _dev->port_id);
-           }
-           this->selected(0, SELECT_READ);
-    }
+#if HAVE_DPDK_INTERRUPT
+    if (!ret && fd->_rx_intr >= 0)
+        fd->wait_rx_intr(-1);
 #endif
 
     t->fast_reschedule();
@@ -475,24 +470,231 @@ bool FromDPDKDevice::multi_run_task(Task *t, void* e) {
 
 bool FromDPDKDevice::run_task(Task *t) {
     int iqueue = queue_for_thisthread_begin();
-    bool ret = _run_task(iqueue);
+    bool ret = _run_task(iqueue, _burst);
 
     t->fast_reschedule();
     return ret;
 }
 
 #if HAVE_DPDK_INTERRUPT
-void FromDPDKDevice::selected(int fd, int mask) {
-    for (int iqueue = queue_for_thisthread_begin();
-            iqueue<=queue_for_thisthread_end(); iqueue++) {
-        if (rte_eth_dev_rx_intr_disable(_dev->port_id, iqueue) != 0) {
+/**
+ * Sleep until a packet is received by one of the queues of this thread, or
+ * for timeout milliseconds (-1 to wait forever). The interrupts are attached
+ * to the epoll instance of the thread the first time it sleeps.
+ *
+ * @return the number of events, 0 on timeout and -1 if interrupts cannot be
+ * used
+ */
+int FromDPDKDevice::wait_rx_intr(int timeout) {
+    FDState &st = *_fdstate;
+    int begin = queue_for_thisthread_begin();
+    int end = queue_for_thisthread_end();
+
+    if (unlikely(st.registered <= 0)) {
+        if (st.registered < 0)
+            return -1;
+        for (int iqueue = begin; iqueue <= end; iqueue++) {
+            uint64_t data = _dev->port_id << CHAR_BIT | iqueue;
+            if (rte_eth_dev_rx_intr_ctl_q(_dev->port_id, iqueue,
+                                          RTE_EPOLL_PER_THREAD,
+                                          RTE_INTR_EVENT_ADD,
+                                          (void *)((uintptr_t)data)) != 0) {
+                click_chatter("%p{element}: Cannot initialize RX interrupt of queue %d", this, iqueue);
+                st.registered = -1;
+                return -1;
+            }
+        }
+        st.registered = 1;
+    }
+
+    for (int iqueue = begin; iqueue <= end; iqueue++) {
+        if (rte_eth_dev_rx_intr_enable(_dev->port_id, iqueue) != 0) {
+            click_chatter("Could not enable interrupts");
+            return -1;
+        }
+    }
+
+    int n = 0;
+#if RTE_VERSION >= RTE_VERSION_NUM(17,05,0,0)
+    //A packet may have been received since the last poll
+    for (int iqueue = begin; iqueue <= end; iqueue++)
+        if (rte_eth_rx_descriptor_status(_dev->port_id, iqueue, 0) == RTE_ETH_RX_DESC_DONE)
+            n = 1;
+#endif
+    if (n == 0) {
+        struct rte_epoll_event event[queue_per_threads];
+        n = rte_epoll_wait(RTE_EPOLL_PER_THREAD, event, queue_per_threads, timeout);
+        if (n < 0)
+            n = 0;
+    }
+
+    for (int iqueue = begin; iqueue <= end; iqueue++) {
+        if (rte_eth_dev_rx_intr_disable(_dev->port_id, iqueue) != 0)
             click_chatter("Could not disable interrupts");
+    }
+    return n;
+}
+#endif
+
+/**
+ * Grow the burst of a queue when it was filled, up to the number of packets
+ * waiting in the ring if the driver can tell. Shrink it when the received
+ * bursts are much smaller on average.
+ */
+inline void
+FromDPDKDevice::adapt_burst(AdaptiveBurst &b, int iqueue, unsigned n)
+{
+    unsigned burst;
+    b.avg = b.avg - (b.avg >> 3) + n;
+    if (n == b.burst) {
+        if (b.burst >= (unsigned)_max_burst)
             return;
-        }
+        int waiting = rte_eth_rx_queue_count(_dev->port_id, iqueue);
+        burst = waiting > 0 ? b.burst + waiting : b.burst * 2;
+    } else if ((b.avg >> 3) < b.burst / 4 && b.burst > (unsigned)_min_burst) {
+        burst = b.burst / 2;
+    } else
+        return;
+
+    //Vectorized drivers receive packets by multiples of 4
+    burst &= ~3u;
+    if (burst < (unsigned)_min_burst)
+        burst = _min_burst;
+    else if (burst > (unsigned)_max_burst)
+        burst = _max_burst;
+    if (burst > b.burst)
+        b.avg = burst << 3;
+    b.burst = burst;
+}
+
+/**
+ * Wait before the next poll of an idle thread, for the current backoff
+ * which doubles at every call. A single queue is watched with umwait when
+ * possible, so the wait ends with the arrival of a packet. Otherwise the
+ * thread spins on pause.
+ */
+inline void
+FromDPDKDevice::idle_wait(AdaptiveState &s, int begin, int end)
+{
+    if (s.backoff < _backoff_min)
+        s.backoff = _backoff_min;
+    click_cycles_t now = click_get_cycles();
+    click_cycles_t deadline = now + s.backoff;
+#if RTE_VERSION >= RTE_VERSION_NUM(22,11,0,0)
+    struct rte_power_monitor_cond pmc;
+    if (_power_monitor && begin == end
+        && rte_eth_get_monitor_addr(_dev->port_id, begin, &pmc) == 0
+        && rte_power_monitor(&pmc, deadline) == 0) {
+        click_cycles_t woken = click_get_cycles();
+        s.sleep += woken - now;
+        if (woken < deadline)
+            s.last_poll = woken;
+    } else
+#endif
+    {
+        do {
+            rte_pause();
+        } while (click_get_cycles() < deadline);
+        s.idle += click_get_cycles() - now;
     }
-    task_for_thread()->reschedule();
+
+    click_cycles_t max = cycles_hz() / (1000000000 / BACKOFF_MAX_NS);
+    s.backoff = s.backoff * 2 < max ? s.backoff * 2 : max;
 }
+
+/**
+ * Task of the adaptive mode. Polls the queues of this thread with their
+ * own burst, and when all of them stay empty, backs off with idle_wait and
+ * then sleeps on interrupts.
+ */
+bool FromDPDKDevice::adaptive_run_task(Task *t, void* e) {
+    FromDPDKDevice* fd = static_cast<FromDPDKDevice*>(e);
+    AdaptiveState &s = *fd->_adaptive_state;
+    int begin = fd->queue_for_thisthread_begin();
+    int end = fd->queue_for_thisthread_end();
+    unsigned total = 0;
+
+    click_cycles_t start = click_get_cycles();
+    click_cycles_t now = start;
+    for (int iqueue = begin; iqueue <= end; iqueue++) {
+        AdaptiveBurst &b = fd->_bursts[iqueue - fd->firstqueue];
+        unsigned n = fd->_run_task(iqueue, b.burst);
+        if (n) {
+            now = click_get_cycles();
+            if (s.last_poll)
+                s.lat[lat_bucket(now - s.last_poll)]++;
+            total += n;
+        }
+        fd->adapt_burst(b, iqueue, n);
+    }
+    if (!total)
+        now = click_get_cycles();
+    s.last_poll = start;
+
+    if (total) {
+        s.busy += now - start;
+        s.empty = 0;
+        s.backoff = 0;
+    } else {
+        s.idle += now - start;
+        if (s.empty < fd->_sleep_polls)
+            s.empty++;
+        if (s.empty >= fd->_idle_polls) {
+#if HAVE_DPDK_INTERRUPT
+            if (fd->_rx_intr >= 0 && s.empty >= fd->_sleep_polls) {
+                int n = fd->wait_rx_intr(INTR_TIMEOUT_MS);
+                click_cycles_t woken = click_get_cycles();
+                s.sleep += woken - now;
+                if (n > 0)
+                    s.last_poll = woken;
+                else if (n < 0)
+                    s.empty = fd->_idle_polls;
+            } else
 #endif
+                fd->idle_wait(s, begin, end);
+        }
+    }
+
+    t->fast_reschedule();
+    return total;
+}
+
+uint64_t
+FromDPDKDevice::latency_percentile(double perc)
+{
+    uint64_t lat[LAT_BUCKETS];
+    uint64_t total = 0;
+    memset(lat, 0, sizeof(lat));
+    for (unsigned i = 0; i < _adaptive_state.weight(); i++) {
+        AdaptiveState &s = _adaptive_state.get_value(i);
+        for (int j = 0; j < LAT_BUCKETS; j++) {
+            lat[j] += s.lat[j];
+            total += s.lat[j];
+        }
+    }
+    if (total == 0 || cycles_hz() == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t)(perc * total / 100);
+    if (rank >= total)
+        rank = total - 1;
+    int j = 0;
+    for (uint64_t seen = 0; j < LAT_BUCKETS; j++) {
+        seen += lat[j];
+        if (seen > rank)
+            break;
+    }
+
+    //Middle of the bucket
+    uint64_t v;
+    if (j < 4)
+        v = j;
+    else {
+        int shift = (j >> 2) - 1;
+        v = ((uint64_t)(4 | (j & 3)) << shift) + ((1ULL << shift) >> 1);
+    }
+    return (uint64_t)((double)v * 1000000000 / cycles_hz());
+}
 
 ToDPDKDevice *
 FromDPDKDevice::find_output_element() {
@@ -516,6 +718,7 @@ enum {
     h_mac, h_add_mac, h_remove_mac, h_vf_mac,
     h_mtu,
     h_device, h_isolate,
+    h_load, h_cpu, h_latency,
 #if HAVE_FLOW_API
     h_rule_add, h_rules_del, h_rules_flush,
     h_rules_list, h_rules_list_with_hits, h_rules_ids_global, h_rules_ids_internal,
@@ -539,6 +742,21 @@ String FromDPDKDevice::read_handler(Element *e, void * thunk)
                   return "undefined";
               else
                   return String((int) fd->_dev->port_id);
+        case h_load:
+        case h_cpu: {
+            uint64_t busy = 0, idle = 0, sleep = 0;
+            for (unsigned i = 0; i < fd->_adaptive_state.weight(); i++) {
+                AdaptiveState &s = fd->_adaptive_state.get_value(i);
+                busy += s.busy;
+                idle += s.idle;
+                sleep += s.sleep;
+            }
+            if (busy + idle + sleep == 0)
+                return "0";
+            if ((uintptr_t) thunk == h_load)
+                return String((double) busy / (busy + idle + sleep));
+            return String((double) (busy + idle) / (busy + idle + sleep));
+        }
         case h_nb_rx_queues:
             return String(fd->_dev->nb_rx_queues());
         case h_nb_tx_queues:
@@ -887,6 +1105,13 @@ int FromDPDKDevice::xstats_handler(
             return -1;
         #endif
         }
+        case h_latency: {
+            double perc = 99;
+            if (input != "" && !DoubleArg().parse(input, perc))
+                return errh->error("Not a valid percentile");
+            input = String(fd->latency_percentile(perc));
+            return 0;
+        }
         case h_queue_count:
             if (input == "") {
                 StringAccum acc;
@@ -951,6 +1176,14 @@ int FromDPDKDevice::xstats_handler(
     }
 }
 
+int FromDPDKDevice::reset_load_handler(
+        const String &, Element *e, void *, ErrorHandler *) {
+    FromDPDKDevice *fd = static_cast<FromDPDKDevice *>(e);
+    for (unsigned i = 0; i < fd->_adaptive_state.weight(); i++)
+        fd->_adaptive_state.get_value(i).reset();
+    return 0;
+}
+
 void FromDPDKDevice::add_handlers()
 {
     add_read_handler("device",read_handler, h_device);
@@ -1018,6 +1251,11 @@ void FromDPDKDevice::add_handlers()
 
     add_read_handler("mtu",read_handler, h_mtu);
     add_data_handlers("burst", Handler::h_read | Handler::h_write, &_burst);
+
+    add_read_handler("load", read_handler, h_load);
+    add_read_handler("cpu", read_handler, h_cpu);
+    set_handler("latency", Handler::f_read | Handler::f_read_param, xstats_handler, h_latency);
+    add_write_handler("reset_load", reset_load_handler, 0, Handler::BUTTON);
 }
 
 CLICK_ENDDECLS
@@ -8,6 +8,10 @@
 #include "queuedevice.hh"
 #include "../../vendor/nicscheduler/ethernetdevice.hh"
 
+#if !defined(HAVE_DPDK_INTERRUPT) && defined(__linux__)
+# define HAVE_DPDK_INTERRUPT 1
+#endif
+
 CLICK_DECLS
 
 /*
@@ -15,7 +19,7 @@ CLICK_DECLS
 
 =c
 
-FromDPDKDevice(PORT [, QUEUE, N_QUEUES, I<keywords> PROMISC, BURST, NDESC])
+FromDPDKDevice(PORT [, QUEUE, N_QUEUES, I<keywords> PROMISC, BURST, NDESC, ADAPTIVE])
 
 =s netdevices
 
@@ -44,6 +48,9 @@ Arguments:
 
 Integer or PCI address. Port identifier of the device or a PCI address in the
 format fffff:ff:ff.f
+or a device name. Virtual devices such as "net_ring0" or "net_null0,size=64"
+are created when not given with --vdev, the arguments following the first
+comma.
 
 =item QUEUE
 
@@ -149,9 +156,41 @@ Integer. Specify the NUMA node to undertake packet processing.
 
 =item RX_INTR
 
-Integer. Enables Rx interrupts if non-negative value is given.
+Integer. Enables Rx interrupts if non-negative value is given. Threads
+sleep until a packet is received when all their queues are empty.
 Defaults to -1 (no interrupts).
 
+=item ADAPTIVE
+
+Boolean. Enables the adaptive mode. The burst of each queue grows when the
+queue is found full, up to the number of packets waiting in the ring as
+given by the driver, and shrinks when the received bursts become much smaller
+than the burst. Bursts are kept multiples of 4, as vectorized drivers
+receive packets by groups of 4. After IDLE_POLLS empty polls, the thread waits between each
+poll, doubling the wait up to 16 microseconds. The wait uses the monitoring
+instructions of the CPU (umwait) to be woken up by the next packet when the
+driver and the CPU allow it, a pause loop otherwise. If RX_INTR is set, the
+thread sleeps until an interrupt is received after SLEEP_POLLS empty polls.
+Statistics are given by the load, cpu and latency handlers. Defaults to false.
+
+=item MIN_BURST
+
+Integer. Minimal burst in adaptive mode. Defaults to 8.
+
+=item MAX_BURST
+
+Integer. Maximal burst in adaptive mode. Defaults to 256.
+
+=item IDLE_POLLS
+
+Integer. Number of consecutive empty polls before waiting between polls in
+adaptive mode. Defaults to 64.
+
+=item SLEEP_POLLS
+
+Integer. Number of consecutive empty polls before sleeping until an
+interrupt is received in adaptive mode, if RX_INTR is set. Defaults to 1024.
+
 =item SCALE
 
 String. Defines the scaling policy. Can be parallel or share.
@@ -276,9 +315,29 @@ Returns the number of packets read by the device.
 
 Resets "count" to zero.
 
+=h load read-only
+
+In adaptive mode, returns the fraction of the time spent by the threads
+receiving and processing packets.
+
+=h cpu read-only
+
+In adaptive mode, returns the fraction of the time the threads kept their
+cores busy, that is all the time but the time spent sleeping on interrupts
+or waiting with umwait.
+
+=h latency read-only
+
+In adaptive mode, returns a percentile of the delay in nanoseconds between
+the start of the poll preceding the reception of a burst and the end of the
+processing of the burst, which is an upper bound of the time spent by its
+packets in the element and its ring. When the thread is woken up by a packet,
+the delay starts at the wake up. The percentile is given as a parameter,
+default is 99.
+
 =h reset_load write-only
 
-Resets load counters to zero.
+Resets load, cpu and latency counters to zero.
 
 =h nb_rx_queues read-only
 
@@ -418,9 +477,6 @@ public:
     void add_handlers() override CLICK_COLD;
     void cleanup(CleanupStage) override CLICK_COLD;
     bool run_task(Task *) override;
-#if HAVE_DPDK_INTERRUPT
-    void selected(int fd, int mask) override;
-#endif
 
     ToDPDKDevice *find_output_element();
 
@@ -439,7 +495,11 @@ public:
 
 protected:
     static bool multi_run_task(Task *t, void* e);
-    inline bool _run_task(int iqueue);
+    static bool adaptive_run_task(Task *t, void* e);
+    inline unsigned _run_task(int iqueue, unsigned burst);
+#if HAVE_DPDK_INTERRUPT
+    int wait_rx_intr(int timeout);
+#endif
     static int reset_load_handler(
         const String &, Element *, void *, ErrorHandler *
     ) CLICK_COLD;
@@ -458,14 +518,70 @@ protected:
                               const Handler *handler, ErrorHandler *errh);
 
     DPDKDevice* _dev;
-#if HAVE_DPDK_INTERRUPT
     int _rx_intr;
+#if HAVE_DPDK_INTERRUPT
     class FDState { public:
-        FDState() : mustresched(0) {};
-        int mustresched;
+        FDState() : registered(0) {};
+        //1 if the interrupts of the queues are attached to the thread, -1 if
+        //they could not be
+        int registered;
     };
     per_thread<FDState> _fdstate;
 #endif
+
+    //Adaptive mode
+
+    enum { LAT_BUCKETS = 252, BACKOFF_MAX_NS = 16000, INTR_TIMEOUT_MS = 10 };
+
+    struct AdaptiveBurst {
+        AdaptiveBurst() : burst(0), avg(0) {};
+        unsigned burst;
+        //Moving average of the received bursts, times 8
+        unsigned avg;
+    } CLICK_CACHE_ALIGN;
+
+    class AdaptiveState { public:
+        AdaptiveState() : empty(0), backoff(0), last_poll(0) {
+            reset();
+        };
+        void reset() {
+            busy = idle = sleep = 0;
+            memset(lat, 0, sizeof(lat));
+        }
+        //Consecutive empty polls
+        unsigned empty;
+        //Current wait between two polls in cycles
+        click_cycles_t backoff;
+        click_cycles_t last_poll;
+        //Cycles spent receiving packets, in empty polls and pause loops,
+        //and sleeping
+        uint64_t busy;
+        uint64_t idle;
+        uint64_t sleep;
+        //Histogram of the latency in cycles, with 4 buckets per power of 2
+        uint64_t lat[LAT_BUCKETS];
+    };
+
+    static inline unsigned lat_bucket(uint64_t v) {
+        if (v < 4)
+            return v;
+        int msb = 63 - __builtin_clzll(v);
+        return ((msb - 1) << 2) | ((v >> (msb - 2)) & 3);
+    }
+
+    inline void adapt_burst(AdaptiveBurst &b, int iqueue, unsigned n);
+    inline void idle_wait(AdaptiveState &s, int begin, int end);
+    uint64_t latency_percentile(double perc);
+
+    bool _adaptive;
+    int _min_burst;
+    int _max_burst;
+    unsigned _idle_polls;
+    unsigned _sleep_polls;
+    bool _power_monitor;
+    click_cycles_t _backoff_min;
+    Vector<AdaptiveBurst,CLICK_CACHE_LINE_SIZE> _bursts;
+    per_thread<AdaptiveState> _adaptive_state;
     bool _set_timestamp;
     bool _tco;
     bool _uco;
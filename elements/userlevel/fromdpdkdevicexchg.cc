@@ -425,17 +425,6 @@ bool FromDPDKDeviceXCHG::run_task(Task *t) {
     output_push_batch(0, batch);
   }
 
-#elif HAVE_VECTOR_PACKET_POOL
-  //Useless. With XCHG we can tell the driver how we advance, linked list, vector, or whatever.
-  unsigned n = rte_eth_rx_burst_xchg(_dev->port_id, queue_idx, WritablePacket::pool_prepare_data(_burst), _burst);
-  if (n) {
-    WritablePacket::pool_consumed_data(n);
-    add_count(n);
-    ret = 1;
-  }
-  vect = PacketVector::alloc();
-  vect->insert(burst, n);
-  output_push_batch(0, vect);
 #else
   //This is the real X-Change. No loop! Yeah :)
   WritablePacket* head = WritablePacket::pool_prepare_data_burst(_burst);
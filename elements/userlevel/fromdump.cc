@@ -30,6 +30,8 @@
 #include <click/packet_anno.hh>
 #include <click/userutils.hh>
 #include <clicknet/ether.h>
+#include <clicknet/ip.h>
+#include <clicknet/ip6.h>
 #if CLICK_NS
 # include <click/master.hh>
 #endif
@@ -95,6 +97,7 @@ FromDump::configure(Vector<String> &conf, ErrorHandler *errh)
     _packet_filepos = 0;
     _preload = 0;
     String timing_fnt;
+    bool zerocopy = false;
 
     if (_ff.configure_keywords(conf, this, errh) < 0)
 	return -1;
@@ -120,9 +123,23 @@ FromDump::configure(Vector<String> &conf, ErrorHandler *errh)
     .read_or_set("ACCELERATION", _current_accel, 100)
     .read_or_set("TIMING_FNT", timing_fnt, "")
     .read_or_set("BURST", _burst, 32)
+    .read("ZEROCOPY", zerocopy)
+    .read_or_set("SHARD", _shard, 0)
+    .read_or_set("SHARDS", _shards, 1)
     .complete() < 0)
 	return -1;
 
+    if (_burst == 0)
+	return errh->error("BURST must be positive");
+    if (_shards == 0 || _shard >= _shards)
+	return errh->error("SHARD must be between 0 and SHARDS - 1");
+#ifdef ALLOW_MMAP
+    _ff.set_zerocopy(zerocopy);
+#else
+    if (zerocopy)
+	errh->warning("%<ZEROCOPY true%> is not supported on this platform");
+#endif
+
     // check sampling rate
     if (_sampling_prob > (1 << SAMPLING_SHIFT)) {
 	errh->warning("SAMPLE probability reduced to 1");
@@ -265,6 +282,9 @@ FromDump::initialize(ErrorHandler *errh)
 	return 0;
 
     // open file
+#ifdef ALLOW_MMAP
+    bool zerocopy_wanted = _ff.zerocopy();
+#endif
     if (_ff.initialize(errh) < 0)
 	return -1;
 
@@ -305,6 +325,11 @@ FromDump::initialize(ErrorHandler *errh)
         _force_ip = true;
     }
 
+#ifdef ALLOW_MMAP
+    if (zerocopy_wanted && !_ff.zerocopy())
+	errh->warning("cannot map %s, packets will not be zero-copy", _ff.print_filename().c_str());
+#endif
+
     // maybe skip ahead in the file
     int result;
     if (_packet_filepos != 0) {
@@ -408,6 +433,75 @@ FromDump::prepare_times(const Timestamp &ts)
      _have_any_times = true;
 }
 
+/**
+ * Return a symmetric hash of the IP addresses and transport ports of a
+ * packet of the given link type, so both directions of a flow have the same
+ * hash. Non-IP packets have hash 0.
+ */
+uint32_t
+FromDump::flow_hash(const uint8_t *data, uint32_t len, int linktype)
+{
+    if (linktype == FAKE_DLT_EN10MB) {
+	if (len < sizeof(click_ether))
+	    return 0;
+	uint16_t type = reinterpret_cast<const click_ether *>(data)->ether_type;
+	data += sizeof(click_ether);
+	len -= sizeof(click_ether);
+	if (type == htons(ETHERTYPE_8021Q) && len >= 4) {
+	    type = *reinterpret_cast<const uint16_t *>(data + 2);
+	    data += 4;
+	    len -= 4;
+	}
+	if (type != htons(ETHERTYPE_IP) && type != htons(ETHERTYPE_IP6))
+	    return 0;
+    } else if (linktype != FAKE_DLT_RAW)
+	return 0;
+
+    uint32_t hash;
+    uint32_t hlen;
+    uint8_t proto;
+    if (len >= sizeof(click_ip) && (data[0] >> 4) == 4) {
+	const click_ip *iph = reinterpret_cast<const click_ip *>(data);
+	hash = iph->ip_src.s_addr ^ iph->ip_dst.s_addr;
+	hlen = iph->ip_hl << 2;
+	proto = iph->ip_p;
+	if (IP_ISFRAG(iph))
+	    hlen = len;
+    } else if (len >= sizeof(click_ip6) && (data[0] >> 4) == 6) {
+	const click_ip6 *ip6h = reinterpret_cast<const click_ip6 *>(data);
+	const uint32_t *src = reinterpret_cast<const uint32_t *>(data + 8);
+	const uint32_t *dst = reinterpret_cast<const uint32_t *>(data + 24);
+	hash = 0;
+	for (int i = 0; i < 4; i++)
+	    hash ^= src[i] ^ dst[i];
+	hlen = sizeof(click_ip6);
+	proto = ip6h->ip6_nxt;
+    } else
+	return 0;
+
+    if ((proto == IP_PROTO_TCP || proto == IP_PROTO_UDP || proto == IP_PROTO_SCTP)
+	&& hlen + 4 <= len) {
+	const uint16_t *ports = reinterpret_cast<const uint16_t *>(data + hlen);
+	hash ^= (uint32_t) (ports[0] ^ ports[1]) << 16;
+    }
+    hash ^= proto;
+
+    hash ^= hash >> 16;
+    hash *= 0x45d9f3b;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+/**
+ * Return the shard of a packet from its flow hash. Non-IP packets belong to
+ * shard 0.
+ */
+inline uint32_t
+FromDump::shard_of(const uint8_t *data, uint32_t len) const
+{
+    return flow_hash(data, len, _linktype) % _shards;
+}
+
 bool
 FromDump::read_packet(ErrorHandler *errh)
 {
@@ -490,10 +584,28 @@ FromDump::read_packet(ErrorHandler *errh)
 	return true;
     }
 
+    // keep only the flows of our shard, looking at the data in place when
+    // possible to avoid creating packets of other shards
+    bool sharded = _shards == 1;
+    if (!sharded) {
+	if (const uint8_t *data = _ff.peek(caplen)) {
+	    if (shard_of(data, caplen) != _shard) {
+		_ff.shift_pos(caplen + skiplen);
+		return true;
+	    }
+	    sharded = true;
+	}
+    }
+
     // create packet
     p = _ff.get_packet(caplen, ts.sec(), ts.subsec(), errh);
     if (!p)
 	return false;
+    if (!sharded && shard_of(p->data(), p->length()) != _shard) {
+	p->kill();
+	_ff.shift_pos(skiplen);
+	return true;
+    }
 
     // Adjust the packet length as requested by the user
     if (_force_len != DISABLED) {
@@ -652,52 +764,66 @@ FromDump::run_task(Task *)
 {
     Timestamp now_s = Timestamp::now_steady();
     bool fresh = true;
+    bool more = true;
+    bool wait = false;
     unsigned n = 0;
-    int retry_count = 0;
-  again:
-    if (!_active)
-	return false;
+    unsigned retry_count = 0;
+#if HAVE_BATCH
+    BATCH_CREATE_INIT(batch);
+#endif
 
-    if (!_packet && !read_packet(0)) {
-	if (_end_h)
-	    _end_h->call_write(ErrorHandler::default_handler());
-	return false;
-    }
-    if (_packet && _timing) {
-        if (!check_timing(_packet, now_s, fresh)) {
-		return false;
-        }
+    while (n < _burst && _active) {
+	if (!_packet && !read_packet(0)) {
+	    more = false;
+	    break;
+	}
+	if (_packet && _timing && !check_timing(_packet, now_s, fresh)) {
+	    wait = true;
+	    break;
+	}
+	if (_packet && _force_ip && !fake_pcap_force_ip(_packet, _linktype)) {
+#if HAVE_BATCH
+	    if (in_batch_mode)
+		checked_output_push_batch(1, PacketBatch::make_from_packet(_packet));
+	    else
+#endif
+		checked_output_push(1, _packet);
+	    _packet = 0;
+	}
+
+	// skipped packets are cheap, but do not spin forever on them; other
+	// shards skip most of the trace
+	if (!_packet) {
+	    if (++retry_count >= 16 * _shards)
+		break;
+	    fresh = false;
+	    continue;
+	}
+
+#if HAVE_BATCH
+	if (in_batch_mode) {
+	    BATCH_CREATE_APPEND(batch, _packet);
+	} else
+#endif
+	    output(0).push(_packet);
+	_packet = 0;
+	n++;
     }
-    if (_packet && _force_ip && !fake_pcap_force_ip(_packet, _linktype)) {
+
 #if HAVE_BATCH
-        if (in_batch_mode) {
-            checked_output_push_batch(1, PacketBatch::make_from_packet(_packet));
-        } else
+    if (batch) {
+	BATCH_CREATE_FINISH(batch);
+	output(0).push_batch(batch);
+    }
 #endif
-            checked_output_push(1, _packet);
-        _packet = 0;
-    }
-
-    if (!_packet && ++retry_count < 16) {
-        fresh = false;
-	    goto again;
-    }
-
-    _task.fast_reschedule();
-    if (_packet) {
-        #if HAVE_BATCH
-            if (in_batch_mode) {
-	            output(0).push_batch(PacketBatch::make_from_packet(_packet));
-            } else
-        #endif
-	            output(0).push(_packet);
-        _count++;
-        _packet = 0;
-        if (n++ < _burst)
-            goto again;
-        return true;
-    } else
-        return false;
+    _count += n;
+
+    if (!more) {
+	if (_end_h)
+	    _end_h->call_write(ErrorHandler::default_handler());
+    } else if (!wait && _active)
+	_task.fast_reschedule();
+    return n > 0;
 }
 
 #if HAVE_BATCH
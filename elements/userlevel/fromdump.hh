@@ -14,7 +14,7 @@ class HandlerCall;
 /*
 =c
 
-FromDump(FILENAME [, I<keywords> STOP, TIMING, SAMPLE, FORCE_IP, START, START_AFTER, END, END_AFTER, INTERVAL, END_CALL, FILEPOS, MMAP])
+FromDump(FILENAME [, I<keywords> STOP, TIMING, SAMPLE, FORCE_IP, START, START_AFTER, END, END_AFTER, INTERVAL, END_CALL, FILEPOS, MMAP, BURST, ZEROCOPY, SHARD, SHARDS])
 
 =s traces
 
@@ -119,6 +119,33 @@ This can result in slightly better performance on some machines. FromDump's
 regular file discipline is pretty optimized, so the difference is often small
 in practice. Default is true on most operating systems, but false on Linux.
 
+=item BURST
+
+Unsigned integer. Maximal number of packets emitted per task run. When the
+output is in batch mode, they are pushed as a single batch. Default is 32.
+
+=item ZEROCOPY
+
+Boolean. If true, FromDump maps the whole file in memory once and packets
+point directly to their data in the mapping, without copy nor reference
+counting of a shared buffer. The mapping is private, so packets stay
+writable without modifying the file, and is only released at cleanup: packets
+must not outlive the router. Implies MMAP. Ignored, with a warning, for
+compressed files and pipes. Default is false.
+
+=item SHARDS
+
+Unsigned integer. Number of FromDump elements replaying the same trace in
+parallel, typically one per thread. Each one only emits the packets whose
+symmetric flow hash, computed on the IP addresses and TCP, UDP or SCTP ports,
+falls in its shard, so both directions of a flow are emitted by the same
+element and in order. Non-IP packets go to shard 0. Default is 1.
+
+=item SHARD
+
+Unsigned integer. Shard of this element, between 0 and SHARDS - 1. Default
+is 0.
+
 =back
 
 You can supply at most one of START and START_AFTER, and at most one of END,
@@ -126,6 +153,19 @@ END_AFTER, and INTERVAL.
 
 Only available in user-level processes.
 
+=e
+
+Replays a trace at full speed on 4 threads, without copying packets:
+
+  elementclass Replay { $shard |
+      f :: FromDump(trace.pcap, ZEROCOPY true, SHARD $shard, SHARDS 4)
+      -> output }
+  r0 :: Replay(0) -> ...
+  r1 :: Replay(1) -> ...
+  r2 :: Replay(2) -> ...
+  r3 :: Replay(3) -> ...
+  StaticThreadSched(r0/f 0, r1/f 1, r2/f 2, r3/f 3)
+
 =n
 
 By default, `tcpdump -w FILENAME' dumps only the first 68 bytes of
@@ -224,6 +264,8 @@ class FromDump : public BatchElement { public:
 
     void set_active(bool);
 
+    static uint32_t flow_hash(const uint8_t *data, uint32_t len, int linktype);
+
   private:
 
     enum { BUFFER_SIZE = 32768, SAMPLING_SHIFT = 28 };
@@ -275,10 +317,13 @@ class FromDump : public BatchElement { public:
     uint32_t _current_accel;
     TinyExpr _fnt_expr;
     uint32_t _burst;
+    uint32_t _shard;
+    uint32_t _shards;
 
     off_t _packet_filepos;
 
     bool read_packet(ErrorHandler *);
+    inline uint32_t shard_of(const uint8_t *data, uint32_t len) const;
 
     void prepare_times(const Timestamp &);
     inline bool check_timing(Packet *p, Timestamp &, bool &fresh);
@@ -0,0 +1,269 @@
+// -*- c-basic-offset: 4; related-file-name: "fromxdpdevice.hh" -*-
+/*
+ * fromxdpdevice.{cc,hh} -- element reads packets from AF_XDP sockets
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "fromxdpdevice.hh"
+#include "xdploader.hh"
+#include <click/args.hh>
+#include <click/master.hh>
+#include <click/error.hh>
+#include <click/packet_anno.hh>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <unistd.h>
+
+CLICK_DECLS
+
+FromXDPDevice::FromXDPDevice() : _device(0), _loader(0)
+{
+#if HAVE_BATCH
+    in_batch_mode = BATCH_MODE_YES;
+#endif
+    _burst = 32;
+    ndesc = 2048;
+}
+
+int
+FromXDPDevice::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    String ifname;
+    Element* loader = 0;
+    bool zerocopy;
+    bool has_zerocopy = false;
+    bool need_wakeup = true;
+
+    if (Args(this, errh).bind(conf)
+            .read_mp("DEVNAME", ifname)
+            .consume() < 0)
+        return -1;
+    if (parse(conf, errh) != 0)
+        return -1;
+
+    _map = "xsks_map";
+    if (Args(conf, this, errh)
+            .read("LOADER", ElementCastArg("XDPLoader"), loader)
+            .read("MAP", _map)
+            .read("BURST", _burst)
+            .read("NDESC", ndesc)
+            .read("ZEROCOPY", zerocopy).read_status(has_zerocopy)
+            .read("NEED_WAKEUP", need_wakeup)
+            .complete() < 0)
+        return -1;
+
+    if (!loader)
+        return errh->error("LOADER must be set to the XDPLoader redirecting packets to the sockets");
+    _loader = static_cast<XDPLoader*>(loader);
+    if (ndesc == 0 || (ndesc & (ndesc - 1)) != 0)
+        return errh->error("NDESC must be a power of 2");
+    if (_burst <= 0 || (unsigned)_burst > ndesc / 2)
+        return errh->error("BURST must be between 1 and NDESC / 2");
+
+    _device = XDPDevice::open(ifname, errh);
+    if (!_device)
+        return -1;
+    if (ndesc > _device->ndesc)
+        _device->ndesc = ndesc;
+    if (has_zerocopy)
+        _device->zerocopy = zerocopy;
+    _device->need_wakeup = need_wakeup;
+
+    int r;
+    if (n_queues == -1) {
+        if (firstqueue == -1) {
+            firstqueue = 0;
+            r = configure_rx(0, _device->n_queues, _device->n_queues, errh);
+        } else
+            r = configure_rx(0, 1, 1, errh);
+    } else {
+        if (firstqueue == -1)
+            firstqueue = 0;
+        if (firstqueue + n_queues > _device->n_queues)
+            return errh->error("You asked for %d queues after queue %d but device only have %d.", n_queues, firstqueue, _device->n_queues);
+        r = configure_rx(0, n_queues, n_queues, errh);
+    }
+    return r;
+}
+
+int
+FromXDPDevice::initialize(ErrorHandler *errh)
+{
+    int ret = initialize_rx(errh);
+    if (ret != 0)
+        return ret;
+
+    ret = initialize_tasks(false, errh);
+    if (ret != 0)
+        return ret;
+
+    if (_promisc) {
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        struct ifreq ifr;
+        memset(&ifr, 0, sizeof(ifr));
+        strncpy(ifr.ifr_name, _device->ifname.c_str(), IFNAMSIZ - 1);
+        if (fd < 0 || ioctl(fd, SIOCGIFFLAGS, &ifr) != 0)
+            errh->warning("Could not put %s in promiscuous mode", _device->ifname.c_str());
+        else if (!(ifr.ifr_flags & IFF_PROMISC)) {
+            ifr.ifr_flags |= IFF_PROMISC;
+            if (ioctl(fd, SIOCSIFFLAGS, &ifr) != 0)
+                errh->warning("Could not put %s in promiscuous mode", _device->ifname.c_str());
+        }
+        if (fd >= 0)
+            close(fd);
+    }
+
+    int map_fd = _loader->get_map_fd(_map);
+    _sockets.resize(n_queues);
+    for (int i = 0; i < n_queues; i++) {
+        int queue = firstqueue + i;
+        XDPSocket* s = _device->socket(queue, errh);
+        if (!s)
+            return -1;
+        _sockets[i] = s;
+        if (bpf_map_update_elem(map_fd, &queue, &s->fd, 0) != 0)
+            return errh->error("Could not insert the socket of queue %d in %s: %s", queue, _map.c_str(), strerror(errno));
+        if (s->fd >= _queue_for_fd.size())
+            _queue_for_fd.resize(s->fd + 1, -1);
+        _queue_for_fd[s->fd] = queue;
+        if (_verbose > 1)
+            click_chatter("%p{element}: queue %d uses %s mode", this, queue, s->zerocopy ? "zero-copy" : "copy");
+    }
+
+    for (int i = 0; i < usable_threads.size(); i++) {
+        if (!usable_threads[i])
+            continue;
+        for (int j = queue_for_thread_begin(i); j <= queue_for_thread_end(i); j++)
+            master()->thread(i)->select_set().add_select(_sockets[j - firstqueue]->fd, this, SELECT_READ);
+    }
+
+    return 0;
+}
+
+inline bool
+FromXDPDevice::receive_packets(Task* task, int begin, int end, bool fromtask)
+{
+    bool pending = false;
+    int received = 0;
+    int dropped = 0;
+
+    for (int i = begin; i <= end; i++) {
+        lock();
+
+        XDPSocket* s = _sockets[i - firstqueue];
+        s->refill();
+        if (s->use_wakeup && s->fill.need_wakeup())
+            recvfrom(s->fd, NULL, 0, MSG_DONTWAIT, NULL, NULL);
+
+        uint32_t n = s->rx.cons_avail(_burst);
+        if (n == 0) {
+            unlock();
+            continue;
+        }
+
+        PacketBatch* head = 0;
+        Packet* last = 0;
+        int count = 0;
+        uint32_t idx = s->rx.cached_cons;
+        for (uint32_t j = 0; j < n; j++) {
+            const struct xdp_desc &d = s->rx.desc(idx + j);
+            uint64_t frame = s->frame_of(d.addr);
+            unsigned char* data = s->umem + d.addr;
+            __builtin_prefetch(data);
+            WritablePacket* p = Packet::make(data, d.len, XDPSocket::frame_destructor, s,
+                                             d.addr - frame, s->frame_size - (d.addr - frame) - d.len);
+            if (unlikely(!p)) {
+                s->return_frame(frame);
+                dropped++;
+                continue;
+            }
+            p->set_packet_type_anno(Packet::HOST);
+            p->set_mac_header(p->data());
+            if (last)
+                last->set_next(p);
+            else
+                head = PacketBatch::start_head(p);
+            last = p;
+            count++;
+        }
+        s->hold(count);
+        s->rx.cons_release(n);
+        if (s->rx.cons_avail(1))
+            pending = true;
+        unlock();
+
+        if (head) {
+            head->make_tail(last, count);
+            output_push_batch(0, head);
+        }
+        received += count;
+    }
+
+    if (pending) {
+        if (fromtask)
+            task->fast_reschedule();
+        else
+            task->reschedule();
+    }
+
+    add_count(received);
+    if (dropped)
+        add_dropped(dropped);
+    return received;
+}
+
+void
+FromXDPDevice::selected(int fd, int)
+{
+    int queue = _queue_for_fd[fd];
+    receive_packets(task_for_thread(), queue, queue, false);
+}
+
+bool
+FromXDPDevice::run_task(Task* t)
+{
+    return receive_packets(t, queue_for_thisthread_begin(), queue_for_thisthread_end(), true);
+}
+
+void
+FromXDPDevice::cleanup(CleanupStage)
+{
+    cleanup_tasks();
+    if (_device)
+        _device->destroy();
+}
+
+String
+FromXDPDevice::read_handler(Element *e, void *)
+{
+    FromXDPDevice* fd = static_cast<FromXDPDevice*>(e);
+    for (int i = 0; i < fd->_sockets.size(); i++)
+        if (!fd->_sockets[i] || !fd->_sockets[i]->zerocopy)
+            return "false";
+    return "true";
+}
+
+void
+FromXDPDevice::add_handlers()
+{
+    add_read_handler("count", count_handler, 0);
+    add_read_handler("dropped", dropped_handler, 0);
+    add_read_handler("zerocopy", read_handler, 0);
+    add_write_handler("reset_counts", reset_count_handler, 0, Handler::BUTTON);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel batch bpf !dpdk-packet QueueDevice XDPDevice XDPLoader)
+EXPORT_ELEMENT(FromXDPDevice)
+ELEMENT_MT_SAFE(FromXDPDevice)
@@ -0,0 +1,150 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_FROMXDPDEVICE_HH
+#define CLICK_FROMXDPDEVICE_HH
+#include <click/config.h>
+#include <click/task.hh>
+#include "queuedevice.hh"
+#include "xdpdevice.hh"
+
+CLICK_DECLS
+
+class XDPLoader;
+
+/*
+ * =c
+ *
+ * FromXDPDevice(DEVNAME [, QUEUE, N_QUEUES, [, I<keywords> LOADER, BURST, NDESC, ZEROCOPY])
+ *
+ * Receives packets using AF_XDP sockets
+ *
+ * =s netdevices
+ *
+ * =d
+ *
+ * Receives packets from an interface through one AF_XDP socket per queue.
+ * The interface stays visible to the kernel: only the packets that the XDP
+ * program of LOADER redirects to the socket of their queue are received.
+ * The program must redirect packets with bpf_redirect_map() to a map of
+ * type BPF_MAP_TYPE_XSKMAP, indexed by the queue, named MAP. An example of
+ * such program is in conf/xdp.
+ *
+ * Packets are built directly over the frames of the UMEM of the socket, and
+ * the frames go back to the kernel when the packets are destroyed. A
+ * ToXDPDevice on the same queue sends those packets without copy.
+ *
+ * Queues are assigned to threads as in FromDPDKDevice, and the receiving
+ * threads are woken up when packets arrive through select().
+ *
+ * Arguments:
+ *
+ * =item DEVNAME
+ *
+ * String. Name of the interface.
+ *
+ * =item QUEUE
+ *
+ * Integer. First queue to use. Default is 0.
+ *
+ * =item N_QUEUES
+ *
+ * Integer. Number of queues to use. Default is to use all queues of the
+ * interface if QUEUE is not set, else only QUEUE.
+ *
+ * =item LOADER
+ *
+ * XDPLoader element that loads the redirecting program.
+ *
+ * =item MAP
+ *
+ * String. Name of the XSKMAP in the program of LOADER. Default is xsks_map.
+ *
+ * =item BURST
+ *
+ * Unsigned integer. Maximal number of packets received per queue at once.
+ * Default is 32.
+ *
+ * =item NDESC
+ *
+ * Unsigned integer. Size of the rings, a power of 2. The UMEM has 4 frames
+ * per descriptor. Default is 2048.
+ *
+ * =item ZEROCOPY
+ *
+ * Boolean. If true, fail if the driver cannot map the UMEM for zero-copy.
+ * If false, use the copy mode. By default, zero-copy is used if the driver
+ * supports it.
+ *
+ * =item NEED_WAKEUP
+ *
+ * Boolean. Only wake the driver up when it asks to, saving system calls.
+ * Default is true.
+ *
+ * =item PROMISC
+ *
+ * Boolean. Put the interface in promiscuous mode. Default is true.
+ *
+ * =item MAXTHREADS
+ *
+ * Maximal number of threads reading packets, see FromDPDKDevice.
+ *
+ * =item VERBOSE
+ *
+ * Amount of verbosity. Default is 1.
+ *
+ * =h count read-only
+ *
+ * Number of packets received.
+ *
+ * =h dropped read-only
+ *
+ * Number of packets dropped because no Click packet could be allocated.
+ *
+ * =h zerocopy read-only
+ *
+ * Whether all sockets use the zero-copy mode of the driver.
+ *
+ * =h reset_counts write-only
+ *
+ * Resets the counts.
+ *
+ * =a ToXDPDevice, XDPLoader, FromDPDKDevice, FromNetmapDevice
+ */
+
+class FromXDPDevice: public RXQueueDevice {
+
+public:
+
+    FromXDPDevice() CLICK_COLD;
+
+    void selected(int, int) override;
+
+    const char *class_name() const override		{ return "FromXDPDevice"; }
+    const char *port_count() const override		{ return PORTS_0_1; }
+    const char *processing() const override		{ return PUSH; }
+
+    int configure_phase() const override		{ return CONFIGURE_PHASE_PRIVILEGED - 5; }
+    int configure(Vector<String>&, ErrorHandler*) override CLICK_COLD;
+    int initialize(ErrorHandler*) override CLICK_COLD;
+    void cleanup(CleanupStage) override CLICK_COLD;
+    void add_handlers() override CLICK_COLD;
+
+    inline bool receive_packets(Task* task, int begin, int end, bool fromtask);
+
+    bool run_task(Task *) override;
+
+  protected:
+
+    XDPDevice* _device;
+    XDPLoader* _loader;
+    String _map;
+
+    //Sockets of our queues, from firstqueue
+    Vector<XDPSocket*> _sockets;
+    Vector<int> _queue_for_fd;
+
+    static String read_handler(Element *e, void *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
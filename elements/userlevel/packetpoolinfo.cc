@@ -0,0 +1,107 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * packetpoolinfo.{cc,hh} -- configure and monitor the packet pools
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/packet.hh>
+#include "packetpoolinfo.hh"
+
+CLICK_DECLS
+
+PacketPoolInfo *PacketPoolInfo::instance = 0;
+
+int PacketPoolInfo::configure(Vector<String> &conf, ErrorHandler *errh) {
+    if (instance)
+        return errh->error("There can be only one instance of PacketPoolInfo!");
+    instance = this;
+#if HAVE_CLICK_PACKET_POOL
+    unsigned size = WritablePacket::pool_size();
+    unsigned data_size = WritablePacket::data_pool_size();
+    if (Args(conf, this, errh)
+        .read("SIZE", size)
+        .read("DATA_SIZE", data_size)
+        .complete() < 0)
+        return -1;
+
+    if (size == 0 || data_size == 0)
+        return errh->error("SIZE and DATA_SIZE must be positive");
+    WritablePacket::set_pool_size(size, data_size);
+    return 0;
+#else
+    (void)conf;
+    return errh->error("Click was compiled without its packet pool");
+#endif
+}
+
+void PacketPoolInfo::cleanup(CleanupStage) {
+    if (instance == this)
+        instance = 0;
+}
+
+String PacketPoolInfo::read_handler(Element *, void * thunk)
+{
+#if HAVE_CLICK_PACKET_POOL
+    StringAccum acc;
+    uint64_t total = 0;
+    int i = 0;
+    for (PacketPool *pp = WritablePacket::packet_pools(); pp; i++) {
+        uint64_t v;
+        switch((uintptr_t) thunk) {
+            case h_hits: v = pp->hits; break;
+            case h_allocs: v = pp->allocs; break;
+            case h_refills: v = pp->refills; break;
+            case h_spills: v = pp->spills; break;
+            case h_frees: v = pp->frees; break;
+            case h_remote_frees: v = pp->remote_frees; break;
+            default:
+                v = 0;
+                acc << "pool " << i << " node " << pp->node
+                    << " packets " << pp->pcount << " data " << pp->pdcount
+                    << " hits " << pp->hits << " allocs " << pp->allocs
+                    << " refills " << pp->refills << " spills " << pp->spills
+                    << " frees " << pp->frees << " remote_frees " << pp->remote_frees << "\n";
+        }
+        total += v;
+# if HAVE_MULTITHREAD
+        pp = pp->thread_pool_next;
+# else
+        pp = 0;
+# endif
+    }
+    if ((uintptr_t) thunk == h_stats)
+        return acc.take_string();
+    return String(total);
+#else
+    (void)thunk;
+    return "0";
+#endif
+}
+
+void PacketPoolInfo::add_handlers() {
+    add_read_handler("hits", read_handler, h_hits);
+    add_read_handler("allocs", read_handler, h_allocs);
+    add_read_handler("refills", read_handler, h_refills);
+    add_read_handler("spills", read_handler, h_spills);
+    add_read_handler("frees", read_handler, h_frees);
+    add_read_handler("remote_frees", read_handler, h_remote_frees);
+    add_read_handler("stats", read_handler, h_stats);
+}
+
+CLICK_ENDDECLS
+
+ELEMENT_REQUIRES(userlevel)
+EXPORT_ELEMENT(PacketPoolInfo)
@@ -0,0 +1,105 @@
+#ifndef CLICK_PACKETPOOLINFO_HH
+#define CLICK_PACKETPOOLINFO_HH
+
+#include <click/element.hh>
+
+CLICK_DECLS
+
+/*
+=title PacketPoolInfo
+
+=c
+
+PacketPoolInfo([I<keywords> SIZE, DATA_SIZE])
+
+=s information
+
+Set the size of the packet pools and report their statistics.
+
+=d
+
+Each thread keeps the packets it frees in its own pool to reuse them
+without calling the system allocator. When a pool is full, its packets go
+as a single list to the global pool of the NUMA node of the thread, from
+which threads of the same node take whole lists when their own pool is
+empty. Packets with a data buffer freed by a thread of another node are
+sent back to the node of the thread that allocated them.
+
+Keyword arguments:
+
+=over 8
+
+=item SIZE
+
+Integer. Number of packets without data buffer a thread pool keeps.
+Defaults to 4096.
+
+=item DATA_SIZE
+
+Integer. Number of packets with a data buffer a thread pool keeps. With
+the DPDK packet pool, DPDKInfo must allocate enough buffers for the global
+pools to be full. Defaults to 4096.
+
+=back
+
+The pool sizes are global, so a configuration can have only one
+PacketPoolInfo.
+
+This element is only useful at user level, when Click is compiled with its
+packet pool.
+
+=h hits read-only
+
+Number of packets allocated from a thread pool, summed over all threads.
+
+=h allocs read-only
+
+Number of packets allocated from the system.
+
+=h refills read-only
+
+Number of lists of packets taken from the global pools.
+
+=h spills read-only
+
+Number of lists of packets given to the global pools.
+
+=h frees read-only
+
+Number of packets returned to the system because a global pool was full.
+
+=h remote_frees read-only
+
+Number of packets freed by a thread of another NUMA node than the one of
+their buffer.
+
+=h stats read-only
+
+All the above per thread pool, one line per pool with its node.
+
+=e
+
+  PacketPoolInfo(SIZE 16384, DATA_SIZE 16384)
+
+=a DPDKInfo */
+
+class PacketPoolInfo : public Element {
+public:
+
+    const char *class_name() const override { return "PacketPoolInfo"; }
+
+    int configure_phase() const override { return CONFIGURE_PHASE_FIRST; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) override CLICK_COLD;
+    void cleanup(CleanupStage) override CLICK_COLD;
+
+    enum {h_hits, h_allocs, h_refills, h_spills, h_frees, h_remote_frees, h_stats};
+    static String read_handler(Element *e, void * thunk) CLICK_COLD;
+    void add_handlers() override CLICK_COLD;
+
+    static PacketPoolInfo *instance;
+};
+
+CLICK_ENDDECLS
+
+#endif
@@ -39,14 +39,25 @@
 
 CLICK_DECLS
 
+#if SOCKET_ALLOW_MMSG
+// room for the UDP_SEGMENT or UDP_GRO control message of one datagram
+static const size_t control_space = CMSG_SPACE(sizeof(int));
+// limits of one UDP_SEGMENT message
+enum { gso_max_segments = 64, gso_max_size = 65507 };
+#endif
+
 Socket::Socket()
   : _task(this),
     _fd(-1), _active(-1), _rq(0), _wq(0),
     _local_port(0), _local_pathname(""),
     _timestamp(true), _sndbuf(-1), _rcvbuf(-1),
     _snaplen(2048), _headroom(Packet::default_headroom), _nodelay(1),
-    _verbose(false), _client(false), _proper(false), _allow(0), _deny(0)
+    _verbose(false), _client(false), _proper(false), _allow(0), _deny(0),
+    _burst(1), _gso(false), _gro(false)
 {
+#if HAVE_BATCH
+  in_batch_mode = BATCH_MODE_YES;
+#endif
 }
 
 Socket::~Socket()
@@ -76,9 +87,21 @@ Socket::configure(Vector<String> &conf, ErrorHandler *errh)
       .read("PROPER", _proper)
       .read("ALLOW", allow)
       .read("DENY", deny)
+      .read("BURST", _burst)
+      .read("GSO", _gso)
+      .read("GRO", _gro)
       .consume() < 0)
     return -1;
 
+  if (_burst < 1)
+    return errh->error("BURST must be at least 1");
+#if !SOCKET_ALLOW_MMSG
+  if (_burst > 1) {
+    errh->warning("BURST is not supported on this platform");
+    _burst = 1;
+  }
+#endif
+
   if (allow && !(_allow = (IPRouteTable *)allow->cast("IPRouteTable")))
     return errh->error("%s is not an IPRouteTable", allow->name().c_str());
 
@@ -119,6 +142,13 @@ Socket::configure(Vector<String> &conf, ErrorHandler *errh)
   else
     return errh->error("unknown socket type `%s'", socktype.c_str());
 
+  if ((_gso || _gro) && _protocol != IPPROTO_UDP)
+    return errh->error("GSO and GRO apply to UDP sockets only");
+#if !SOCKET_ALLOW_UDP_OFFLOAD
+  if (_gso || _gro)
+    return errh->error("GSO and GRO are not supported on this platform");
+#endif
+
   return 0;
 }
 
@@ -189,6 +219,26 @@ Socket::initialize(ErrorHandler *errh)
     if (setsockopt(_fd, SOL_SOCKET, SO_RCVBUF, &_rcvbuf, sizeof(_rcvbuf)) < 0)
       return initialize_socket_error(errh, "setsockopt(SO_RCVBUF)");
 
+#if SOCKET_ALLOW_UDP_OFFLOAD
+  // let the kernel coalesce received datagrams
+  if (_gro) {
+    int one = 1;
+    if (setsockopt(_fd, SOL_UDP, UDP_GRO, &one, sizeof(one)) < 0)
+      return initialize_socket_error(errh, "setsockopt(UDP_GRO)");
+  }
+#endif
+
+#if SOCKET_ALLOW_MMSG
+  if (batched()) {
+    _rqs.resize(_burst, 0);
+    _msgs.resize(_burst);
+    _iovs.resize(_gso && _burst < gso_max_segments ? gso_max_segments : _burst);
+    _addrs.resize(_burst);
+    _control.resize(_burst * control_space);
+    memset(_msgs.data(), 0, _msgs.size() * sizeof(struct mmsghdr));
+  }
+#endif
+
   // if a server, then the first arguments should be interpreted as
   // the address/port/file to bind() to, not to connect() to
   if (!_client) {
@@ -262,8 +312,17 @@ Socket::cleanup(CleanupStage)
   }
   if (_rq)
     _rq->kill();
-  if (_wq)
+  while (_wq) {
+    Packet *next = _wq->next();
     _wq->kill();
+    _wq = next;
+  }
+#if SOCKET_ALLOW_MMSG
+  for (int i = 0; i < _rqs.size(); i++)
+    if (_rqs[i])
+      _rqs[i]->kill();
+  _rqs.clear();
+#endif
   if (_fd >= 0) {
     // shut down the listening socket in case we forked
 #ifdef SHUT_RDWR
@@ -346,6 +405,16 @@ Socket::selected(int fd, int)
       add_select(_active, SELECT_READ);
     }
 
+#if SOCKET_ALLOW_MMSG
+    // read a batch of datagrams from socket
+    if (batched()) {
+      read_packets();
+      if (ninputs() && input_is_pull(0))
+	run_task(0);
+      return;
+    }
+#endif
+
     // read data from socket
     if (!_rq)
       _rq = Packet::make(_headroom, 0, _snaplen, 0);
@@ -404,6 +473,229 @@ Socket::selected(int fd, int)
     run_task(0);
 }
 
+#if SOCKET_ALLOW_MMSG
+/*
+ * Receive up to BURST datagrams with a single recvmmsg() and push them as
+ * one batch. With GRO, the datagrams are copied out of the receive buffers,
+ * split in segments of the size given by the kernel.
+ */
+void
+Socket::read_packets()
+{
+  int n;
+  for (n = 0; n < _burst; n++) {
+    if (!_rqs[n] && !(_rqs[n] = Packet::make(_headroom, 0, _gro ? 65535 : _snaplen, 0)))
+      break;
+    struct msghdr &h = _msgs[n].msg_hdr;
+    _iovs[n].iov_base = _rqs[n]->data();
+    _iovs[n].iov_len = _rqs[n]->length();
+    h.msg_iov = &_iovs[n];
+    h.msg_iovlen = 1;
+    h.msg_name = &_addrs[n];
+    h.msg_namelen = sizeof(address);
+    h.msg_control = _gro ? &_control[n * control_space] : 0;
+    h.msg_controllen = _gro ? control_space : 0;
+    h.msg_flags = 0;
+  }
+  if (n == 0)
+    return;
+
+  int r = recvmmsg(_active, _msgs.data(), n, MSG_TRUNC | MSG_DONTWAIT, 0);
+  if (r < 0) {
+    if (errno != EAGAIN) {
+      if (_verbose)
+	click_chatter("%s: %s", declaration().c_str(), strerror(errno));
+      close_active();
+    }
+    return;
+  }
+
+  Timestamp now;
+  if (_timestamp)
+    now.assign_now();
+#if HAVE_BATCH
+  BATCH_CREATE_INIT(batch);
+#endif
+  for (int i = 0; i < r; i++) {
+    struct msghdr &h = _msgs[i].msg_hdr;
+    if (!_client) {
+      // datagram server, find out who we are talking to
+      if (_family == AF_INET && !allowed(IPAddress(_addrs[i].in.sin_addr))) {
+	if (_verbose)
+	  click_chatter("%s: dropped datagram from %s:%d", declaration().c_str(),
+			IPAddress(_addrs[i].in.sin_addr).unparse().c_str(), ntohs(_addrs[i].in.sin_port));
+	continue;
+      }
+      memcpy(&_remote, &_addrs[i], h.msg_namelen);
+      _remote_len = h.msg_namelen;
+    }
+
+    int len = _msgs[i].msg_len;
+    int seg = len;
+#if SOCKET_ALLOW_UDP_OFFLOAD
+    if (_gro)
+      for (struct cmsghdr *c = CMSG_FIRSTHDR(&h); c; c = CMSG_NXTHDR(&h, c))
+	if (c->cmsg_level == SOL_UDP && c->cmsg_type == UDP_GRO)
+	  memcpy(&seg, CMSG_DATA(c), sizeof(seg));
+#endif
+
+    for (int off = 0; off < len; off += seg) {
+      WritablePacket *p = _rqs[i];
+      if (_gro) {
+	// the buffer stays for the next datagrams
+	p = Packet::make(_headroom, _rqs[i]->data() + off, len - off < seg ? len - off : seg, 0);
+	if (!p)
+	  break;
+      } else {
+	_rqs[i] = 0;
+	if (len > _snaplen) {
+	  assert(p->length() == (uint32_t)_snaplen);
+	  SET_EXTRA_LENGTH_ANNO(p, len - _snaplen);
+	} else
+	  p->take(_snaplen - len);
+      }
+      if (_timestamp)
+	p->timestamp_anno() = now;
+#if HAVE_BATCH
+      BATCH_CREATE_APPEND(batch, p);
+#else
+      output(0).push(p);
+#endif
+    }
+  }
+#if HAVE_BATCH
+  BATCH_CREATE_FINISH(batch);
+  if (batch)
+    output(0).push_batch(batch);
+#endif
+}
+
+/*
+ * Send a list of packets with sendmmsg(), BURST datagrams at most per call.
+ * With GSO, consecutive packets to the same destination are gathered without
+ * copy in a UDP_SEGMENT message. Returns the packets that were not sent
+ * because the socket would block.
+ */
+Packet *
+Socket::write_packets(Packet *p)
+{
+  bool dst_anno = !IPAddress(_remote_ip) && _client && _family == AF_INET;
+
+  while (p && _active >= 0) {
+    int nmsg = 0, niov = 0;
+    Packet *q = p;
+    while (q && nmsg < _msgs.size() && niov < _iovs.size()) {
+      address &a = _addrs[nmsg];
+      memcpy(&a, &_remote, _remote_len);
+      if (dst_anno)
+	a.in.sin_addr = q->dst_ip_anno();
+      struct msghdr &h = _msgs[nmsg].msg_hdr;
+      memset(&h, 0, sizeof(h));
+      h.msg_name = &a;
+      h.msg_namelen = _remote_len;
+      h.msg_iov = &_iovs[niov];
+
+      // a message of segments of the length of its first packet, ended by
+      // a shorter one
+      uint32_t seg = q->length();
+      uint32_t total = 0;
+      while (true) {
+	_iovs[niov].iov_base = (void *)q->data();
+	_iovs[niov].iov_len = q->length();
+	niov++;
+	h.msg_iovlen++;
+	total += q->length();
+	Packet *last = q;
+	q = q->next();
+	if (!_gso || !q || last->length() != seg || q->length() > seg
+	    || niov == _iovs.size() || h.msg_iovlen == gso_max_segments
+	    || total + q->length() > gso_max_size
+	    || (dst_anno && q->dst_ip_anno() != IPAddress(a.in.sin_addr)))
+	  break;
+      }
+#if SOCKET_ALLOW_UDP_OFFLOAD
+      if (h.msg_iovlen > 1) {
+	h.msg_control = &_control[nmsg * control_space];
+	h.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+	struct cmsghdr *c = CMSG_FIRSTHDR(&h);
+	c->cmsg_level = SOL_UDP;
+	c->cmsg_type = UDP_SEGMENT;
+	c->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+	uint16_t gso_size = seg;
+	memcpy(CMSG_DATA(c), &gso_size, sizeof(gso_size));
+      }
+#endif
+      nmsg++;
+    }
+
+    int r = sendmmsg(_active, _msgs.data(), nmsg, 0);
+    if (r < 0) {
+      // out of memory or would block
+      if (errno == ENOBUFS || errno == EAGAIN)
+	return p;
+
+      // interrupted by signal, try again immediately
+      else if (errno == EINTR)
+	continue;
+
+      // segments too large for the route, send datagrams one by one
+      else if (errno == EINVAL && _gso) {
+	click_chatter("%s: UDP_SEGMENT refused, disabling GSO", declaration().c_str());
+	_gso = false;
+	continue;
+      }
+
+      // connection probably terminated or other fatal error
+      if (_verbose)
+	click_chatter("%s: %s", declaration().c_str(), strerror(errno));
+      close_active();
+      break;
+    }
+
+    for (int i = 0; i < r; i++)
+      for (size_t j = 0; j < _msgs[i].msg_hdr.msg_iovlen; j++) {
+	Packet *next = p->next();
+	p->kill();
+	p = next;
+      }
+  }
+
+  while (p) {
+    Packet *next = p->next();
+    p->kill();
+    p = next;
+  }
+  return 0;
+}
+
+/*
+ * Pull up to BURST packets, as a list
+ */
+Packet *
+Socket::pull_packets()
+{
+#if HAVE_BATCH
+  PacketBatch *batch = input(0).pull_batch(_burst);
+  return batch ? batch->first() : 0;
+#else
+  Packet *head = 0, *last = 0;
+  for (int i = 0; i < _burst; i++) {
+    Packet *p = input(0).pull();
+    if (!p)
+      break;
+    if (last)
+      last->set_next(p);
+    else
+      head = p;
+    last = p;
+  }
+  if (last)
+    last->set_next(0);
+  return head;
+#endif
+}
+#endif
+
 int
 Socket::write_packet(Packet *p)
 {
@@ -481,6 +773,43 @@ Socket::push(int, Packet *p)
     p->kill();
 }
 
+#if HAVE_BATCH
+void
+Socket::push_batch(int port, PacketBatch *batch)
+{
+#if SOCKET_ALLOW_MMSG
+  if (batched()) {
+    Packet *p = batch->first();
+    fd_set fds;
+    int err;
+
+    while (p && _active >= 0) {
+      // block
+      do {
+	FD_ZERO(&fds);
+	FD_SET(_active, &fds);
+	err = select(_active + 1, NULL, &fds, NULL, NULL);
+      } while (err < 0 && errno == EINTR);
+      if (err < 0)
+	break;
+
+      // write
+      p = write_packets(p);
+    }
+
+    while (p) {
+      Packet *next = p->next();
+      p->kill();
+      p = next;
+    }
+    return;
+  }
+#endif
+  FOR_EACH_PACKET_SAFE(batch, p)
+    push(port, p);
+}
+#endif
+
 bool
 Socket::run_task(Task *)
 {
@@ -491,6 +820,22 @@ Socket::run_task(Task *)
     Packet *p = 0;
     int err = 0;
 
+#if SOCKET_ALLOW_MMSG
+    // write as much as we can, BURST packets at a time
+    if (batched()) {
+      Packet *rest = 0;
+      do {
+	p = _wq ? _wq : pull_packets();
+	_wq = 0;
+	if (p) {
+	  any = true;
+	  rest = write_packets(p);
+	}
+      } while (p && !rest && _active >= 0);
+      p = rest;
+      err = rest ? -1 : 0;
+    } else
+#endif
     // write as much as we can
     do {
       p = _wq ? _wq : input(0).pull();
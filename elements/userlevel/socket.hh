@@ -1,12 +1,20 @@
 // -*- mode: c++; c-basic-offset: 2 -*-
 #ifndef CLICK_SOCKET_HH
 #define CLICK_SOCKET_HH
-#include <click/element.hh>
+#include <click/batchelement.hh>
 #include <click/string.hh>
 #include <click/task.hh>
 #include <click/notifier.hh>
 #include "../ip/iproutetable.hh"
 #include <sys/un.h>
+#include <sys/socket.h>
+#ifdef __linux__
+# include <netinet/udp.h>
+# define SOCKET_ALLOW_MMSG 1
+# if defined(UDP_SEGMENT) && defined(UDP_GRO)
+#  define SOCKET_ALLOW_UDP_OFFLOAD 1
+# endif
+#endif
 CLICK_DECLS
 
 /*
@@ -141,6 +149,27 @@ Boolean. PlanetLab specific. If true and Click has been configured
 
 Integer. Per-packet headroom. Defaults to 28.
 
+=item BURST
+
+Unsigned integer. Applies to datagram sockets only. Maximum number of
+datagrams received with a single recvmmsg() call, and emitted as one batch,
+or sent with a single sendmmsg() call. Input packets are pulled in batches
+of BURST packets. Default is 1, which uses one system call per datagram.
+
+=item GSO
+
+Boolean. Applies to UDP sockets on Linux only. If set, consecutive packets
+of a batch going to the same destination are sent as one UDP_SEGMENT
+message, split in datagrams by the kernel or the interface. Such a message
+groups packets of the same length, possibly followed by one shorter packet.
+Default is false.
+
+=item GRO
+
+Boolean. Applies to UDP sockets on Linux only. If set, the kernel may
+coalesce datagrams of a flow, which are split back into packets after a
+single receive. Default is false.
+
 =back
 
 =e
@@ -160,6 +189,9 @@ Integer. Per-packet headroom. Defaults to 28.
   // A bi-directional client socket bound to a particular local port
   ... -> Socket(TCP, 1.2.3.4, 80, 0.0.0.0, 54321) -> ...
 
+  // A UDP tunnel endpoint, 32 datagrams per system call
+  ... -> Socket(UDP, 10.0.0.2, 4789, 0.0.0.0, 4789, BURST 32, GSO true, GRO true) -> ...
+
   // A localhost server socket
   allow :: RadixIPLookup(127.0.0.1 0);
   deny :: RadixIPLookup(0.0.0.0/0	0);
@@ -168,7 +200,7 @@ Integer. Per-packet headroom. Defaults to 28.
 
 =a RawSocket */
 
-class Socket : public Element { public:
+class Socket : public BatchElement { public:
 
   Socket() CLICK_COLD;
   ~Socket() CLICK_COLD;
@@ -188,10 +220,18 @@ class Socket : public Element { public:
   bool run_task(Task *);
   void selected(int fd, int mask);
   void push(int port, Packet*);
+#if HAVE_BATCH
+  void push_batch(int port, PacketBatch*) override;
+#endif
 
   bool allowed(IPAddress);
   void close_active(void);
   int write_packet(Packet*);
+#if SOCKET_ALLOW_MMSG
+  void read_packets();
+  Packet *write_packets(Packet*);
+  Packet *pull_packets();
+#endif
 
 protected:
   Task _task;
@@ -234,6 +274,24 @@ private:
   bool _proper;			// (PlanetLab only) use Proper to bind port
   IPRouteTable *_allow;		// lookup table of good hosts
   IPRouteTable *_deny;		// lookup table of bad hosts
+  int _burst;			// datagrams per system call
+  bool _gso;			// send packets as UDP_SEGMENT messages
+  bool _gro;			// receive coalesced UDP datagrams
+
+#if SOCKET_ALLOW_MMSG
+  typedef union { struct sockaddr_in in; struct sockaddr_un un; } address;
+
+  // buffers of recvmmsg() and sendmmsg(), BURST entries each
+  Vector<WritablePacket *> _rqs;
+  Vector<struct mmsghdr> _msgs;
+  Vector<struct iovec> _iovs;
+  Vector<address> _addrs;
+  Vector<char> _control;
+
+  inline bool batched() const {
+    return _socktype == SOCK_DGRAM && (_burst > 1 || _gso || _gro);
+  }
+#endif
 
   int initialize_socket_error(ErrorHandler *, const char *);
 
@@ -54,6 +54,9 @@
 #  include <linux/if_packet.h>
 # endif
 #endif
+#if TODEVICE_ALLOW_MMAP
+# include <sys/mman.h>
+#endif
 
 CLICK_DECLS
 
@@ -68,6 +71,10 @@ ToDevice::ToDevice()
     _fd = -1;
     _my_fd = false;
 #endif
+#if TODEVICE_ALLOW_MMAP
+    _ring = 0;
+    _ring_pending = false;
+#endif
 #if HAVE_BATCH
     in_batch_mode = BATCH_MODE_YES;
 #endif
@@ -82,17 +89,26 @@ ToDevice::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     String method;
     _burst = 1;
+    unsigned ring_size = 1024;
     if (Args(conf, this, errh)
         .read_mp("DEVNAME", _ifname)
         .read("DEBUG", _debug)
         .read("METHOD", WordArg(), method)
         .read("BURST", _burst)
+        .read("RING_SIZE", ring_size)
         .complete() < 0)
         return -1;
     if (!_ifname)
         return errh->error("interface not set");
     if (_burst <= 0)
         return errh->error("bad BURST");
+#if TODEVICE_ALLOW_MMAP
+    if (ring_size == 0)
+        return errh->error("bad RING_SIZE");
+    _ring_size = ring_size;
+#else
+    (void) ring_size;
+#endif
 
     if (method == "") {
 #if TODEVICE_ALLOW_PCAP || TODEVICE_ALLOW_PCAPFD || TODEVICE_ALLOW_LINUX || TODEVICE_ALLOW_DEVBPF
@@ -109,6 +125,10 @@ ToDevice::configure(Vector<String> &conf, ErrorHandler *errh)
     else if (method == "LINUX")
         _method = method_linux;
 #endif
+#if TODEVICE_ALLOW_MMAP
+    else if (method == "MMAP")
+        _method = method_mmap;
+#endif
 #if TODEVICE_ALLOW_DEVBPF
     else if (method == "DEVBPF")
         _method = method_devbpf;
@@ -149,9 +169,36 @@ ToDevice::initialize(ErrorHandler *errh)
 #if FROMDEVICE_ALLOW_LINUX && TODEVICE_ALLOW_LINUX
         if (fd->linux_fd() >= 0)
             _method = method_linux;
+#endif
+#if TODEVICE_ALLOW_MMAP
+        if (fd->uses_mmap())
+            _method = method_mmap;
 #endif
     }
 
+#if TODEVICE_ALLOW_MMAP
+    if (_method == method_mmap) {
+        // the ring has its own socket, which does not receive packets
+        _fd = FromDevice::open_packet_socket(_ifname, errh, false);
+        if (_fd < 0)
+            return -1;
+        _my_fd = true;
+
+        struct tpacket_req3 req;
+        memset(&req, 0, sizeof(req));
+        req.tp_frame_size = TPACKET_ALIGNMENT << 7;
+        req.tp_block_size = getpagesize() > (int) req.tp_frame_size ? getpagesize() : req.tp_frame_size;
+        unsigned per_block = req.tp_block_size / req.tp_frame_size;
+        req.tp_block_nr = (_ring_size + per_block - 1) / per_block;
+        req.tp_frame_nr = req.tp_block_nr * per_block;
+        _ring = FromDevice::map_ring(_fd, TPACKET_V2, PACKET_TX_RING, &req, _ring_map_size, errh);
+        if (!_ring)
+            return -1;
+        _ring_frames = req.tp_frame_nr;
+        _ring_cur = 0;
+    }
+#endif
+
 #if TODEVICE_ALLOW_PCAP
     if (_method == method_default || _method == method_pcap) {
         if (fd && fd->pcap())
@@ -241,6 +288,11 @@ ToDevice::cleanup(CleanupStage)
     if (_fd >= 0 && _my_fd)
         close(_fd);
     _fd = -1;
+#endif
+#if TODEVICE_ALLOW_MMAP
+    if (_ring)
+        munmap(_ring, _ring_map_size);
+    _ring = 0;
 #endif
     _tot_count = 0;
 }
@@ -277,6 +329,33 @@ ToDevice::send_packet(Packet *p)
         r = send(_fd, p->data(), p->length(), 0);
 #endif
 
+#if TODEVICE_ALLOW_MMAP
+    if (_method == method_mmap) {
+        enum { frame_size = TPACKET_ALIGNMENT << 7,
+               data_offset = TPACKET2_HDRLEN - sizeof(struct sockaddr_ll) };
+        if (p->length() > frame_size - data_offset) {
+            // send after the packets already in the ring
+            kick_ring();
+            r = send(_fd, p->data(), p->length(), 0);
+        } else {
+            unsigned char *frame = _ring + (size_t) _ring_cur * frame_size;
+            struct tpacket2_hdr *h = (struct tpacket2_hdr *) frame;
+            uint32_t status = __atomic_load_n(&h->tp_status, __ATOMIC_ACQUIRE);
+            if (status != TP_STATUS_AVAILABLE && status != TP_STATUS_WRONG_FORMAT) {
+                // ring is full, make sure the kernel is sending it
+                kick_ring();
+                return -EAGAIN;
+            }
+            memcpy(frame + data_offset, p->data(), p->length());
+            h->tp_len = p->length();
+            __atomic_store_n(&h->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+            if (++_ring_cur == _ring_frames)
+                _ring_cur = 0;
+            _ring_pending = true;
+        }
+    }
+#endif
+
 #if TODEVICE_ALLOW_DEVBPF
     if (_method == method_devbpf)
         if (write(_fd, p->data(), p->length()) != (ssize_t) p->length())
@@ -295,6 +374,15 @@ ToDevice::send_packet(Packet *p)
         return errno ? -errno : -EINVAL;
 }
 
+#if TODEVICE_ALLOW_MMAP
+void
+ToDevice::kick_ring()
+{
+    _ring_pending = false;
+    sendto(_fd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+}
+#endif
+
 bool
 ToDevice::run_task(Task *)
 {
@@ -350,6 +438,12 @@ ToDevice::run_task(Task *)
     _tot_count += count;
 #endif
 
+#if TODEVICE_ALLOW_MMAP
+    // a single system call sends the whole batch
+    if (_ring_pending)
+        kick_ring();
+#endif
+
     if (r == -ENOBUFS || r == -EAGAIN) {
         assert(!_q);
         _q = p;
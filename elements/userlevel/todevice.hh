@@ -33,11 +33,19 @@ CLICK_DECLS
  * =item METHOD
  *
  * Word. Defines the method ToDevice will use to write packets to the
- * device. Linux targets generally support PCAP and LINUX; other targets
+ * device. Linux targets generally support PCAP, LINUX and MMAP; other targets
  * support PCAP or, occasionally, other methods. Defaults to the method
  * specified for a matching L<FromDevice(n)>, or the first supported
  * method among PCAP, DEVBPF, LINUX and PCAPFD otherwise.
  *
+ * MMAP copies packets in the TX ring of a packet socket, and wakes the kernel
+ * up with a single system call per batch.
+ *
+ * =item RING_SIZE
+ *
+ * Integer. Number of frames of the TX ring for METHOD MMAP. Defaults to 1024.
+ * Packets larger than a frame, about 2000 bytes, are sent with a system call.
+ *
  * =item DEBUG
  *
  * Boolean.  If true, print out debug messages.
@@ -74,6 +82,9 @@ extern "C" {
 }
 # define TODEVICE_ALLOW_PCAP 1
 #endif
+#if FROMDEVICE_ALLOW_MMAP
+# define TODEVICE_ALLOW_MMAP 1
+#endif
 #if defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__APPLE__) || defined(__NetBSD__)
 # define TODEVICE_ALLOW_DEVBPF 1
 #elif defined(__sun)
@@ -115,8 +126,18 @@ class ToDevice : public BatchElement { public:
 #if TODEVICE_ALLOW_LINUX || TODEVICE_ALLOW_DEVBPF || TODEVICE_ALLOW_PCAPFD
     int _fd;
 #endif
-    enum { method_default, method_linux, method_pcap, method_devbpf, method_pcapfd };
+    enum { method_default, method_linux, method_pcap, method_devbpf, method_pcapfd, method_mmap };
     int _method;
+#if TODEVICE_ALLOW_MMAP
+    unsigned char *_ring;
+    size_t _ring_map_size;
+    unsigned _ring_size;
+    unsigned _ring_frames;
+    unsigned _ring_cur;
+    bool _ring_pending;
+
+    void kick_ring();
+#endif
     NotifierSignal _signal;
 
 #if HAVE_BATCH
@@ -19,6 +19,7 @@
 
 #include <click/args.hh>
 #include <click/error.hh>
+#include <click/algorithm.hh>
 
 #include "todpdkdevice.hh"
 
@@ -39,7 +40,7 @@ ToDPDKDevice::ToDPDKDevice() :
 #endif
     _dev(0),
     _timeout(0), _congestion_warning_printed(false), _create(true),
-    _tso(0), _tco(false), _uco(false), _ipco(false)
+    _tso(0), _tco(false), _uco(false), _ipco(false), _stripe(false), _next_queue(0)
 {
      _blocking = false;
      _burst = -1;
@@ -55,6 +56,7 @@ int ToDPDKDevice::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     int maxqueues;
     String dev;
+    String tx_mode = "lock";
     if (Args(this, errh).bind(conf)
             .read_mp("PORT", dev)
             .consume() < 0)
@@ -69,6 +71,7 @@ int ToDPDKDevice::configure(Vector<String> &conf, ErrorHandler *errh)
         .read_or_set("MAXQUEUES", maxqueues,128)
         .read("ALLOC",_create)
         .read("BURST",_burst)
+        .read("TX_MODE", WordArg(), tx_mode)
 
 #if RTE_VERSION >= RTE_VERSION_NUM(18,02,0,0)
         .read("TSO", _tso)
@@ -85,6 +88,16 @@ int ToDPDKDevice::configure(Vector<String> &conf, ErrorHandler *errh)
             return errh->error("%s : Unknown or invalid PORT", dev.c_str());
     }
 
+    tx_mode = tx_mode.lower();
+    if (tx_mode == "stripe")
+        _stripe = true;
+    else if (tx_mode != "lock")
+        return errh->error("TX_MODE must be lock or stripe");
+#ifdef DPDK_USE_XCHG
+    if (_stripe)
+        return errh->error("TX_MODE stripe is not supported with X-Change");
+#endif
+
 
 #if HAVE_IQUEUE
     if (_timeout > 0) {
@@ -145,6 +158,21 @@ int ToDPDKDevice::initialize(ErrorHandler *errh)
     ret = initialize_tasks(false,errh);
     if (ret != 0)
         return ret;
+
+    // Queues shared by several threads have a lock, in STRIPE mode they get a
+    // ring to their owner instead
+    _shared_rings.resize(n_queues, 0);
+    if (_stripe) {
+        for (int i = 0; i < n_queues; i++) {
+            if (_q_infos[i].lock.value() == NO_LOCK)
+                continue;
+            String ring_name = "tx_" + String(_dev->port_id) + "_" + String(firstqueue + i);
+            _shared_rings[i] = rte_ring_create(ring_name.c_str(), next_pow2(_internal_tx_queue_size),
+                                               SOCKET_ID_ANY, RING_F_SC_DEQ);
+            if (!_shared_rings[i])
+                return errh->error("Could not create the ring of shared queue %d: %s", firstqueue + i, rte_strerror(rte_errno));
+        }
+    }
 #if HAVE_IQUEUE
     for (unsigned i = 0; i < _iqueues.weight(); i++) {
         _iqueues.get_value(i).pkts = new struct rte_mbuf *[_internal_tx_queue_size];
@@ -168,6 +196,15 @@ int ToDPDKDevice::initialize(ErrorHandler *errh)
 void ToDPDKDevice::cleanup(CleanupStage)
 {
     cleanup_tasks();
+    for (int i = 0; i < _shared_rings.size(); i++) {
+        if (!_shared_rings[i])
+            continue;
+        void *mbuf;
+        while (rte_ring_sc_dequeue(_shared_rings[i], &mbuf) == 0)
+            rte_pktmbuf_free((struct rte_mbuf *) mbuf);
+        rte_ring_free(_shared_rings[i]);
+    }
+    _shared_rings.clear();
 #if HAVE_IQUEUE
     for (unsigned i = 0; i < _iqueues.weight(); i++) {
         delete[] _iqueues.get_value(i).pkts;
@@ -208,6 +245,103 @@ void ToDPDKDevice::add_handlers()
     add_read_handler("hw_errors",statistics_handler, h_oerrors);
 }
 
+/**
+ * Send the packets handed by the other threads sharing @a queue, which this
+ * thread owns. They were already counted by the thread that handed them.
+ */
+unsigned ToDPDKDevice::drain_shared_queue(int queue)
+{
+    struct rte_ring *ring = _shared_rings[queue - firstqueue];
+    struct rte_mbuf *pkts[32];
+    unsigned total = 0;
+    unsigned n;
+
+    do {
+#if RTE_VERSION >= RTE_VERSION_NUM(17,5,0,0)
+        n = rte_ring_sc_dequeue_burst(ring, (void **) pkts, 32, 0);
+#else
+        n = rte_ring_sc_dequeue_burst(ring, (void **) pkts, 32);
+#endif
+        unsigned sent = 0;
+        do {
+            sent += rte_eth_tx_burst(_dev->port_id, queue, pkts + sent, n - sent);
+        } while (_blocking && sent < n);
+        if (unlikely(sent < n)) {
+            add_dropped(n - sent);
+            for (unsigned i = sent; i < n; i++)
+                rte_pktmbuf_free(pkts[i]);
+        }
+        total += n;
+    } while (n == 32);
+
+    return total;
+}
+
+/**
+ * Send up to @a n packets on the queues of this thread and return how many
+ * were sent, or handed to the owner of a shared queue in STRIPE mode.
+ */
+inline unsigned ToDPDKDevice::tx_burst(struct rte_mbuf **pkts, unsigned n)
+{
+    int queue = queue_for_thisthread_begin();
+
+    if (likely(!_stripe)) {
+        lock(); // ! This is a queue lock, not a thread lock.
+        unsigned r = rte_eth_tx_burst(_dev->port_id, queue, pkts, n);
+        unlock();
+        return r;
+    }
+
+    if (struct rte_ring *ring = _shared_rings[queue - firstqueue]) {
+        int owner = thread_for_queue_offset(queue - firstqueue);
+        if (owner != (int) click_current_cpu_id()) {
+#if RTE_VERSION >= RTE_VERSION_NUM(17,5,0,0)
+            unsigned r = rte_ring_mp_enqueue_burst(ring, (void * const *) pkts, n, 0);
+#else
+            unsigned r = rte_ring_mp_enqueue_burst(ring, (void * const *) pkts, n);
+#endif
+            if (r > 0)
+                task_for_thread(owner)->reschedule();
+            return r;
+        }
+        drain_shared_queue(queue);
+    }
+
+    unsigned nqueues = queue_for_thisthread_end() - queue + 1;
+    unsigned &next = *_next_queue;
+    unsigned sent = 0;
+    for (unsigned i = 0; i < nqueues && sent < n; i++) {
+        sent += rte_eth_tx_burst(_dev->port_id, queue + next, pkts + sent, n - sent);
+        if (++next >= nqueues)
+            next = 0;
+    }
+    return sent;
+}
+
+/**
+ * In STRIPE mode, the task of the owner of a shared queue sends the packets
+ * handed by the other threads.
+ */
+bool ToDPDKDevice::run_task(Task *t)
+{
+    if (!_stripe)
+        return false;
+
+    unsigned sent = 0;
+    bool more = false;
+    for (int q = queue_for_thisthread_begin(); q <= queue_for_thisthread_end(); q++) {
+        struct rte_ring *ring = _shared_rings[q - firstqueue];
+        if (!ring || thread_for_queue_offset(q - firstqueue) != (int) click_current_cpu_id())
+            continue;
+        sent += drain_shared_queue(q);
+        if (!rte_ring_empty(ring))
+            more = true;
+    }
+    if (more)
+        t->fast_reschedule();
+    return sent > 0;
+}
+
 #if HAVE_IQUEUE
 
 inline void ToDPDKDevice::set_flush_timer(DPDKDevice::TXInternalQueue &iqueue) {
@@ -254,21 +388,20 @@ void ToDPDKDevice::flush_internal_tx_queue(DPDKDevice::TXInternalQueue &iqueue)
      */
     unsigned sub_burst;
 
+# ifdef DPDK_USE_XCHG
     lock(); // ! This is a queue lock, not a thread lock.
+# endif
 
     do {
         sub_burst = iqueue.nr_pending > 32 ? 32 : iqueue.nr_pending;
         if (iqueue.index + sub_burst >= (unsigned)_internal_tx_queue_size)
             // The sub_burst wraps around the ring
             sub_burst = _internal_tx_queue_size - iqueue.index;
-        //Todo : if there is multiple queue assigned to this thread, send on all of them
-
 
 # ifdef DPDK_USE_XCHG
         r = rte_mlx5_tx_burst_xchg(_dev->port_id, queue_for_thisthread_begin(),(struct xchg**) &iqueue.pkts[iqueue.index], sub_burst);
 # else
-        r = rte_eth_tx_burst(_dev->port_id, queue_for_thisthread_begin(), &iqueue.pkts[iqueue.index],
-                            sub_burst);
+        r = tx_burst(&iqueue.pkts[iqueue.index], sub_burst);
 # endif
 
         iqueue.nr_pending -= r;
@@ -279,7 +412,9 @@ void ToDPDKDevice::flush_internal_tx_queue(DPDKDevice::TXInternalQueue &iqueue)
 
         sent += r;
     } while (r == sub_burst && iqueue.nr_pending > 0);
+# ifdef DPDK_USE_XCHG
     unlock();
+# endif
 
     add_count(sent);
 }
@@ -455,11 +590,7 @@ void ToDPDKDevice::push_batch(int, PacketBatch *head)
 
         unsigned sent = 0;
 
-        lock(); // ! This is a queue lock, not a thread lock.
-
-        sent = rte_eth_tx_burst(_dev->port_id, queue_for_thisthread_begin(), pkts, count);
-
-        unlock();
+        sent = tx_burst(pkts, count);
 
         add_count(sent);
 
@@ -470,9 +601,7 @@ void ToDPDKDevice::push_batch(int, PacketBatch *head)
                     count-=sent;
                     do {
 
-                        lock(); // ! This is a queue lock, not a thread lock.
-                        sent = rte_eth_tx_burst(_dev->port_id, queue_for_thisthread_begin(), pkts + base, count);
-                        unlock();
+                        sent = tx_burst(pkts + base, count);
 
                         add_count(sent);
                         base+=sent;
@@ -37,6 +37,9 @@ Arguments:
 
 Integer or PCI address.  Port identifier of the device, or a PCI address in the
 format fffff:ff:ff.f
+or a device name. Virtual devices such as "net_ring0" or "net_null0,size=64"
+are created when not given with --vdev, the arguments following the first
+comma.
 
 =item QUEUE
 
@@ -87,6 +90,19 @@ packets will never wait in the internal queue.
 
 Integer.  Number of descriptors per ring. The default is 1024.
 
+=item TX_MODE
+
+Either C<lock> or C<stripe>. In C<lock> mode, each thread always sends on its
+first queue, and threads sharing a queue because there are more threads than
+queues take a spinlock around each transmission. In C<stripe> mode, each burst
+is sent on the next queue of the thread in a round-robin fashion, and the
+rest of a burst that did not fit goes to the following queues. A queue shared
+by several threads is only used by one of them, its owner. The other threads
+hand their bursts to the owner through a multi-producer single-consumer
+ring, without locking, and wake the task of the owner up to send them. In
+that case, the count handler includes packets handed to the owner. Default
+is C<lock>.
+
 =item ALLOW_NONEXISTENT
 
 Boolean.  Do not fail if the PORT do not existent. If it's the case the task
@@ -148,9 +164,13 @@ public:
     void push_batch(int port, PacketBatch *head);
 #endif
     void push(int port, Packet *p);
+    bool run_task(Task *) override;
 
 protected:
 
+    inline unsigned tx_burst(struct rte_mbuf **pkts, unsigned n);
+    unsigned drain_shared_queue(int queue);
+
     inline void warn_congestion();
 
     inline void enqueue(rte_mbuf* &q, rte_mbuf* mbuf, const Packet* p);
@@ -170,6 +190,11 @@ protected:
     bool _uco;
     bool _ipco;
 
+    // STRIPE mode: next queue of each thread, and rings of shared queues
+    bool _stripe;
+    per_thread<unsigned> _next_queue;
+    Vector<struct rte_ring *> _shared_rings;
+
     friend class FromDPDKDevice;
 };
 
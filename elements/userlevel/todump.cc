@@ -24,14 +24,16 @@
 #include "todump.hh"
 #include <click/args.hh>
 #include <click/router.hh>
-#if CLICK_NS
-# include <click/master.hh>
-#endif
+#include <click/master.hh>
+#include <click/straccum.hh>
 #include <click/error.hh>
 #include <click/standard/scheduleinfo.hh>
 #include <click/packet_anno.hh>
 #include "fakepcap.hh"
 #include <click/userutils.hh>
+#if TODUMP_ALLOW_ASYNC
+# include <sys/uio.h>
+#endif
 #if HAVE_PCAP
 extern "C" {
 # include <pcap.h>
@@ -39,8 +41,19 @@ extern "C" {
 #endif
 CLICK_DECLS
 
+// pcapng block types and options
+enum {
+    PCAPNG_SHB = 0x0A0D0D0A, PCAPNG_IDB = 1, PCAPNG_EPB = 6,
+    PCAPNG_BYTE_ORDER_MAGIC = 0x1A2B3C4D,
+    PCAPNG_OPT_ENDOFOPT = 0, PCAPNG_OPT_IF_NAME = 2, PCAPNG_OPT_IF_TSRESOL = 9,
+    PCAPNG_EPB_HEADER = 28
+};
+
 ToDump::ToDump()
     : _fp(0), _count(0), _task(this), _use_encap_from(0)
+#if TODUMP_ALLOW_ASYNC
+    , _stopping(false), _writer_running(false)
+#endif
 {
 }
 
@@ -53,6 +66,10 @@ ToDump::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     String encap_type;
     String use_encap_from;
+    String format = "pcap";
+    uint32_t buffer_size = 1 << 20;
+    uint32_t nbuffers = 4;
+    _async = false;
     _snaplen = 2000;
     _extra_length = true;
     _unbuffered = false;
@@ -77,12 +94,37 @@ ToDump::configure(Vector<String> &conf, ErrorHandler *errh)
         .read("PER_NODE", per_node)
 #endif
         .read("FORCE_TS", _force_ts)
+        .read("FORMAT", WordArg(), format)
+        .read("ASYNC", _async)
+        .read("BUFFER_SIZE", buffer_size)
+        .read("BUFFERS", nbuffers)
         .complete() < 0)
             return -1;
 
     if (_snaplen == 0)
         _snaplen = 0xFFFFFFFFU;
 
+    format = format.lower();
+    if (format == "pcapng")
+        _pcapng = true;
+    else if (format == "pcap")
+        _pcapng = false;
+    else
+        return errh->error("FORMAT must be pcap or pcapng");
+
+#if TODUMP_ALLOW_ASYNC
+    if (nbuffers < 2)
+        return errh->error("BUFFERS must be at least 2");
+    if (_snaplen != 0xFFFFFFFFU && buffer_size < _snaplen + PCAPNG_EPB_HEADER + 8)
+        return errh->error("BUFFER_SIZE must hold a record of SNAPLEN bytes");
+    _buffer_size = buffer_size;
+    _nbuffers = nbuffers;
+#else
+    (void) buffer_size, (void) nbuffers;
+    if (_async)
+        return errh->error("ASYNC requires multithreading support");
+#endif
+
     if (use_encap_from && encap_type)
         return errh->error("specify at most one of 'ENCAP' and 'USE_ENCAP_FROM'");
     else if (use_encap_from) {
@@ -119,11 +161,67 @@ ToDump::hotswap_element() const
     if (Element *e = Element::hotswap_element())
     if (ToDump *td = (ToDump *)e->cast("ToDump"))
         if (td->_filename == _filename
-        && td->_linktype == _linktype)
+        && td->_linktype == _linktype
+        && td->_pcapng == _pcapng
+        && !td->_async && !_async)
         return td;
     return 0;
 }
 
+/**
+ * Write the section header block, and an interface description block for
+ * each thread of @a threads.
+ */
+int
+ToDump::write_pcapng_header(const Bitvector &threads, ErrorHandler *errh)
+{
+    StringAccum sa;
+    struct {
+        uint32_t type, len, magic;
+        uint16_t major, minor;
+        int64_t section_len;
+        uint32_t len2;
+    } CLICK_SIZE_PACKED_ATTRIBUTE shb = {
+        PCAPNG_SHB, sizeof(shb), PCAPNG_BYTE_ORDER_MAGIC, 1, 0, -1, sizeof(shb)
+    };
+    sa.append(reinterpret_cast<char *>(&shb), sizeof(shb));
+
+    for (int i = 0; i < threads.size(); i++) {
+        if (!threads[i])
+            continue;
+
+        String name = "thread" + String(i);
+        uint32_t name_len = (name.length() + 3) & ~3;
+        uint32_t len = 16 + 4 + name_len + (_nano ? 8 : 0) + 8;
+        struct {
+            uint32_t type, len;
+            uint16_t linktype, reserved;
+            uint32_t snaplen;
+            uint16_t code, optlen;
+        } idb = {
+            PCAPNG_IDB, len, (uint16_t) _linktype, 0,
+            _snaplen == 0xFFFFFFFFU ? 0 : _snaplen,
+            PCAPNG_OPT_IF_NAME, (uint16_t) name.length()
+        };
+        sa.append(reinterpret_cast<char *>(&idb), sizeof(idb));
+        sa << name;
+        sa.append_fill(0, name_len - name.length());
+        if (_nano) {
+            struct {
+                uint16_t code, optlen;
+                uint8_t value[4];
+            } tsresol = {PCAPNG_OPT_IF_TSRESOL, 1, {9, 0, 0, 0}};
+            sa.append(reinterpret_cast<char *>(&tsresol), sizeof(tsresol));
+        }
+        uint32_t end[2] = {PCAPNG_OPT_ENDOFOPT, len};
+        sa.append(reinterpret_cast<char *>(end), sizeof(end));
+    }
+
+    if (fwrite(sa.data(), 1, sa.length(), _fp) != (size_t) sa.length())
+        return errh->error("%s: unable to write file header", _filename.c_str());
+    return 0;
+}
+
 int
 ToDump::initialize(ErrorHandler *errh)
 {
@@ -153,6 +251,23 @@ ToDump::initialize(ErrorHandler *errh)
     }
     }
 
+    if (input_is_pull(0) && noutputs() == 0) {
+        ScheduleInfo::join_scheduler(this, &_task, errh);
+        _signal = Notifier::upstream_empty_signal(this, 0, &_task);
+    }
+
+    // one pcapng interface per thread writing packets
+    Bitvector threads = get_passing_threads();
+    threads.resize(master()->nthreads());
+    if (input_is_pull(0) && noutputs() == 0)
+        threads[_task.home_thread_id()] = true;
+    if (threads.weight() == 0)
+        threads[0] = true;
+    _ifindex.assign(threads.size(), 0);
+    for (int i = 0, n = 0; i < threads.size(); i++)
+        if (threads[i])
+            _ifindex[i] = n++;
+
     // skip initialization if we're hotswapping later
     if (!hotswap_element()) {
 
@@ -173,6 +288,10 @@ ToDump::initialize(ErrorHandler *errh)
     if (_unbuffered)
         setvbuf(_fp, (char *) 0, _IONBF, 0);
 
+    if (_pcapng) {
+        if (write_pcapng_header(threads, errh) < 0)
+            return -1;
+    } else {
     struct fake_pcap_file_header h;
 
     h.magic = _nano ? FAKE_PCAP_MAGIC_NANO : FAKE_PCAP_MAGIC;
@@ -188,14 +307,37 @@ ToDump::initialize(ErrorHandler *errh)
     if (wrote_header != 1)
         return errh->error("%s: unable to write file header", _filename.c_str());
     }
+    }
 
-    if (input_is_pull(0) && noutputs() == 0) {
-        ScheduleInfo::join_scheduler(this, &_task, errh);
-        _signal = Notifier::upstream_empty_signal(this, 0, &_task);
+#if TODUMP_ALLOW_ASYNC
+    if (_async) {
+        fflush(_fp);
+        // one more staging area, shared by the threads we did not expect
+        _staging.resize(threads.size() + 1);
+        for (int i = 0; i < threads.size() + 1; i++) {
+            Staging *s = new Staging();
+            s->full.initialize(_nbuffers);
+            s->free.initialize(_nbuffers);
+            if (i == threads.size() || threads[i]) {
+                s->buffers = new Buffer[_nbuffers];
+                s->memory = new unsigned char[(size_t) _buffer_size * _nbuffers];
+                for (uint32_t j = 0; j < _nbuffers; j++) {
+                    s->buffers[j].data = s->memory + (size_t) _buffer_size * j;
+                    s->free.insert(&s->buffers[j]);
+                }
+            }
+            s->ifindex = i < threads.size() ? _ifindex[i] : 0;
+            _staging[i] = s;
+        }
+        sem_init(&_sem, 0, 0);
+        if (pthread_create(&_writer, 0, writer_thread, this) != 0)
+            return errh->error("could not start the writer thread: %s", strerror(errno));
+        _writer_running = true;
     }
+#endif
     _active = true;
 
-    _mt = get_passing_threads().weight() > 1;
+    _mt = threads.weight() > 1;
     return 0;
 }
 
@@ -210,33 +352,263 @@ ToDump::take_state(Element *e, ErrorHandler *)
 void
 ToDump::cleanup(CleanupStage)
 {
+#if TODUMP_ALLOW_ASYNC
+    if (_writer_running) {
+        _stopping = true;
+        sem_post(&_sem);
+        pthread_join(_writer, 0);
+        _writer_running = false;
+        sem_destroy(&_sem);
+        // packets do not flow anymore, hand the partial buffers over ourselves
+        for (int i = 0; i < _staging.size(); i++) {
+            Staging *s = _staging[i];
+            if (s->current && s->current->length)
+                s->full.insert(s->current);
+            s->current = 0;
+        }
+        write_buffers();
+    }
+    for (int i = 0; i < _staging.size(); i++) {
+        delete[] _staging[i]->buffers;
+        delete[] _staging[i]->memory;
+        delete _staging[i];
+    }
+    _staging.clear();
+#endif
     if (_fp && _fp != stdout)
         fclose(_fp);
     _fp = 0;
 }
 
-void
-ToDump::write_packet(Packet *p)
+/**
+ * Write the record header of a packet with @a caplen bytes of data in @a hdr,
+ * which must hold PCAPNG_EPB_HEADER bytes, and return its length.
+ */
+inline unsigned
+ToDump::record_header(unsigned char *hdr, Packet *p, unsigned caplen)
 {
-    struct fake_pcap_pkthdr ph;
-
     Timestamp ts = p->timestamp_anno();
     if (!ts && !_force_ts)
         ts = Timestamp::now();
+    uint32_t len = p->length() + (_extra_length ? EXTRA_LENGTH_ANNO(p) : 0);
+
+    if (_pcapng) {
+        uint64_t t = _nano ? (uint64_t) ts.sec() * 1000000000 + ts.nsec()
+            : (uint64_t) ts.sec() * 1000000 + ts.usec();
+        uint32_t epb[7] = {PCAPNG_EPB, PCAPNG_EPB_HEADER + ((caplen + 3) & ~3U) + 4,
+                           _ifindex[click_current_cpu_id()],
+                           (uint32_t) (t >> 32), (uint32_t) t, caplen, len};
+        memcpy(hdr, epb, sizeof(epb));
+        return sizeof(epb);
+    }
+
+    struct fake_pcap_pkthdr ph;
     ph.ts.tv.tv_sec = ts.sec();
     ph.ts.tv.tv_usec = _nano ? ts.nsec() : ts.usec();
+    ph.caplen = caplen;
+    ph.len = len;
+    memcpy(hdr, &ph, sizeof(ph));
+    return sizeof(ph);
+}
+
+/**
+ * Write the padding and trailing length of a pcapng record in @a tr, which
+ * must hold 8 bytes, and return their length.
+ */
+inline unsigned
+ToDump::record_trailer(unsigned char *tr, unsigned caplen)
+{
+    if (!_pcapng)
+        return 0;
+    unsigned pad = ((caplen + 3) & ~3U) - caplen;
+    uint32_t len = PCAPNG_EPB_HEADER + caplen + pad + 4;
+    memset(tr, 0, pad);
+    memcpy(tr + pad, &len, 4);
+    return pad + 4;
+}
+
+#if TODUMP_ALLOW_ASYNC
+/**
+ * Hand the current buffer of @a s over to the writer thread. The ring of
+ * full buffers has room for all buffers, so this never fails.
+ */
+void
+ToDump::flush_staging(Staging *s)
+{
+    s->full.insert(s->current);
+    s->current = 0;
+    sem_post(&_sem);
+}
+
+/**
+ * Return the staging area of the current thread, after handing over its
+ * buffer if it waited for too long. A thread which get_passing_threads() did
+ * not announce takes the shared staging area, under the lock.
+ */
+inline ToDump::Staging *
+ToDump::acquire_staging()
+{
+    unsigned id = click_current_cpu_id();
+    Staging *s;
+    if (likely(id < (unsigned) _staging.size() - 1 && _staging[id]->buffers))
+        s = _staging[id];
+    else {
+        _lock.acquire();
+        s = _staging.back();
+    }
+    if (s->current && click_jiffies() - s->since >= CLICK_HZ / 10)
+        flush_staging(s);
+    return s;
+}
+
+inline void
+ToDump::release_staging(Staging *s)
+{
+    if (unlikely(s == _staging.back()))
+        _lock.release();
+}
+
+/**
+ * Copy the record of @a p in the staging buffer of the current thread,
+ * taking a free buffer if needed. Never waits for the writer thread.
+ */
+inline void
+ToDump::stage_packet(Staging *s, Packet *p)
+{
+    unsigned to_write = p->length();
+    if (_snaplen && to_write > _snaplen)
+        to_write = _snaplen;
+
+    unsigned char hdr[PCAPNG_EPB_HEADER];
+    unsigned char tr[8];
+    unsigned hlen = record_header(hdr, p, to_write);
+    unsigned tlen = record_trailer(tr, to_write);
+    uint32_t size = hlen + to_write + tlen;
+
+    Buffer *b = s->current;
+    if (b && b->length + size > _buffer_size) {
+        flush_staging(s);
+        b = 0;
+    }
+    if (!b) {
+        if (size > _buffer_size || !(b = s->free.extract())) {
+            s->dropped++;
+            return;
+        }
+        b->length = 0;
+        s->current = b;
+        s->since = click_jiffies();
+    }
+
+    unsigned char *data = b->data + b->length;
+    memcpy(data, hdr, hlen);
+    memcpy(data + hlen, p->data(), to_write);
+    memcpy(data + hlen + to_write, tr, tlen);
+    b->length += size;
+    s->count++;
+}
+
+/**
+ * Write all full buffers with as few system calls as possible, and give them
+ * back to their thread. Called by the writer thread only, or once it stopped.
+ */
+bool
+ToDump::write_buffers()
+{
+    enum { MAX_IOV = 64 };
+    struct iovec iov[MAX_IOV];
+    Buffer *buffers[MAX_IOV];
+    Staging *owners[MAX_IOV];
+    int fd = fileno(_fp);
+    bool wrote = false;
+    int n;
+
+    do {
+        n = 0;
+        for (int i = 0; i < _staging.size() && n < MAX_IOV; i++) {
+            Staging *s = _staging[i];
+            while (n < MAX_IOV) {
+                Buffer *b = s->full.extract();
+                if (!b)
+                    break;
+                iov[n].iov_base = b->data;
+                iov[n].iov_len = b->length;
+                buffers[n] = b;
+                owners[n] = s;
+                n++;
+            }
+        }
+
+        int i = 0;
+        while (i < n && _active) {
+            ssize_t w = writev(fd, iov + i, n - i);
+            if (w < 0) {
+                if (errno == EINTR || errno == EAGAIN)
+                    continue;
+                _active = false;
+                click_chatter("ToDump(%s): %s", _filename.c_str(), strerror(errno));
+                break;
+            }
+            while (i < n && (size_t) w >= iov[i].iov_len) {
+                w -= iov[i].iov_len;
+                i++;
+            }
+            if (i < n) {
+                iov[i].iov_base = (char *) iov[i].iov_base + w;
+                iov[i].iov_len -= w;
+            }
+        }
+
+        for (i = 0; i < n; i++)
+            owners[i]->free.insert(buffers[i]);
+        wrote |= n > 0;
+    } while (n == MAX_IOV);
+
+    return wrote;
+}
+
+void *
+ToDump::writer_thread(void *arg)
+{
+    ToDump *td = static_cast<ToDump *>(arg);
+    while (1) {
+        if (sem_wait(&td->_sem) != 0 && errno == EINTR)
+            continue;
+        td->write_buffers();
+        if (td->_stopping)
+            break;
+    }
+    return 0;
+}
+#endif
+
+void
+ToDump::write_packet(Packet *p)
+{
+#if TODUMP_ALLOW_ASYNC
+    if (_async) {
+        Staging *s = acquire_staging();
+        stage_packet(s, p);
+        release_staging(s);
+        return;
+    }
+#endif
 
     unsigned to_write = p->length();
-    ph.len = to_write + (_extra_length ? EXTRA_LENGTH_ANNO(p) : 0);
     if (_snaplen && to_write > _snaplen)
         to_write = _snaplen;
-    ph.caplen = to_write;
+
+    unsigned char hdr[PCAPNG_EPB_HEADER];
+    unsigned char tr[8];
+    unsigned hlen = record_header(hdr, p, to_write);
+    unsigned tlen = record_trailer(tr, to_write);
 
     if (_mt)
         _lock.acquire();
     // XXX writing to pipe?
-    if (fwrite(&ph, sizeof(ph), 1, _fp) == 0
-    || (to_write > 0 && fwrite(p->data(), 1, to_write, _fp) == 0)) {
+    if (fwrite(hdr, hlen, 1, _fp) == 0
+    || (to_write > 0 && fwrite(p->data(), 1, to_write, _fp) == 0)
+    || (tlen > 0 && fwrite(tr, tlen, 1, _fp) == 0)) {
         if (errno != EAGAIN) {
             _active = false;
             click_chatter("ToDump(%s): %s", _filename.c_str(), strerror(errno));
@@ -252,6 +624,15 @@ void
 ToDump::push_batch(int, PacketBatch *b)
 {
     if (_active) {
+#if TODUMP_ALLOW_ASYNC
+        if (_async) {
+            Staging *s = acquire_staging();
+            FOR_EACH_PACKET(b,p) {
+                stage_packet(s, p);
+            }
+            release_staging(s);
+        } else
+#endif
         FOR_EACH_PACKET(b,p) {
             write_packet(p);
         }
@@ -291,7 +672,7 @@ ToDump::run_task(Task *)
     return p != 0;
 }
 
-enum { H_FILENAME = 0, H_COUNT = 1, H_RESET_COUNTS = 2 };
+enum { H_FILENAME = 0, H_COUNT = 1, H_RESET_COUNTS = 2, H_DROPPED = 3 };
 
 String
 ToDump::read_handler(Element *e, void *thunk)
@@ -300,8 +681,22 @@ ToDump::read_handler(Element *e, void *thunk)
     switch ((uintptr_t) thunk) {
       case H_FILENAME:
         return td->_filename;
-      case H_COUNT:
-        return String(td->_count);
+      case H_COUNT: {
+        counter_t count = td->_count;
+#if TODUMP_ALLOW_ASYNC
+        for (int i = 0; i < td->_staging.size(); i++)
+            count += td->_staging[i]->count;
+#endif
+        return String(count);
+      }
+      case H_DROPPED: {
+        counter_t dropped = 0;
+#if TODUMP_ALLOW_ASYNC
+        for (int i = 0; i < td->_staging.size(); i++)
+            dropped += td->_staging[i]->dropped;
+#endif
+        return String(dropped);
+      }
       default:
         return "<error>";
     }
@@ -312,6 +707,10 @@ ToDump::write_handler(const String &, Element *e, void *, ErrorHandler *)
 {
     ToDump *td = static_cast<ToDump *>(e);
     td->_count = 0;
+#if TODUMP_ALLOW_ASYNC
+    for (int i = 0; i < td->_staging.size(); i++)
+        td->_staging[i]->count = td->_staging[i]->dropped = 0;
+#endif
     return 0;
 }
 
@@ -320,6 +719,7 @@ ToDump::add_handlers()
 {
     add_read_handler("filename", read_handler, H_FILENAME);
     add_read_handler("count", read_handler, H_COUNT);
+    add_read_handler("dropped", read_handler, H_DROPPED);
     add_write_handler("reset_counts", write_handler, H_RESET_COUNTS, Handler::BUTTON);
     if (input_is_pull(0) && noutputs() == 0)
         add_task_handlers(&_task);
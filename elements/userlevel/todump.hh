@@ -7,12 +7,18 @@
 #include <click/notifier.hh>
 #include <click/sync.hh>
 #include <stdio.h>
+#if HAVE_USER_MULTITHREAD
+# include <click/ring.hh>
+# include <pthread.h>
+# include <semaphore.h>
+# define TODUMP_ALLOW_ASYNC 1
+#endif
 CLICK_DECLS
 
 /*
 =c
 
-ToDump(FILENAME [, I<keywords> SNAPLEN, ENCAP, USE_ENCAP_FROM, EXTRA_LENGTH, NANO])
+ToDump(FILENAME [, I<keywords> SNAPLEN, ENCAP, USE_ENCAP_FROM, EXTRA_LENGTH, NANO, FORMAT, ASYNC])
 
 =s traces
 
@@ -78,6 +84,36 @@ Boolean. Set to true to force writing a "zero" timestamp. This may be useful to
 write trace with offests relative to the first packet, that will be zero.
 Defaults to False for backward compatibility.
 
+=item FORMAT
+
+Either C<pcap> or C<pcapng>. With C<pcapng>, ToDump writes one interface
+description block per thread passing packets to it, and each packet is
+recorded on the interface of the thread that wrote it. Default is C<pcap>.
+
+=item ASYNC
+
+Boolean. If true, the threads passing packets do not write to the file.
+They copy each record, truncated to SNAPLEN, in a staging buffer of their
+own, and hand full buffers to a dedicated writer thread through a lock-free
+ring. The writer thread writes all available buffers with a single writev(2)
+and gives them back. If a thread has no free buffer because the disk is too
+slow, its records are dropped instead of waiting, see the C<dropped> handler.
+Packets from threads that were not expected to pass packets to ToDump are
+staged in buffers shared under a lock; with C<pcapng>, they are recorded on
+the first interface.
+A partially filled buffer is handed over when the next packet arrives after
+100 ms, and at the latest at cleanup. Default is false.
+
+=item BUFFER_SIZE
+
+Integer. Size in bytes of each staging buffer in ASYNC mode. Records larger
+than a buffer are dropped. Default is 1 MB.
+
+=item BUFFERS
+
+Integer. Number of staging buffers per thread in ASYNC mode, at least 2.
+Default is 4.
+
 =back
 
 This element is only available at user level.
@@ -90,6 +126,11 @@ ToDump stores packets' true length annotations when available.
 
 Returns the number of packets emitted so far.
 
+=h dropped read-only
+
+Returns the number of packets not recorded in ASYNC mode because no staging
+buffer was free.
+
 =h reset_counts write-only
 
 Resets "count" to 0.
@@ -127,6 +168,26 @@ class ToDump : public BatchElement { public:
     bool run_task(Task *);
 
   private:
+
+#if TODUMP_ALLOW_ASYNC
+    struct Buffer {
+	unsigned char *data;
+	uint32_t length;
+    };
+
+    struct Staging {
+	SPSCLockFreeRing<Buffer*> full;
+	SPSCLockFreeRing<Buffer*> free;
+	Buffer *buffers;
+	unsigned char *memory;
+	Buffer *current;
+	click_jiffies_t since;
+	uint32_t ifindex;
+	uint64_t count;
+	uint64_t dropped;
+    } CLICK_CACHE_ALIGN;
+#endif
+
     bool _mt;
     Spinlock _lock;
 
@@ -139,6 +200,8 @@ class ToDump : public BatchElement { public:
     bool _unbuffered;
     bool _nano;
     bool _force_ts;
+    bool _pcapng;
+    bool _async;
 
 #if HAVE_INT64_TYPES
     typedef uint64_t counter_t;
@@ -151,8 +214,31 @@ class ToDump : public BatchElement { public:
     NotifierSignal _signal;
     Element **_use_encap_from;
 
+    // pcapng interface of each thread
+    Vector<uint32_t> _ifindex;
+
+#if TODUMP_ALLOW_ASYNC
+    uint32_t _buffer_size;
+    uint32_t _nbuffers;
+    Vector<Staging*> _staging;
+    pthread_t _writer;
+    sem_t _sem;
+    volatile bool _stopping;
+    bool _writer_running;
+
+    inline Staging *acquire_staging();
+    inline void release_staging(Staging *);
+    void stage_packet(Staging *, Packet *);
+    void flush_staging(Staging *);
+    bool write_buffers();
+    static void *writer_thread(void *);
+#endif
+
     static String read_handler(Element *, void *) CLICK_COLD;
     static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+    inline unsigned record_header(unsigned char *, Packet *, unsigned caplen);
+    inline unsigned record_trailer(unsigned char *, unsigned caplen);
+    int write_pcapng_header(const Bitvector &, ErrorHandler *);
     void write_packet(Packet *);
 
 };
@@ -0,0 +1,188 @@
+// -*- c-basic-offset: 4; related-file-name: "toxdpdevice.hh" -*-
+/*
+ * toxdpdevice.{cc,hh} -- element sends packets to AF_XDP sockets
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "toxdpdevice.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+
+CLICK_DECLS
+
+ToXDPDevice::ToXDPDevice() : _device(0)
+{
+#if HAVE_BATCH
+    in_batch_mode = BATCH_MODE_YES;
+#endif
+    ndesc = 2048;
+}
+
+int
+ToXDPDevice::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    String ifname;
+    bool zerocopy;
+    bool has_zerocopy = false;
+
+    if (Args(this, errh).bind(conf)
+            .read_mp("DEVNAME", ifname)
+            .consume() < 0)
+        return -1;
+    if (parse(conf, errh) != 0)
+        return -1;
+
+    if (Args(conf, this, errh)
+            .read("NDESC", ndesc)
+            .read("ZEROCOPY", zerocopy).read_status(has_zerocopy)
+            .complete() < 0)
+        return -1;
+
+    if (ndesc == 0 || (ndesc & (ndesc - 1)) != 0)
+        return errh->error("NDESC must be a power of 2");
+
+    _device = XDPDevice::open(ifname, errh);
+    if (!_device)
+        return -1;
+    if (ndesc > _device->ndesc)
+        _device->ndesc = ndesc;
+    if (has_zerocopy)
+        _device->zerocopy = zerocopy;
+
+    if (firstqueue == -1)
+        firstqueue = 0;
+    if (firstqueue >= _device->n_queues)
+        return errh->error("You asked for queue %d but device only have %d queues.", firstqueue, _device->n_queues);
+    if (n_queues == -1)
+        return configure_tx(1, _device->n_queues - firstqueue, errh);
+    return configure_tx(n_queues, n_queues, errh);
+}
+
+int
+ToXDPDevice::initialize(ErrorHandler *errh)
+{
+    int ret = initialize_tx(errh);
+    if (ret != 0)
+        return ret;
+
+    ret = initialize_tasks(false, errh);
+    if (ret != 0)
+        return ret;
+
+    _sockets.resize(n_queues);
+    for (int i = 0; i < n_queues; i++) {
+        _sockets[i] = _device->socket(firstqueue + i, errh);
+        if (!_sockets[i])
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * Fill the TX ring of the queue of this thread. Packets whose buffer is a
+ * frame of the same UMEM give that frame to the ring, others are copied in
+ * a free frame.
+ */
+void
+ToXDPDevice::push_batch(int, PacketBatch *head)
+{
+    XDPSocket* s = _sockets[queue_for_thisthread_begin() - firstqueue];
+    Packet* p = head->first();
+    unsigned sent = 0;
+    unsigned dropped = 0;
+    unsigned reused = 0;
+    uint64_t frames[64];
+
+    lock();
+    s->reclaim();
+    while (p) {
+        uint32_t n = s->tx.prod_space(64);
+        if (n == 0) {
+            if (!_blocking)
+                break;
+            s->kick_tx();
+            s->reclaim();
+            continue;
+        }
+
+        uint32_t nframes = s->alloc_frames(frames, n);
+        uint32_t f = 0;
+        uint32_t idx = s->tx.cached_prod;
+        uint32_t done = 0;
+        while (done < n && p) {
+            Packet* next = p->next();
+            struct xdp_desc &d = s->tx.desc(idx + done);
+            d.len = p->length();
+            d.options = 0;
+            if (p->buffer_destructor() == XDPSocket::frame_destructor
+                && p->destructor_argument() == s && !p->shared()) {
+                d.addr = p->data() - s->umem;
+                p->reset_buffer();
+                reused++;
+            } else if (f < nframes && p->length() <= s->frame_size) {
+                d.addr = frames[f++];
+                memcpy(s->umem + d.addr, p->data(), p->length());
+            } else {
+                dropped++;
+                p->kill();
+                p = next;
+                continue;
+            }
+            p->kill();
+            p = next;
+            done++;
+        }
+        if (f < nframes)
+            s->free_frames(frames + f, nframes - f);
+        s->tx.prod_submit(done);
+        sent += done;
+    }
+    if (sent)
+        s->kick_tx();
+    unlock();
+    //The reused frames are no longer held by packets
+    if (reused)
+        s->put(reused);
+
+    while (p) {
+        Packet* next = p->next();
+        p->kill();
+        dropped++;
+        p = next;
+    }
+
+    add_count(sent);
+    if (dropped)
+        add_dropped(dropped);
+}
+
+void
+ToXDPDevice::cleanup(CleanupStage)
+{
+    cleanup_tasks();
+    if (_device)
+        _device->destroy();
+}
+
+void
+ToXDPDevice::add_handlers()
+{
+    add_read_handler("count", count_handler, 0);
+    add_read_handler("dropped", dropped_handler, 0);
+    add_write_handler("reset_counts", reset_count_handler, 0, Handler::BUTTON);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel batch !dpdk-packet QueueDevice XDPDevice)
+EXPORT_ELEMENT(ToXDPDevice)
+ELEMENT_MT_SAFE(ToXDPDevice)
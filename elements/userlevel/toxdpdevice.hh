@@ -0,0 +1,102 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_TOXDPDEVICE_HH
+#define CLICK_TOXDPDEVICE_HH
+#include <click/config.h>
+#include "queuedevice.hh"
+#include "xdpdevice.hh"
+
+CLICK_DECLS
+
+/*
+ * =c
+ *
+ * ToXDPDevice(DEVNAME [, QUEUE, N_QUEUES, [, I<keywords> BLOCKING, NDESC, ZEROCOPY])
+ *
+ * Sends packets using AF_XDP sockets
+ *
+ * =s netdevices
+ *
+ * =d
+ *
+ * Sends packets through the AF_XDP socket of a queue of an interface. Each
+ * thread pushing packets uses its own queue if there are enough, as in
+ * ToDPDKDevice. The sockets are shared with FromXDPDevice.
+ *
+ * Packets received by a FromXDPDevice on the same queue are sent without
+ * copy, other packets are copied in a frame of the UMEM of the socket. A
+ * single system call per batch wakes the driver up, and only if it asks to.
+ *
+ * Arguments:
+ *
+ * =item DEVNAME
+ *
+ * String. Name of the interface.
+ *
+ * =item QUEUE
+ *
+ * Integer. First queue to use. Default is 0.
+ *
+ * =item N_QUEUES
+ *
+ * Integer. Number of queues to use. Default is as many as threads pushing
+ * packets to this element.
+ *
+ * =item BLOCKING
+ *
+ * Boolean. If true, wait for the ring to have space instead of dropping
+ * packets. Default is false.
+ *
+ * =item NDESC
+ *
+ * Unsigned integer. Size of the rings, a power of 2. Default is 2048.
+ *
+ * =item ZEROCOPY
+ *
+ * Boolean. If true, fail if the driver cannot map the UMEM for zero-copy.
+ * If false, use the copy mode. By default, zero-copy is used if the driver
+ * supports it.
+ *
+ * =h count read-only
+ *
+ * Number of packets sent.
+ *
+ * =h dropped read-only
+ *
+ * Number of packets dropped because the ring or the UMEM was full.
+ *
+ * =h reset_counts write-only
+ *
+ * Resets the counts.
+ *
+ * =a FromXDPDevice, XDPLoader, ToDPDKDevice
+ */
+
+class ToXDPDevice: public TXQueueDevice {
+
+public:
+
+    ToXDPDevice() CLICK_COLD;
+
+    const char *class_name() const override		{ return "ToXDPDevice"; }
+    const char *port_count() const override		{ return PORTS_1_0; }
+    const char *processing() const override		{ return PUSH; }
+
+    int configure_phase() const override		{ return CONFIGURE_PHASE_PRIVILEGED; }
+    int configure(Vector<String>&, ErrorHandler*) override CLICK_COLD;
+    int initialize(ErrorHandler*) override CLICK_COLD;
+    void cleanup(CleanupStage) override CLICK_COLD;
+    void add_handlers() override CLICK_COLD;
+
+    void push_batch(int port, PacketBatch*) override;
+
+  protected:
+
+    XDPDevice* _device;
+
+    //Sockets of our queues, from firstqueue
+    Vector<XDPSocket*> _sockets;
+
+};
+
+CLICK_ENDDECLS
+#endif
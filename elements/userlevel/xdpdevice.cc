@@ -0,0 +1,304 @@
+// -*- c-basic-offset: 4; related-file-name: "xdpdevice.hh" -*-
+/*
+ * xdpdevice.{cc,hh} -- AF_XDP sockets and UMEM shared by FromXDPDevice and
+ * ToXDPDevice
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "xdpdevice.hh"
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#ifndef AF_XDP
+# define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+# define SOL_XDP 283
+#endif
+
+CLICK_DECLS
+
+HashTable<String, XDPDevice*> XDPDevice::_devs;
+
+XDPDevice::XDPDevice(const String &name) : ifname(name), ifindex(0), n_queues(1),
+    ndesc(0), frame_size(2048), zerocopy(-1), need_wakeup(true), _refs(0)
+{
+}
+
+XDPDevice *
+XDPDevice::open(const String &ifname, ErrorHandler *errh)
+{
+    XDPDevice *&d = _devs[ifname];
+    if (!d) {
+        int ifindex = if_nametoindex(ifname.c_str());
+        if (!ifindex) {
+            errh->error("Unknown interface %s", ifname.c_str());
+            _devs.erase(ifname);
+            return 0;
+        }
+        d = new XDPDevice(ifname);
+        d->ifindex = ifindex;
+
+        //Count the RX queues the kernel exposes for the interface
+        String path = "/sys/class/net/" + ifname + "/queues";
+        DIR *dir = opendir(path.c_str());
+        if (dir) {
+            int n = 0;
+            struct dirent *ent;
+            while ((ent = readdir(dir)) != NULL)
+                if (strncmp(ent->d_name, "rx-", 3) == 0)
+                    n++;
+            closedir(dir);
+            if (n > 0)
+                d->n_queues = n;
+        }
+    }
+    d->_refs++;
+    return d;
+}
+
+int
+XDPDevice::map_ring(XDPSocket *s, XDPRing &r, uint32_t size, uint64_t pgoff,
+                    const struct xdp_ring_offset &off, size_t entry_size, ErrorHandler *errh)
+{
+    r.map_size = off.desc + size * entry_size;
+    r.map = mmap(0, r.map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, s->fd, pgoff);
+    if (r.map == MAP_FAILED) {
+        r.map = 0;
+        return errh->error("Could not map AF_XDP ring of %s queue %d: %s", ifname.c_str(), s->queue, strerror(errno));
+    }
+    r.producer = (uint32_t*)((char*)r.map + off.producer);
+    r.consumer = (uint32_t*)((char*)r.map + off.consumer);
+    r.flags = (uint32_t*)((char*)r.map + off.flags);
+    r.ring = (char*)r.map + off.desc;
+    r.size = size;
+    r.mask = size - 1;
+    r.cached_prod = *r.producer;
+    r.cached_cons = *r.consumer;
+    return 0;
+}
+
+/**
+ * Return the socket of @a queue, creating it and its UMEM on first use. The
+ * UMEM holds four frames per descriptor of one ring, so the fill and TX
+ * rings can be full while packets are still processed.
+ */
+XDPSocket *
+XDPDevice::socket(int queue, ErrorHandler *errh)
+{
+    if (queue < _sockets.size() && _sockets[queue])
+        return _sockets[queue];
+    if (_sockets.size() <= queue)
+        _sockets.resize(queue + 1, 0);
+
+    XDPSocket *s = new XDPSocket();
+    for (int i = 0; i < 4; i++)
+        memset(s->ring(i), 0, sizeof(XDPRing));
+    s->_returned = 0;
+    s->_refs = 1;
+    s->queue = queue;
+    s->use_wakeup = need_wakeup;
+    s->frame_size = frame_size;
+    uint32_t nframes = ndesc * 4;
+    s->umem_size = (size_t)nframes * frame_size;
+    s->umem = (unsigned char*)mmap(0, s->umem_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (s->umem == MAP_FAILED) {
+        errh->error("Could not allocate UMEM of %s queue %d", ifname.c_str(), queue);
+        delete s;
+        return 0;
+    }
+
+    s->fd = ::socket(AF_XDP, SOCK_RAW, 0);
+    if (s->fd < 0) {
+        errh->error("Could not create AF_XDP socket: %s", strerror(errno));
+        munmap(s->umem, s->umem_size);
+        delete s;
+        return 0;
+    }
+
+    struct xdp_umem_reg mr;
+    memset(&mr, 0, sizeof(mr));
+    mr.addr = (uintptr_t)s->umem;
+    mr.len = s->umem_size;
+    mr.chunk_size = frame_size;
+    mr.headroom = 0;
+    int size = ndesc;
+    struct xdp_mmap_offsets off;
+    socklen_t optlen = sizeof(off);
+    if (setsockopt(s->fd, SOL_XDP, XDP_UMEM_REG, &mr, sizeof(mr))
+        || setsockopt(s->fd, SOL_XDP, XDP_UMEM_FILL_RING, &size, sizeof(size))
+        || setsockopt(s->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &size, sizeof(size))
+        || setsockopt(s->fd, SOL_XDP, XDP_RX_RING, &size, sizeof(size))
+        || setsockopt(s->fd, SOL_XDP, XDP_TX_RING, &size, sizeof(size))
+        || getsockopt(s->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen)) {
+        errh->error("Could not set up AF_XDP socket of %s queue %d: %s", ifname.c_str(), queue, strerror(errno));
+        goto error;
+    }
+
+    if (map_ring(s, s->rx, ndesc, XDP_PGOFF_RX_RING, off.rx, sizeof(struct xdp_desc), errh)
+        || map_ring(s, s->tx, ndesc, XDP_PGOFF_TX_RING, off.tx, sizeof(struct xdp_desc), errh)
+        || map_ring(s, s->fill, ndesc, XDP_UMEM_PGOFF_FILL_RING, off.fr, sizeof(uint64_t), errh)
+        || map_ring(s, s->comp, ndesc, XDP_UMEM_PGOFF_COMPLETION_RING, off.cr, sizeof(uint64_t), errh))
+        goto error;
+
+    s->_free.reserve(nframes);
+    for (uint32_t i = 0; i < nframes; i++)
+        s->_free.push_back((uint64_t)i * frame_size);
+
+    {
+        struct sockaddr_xdp sxdp;
+        memset(&sxdp, 0, sizeof(sxdp));
+        sxdp.sxdp_family = AF_XDP;
+        sxdp.sxdp_ifindex = ifindex;
+        sxdp.sxdp_queue_id = queue;
+        if (zerocopy == 1)
+            sxdp.sxdp_flags |= XDP_ZEROCOPY;
+        else if (zerocopy == 0)
+            sxdp.sxdp_flags |= XDP_COPY;
+        if (need_wakeup)
+            sxdp.sxdp_flags |= XDP_USE_NEED_WAKEUP;
+        if (bind(s->fd, (struct sockaddr*)&sxdp, sizeof(sxdp)) != 0) {
+            errh->error("Could not bind AF_XDP socket to %s queue %d: %s%s", ifname.c_str(), queue, strerror(errno),
+                        zerocopy == 1 ? " (the driver may not support zero-copy)" : "");
+            goto error;
+        }
+    }
+
+    {
+        struct xdp_options opts;
+        optlen = sizeof(opts);
+        s->zerocopy = getsockopt(s->fd, SOL_XDP, XDP_OPTIONS, &opts, &optlen) == 0
+            && (opts.flags & XDP_OPTIONS_ZEROCOPY);
+    }
+
+    s->refill();
+    _sockets[queue] = s;
+    return s;
+
+error:
+    for (int i = 0; i < 4; i++)
+        if (s->ring(i)->map)
+            munmap(s->ring(i)->map, s->ring(i)->map_size);
+    close(s->fd);
+    munmap(s->umem, s->umem_size);
+    delete s;
+    return 0;
+}
+
+/**
+ * Give free frames to the kernel through the fill ring
+ */
+void
+XDPSocket::refill()
+{
+    uint64_t frames[64];
+    uint32_t n;
+    while ((n = fill.prod_space(64)) > 0 && (n = alloc_frames(frames, n)) > 0) {
+        for (uint32_t i = 0; i < n; i++)
+            fill.addr(fill.cached_prod + i) = frames[i];
+        fill.prod_submit(n);
+    }
+}
+
+/**
+ * Put back in the free stack the frames the kernel sent
+ */
+void
+XDPSocket::reclaim()
+{
+    uint32_t n = comp.cons_avail(comp.size);
+    if (n == 0)
+        return;
+    _lock.acquire();
+    for (uint32_t i = 0; i < n; i++)
+        _free.push_back(frame_of(comp.addr(comp.cached_cons + i)));
+    _lock.release();
+    comp.cons_release(n);
+}
+
+/**
+ * Ask the kernel to send the TX ring, unless it already polls it
+ */
+void
+XDPSocket::kick_tx()
+{
+    if (!use_wakeup || tx.need_wakeup())
+        sendto(fd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+}
+
+/**
+ * Move the frames returned by destroyed packets to the free stack. Called
+ * with the lock held.
+ */
+void
+XDPSocket::take_returned()
+{
+    uint64_t x = __atomic_exchange_n(&_returned, 0, __ATOMIC_ACQUIRE);
+    while (x) {
+        _free.push_back(x - 1);
+        x = *(uint64_t*)(umem + x - 1);
+    }
+}
+
+void
+XDPSocket::frame_destructor(unsigned char *buf, size_t, void *arg)
+{
+    XDPSocket *s = static_cast<XDPSocket*>(arg);
+    s->return_frame(buf - s->umem);
+    s->put(1);
+}
+
+/**
+ * Unmap the rings and close the socket, then drop the reference of the
+ * device
+ */
+void
+XDPSocket::close()
+{
+    for (int r = 0; r < 4; r++)
+        munmap(ring(r)->map, ring(r)->map_size);
+    ::close(fd);
+    fd = -1;
+    put(1);
+}
+
+void
+XDPSocket::release()
+{
+    munmap(umem, umem_size);
+    delete this;
+}
+
+/**
+ * Close the sockets and free the device once the last element using it is
+ * cleaned up. A UMEM is freed when the last packet built over its frames is
+ * destroyed, which may be later.
+ */
+void
+XDPDevice::destroy()
+{
+    if (--_refs > 0)
+        return;
+    for (int q = 0; q < _sockets.size(); q++)
+        if (XDPSocket *s = _sockets[q])
+            s->close();
+    _devs.erase(ifname);
+    delete this;
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel linux !dpdk-packet)
+ELEMENT_PROVIDES(XDPDevice)
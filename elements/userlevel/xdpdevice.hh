@@ -0,0 +1,225 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_XDPDEVICE_HH
+#define CLICK_XDPDEVICE_HH
+#include <click/config.h>
+#include <click/string.hh>
+#include <click/vector.hh>
+#include <click/hashtable.hh>
+#include <click/sync.hh>
+#include <click/error.hh>
+#include <linux/if_xdp.h>
+
+CLICK_DECLS
+
+/**
+ * Ring shared with the kernel by an AF_XDP socket. The kernel and Click
+ * each own one of the producer and consumer indexes, the cached copies avoid
+ * reading the other side's index for every entry.
+ */
+struct XDPRing {
+    uint32_t *producer;
+    uint32_t *consumer;
+    uint32_t *flags;
+    void *ring;
+    uint32_t mask;
+    uint32_t size;
+    uint32_t cached_prod;
+    uint32_t cached_cons;
+    void *map;
+    size_t map_size;
+
+    inline bool need_wakeup() const {
+        return *(volatile uint32_t*)flags & XDP_RING_NEED_WAKEUP;
+    }
+
+    /**
+     * Number of entries that can be produced, at most @a n
+     */
+    inline uint32_t prod_space(uint32_t n) {
+        uint32_t space = size - (cached_prod - cached_cons);
+        if (space >= n)
+            return n;
+        cached_cons = __atomic_load_n(consumer, __ATOMIC_ACQUIRE);
+        space = size - (cached_prod - cached_cons);
+        return space < n ? space : n;
+    }
+
+    inline void prod_submit(uint32_t n) {
+        cached_prod += n;
+        __atomic_store_n(producer, cached_prod, __ATOMIC_RELEASE);
+    }
+
+    /**
+     * Number of entries that can be consumed, at most @a n
+     */
+    inline uint32_t cons_avail(uint32_t n) {
+        uint32_t avail = cached_prod - cached_cons;
+        if (avail == 0) {
+            cached_prod = __atomic_load_n(producer, __ATOMIC_ACQUIRE);
+            avail = cached_prod - cached_cons;
+        }
+        return avail < n ? avail : n;
+    }
+
+    inline void cons_release(uint32_t n) {
+        cached_cons += n;
+        __atomic_store_n(consumer, cached_cons, __ATOMIC_RELEASE);
+    }
+
+    inline uint64_t &addr(uint32_t idx) {
+        return ((uint64_t*)ring)[idx & mask];
+    }
+
+    inline struct xdp_desc &desc(uint32_t idx) {
+        return ((struct xdp_desc*)ring)[idx & mask];
+    }
+};
+
+/**
+ * AF_XDP socket of one queue and its UMEM. Frames are either in the kernel
+ * rings, in the free stack, or held by packets built over received frames.
+ * The free stack is shared by the elements of the queue and protected by a
+ * lock. Packets may be destroyed on any thread, and give their frame back
+ * through a lock-free stack linked through the frames themselves, which
+ * alloc_frames() takes back in one go.
+ *
+ * The socket is reference counted by its device and by the frames held by
+ * packets, so the UMEM outlives the device until the last such packet is
+ * destroyed.
+ */
+class XDPSocket { public:
+    int fd;
+    int queue;
+    unsigned char *umem;
+    size_t umem_size;
+    uint32_t frame_size;
+
+    XDPRing rx;
+    XDPRing tx;
+    XDPRing fill;
+    XDPRing comp;
+
+    bool use_wakeup;
+    bool zerocopy;
+
+    inline XDPRing *ring(int i) {
+        XDPRing *rings[4] = {&rx, &tx, &fill, &comp};
+        return rings[i];
+    }
+
+    inline bool owns(const unsigned char *p) const {
+        return p >= umem && p < umem + umem_size;
+    }
+
+    inline uint64_t frame_of(uint64_t addr) const {
+        return addr & ~((uint64_t)frame_size - 1);
+    }
+
+    /**
+     * Give back the frame of a destroyed packet, without taking the lock
+     */
+    inline void return_frame(uint64_t frame) {
+        uint64_t *link = (uint64_t*)(umem + frame);
+        uint64_t head = __atomic_load_n(&_returned, __ATOMIC_RELAXED);
+        do {
+            *link = head;
+        } while (!__atomic_compare_exchange_n(&_returned, &head, frame + 1, true,
+                                              __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+
+    inline void free_frames(const uint64_t *frames, uint32_t n) {
+        _lock.acquire();
+        for (uint32_t i = 0; i < n; i++)
+            _free.push_back(frames[i]);
+        _lock.release();
+    }
+
+    /**
+     * Take up to @a n free frames into @a frames
+     * @return the number of frames taken
+     */
+    inline uint32_t alloc_frames(uint64_t *frames, uint32_t n) {
+        _lock.acquire();
+        if (n > (uint32_t)_free.size())
+            take_returned();
+        if (n > (uint32_t)_free.size())
+            n = _free.size();
+        for (uint32_t i = 0; i < n; i++) {
+            frames[i] = _free.back();
+            _free.pop_back();
+        }
+        _lock.release();
+        return n;
+    }
+
+    /**
+     * Count @a n frames as held by packets
+     */
+    inline void hold(uint32_t n) {
+        __atomic_add_fetch(&_refs, n, __ATOMIC_RELAXED);
+    }
+
+    /**
+     * Drop @a n references, freeing the UMEM and the socket with the last
+     */
+    inline void put(uint32_t n) {
+        if (__atomic_sub_fetch(&_refs, n, __ATOMIC_ACQ_REL) == 0)
+            release();
+    }
+
+    void refill();
+    void reclaim();
+    void kick_tx();
+    void close();
+
+    static void frame_destructor(unsigned char *buf, size_t, void *arg);
+
+  private:
+    Vector<uint64_t> _free;
+    SimpleSpinlock _lock;
+    uint64_t _returned;     //Offset + 1 of the last returned frame, 0 if none
+    uint32_t _refs;
+
+    void take_returned();
+    void release();
+
+    friend class XDPDevice;
+};
+
+/**
+ * An interface used through AF_XDP sockets, shared by the FromXDPDevice and
+ * ToXDPDevice of the same interface. Each queue has its own socket and
+ * UMEM, created by the first element that initializes it.
+ */
+class XDPDevice { public:
+    String ifname;
+    int ifindex;
+    int n_queues;
+
+    //Parameters of the sockets, the largest asked by the elements
+    uint32_t ndesc;
+    uint32_t frame_size;
+    //1 to force zero-copy, 0 to force copy mode, -1 to let the driver choose
+    int zerocopy;
+    bool need_wakeup;
+
+    static XDPDevice *open(const String &ifname, ErrorHandler *errh);
+
+    XDPSocket *socket(int queue, ErrorHandler *errh);
+
+    void destroy();
+
+  private:
+    XDPDevice(const String &ifname);
+
+    Vector<XDPSocket*> _sockets;
+    int _refs;      //Elements using the device
+
+    int map_ring(XDPSocket *s, XDPRing &r, uint32_t size, uint64_t pgoff,
+                 const struct xdp_ring_offset &off, size_t entry_size, ErrorHandler *errh);
+
+    static HashTable<String, XDPDevice*> _devs;
+};
+
+CLICK_ENDDECLS
+#endif
@@ -8,8 +8,13 @@
 CLICK_DECLS
 class DPDKDevice;
 
-struct BatchBuilder {
-	BatchBuilder() : first(0), count(0), last(-1), last_id() {
+/**
+ * Builds a batch of packets of the same flow. K is the type of the flow
+ * key remembered to skip the lookup of consecutive packets of the same flow.
+ */
+template <typename K>
+struct FlowBatchBuilder {
+	FlowBatchBuilder() : first(0), count(0), last(-1), last_id() {
 
 	};
 
@@ -17,7 +22,7 @@ struct BatchBuilder {
 	Packet* tail;
 	int count;
 	int last;
-    IPFlow5ID last_id;
+    K last_id;
 
 	inline void init() {
 		count = 0;
@@ -43,6 +48,7 @@ struct BatchBuilder {
 
 };
 
+typedef FlowBatchBuilder<IPFlow5ID> BatchBuilder;
 
 CLICK_ENDDECLS
 #endif
@@ -0,0 +1,179 @@
+#ifndef CLICK_CALENDARQUEUE_HH
+#define CLICK_CALENDARQUEUE_HH 1
+
+#include <click/vector.hh>
+#include <click/integers.hh>
+
+CLICK_DECLS
+
+/**
+ * Bucketed priority queue of T ordered by an integer key, lowest first.
+ *
+ * Keys are put in one of N buckets of 2^shift consecutive keys, around the
+ * key of the first insertion in the empty queue. When a key falls out of
+ * this window, the buckets are widened so the window covers twice the range
+ * of keys inserted since the queue was last empty, and the queued entries
+ * are moved to their new bucket. Entries in different buckets therefore
+ * always come out in key order, while entries whose keys fall in the same
+ * bucket come out in insertion order. A bitmap of the non-empty buckets
+ * finds the next bucket to dequeue.
+ *
+ * Entries are stored in a pool that is only reset when the queue becomes
+ * empty, so insert() and pop() are O(1) and do not allocate once the pool
+ * reached the largest number of queued entries. Widening is O(N / 64 + size)
+ * and at least doubles the bucket width, so it happens a few times at most
+ * until the queue is empty again, when the initial width comes back.
+ */
+template <typename T, int N = 1024>
+class CalendarQueue {
+    static_assert((N & (N - 1)) == 0 && N >= 64, "N must be a power of 2, at least 64");
+
+    struct Node {
+        T value;
+        int64_t key;
+        int next;
+    };
+
+    public:
+        CalendarQueue() : _shift(0), _cur_shift(0), _origin(0), _min(0), _max(0),
+            _size(0), _low(NWORDS) {
+            memset(_bits, 0, sizeof(_bits));
+        }
+
+        /**
+         * Preallocate @a capacity entries. Buckets span 2^@a shift keys.
+         */
+        void initialize(int capacity, int shift) {
+            _pool.reserve(capacity);
+            _shift = shift;
+        }
+
+        /**
+         * Smallest shift so that N buckets cover @a range keys.
+         */
+        static int shift_for_range(int64_t range) {
+            int shift = 0;
+            while ((range >> shift) >= N)
+                shift++;
+            return shift;
+        }
+
+        inline int size() const {
+            return _size;
+        }
+
+        inline bool empty() const {
+            return _size == 0;
+        }
+
+        inline void insert(int64_t key, const T& value) {
+            if (_size == 0) {
+                _cur_shift = _shift;
+                _origin = key - ((int64_t)(N / 2) << _cur_shift);
+                _min = _max = key;
+            } else if (key < _min)
+                _min = key;
+            else if (key > _max)
+                _max = key;
+            int64_t b = (key - _origin) >> _cur_shift;
+            if (unlikely(b < 0 || b >= N)) {
+                widen();
+                b = (key - _origin) >> _cur_shift;
+            }
+
+            int idx = _pool.size();
+            _pool.push_back(Node{value, key, -1});
+            link(b, idx);
+            _size++;
+        }
+
+        /**
+         * Remove the entry with the lowest key into @a value.
+         * @return false if the queue is empty
+         */
+        inline bool pop(T& value) {
+            if (_size == 0)
+                return false;
+            while (_bits[_low] == 0)
+                _low++;
+            int b = (_low << 6) | (ffs_lsb(_bits[_low]) - 1);
+            Node &n = _pool.unchecked_at(_head[b]);
+            value = n.value;
+            if (n.next < 0)
+                _bits[_low] &= ~(1ULL << (b & 63));
+            else
+                _head[b] = n.next;
+            if (--_size == 0) {
+                _pool.clear();
+                _low = NWORDS;
+            }
+            return true;
+        }
+
+    private:
+        enum { NWORDS = N / 64 };
+
+        inline void link(int b, int idx) {
+            if (_bits[b >> 6] & (1ULL << (b & 63)))
+                _pool.unchecked_at(_tail[b]).next = idx;
+            else {
+                _bits[b >> 6] |= 1ULL << (b & 63);
+                _head[b] = idx;
+                if ((b >> 6) < _low)
+                    _low = b >> 6;
+            }
+            _tail[b] = idx;
+        }
+
+        /**
+         * Widen the buckets so the window is centered on the keys inserted
+         * since the queue was last empty and covers twice their range, then
+         * move the queued entries to their new bucket, keeping their order.
+         */
+        void widen() {
+            // Chain the queued entries in bucket order
+            int first = -1, last = -1;
+            for (int w = _low; w < NWORDS; w++) {
+                uint64_t bits = _bits[w];
+                while (bits) {
+                    int b = (w << 6) | (ffs_lsb(bits) - 1);
+                    bits &= bits - 1;
+                    if (last < 0)
+                        first = _head[b];
+                    else
+                        _pool.unchecked_at(last).next = _head[b];
+                    last = _tail[b];
+                }
+                _bits[w] = 0;
+            }
+            _low = NWORDS;
+
+            int shift = shift_for_range(2 * (_max - _min) + 2);
+            if (shift > _cur_shift)
+                _cur_shift = shift;
+            _origin = _min + (_max - _min) / 2 - ((int64_t)(N / 2) << _cur_shift);
+
+            while (first >= 0) {
+                Node &n = _pool.unchecked_at(first);
+                int next = n.next;
+                n.next = -1;
+                link((n.key - _origin) >> _cur_shift, first);
+                first = next;
+            }
+        }
+
+        Vector<Node> _pool;
+        int _head[N];
+        int _tail[N];
+        uint64_t _bits[NWORDS];
+        int _shift;
+        int _cur_shift;
+        int64_t _origin;
+        int64_t _min;
+        int64_t _max;
+        int _size;
+        int _low;
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,103 @@
+#ifndef CLICK_CLASSIFIERJIT_HH
+#define CLICK_CLASSIFIERJIT_HH
+#include <click/vector.hh>
+CLICK_DECLS
+class ErrorHandler;
+CLICK_ENDDECLS
+
+namespace llvm {
+namespace orc {
+    class ResourceTracker;
+}
+}
+
+CLICK_DECLS
+
+/** @class ClassifierJIT
+ * @brief Compiles a classifier decision tree to native code using LLVM.
+ *
+ * The tree is the one of a Classification::Wordwise::Program. Each test reads
+ * the 32-bit word at address bases[base] + offset, masks it, and compares it
+ * with its value. The test then jumps to the test j[result] if it is
+ * positive, or to the output -j[result] otherwise.
+ *
+ * Offsets and lengths share the same space: a packet is long enough for a
+ * test if length >= required_length. When length < safe_length, tests that
+ * would read past the packet jump to j[short_output], as
+ * Program::length_checked_match does. When length >= safe_length, no length
+ * is checked at all.
+ *
+ * Two functions are generated. The match function classifies a single
+ * packet. The batch function classifies n packets at once: the tree is
+ * inlined in a loop over arrays of bases and lengths, avoiding a call per
+ * packet.
+ *
+ * Compiled code stays valid until the ClassifierJIT is destroyed, so that a
+ * thread still running an old tree after a live reconfiguration is safe.
+ */
+class ClassifierJIT { public:
+
+    struct Test {
+        int32_t offset;
+        uint32_t mask;
+        uint32_t value;
+        int32_t j[2];
+        uint32_t required_length;
+        uint8_t base;
+        uint8_t short_output;
+    };
+
+    typedef int (*MatchFunction)(const unsigned char * const *bases, int length);
+    typedef void (*BatchFunction)(const unsigned char * const *bases, const int *lengths, int *outputs, int n);
+
+    ClassifierJIT();
+    ~ClassifierJIT();
+
+    /** @brief Compile a tree.
+     * @param tests tests of the tree, starting with test 0
+     * @param nbases number of base pointers per packet
+     * @param safe_length length above which no length is checked
+     * @return 0 on success, or a negative error after reporting it to @a errh
+     *
+     * On failure, the previous functions are disabled. */
+    int compile(const Vector<Test> &tests, int nbases, int safe_length, ErrorHandler *errh);
+
+    /** @brief Stop using compiled code, keeping it alive. */
+    void disable() {
+        _match = 0;
+        _batch = 0;
+    }
+
+    bool enabled() const {
+        return _match != 0;
+    }
+    int nbases() const {
+        return _nbases;
+    }
+    int ncompiled() const {
+        return _code.size();
+    }
+
+    int match(const unsigned char * const *bases, int length) const {
+        return _match(bases, length);
+    }
+    void match_batch(const unsigned char * const *bases, const int *lengths, int *outputs, int n) const {
+        _batch(bases, lengths, outputs, n);
+    }
+
+    enum { batch_size = 64 };
+
+  private:
+
+    MatchFunction _match;
+    BatchFunction _batch;
+    int _nbases;
+    Vector<llvm::orc::ResourceTracker *> _code;
+
+    ClassifierJIT(const ClassifierJIT &);
+    ClassifierJIT &operator=(const ClassifierJIT &);
+
+};
+
+CLICK_ENDDECLS
+#endif
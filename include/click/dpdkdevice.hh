@@ -97,7 +97,7 @@ public:
             rx_offload(0), tx_offload(0),	
 	        flow_isolate(false),
             vlan_filter(false), vlan_strip(false), vlan_extend(false), vf_vlan(),
-            lro(false), jumbo(false)
+            lro(false), jumbo(false), rx_intr(false)
         {
             rx_queues.reserve(128);
             tx_queues.reserve(128);
@@ -132,6 +132,7 @@ public:
             click_chatter("      Virtual Function VLAN: %d", vf_vlan.size());
             click_chatter("Large Receive Offload (LRO): %s", lro ? "true":"false");
             click_chatter("    Rx Jumbo Frames Offload: %s", jumbo ? "true":"false");
+            click_chatter("              Rx Interrupts: %s", rx_intr ? "true":"false");
         }
 
         uint16_t vendor_id;
@@ -160,6 +161,7 @@ public:
         Vector<int> vf_vlan;
         bool lro;
         bool jumbo;
+        bool rx_intr;
     };
 
 #if HAVE_FLOW_API
@@ -187,6 +189,7 @@ public:
     void set_init_rss_max(int rss_max);
     void set_init_reta_size(int reta_size);
     void set_init_fc_mode(FlowControlMode fc);
+    void set_init_rx_intr(bool rx_intr);
     void set_rx_offload(uint64_t offload);
     void set_tx_offload(uint64_t offload);
 
@@ -232,6 +235,10 @@ public:
 
     static int get_port_numa_node(portid_t port_id);
 
+#if RTE_VERSION >= RTE_VERSION_NUM(18,05,0,0)
+    static int create_vdev(const String &spec, portid_t &port_id, ErrorHandler *errh);
+#endif
+
 #if HAVE_FLOW_API
     int set_mode(
         String mode, int num_pools, Vector<int> vf_vlan,
@@ -428,7 +435,9 @@ class DPDKRing { public:
 };
 
 /** @class DPDKDeviceArg
-  @brief Parser class for DPDK Port, either an integer or a PCI address. */
+  @brief Parser class for DPDK Port, either an integer, a PCI address or a
+  device name. A virtual device such as "net_ring0" or "net_null0,size=64"
+  is created if it does not exist yet. */
 class DPDKDeviceArg { public:
     static bool parse(const String &str, DPDKDevice* &result, const ArgContext &args = ArgContext());
     static String unparse(DPDKDevice* dev) {
@@ -4,6 +4,7 @@
 #include <click/multithread.hh>
 #include <functional>
 #include <click/allocator.hh>
+#include <click/algorithm.hh>
 CLICK_DECLS
 
 #ifdef HAVE_FLOW
@@ -272,7 +273,32 @@ class FlowTableHolder;
 
 extern __thread FlowControlBlock* fcb_stack;
 #if FLOW_PUSH_BATCH
+/**
+ * Per-thread queue of the FCB of each packet of the batch being pushed by
+ * the flow manager, indexed by FLOW_ID_ANNO.
+ */
 extern __thread FlowControlBlock** fcb_queue;
+extern __thread unsigned fcb_queue_size;
+
+/**
+ * Largest batch FlowStateElement hands to push_flow_batch at once. Larger
+ * batches are passed in chunks of this size.
+ */
+#define FLOW_PUSH_BATCH_MAX 256
+
+/**
+ * Make sure the per-thread FCB queue can hold a batch of @a count packets.
+ * The queue only grows, so it ends up sized to the largest burst seen by
+ * the thread and is not reallocated in the steady state.
+ */
+inline void fcb_queue_reserve(unsigned count) {
+    if (likely(count <= fcb_queue_size))
+        return;
+    unsigned size = next_pow2(count < 256 ? 256 : count);
+    delete[] fcb_queue;
+    fcb_queue = new FlowControlBlock*[size];
+    fcb_queue_size = size;
+}
 #endif
 extern __thread FlowTableHolder* fcb_table;
 
@@ -188,6 +188,8 @@ public:
 protected:
 
     int _flow_data_offset;
+    //Set if the managers push batches of multiple flows, see VirtualFlowManager::pushes_flow_batch()
+    bool _flow_batch;
     friend class FlowBufferVisitor;
     friend class VirtualFlowManager;
 };
@@ -255,6 +257,15 @@ protected:
 
     bool stopClassifier() { return true; };
 
+    /**
+     * Whether this manager pushes batches of packets of multiple flows, the
+     * FCB of each packet being in fcb_queue at index FLOW_ID_ANNO. Otherwise
+     * batches contain a single flow, whose FCB is fcb_stack.
+     */
+    virtual bool pushes_flow_batch() const {
+        return false;
+    }
+
     friend class CTXElement;
 };
 
@@ -286,10 +297,55 @@ public :
     }
 
     void push_batch(int port, PacketBatch* head) final {
+#if FLOW_PUSH_BATCH
+            if (likely(_flow_batch)) {
+                FlowControlBlock* tmp = fcb_stack;
+                push_flow_batch(port, head);
+                fcb_stack = tmp;
+                return;
+            }
+#endif
             push_flow(port, fcb_data(), head);
     };
 
     virtual void push_flow(int port, T* flowdata, PacketBatch* head) = 0;
+
+#if FLOW_PUSH_BATCH
+    /**
+     * Process a batch that may contain packets of multiple flows, the FCB of
+     * each packet being in the FCB queue.
+     *
+     * By default the batch is cut in runs of consecutive packets of the same
+     * flow, and push_flow() is called for each run with its FCB on the
+     * stack. Elements that can work packet by packet override this.
+     */
+    virtual void push_flow_batch(int port, PacketBatch* head) {
+        Packet* first = head->first();
+        FlowControlBlock* fcb = *(fcb_queue + FLOW_ID_ANNO(first));
+        Packet* last = first;
+        int count = 1;
+        Packet* p = first->next();
+        while (p) {
+            Packet* next = p->next();
+            if (next)
+                __builtin_prefetch(fcb_data_for(*(fcb_queue + FLOW_ID_ANNO(next))));
+            FlowControlBlock* pfcb = *(fcb_queue + FLOW_ID_ANNO(p));
+            if (pfcb != fcb) {
+                last->set_next(0);
+                fcb_stack = fcb;
+                push_flow(port, fcb_data_for(fcb), PacketBatch::make_from_simple_list(first, last, count));
+                first = p;
+                fcb = pfcb;
+                count = 0;
+            }
+            last = p;
+            count++;
+            p = next;
+        }
+        fcb_stack = fcb;
+        push_flow(port, fcb_data_for(fcb), PacketBatch::make_from_simple_list(first, last, count));
+    }
+#endif
 };
 
 class DefaultChecker { public:
@@ -375,52 +431,62 @@ public :
 
     void push_batch(int port, PacketBatch* head) {
 #if FLOW_PUSH_BATCH
-        int count = head->count();
-
-        const int MAX_PACKETS = 64;
-        T* fcbs[MAX_PACKETS];
-
-//        T** fcbs = new T*[count]; 
-        int i = 0;
-
-        int idx = 0;
-        Packet* p = head->first();
-        Packet* fep_next = ((p != 0)? p->next() : 0 );
-        Packet* fep_two_ahead = (fep_next != 0 ? fep_next->next() : 0); // Second packet ahead of the current packet
-
-        for (;p != 0;idx++,p=fep_next,fep_next=(p==0?0:p->next()), fep_two_ahead = (fep_next == 0 ? 0 : fep_next->next())) {
-//            if (fep_two_ahead != 0) {
-//                auto next_fcb = my_fcb_data_from_queue(idx+2);
-//                rte_prefetch0(next_fcb);
-//            }
-
-            auto my_fcb = my_fcb_data_from_queue(FLOW_ID_ANNO(p));
-            if (!Checker::seen(&my_fcb->v, &my_fcb->str)) {
+      if (likely(_flow_batch)) {
+        //One entry per packet, larger batches are passed in chunks
+        T* fcbs[FLOW_PUSH_BATCH_MAX];
+        while (head) {
+            PacketBatch* next = 0;
+            if (unlikely(head->count() > FLOW_PUSH_BATCH_MAX))
+                head->split(FLOW_PUSH_BATCH_MAX, next, true);
+            int i = 0;
+
+            FlowControlBlock* tmp = fcb_stack;
+            auto fnt = [this, &fcbs, &i](Packet* p) -> Packet* {
+                //The flow state of the packet two ahead is needed soon
+                Packet* ahead = p->next() ? p->next()->next() : 0;
+                if (ahead) {
+                    AT* next_fcb = my_fcb_data_from_queue(FLOW_ID_ANNO(ahead));
+                    __builtin_prefetch(next_fcb);
+                    if (static_cast<Derived*>(this)->is_fcb_large())
+                        static_cast<Derived*>(this)->prefetch_fcb(0, &next_fcb->v);
+                }
 
-                if (likely(static_cast<Derived*>(this)->new_flow(&my_fcb->v, p))) {
-                    Checker::mark_seen(&my_fcb->v, &my_fcb->str);
-                    if (Derived::timeout > 0)
-                        this->ctx_acquire_timeout(Derived::timeout);
+                auto my_fcb = my_fcb_data_from_queue(FLOW_ID_ANNO(p));
+                if (!Checker::seen(&my_fcb->v, &my_fcb->str)) {
+                    //Timeout and release functions apply to the FCB on the stack
+                    fcb_stack = *(fcb_queue + FLOW_ID_ANNO(p));
+                    if (likely(static_cast<Derived*>(this)->new_flow(&my_fcb->v, p))) {
+                        Checker::mark_seen(&my_fcb->v, &my_fcb->str);
+                        if (Derived::timeout > 0)
+                            this->ctx_acquire_timeout(Derived::timeout);
 #if HAVE_FLOW_DYNAMIC
-                        this->fcb_set_release_fnt(my_fcb, &release_fnt);
+                            this->fcb_set_release_fnt(my_fcb, &release_fnt);
 #endif
-                } else { //TODO set early drop?
-                    head->fast_kill();
-                    return;
+                    } else { //TODO set early drop?
+                        return 0;
+                    }
                 }
-                
-            }
 
-           if(static_cast<Derived*>(this)->is_fcb_large())
-               static_cast<Derived*>(this)->prefetch_fcb(0, &my_fcb->v);
-           fcbs[i] = &my_fcb->v;
-           i++;
-        }
+                fcbs[i++] = &my_fcb->v;
+                return p;
+            };
+            EXECUTE_FOR_EACH_PACKET_DROPPABLE(fnt, head, [](Packet* p) { p->kill(); });
+            fcb_stack = tmp;
 
-        static_cast<Derived*>(this)->push_flow_batch(port, fcbs, head);
+            if (unlikely(!head)) {
+                head = next;
+                continue;
+            }
 
-        output_push_batch(0, head);
-#else
+            static_cast<Derived*>(this)->push_flow_batch(port, fcbs, head);
+
+            if (head)
+                output_push_batch(0, head);
+            head = next;
+        }
+        return;
+      }
+#endif
          auto my_fcb = my_fcb_data();
          if (!Checker::seen(&my_fcb->v, &my_fcb->str)) {
              if (static_cast<Derived*>(this)->new_flow(&my_fcb->v, head->first())) {
@@ -436,7 +502,6 @@ public :
              }
          }
          static_cast<Derived*>(this)->push_flow(port, &my_fcb->v, head);
-#endif
     };
 
     void close_flow() {
@@ -450,7 +515,15 @@ public :
     }
 
 #if FLOW_PUSH_BATCH
-    /* TODO: This should be virtual and implemented by each element, for now let's put an empty body for testing */
+    /**
+     * CRTP virtual, process a batch that may contain packets of multiple
+     * flows. flowdata[i] is the state of the flow of the i-th packet.
+     *
+     * The batch is pushed to output 0 afterwards. Implementations that drop
+     * packets take the batch by reference, and set it to null if they
+     * consumed or dropped all packets. Those that need the FCB of a packet on
+     * the stack (e.g. to call close_flow()) use set_fcb_stack_for().
+     */
     inline void push_flow_batch(int port, T** flowdata, PacketBatch *head) {
 
     }
@@ -470,10 +543,28 @@ private:
     }
 
 #if FLOW_PUSH_BATCH
-    inline AT* my_fcb_data_from_queue(uint8_t offset) {
+    inline AT* my_fcb_data_from_queue(uint32_t offset) {
         auto *fcb = *(fcb_queue + offset);
         return static_cast<AT*>((void*)&fcb->data[_flow_data_offset]);
     }
+
+protected:
+    /**
+     * Put the FCB of packet @a p on the stack, in multi-flow batch mode.
+     * The caller must restore the previous one.
+     */
+    inline void set_fcb_stack_for(Packet* p) {
+        fcb_stack = *(fcb_queue + FLOW_ID_ANNO(p));
+    }
+
+    /**
+     * Whether the flow of packet @a p was closed, e.g. by a previous packet
+     * of the same multi-flow batch.
+     */
+    inline bool is_flow_closed(Packet* p) {
+        auto my_fcb = my_fcb_data_from_queue(FLOW_ID_ANNO(p));
+        return !Checker::seen(&my_fcb->v, &my_fcb->str);
+    }
 #endif
 
 };
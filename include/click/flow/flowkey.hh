@@ -0,0 +1,103 @@
+#ifndef CLICK_FLOWKEY_HH
+#define CLICK_FLOWKEY_HH
+#include <click/glue.hh>
+#include <click/packet.hh>
+#include <click/packet_anno.hh>
+#include <click/straccum.hh>
+#include <click/ipflowid.hh>
+#include <click/ip6flowid.hh>
+
+CLICK_DECLS
+
+/**
+ * Flow keys usable as the key type of VirtualFlowManagerIMP and
+ * TagCuckooTable. A key must be default-constructible, constructible from a
+ * Packet, and provide hashcode(), operator== and unparse().
+ *
+ * IPFlow5ID and IP6Flow5ID are keys. QualifiedFlowID extends any of them with
+ * a 32-bit qualifier read from the packet annotations, so overlapping tenant
+ * address spaces do not collide.
+ */
+
+/**
+ * Qualifies a flow by the VLAN ID of the VLAN_TCI annotation, as set by
+ * VLANDecap, SetVLANAnno or FromDPDKDevice with VLAN offloading.
+ */
+struct VLANQualifier {
+    static inline uint32_t get(const Packet *p) {
+        return ntohs(VLAN_TCI_ANNO(p)) & 0x0FFF;
+    }
+    static const char *name() { return "vlan"; }
+    static constexpr bool reads_aggregate = false;
+};
+
+/**
+ * Qualifies a flow by the AGGREGATE annotation, which tunnel decapsulation
+ * elements set to the tunnel identifier (e.g. GTPDecap sets the TEID). A
+ * VXLAN VNI can be set the same way. The annotation then no longer holds
+ * the RSS redirection entry, so flow managers keyed this way cannot use
+ * GROUPS.
+ */
+struct TunnelQualifier {
+    static inline uint32_t get(const Packet *p) {
+        return AGGREGATE_ANNO(p);
+    }
+    static const char *name() { return "tunnel"; }
+    static constexpr bool reads_aggregate = true;
+};
+
+template <typename Base, typename Qualifier>
+class QualifiedFlowID : public Base { public:
+
+    explicit QualifiedFlowID(const Packet *p, bool reverse = false) : Base(p, reverse), _qualifier(Qualifier::get(p)) {
+    }
+
+    QualifiedFlowID() : Base(), _qualifier(0) {
+    }
+
+    inline uint32_t qualifier() const {
+        return _qualifier;
+    }
+
+    inline hashcode_t hashcode() const {
+        return Base::hashcode() ^ (_qualifier * 0x9e3779b1);
+    }
+
+    String unparse() const {
+        StringAccum sa;
+        sa << Qualifier::name() << ' ' << _qualifier << ' ' << Base::unparse();
+        return sa.take_string();
+    }
+
+    inline bool operator==(const QualifiedFlowID &o) const {
+        return _qualifier == o._qualifier && static_cast<const Base&>(*this) == static_cast<const Base&>(o);
+    }
+
+    inline bool operator!=(const QualifiedFlowID &o) const {
+        return !(*this == o);
+    }
+
+  protected:
+    uint32_t _qualifier;
+};
+
+/**
+ * True if the key K is read from the AGGREGATE annotation.
+ */
+template <typename K>
+struct FlowKeyReadsAggregate {
+    static constexpr bool value = false;
+};
+
+template <typename Base, typename Qualifier>
+struct FlowKeyReadsAggregate<QualifiedFlowID<Base, Qualifier> > {
+    static constexpr bool value = Qualifier::reads_aggregate;
+};
+
+typedef QualifiedFlowID<IPFlow5ID, VLANQualifier> IPFlow5VLANID;
+typedef QualifiedFlowID<IP6Flow5ID, VLANQualifier> IP6Flow5VLANID;
+typedef QualifiedFlowID<IPFlow5ID, TunnelQualifier> IPFlow5TunnelID;
+typedef QualifiedFlowID<IP6Flow5ID, TunnelQualifier> IP6Flow5TunnelID;
+
+CLICK_ENDDECLS
+#endif
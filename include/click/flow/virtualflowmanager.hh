@@ -3,21 +3,127 @@
 #include <click/flow/flowelement.hh>
 #include <click/timerwheel.hh>
 #include <click/batchbuilder.hh>
+#include <click/flow/flowkey.hh>
+#include <click/ring.hh>
 #include <type_traits>
+#include <vector>
 #include <clicknet/ether.h>
+#if HAVE_JSON
+# include <click/json.hh>
+#endif
+#if HAVE_RSSPP
+# include <nicscheduler/ethernetdevice.hh>
+# include <nicscheduler/nicscheduler.hh>
+# if HAVE_DPDK
+#  include <rte_ethdev.h>
+# endif
+#endif
+
+/**
+ * Always-on counters of a per-core flow table. They are only written by
+ * their core, handlers read them without synchronization.
+ */
+struct FlowTableStats {
+    enum { backlog_buckets = 16 };
+
+    uint64_t hits = 0;
+    uint64_t inserts = 0;
+    //The table refused the key, e.g. too many collisions
+    uint64_t insert_failures = 0;
+    //No flow ID was left
+    uint64_t table_full = 0;
+    //Flows removed by the timeout
+    uint64_t evictions = 0;
+    //FCBs the timer wheel went through at each tick. Bucket 0 counts empty
+    //ticks, bucket i > 0 ticks with 2^(i-1) to 2^i - 1 FCBs.
+    uint64_t wheel_backlog[backlog_buckets] = {0};
+
+    inline uint64_t lookups() const {
+        return hits + inserts + insert_failures + table_full;
+    }
+
+    inline void add_backlog(uint32_t n) {
+        int b = n ? 32 - __builtin_clz(n) : 0;
+        wheel_backlog[b < backlog_buckets ? b : backlog_buckets - 1]++;
+    }
+
+    void add(const FlowTableStats &o) {
+        hits += o.hits;
+        inserts += o.inserts;
+        insert_failures += o.insert_failures;
+        table_full += o.table_full;
+        evictions += o.evictions;
+        for (int i = 0; i < backlog_buckets; i++)
+            wheel_backlog[i] += o.wheel_backlog[i];
+    }
+};
+
+/**
+ * Flows of a migrating group handed by a core to another. The header is
+ * followed by count copies of FCBs, each holding the flow key.
+ */
+struct FlowMigrationChunk {
+    uint32_t count;
+} CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+
+/**
+ * Per-core state of the flow migration protocol of VirtualFlowManagerIMP.
+ *
+ * pending, watch and incoming are written by other cores, everything else
+ * is only touched by the owning core.
+ */
+class FlowMigrationCore { public:
+    //Packets seen by this core
+    uint64_t count = 0;
+    uint64_t last_tick_count = 0;
+
+    //Some groups owned by this core must be handed over
+    bool pending = false;
+    //Hand over once count reaches watch, 0 until the NIC was reprogrammed
+    uint64_t watch = 0;
+    //Some rings of the inbox hold chunks
+    bool incoming = false;
+
+    //One ring per source core
+    SPSCLockFreeRing<FlowMigrationChunk*>* inbox = 0;
+
+    //Packets of groups migrating to this core, waiting for their flows
+    Vector<PacketBatch*> queue;
+    Vector<int> buffered;
+
+    //Destination of each group being handed over, -1 otherwise
+    Vector<int> give;
+
+    //First flow ID of the list of flows of each group in this core's table
+    Vector<uint32_t> members;
+
+    uint64_t migrated_in = 0;
+    uint64_t migrated_out = 0;
+    uint64_t lost = 0;
+    uint64_t drops = 0;
+
+    void initialize(int groups) {
+        inbox = new SPSCLockFreeRing<FlowMigrationChunk*>[click_max_cpu_ids()];
+        queue.resize(groups, 0);
+        give.resize(groups, -1);
+        members.resize(groups, 0);
+    }
+} CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
 
 
 class _FlowManagerIMPState { public:
    //The table of FCBs
     FlowControlBlock *fcbs;
-    TimerWheel<FlowControlBlock> _timer_wheel;
+    HierarchicalTimerWheel<FlowControlBlock> _timer_wheel;
     Timer* maintain_timer;
 
-    int _failed_searches = 0;
-    int _successful_searches = 0;
+    FlowTableStats stats;
+
+    FlowMigrationCore* migration = 0;
 
     void **key_array = new void*[256];
     IPFlow5ID* flowIDs = new IPFlow5ID[256];
+    int32_t* positions = new int32_t[256];
 
 };
 
@@ -35,7 +141,8 @@ class FlowManagerIMPState : public _FlowManagerIMPState { public:
 
     // Flow stack management
     uint32_t *flows_stack = 0;
-    int flows_stack_i;
+    //Slot 0 is unused, the ID 0 stays at the bottom of the stack
+    int flows_stack_i = 0;
     FlowControlBlock* _qbsr;
 
     static constexpr bool need_fid() {
@@ -57,10 +164,33 @@ class FlowManagerIMPState : public _FlowManagerIMPState { public:
 
 /**
  * Element that allocates some FCB Space per-thread
+ *
+ * T is the implementation (CRTP), State its per-thread state and K the flow
+ * key type (see click/flow/flowkey.hh). Hashing, comparison and storage of
+ * the key in the FCB are specialized for K.
+ *
+ * If GROUPS is set, flows are split in groups by the AGGREGATE annotation
+ * (e.g. the RSS redirection table entry) and groups can be migrated from a
+ * core to another, as RSS++ does when it rebalances the load. Only the core
+ * owning a group handles its packets. When a group moves, the destination
+ * buffers its packets locally until the source core, once it saw the
+ * packets still in its queue, copies the FCBs of the group into SPSC rings
+ * towards the destination and gives the ownership away. No lock is taken
+ * on the packet path. Each core links the FCBs of a group in a list, so a
+ * handover only walks the flows of the groups that move.
+ * Keys that include the AGGREGATE annotation, such as tunnel keys, hold
+ * another value there, so GROUPS is rejected for them.
  */
-template<typename T, class State> 
-class VirtualFlowManagerIMP : public VirtualFlowManager, public Router::InitFuture { public:
-    VirtualFlowManagerIMP() : _tables(), _cache(true) {
+template<typename T, class State, typename K = IPFlow5ID>
+class VirtualFlowManagerIMP : public VirtualFlowManager, public Router::InitFuture
+#if HAVE_RSSPP
+                            , public MigrationListener
+#endif
+{ public:
+
+    typedef K key_type;
+    typedef FlowBatchBuilder<K> Builder;
+    VirtualFlowManagerIMP() : _tables(), _cache(true), _groups(0), _group_owner(0), _group_dest(0) {
 
     };
 
@@ -77,8 +207,26 @@ class VirtualFlowManagerIMP : public VirtualFlowManager, public Router::InitFutu
                 .read_or_set("TIMEOUT", timeout, 0) // Timeout for the entries
                 .read_or_set("RECYCLE_INTERVAL", recycle_interval, 1)
                 .read_or_set("PROCESS_BATCH", _processing_batch_size, 256)
+                .read_or_set("GROUPS", _groups, 0)
                 .consume();
 
+        if (_groups) {
+            if (!State::need_fid()) {
+                args->error("GROUPS is not supported by this table");
+                return -1;
+            }
+            if (FlowKeyReadsAggregate<K>::value) {
+                args->error("GROUPS cannot be used when the AGGREGATE annotation is part of the flow key");
+                return -1;
+            }
+            _group_owner = new int[_groups];
+            _group_dest = new int[_groups];
+            for (uint32_t i = 0; i < _groups; i++) {
+                _group_owner[i] = -1;
+                _group_dest[i] = -1;
+            }
+        }
+
         _recycle_interval_ms = (int)(recycle_interval * 1000);
         _epochs_per_sec = max(1, 1000 / _recycle_interval_ms);
         _timeout_ms = timeout * 1000;
@@ -88,6 +236,10 @@ class VirtualFlowManagerIMP : public VirtualFlowManager, public Router::InitFutu
         return ret;
     }
 
+    bool pushes_flow_batch() const override {
+        return FLOW_PUSH_BATCH;
+    }
+
     int solve_initialize(ErrorHandler *errh) override
     {        
         auto passing = get_passing_threads();
@@ -125,7 +277,15 @@ class VirtualFlowManagerIMP : public VirtualFlowManager, public Router::InitFutu
                     t.imp_flows_push(i);
             }
 
-             if (_timeout_ms > 0 && have_maintainer) {
+            if (_groups) {
+                t.migration = new FlowMigrationCore();
+                t.migration->initialize(_groups);
+                //Rings are large enough for a whole table
+                for (int si = 0; si < _tables.weight(); si++)
+                    t.migration->inbox[_tables.get_mapping(si)].initialize(_capacity / migration_chunk + 2);
+            }
+
+             if ((_timeout_ms > 0 || _groups) && have_maintainer) {
                 //click_chatter("Initializing maintain timer %d", core);
                 t.maintain_timer = new Timer(this);
                 t.maintain_timer->initialize(this, true);
@@ -147,8 +307,10 @@ class VirtualFlowManagerIMP : public VirtualFlowManager, public Router::InitFutu
         VirtualFlowManagerIMP *e =
             reinterpret_cast<VirtualFlowManagerIMP *>(thunk);
 
-        int removed = e->maintainer();
-        //click_chatter("Run timer, removed %d", removed);
+        if (e->_timeout_epochs)
+            e->maintainer();
+        if (e->_groups)
+            e->migration_tick();
 
         e->_tables.get_value_for_thread(core).maintain_timer->schedule_after_msec(e->_recycle_interval_ms);
     }
@@ -171,14 +333,24 @@ class VirtualFlowManagerIMP : public VirtualFlowManager, public Router::InitFutu
         }
 
         int checker = 0;
-        TimerWheel<FlowControlBlock> &tw = state._timer_wheel;
-        tw.run_timers([this,recent,&checker, &tw, &state, dest_core](FlowControlBlock* prev) -> FlowControlBlock* {
+        uint32_t visited = 0;
+        auto &tw = state._timer_wheel;
+        tw.run_timers([this,recent,&checker,&visited, &tw, &state, dest_core](FlowControlBlock* prev) -> FlowControlBlock* {
+            visited++;
             if (unlikely(checker >= _capacity))
             {
                 click_chatter("Loop detected!");
                 abort();
             }
             FlowControlBlock * next = *get_next_released_fcb(prev);
+            if constexpr (State::need_fid()) {
+                //The flow was handed to another core, only the ID is left
+                if (unlikely(*get_fcb_group(prev) == FLOW_GROUP_MIGRATED)) {
+                    *get_next_released_fcb(prev) = state._qbsr;
+                    state._qbsr = prev;
+                    return next;
+                }
+            }
             //Verify lastseen is not in the future
            // click_chatter("%d %d, next %p", recent, prev->lastseen, next);
             if (unlikely(recent <= prev->lastseen)) {
@@ -197,6 +369,10 @@ class VirtualFlowManagerIMP : public VirtualFlowManager, public Router::InitFutu
                 //expire
                 //click_chatter("Release %p", prev);
 
+                if constexpr (State::need_fid()) {
+                    if (_groups)
+                        group_unlink(*state.migration, prev);
+                }
                 int pos = ((T*)this)->remove(*get_fcb_key(prev));
                 if constexpr (State::need_fid()) {
                     if (likely(pos==0))
@@ -229,18 +405,22 @@ class VirtualFlowManagerIMP : public VirtualFlowManager, public Router::InitFutu
             return next;
         });
 
+        state.stats.evictions += checker;
+        state.stats.add_backlog(visited);
         return checker;
     }
 
     void push_batch(int, PacketBatch *batch) override {
-        BatchBuilder b;
+        Builder b;
         Timestamp recent;
 
-        uint8_t fcb_idx = 0;
+        uint32_t fcb_idx = 0;
+        if (unlikely(_groups))
+            migration_steer(batch);
+        if (!batch)
+            return;
 #if FLOW_PUSH_BATCH
-        if (fcb_queue == 0)
-            // TODO: this is statically 256 but it should be the size of the DPDK queue
-            fcb_queue = new FlowControlBlock*[256];
+        fcb_queue_reserve(batch->count());
 #endif
 
         FlowControlBlock* tmp = fcb_stack;
@@ -250,16 +430,17 @@ class VirtualFlowManagerIMP : public VirtualFlowManager, public Router::InitFutu
 #if FLOW_BULK_SEARCH
         ((T*) this)->process_bulk(batch, b, recent, fcb_idx);
 #else
-        FOR_EACH_PACKET_SAFE(batch, p) {
-            ((T*)this)->process(p, b, recent, fcb_idx, 0);
-        }
+        //process() searches by itself, after checking the last flow cache
+        process_each(batch, b, recent, fcb_idx, [](Packet*) -> int { return -1; });
 #endif
 
 #if FLOW_PUSH_BATCH
+        if (batch) {
 #if HAVE_FLOW_DYNAMIC
             fcb_acquire(batch->count());
 #endif
-        output_push_batch(0, batch);
+            output_push_batch(0, batch);
+        }
 #else
         batch = b.finish();
         if (batch) {
@@ -273,31 +454,70 @@ class VirtualFlowManagerIMP : public VirtualFlowManager, public Router::InitFutu
 #endif
 
         fcb_stack = tmp;
+
+        if (unlikely(_groups))
+            migration_check_out(*_tables);
     }
 
-inline void process_bulk(PacketBatch *batch, BatchBuilder &b, Timestamp &recent, uint8_t &fcb_idx) {
-    
-    int* ret = new int[batch->count()];
+/**
+ * Call process() on each packet of the batch, with the search result given
+ * by lookup(p). Packets for which process() returns null are killed. In
+ * FLOW_PUSH_BATCH mode they are also removed from the batch, which may
+ * become null.
+ */
+template <typename Lookup>
+inline void process_each(PacketBatch* &batch, Builder &b, Timestamp &recent, uint32_t &fcb_idx, Lookup lookup) {
+#if FLOW_PUSH_BATCH
+    auto fnt = [this, &b, &recent, &fcb_idx, &lookup](Packet* p) -> Packet* {
+        return process(p, b, recent, fcb_idx, lookup(p));
+    };
+    EXECUTE_FOR_EACH_PACKET_DROPPABLE(fnt, batch, [](Packet* p) { p->kill(); });
+#else
+    FOR_EACH_PACKET_SAFE(batch, p) {
+        if (!process(p, b, recent, fcb_idx, lookup(p)))
+            p->kill();
+    }
+#endif
+}
+
+inline void process_bulk(PacketBatch* &batch, Builder &b, Timestamp &recent, uint32_t &fcb_idx) {
+    //The per-thread scratch arrays only hold 256 entries, bigger batches are searched one by one
+    if (unlikely(batch->count() > 256)) {
+        process_each(batch, b, recent, fcb_idx, [this](Packet* p) -> int {
+            K fid = K(p);
+            return ((T*)this)->find(fid);
+        });
+        return;
+    }
+
+    int32_t* ret = _tables->positions;
     ((T*)this)->find_bulk(batch, ret);
 
     int index = 0;
-    FOR_EACH_PACKET_SAFE(batch, pt) {
-        process(pt, b, recent, fcb_idx, ret[index]);
-        index++;
-    }
+    process_each(batch, b, recent, fcb_idx, [ret, &index](Packet*) -> int {
+        return ret[index++];
+    });
 }
 
-inline void process(Packet *p, BatchBuilder &b, Timestamp &recent, uint8_t &fcb_idx, int bulk_ret) {
-    IPFlow5ID fid = IPFlow5ID(p);
+/**
+ * Classify @a p, whose search result in the table is @a found.
+ * @return the packet to pass, or null if it must be dropped
+ */
+inline Packet* process(Packet *p, Builder &b, Timestamp &recent, uint32_t &fcb_idx, int found) {
+    K fid = K(p);
     FlowControlBlock *fcb;
     auto &state = *_tables;
     int ret;
-    uint8_t curr_idx;
+    uint32_t curr_idx;
 
 #if FLOW_BULK_SEARCH
-        ret = bulk_ret;
+        ret = found;
+        //A new flow may have been inserted by a previous packet of the batch
+        if (ret < 0)
+            ret = ((T*)this)->find(fid);
 #else
         if (_cache && fid == b.last_id) {
+            state.stats.hits++;
 #if FLOW_PUSH_BATCH
             curr_idx = fcb_idx++;
             SET_FLOW_ID_ANNO(p, curr_idx);
@@ -305,14 +525,13 @@ inline void process(Packet *p, BatchBuilder &b, Timestamp &recent, uint8_t &fcb_
 #else
             b.append(p);
 #endif
-            return;
+            return p;
         }
         ret = ((T*)this)->find(fid);
 #endif
     
     if (likely(ret >= 0) ){
-        if (_verbose)
-            _tables->_successful_searches += 1;
+        state.stats.hits++;
 
         fcb = get_fcb_from_flowid(ret);
 
@@ -340,16 +559,15 @@ inline void process(Packet *p, BatchBuilder &b, Timestamp &recent, uint8_t &fcb_
 
     }
     else {
-        if (_verbose)
-            _tables->_failed_searches += 1;
-
         uint32_t flowid;
         if constexpr (State::need_fid()) {
             flowid = state.imp_flows_pop();
             if (unlikely(flowid == 0)) {
-                click_chatter("ID is 0 and table is full!");
-                p->kill();
-                return;
+                //0 is the bottom of the stack, keep it there
+                state.imp_flows_push(0);
+                if (state.stats.table_full++ == 0)
+                    click_chatter("%p{element}: ID is 0 and table is full!", this);
+                return 0;
             }
 
             // INSERT IN TABLE
@@ -364,9 +582,13 @@ inline void process(Packet *p, BatchBuilder &b, Timestamp &recent, uint8_t &fcb_
         }
 
         if (unlikely(ret < 0)) {
-            p->kill();
-            return;
+            if constexpr (State::need_fid()) {
+                state.imp_flows_push(flowid);
+            }
+            state.stats.insert_failures++;
+            return 0;
         }
+        state.stats.inserts++;
         fcb = get_fcb_from_flowid(ret);
 
         fcb->fcb_idx = ret;
@@ -376,10 +598,14 @@ inline void process(Packet *p, BatchBuilder &b, Timestamp &recent, uint8_t &fcb_
             *(get_fcb_flowid(fcb)) = flowid;
         }
 
-        if (_timeout_epochs) {
-            memcpy(get_fcb_key(fcb), &fid, sizeof(IPFlow5ID));
-            state._timer_wheel.schedule_after(fcb, _timeout_epochs, setter);
+        if (_timeout_epochs || _groups)
+            memcpy((void*)get_fcb_key(fcb), &fid, sizeof(K));
+        if (_groups) {
+            *get_fcb_group(fcb) = AGGREGATE_ANNO(p) % _groups;
+            group_link(*state.migration, fcb, ret);
         }
+        if (_timeout_epochs)
+            state._timer_wheel.schedule_after(fcb, _timeout_epochs, setter);
 
     } // (end)It's a new flow
 
@@ -423,10 +649,309 @@ inline void process(Packet *p, BatchBuilder &b, Timestamp &recent, uint8_t &fcb_
         }
     }
 #endif
+    return p;
+}
+
+/**
+ * Ask core @a from to hand the groups of @a moves (group, destination core)
+ * over. Packets of those groups reaching their destination are buffered
+ * until the flows are installed there. Does not wait for the migration.
+ */
+void migration_request(int from, const std::vector<std::pair<int,int>> &moves) {
+    for (unsigned i = 0; i < moves.size(); i++) {
+        assert(moves[i].first >= 0 && (uint32_t)moves[i].first < _groups);
+        __atomic_store_n(&_group_dest[moves[i].first], moves[i].second, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&_tables.get_value_for_thread(from).migration->pending, true, __ATOMIC_RELEASE);
+}
+
+/**
+ * The steering was updated, so core @a from will not receive packets of the
+ * groups it gives away after the @a backlog packets already in its queue.
+ * It hands them over once it saw those packets, or as soon as it is idle.
+ */
+void migration_arm(int from, unsigned backlog) {
+    FlowMigrationCore &m = *_tables.get_value_for_thread(from).migration;
+    __atomic_store_n(&m.watch, __atomic_load_n(&m.count, __ATOMIC_RELAXED) + backlog + 1, __ATOMIC_RELEASE);
+}
+
+#if HAVE_RSSPP
+void pre_migrate(EthernetDevice*, int from, std::vector<std::pair<int,int>> gids) override {
+    if (!_groups) {
+        click_chatter("%p{element}: GROUPS is not set, flows will not follow the migration", this);
+        return;
+    }
+    migration_request(from, gids);
 }
 
+void post_migrate(EthernetDevice* dev, int from) override {
+    if (!_groups)
+        return;
+    unsigned backlog = 0;
+# if HAVE_DPDK
+    int v = rte_eth_rx_queue_count(((DPDKEthernetDevice*)dev)->get_port_id(), from);
+    if (v > 0)
+        backlog = v;
+# endif
+    migration_arm(from, backlog);
+}
+
+void init_assignment(unsigned* table, int sz) override {
+    if ((uint32_t)sz != _groups) {
+        click_chatter("ERROR: Initializing %p{element} with %d buckets, but configured with %d groups", this, sz, _groups);
+        return;
+    }
+    for (int i = 0; i < sz; i++)
+        _group_owner[i] = table[i];
+}
+#endif
+
 protected:
 
+    enum { migration_chunk = 32 };
+    static constexpr uint32_t FLOW_GROUP_MIGRATED = UINT32_MAX;
+
+    inline int group_owner(int g) {
+        return __atomic_load_n(&_group_owner[g], __ATOMIC_ACQUIRE);
+    }
+
+    inline void migration_enqueue(FlowMigrationCore &m, int g, Packet* p) {
+        if (m.queue[g]) {
+            m.queue[g]->append_packet(p);
+        } else {
+            m.queue[g] = PacketBatch::make_from_packet(p);
+            m.buffered.push_back(g);
+        }
+    }
+
+    /**
+     * Keep in @a batch the packets of groups owned by this core, preceded by
+     * the buffered packets of groups that just moved in. Packets of groups
+     * moving in are buffered, other packets are stray and are dropped.
+     */
+    void migration_steer(PacketBatch* &batch) {
+        State &state = *_tables;
+        FlowMigrationCore &m = *state.migration;
+        int me = click_current_cpu_id();
+
+        PacketBatch* ready = 0;
+        bool has_buffered = m.buffered.size();
+        if (unlikely(has_buffered)) {
+            for (int i = 0; i < m.buffered.size(); ) {
+                int g = m.buffered[i];
+                if (group_owner(g) == me) {
+                    if (ready)
+                        ready->append_batch(m.queue[g]);
+                    else
+                        ready = m.queue[g];
+                    m.queue[g] = 0;
+                    m.buffered[i] = m.buffered.back();
+                    m.buffered.pop_back();
+                } else
+                    i++;
+            }
+        }
+
+        if (batch) {
+            m.count += batch->count();
+            auto fnt = [this, &m, me, has_buffered](Packet* p) -> Packet* {
+                int g = AGGREGATE_ANNO(p) % _groups;
+                int o = group_owner(g);
+                if (likely(o == me)) {
+                    //Keep the order behind packets that were already waiting
+                    if (unlikely(has_buffered && m.queue[g])) {
+                        migration_enqueue(m, g, p);
+                        return 0;
+                    }
+                    return p;
+                }
+                if (o < 0 && __atomic_compare_exchange_n(&_group_owner[g], &o, me, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+                    return p;
+                if (__atomic_load_n(&_group_dest[g], __ATOMIC_ACQUIRE) == me) {
+                    migration_enqueue(m, g, p);
+                    return 0;
+                }
+                if (unlikely(_verbose > 1))
+                    click_chatter("Packet of group %d pushed on core %d while %d owns it", g, me, o);
+                m.drops++;
+                p->kill();
+                return 0;
+            };
+            EXECUTE_FOR_EACH_PACKET_DROPPABLE(fnt, batch, [](Packet*) {});
+        }
+
+        if (ready) {
+            if (batch)
+                ready->append_batch(batch);
+            batch = ready;
+        }
+
+        //Ownership was read above, so the flows of new groups are in the rings
+        if (unlikely(__atomic_exchange_n(&m.incoming, false, __ATOMIC_ACQ_REL)))
+            migration_in(state);
+    }
+
+    inline void migration_check_out(State &state) {
+        FlowMigrationCore &m = *state.migration;
+        if (unlikely(__atomic_load_n(&m.pending, __ATOMIC_ACQUIRE))) {
+            uint64_t w = __atomic_load_n(&m.watch, __ATOMIC_ACQUIRE);
+            if (w && m.count >= w)
+                migration_out(state);
+        }
+    }
+
+    /**
+     * Called by the maintenance timer. Install flows sent by other cores,
+     * release buffered packets and hand groups over if this core is idle.
+     */
+    void migration_tick() {
+        State &state = *_tables;
+        FlowMigrationCore &m = *state.migration;
+
+        if (__atomic_load_n(&m.pending, __ATOMIC_ACQUIRE) && __atomic_load_n(&m.watch, __ATOMIC_ACQUIRE) && m.count == m.last_tick_count)
+            migration_out(state);
+        m.last_tick_count = m.count;
+
+        if (__atomic_exchange_n(&m.incoming, false, __ATOMIC_ACQ_REL))
+            migration_in(state);
+
+        if (m.buffered.size())
+            push_batch(0, 0);
+    }
+
+    void migration_send(FlowMigrationChunk* chunk, int dest) {
+        FlowMigrationCore &d = *_tables.get_value_for_thread(dest).migration;
+        if (unlikely(!d.inbox[click_current_cpu_id()].insert(chunk))) {
+            click_chatter("%p{element}: migration ring to core %d is full, %d flows lost", this, dest, chunk->count);
+            _tables->migration->lost += chunk->count;
+            CLICK_ALIGNED_FREE(chunk, sizeof(FlowMigrationChunk) + migration_chunk * _flow_state_size_full);
+            return;
+        }
+        __atomic_store_n(&d.incoming, true, __ATOMIC_RELEASE);
+    }
+
+    /**
+     * Hand the groups this core gives away to their destination. The FCBs
+     * in the list of each of those groups are copied in chunks sent through
+     * the SPSC ring towards the destination and removed from the table. The
+     * ownership is given once all chunks are enqueued.
+     */
+    void migration_out(State &state) {
+        FlowMigrationCore &m = *state.migration;
+        int me = click_current_cpu_id();
+        __atomic_store_n(&m.pending, false, __ATOMIC_RELAXED);
+        __atomic_store_n(&m.watch, 0, __ATOMIC_RELAXED);
+
+        int moves = 0;
+        for (uint32_t g = 0; g < _groups; g++) {
+            int d = __atomic_load_n(&_group_dest[g], __ATOMIC_ACQUIRE);
+            if (group_owner(g) == me && d >= 0 && d != me) {
+                m.give[g] = d;
+                moves++;
+            }
+        }
+        if (!moves)
+            return;
+
+        size_t chunk_size = sizeof(FlowMigrationChunk) + migration_chunk * _flow_state_size_full;
+        Vector<FlowMigrationChunk*> out(click_max_cpu_ids(), 0);
+        uint64_t sent = 0;
+        for (uint32_t g = 0; g < _groups; g++) {
+            int d = m.give[g];
+            if (d < 0)
+                continue;
+            uint32_t i = m.members[g];
+            m.members[g] = 0;
+            while (i) {
+                FlowControlBlock* fcb = get_fcb_from_flowid(i);
+                uint32_t next = get_fcb_group_links(fcb)[1];
+
+                FlowMigrationChunk* &c = out[d];
+                if (!c) {
+                    c = (FlowMigrationChunk*)CLICK_ALIGNED_ALLOC(chunk_size);
+                    c->count = 0;
+                }
+                memcpy((uint8_t*)(c + 1) + c->count * _flow_state_size_full, (void*)fcb, _flow_state_size_full);
+                if (++c->count == migration_chunk) {
+                    migration_send(c, d);
+                    c = 0;
+                }
+
+                ((T*)this)->remove(*get_fcb_key(fcb));
+                *get_fcb_group(fcb) = FLOW_GROUP_MIGRATED;
+                //With timeouts, the timer wheel still links the FCB and releases its ID
+                if constexpr (State::need_fid()) {
+                    if (!_timeout_epochs)
+                        state.imp_flows_push(i);
+                }
+                sent++;
+                i = next;
+            }
+        }
+        for (int d = 0; d < out.size(); d++)
+            if (out[d])
+                migration_send(out[d], d);
+        m.migrated_out += sent;
+
+        for (uint32_t g = 0; g < _groups; g++) {
+            if (m.give[g] >= 0) {
+                if (unlikely(_verbose))
+                    click_chatter("Group %d now owned by %d", g, m.give[g]);
+                __atomic_store_n(&_group_owner[g], m.give[g], __ATOMIC_RELEASE);
+                m.give[g] = -1;
+            }
+        }
+        if (unlikely(_verbose))
+            click_chatter("Core %d handed %d groups over (%lu flows)", me, moves, sent);
+    }
+
+    /**
+     * Install the flows received from other cores in the table of this core.
+     */
+    void migration_in(State &state) {
+        FlowMigrationCore &m = *state.migration;
+        for (int si = 0; si < _tables.weight(); si++) {
+            SPSCLockFreeRing<FlowMigrationChunk*> &ring = m.inbox[_tables.get_mapping(si)];
+            while (FlowMigrationChunk* c = ring.extract()) {
+                for (uint32_t j = 0; j < c->count; j++) {
+                    FlowControlBlock* from = (FlowControlBlock*)((uint8_t*)(c + 1) + j * _flow_state_size_full);
+                    uint32_t flowid;
+                    if constexpr (State::need_fid()) {
+                        flowid = state.imp_flows_pop();
+                        if (unlikely(flowid == 0)) {
+                            state.imp_flows_push(0);
+                            m.lost++;
+                            continue;
+                        }
+                        if (unlikely(((T*)this)->insert(*get_fcb_key(from), flowid) < 0)) {
+                            state.imp_flows_push(flowid);
+                            m.lost++;
+                            continue;
+                        }
+                    } else {
+                        int ret = ((T*)this)->insert(*get_fcb_key(from), 0);
+                        if (unlikely(ret < 0)) {
+                            m.lost++;
+                            continue;
+                        }
+                        flowid = ret;
+                    }
+                    FlowControlBlock* fcb = get_fcb_from_flowid(flowid);
+                    memcpy((void*)fcb, (void*)from, _flow_state_size_full);
+                    fcb->fcb_idx = flowid;
+                    if constexpr (State::need_fid()) {
+                        *get_fcb_flowid(fcb) = flowid;
+                    }
+                    group_link(m, fcb, flowid);
+                    if (_timeout_epochs)
+                        state._timer_wheel.schedule_after(fcb, _timeout_epochs, setter);
+                    m.migrated_in++;
+                }
+                CLICK_ALIGNED_FREE(c, sizeof(FlowMigrationChunk) + migration_chunk * _flow_state_size_full);
+            }
+        }
+    }
+
     #define FCB_DATA(fcb, offset) (((uint8_t *)(fcb->data_32)) + (offset))
 
     static inline uint32_t *get_fcb_flowid(FlowControlBlock *fcb) {
@@ -437,10 +962,10 @@ protected:
     };
 
     /**
-     * Returns the location of the IPFlow5ID in the FCB
+     * Returns the location of the key in the FCB
      */
-    static inline IPFlow5ID *get_fcb_key(FlowControlBlock *fcb) {
-        return (IPFlow5ID *)FCB_DATA(fcb, (State::need_fid()? sizeof(uint32_t) : 0 ));
+    static inline K *get_fcb_key(FlowControlBlock *fcb) {
+        return (K *)FCB_DATA(fcb, (State::need_fid()? sizeof(uint32_t) : 0 ));
     };
 
     inline FlowControlBlock* get_fcb_from_flowid(int i) {
@@ -449,11 +974,46 @@ protected:
     }
 
 
+    /**
+     * Returns the location of the migration group in the FCB
+     */
+    static inline uint32_t *get_fcb_group(FlowControlBlock *fcb) {
+        return (uint32_t *)FCB_DATA(fcb, (State::need_fid()? sizeof(uint32_t) : 0 ) + sizeof(K));
+    };
+
+    /**
+     * Returns the previous and next flow IDs of the list of the group of
+     * the FCB, 0 ending the list. Only with flow IDs.
+     */
+    static inline uint32_t *get_fcb_group_links(FlowControlBlock *fcb) {
+        return (uint32_t *)FCB_DATA(fcb, sizeof(uint32_t) + sizeof(K) + sizeof(uint32_t));
+    };
+
+    inline void group_link(FlowMigrationCore &m, FlowControlBlock *fcb, uint32_t id) {
+        uint32_t *l = get_fcb_group_links(fcb);
+        uint32_t &head = m.members[*get_fcb_group(fcb)];
+        l[0] = 0;
+        l[1] = head;
+        if (head)
+            get_fcb_group_links(get_fcb_from_flowid(head))[0] = id;
+        head = id;
+    }
+
+    inline void group_unlink(FlowMigrationCore &m, FlowControlBlock *fcb) {
+        uint32_t *l = get_fcb_group_links(fcb);
+        if (l[0])
+            get_fcb_group_links(get_fcb_from_flowid(l[0]))[1] = l[1];
+        else
+            m.members[*get_fcb_group(fcb)] = l[1];
+        if (l[1])
+            get_fcb_group_links(get_fcb_from_flowid(l[1]))[0] = l[0];
+    }
+
     inline static const int reserve_size() {
         if constexpr (State::need_fid()) {
-             return sizeof(uint32_t) + sizeof(IPFlow5ID) + sizeof(FlowControlBlock*);
+             return sizeof(uint32_t) + sizeof(K) + sizeof(uint32_t) + 2 * sizeof(uint32_t) + sizeof(FlowControlBlock*);
         } else {
-             return sizeof(IPFlow5ID) + sizeof(FlowControlBlock*);
+             return sizeof(K) + sizeof(uint32_t) + sizeof(FlowControlBlock*);
         }
        
     }
@@ -476,9 +1036,86 @@ protected:
         h_capacity,
         h_total_capacity,
         h_failed_searches,
-        h_successful_searches
+        h_successful_searches,
+        h_lookups,
+        h_hits,
+        h_inserts,
+        h_insert_failures,
+        h_table_full,
+        h_evictions,
+        h_wheel_backlog,
+        h_stats,
+        h_migrated,
+        h_migration_lost,
+        h_migration_drops,
+        h_migrate
     };
 
+    FlowTableStats total_stats() {
+        FlowTableStats s;
+        for (int i = 0; i < _tables.weight(); i++)
+            s.add(_tables.get_value(i).stats);
+        return s;
+    }
+
+    /**
+     * Counters of each core, as JSON if available
+     */
+    String unparse_stats() {
+#if HAVE_JSON
+        Json jcores = Json::make_array();
+        for (int i = 0; i < _tables.weight(); i++) {
+            State &t = _tables.get_value(i);
+            FlowTableStats &s = t.stats;
+            Json jbacklog = Json::make_array();
+            for (int b = 0; b < FlowTableStats::backlog_buckets; b++)
+                jbacklog.push_back(s.wheel_backlog[b]);
+            Json jc = Json::make_object();
+            jc.set("core", _tables.get_mapping(i));
+            if constexpr (State::need_fid())
+                jc.set("used_ids", _capacity - t.flows_stack_i);
+            jc.set("lookups", s.lookups());
+            jc.set("hits", s.hits);
+            jc.set("inserts", s.inserts);
+            jc.set("insert_failures", s.insert_failures);
+            jc.set("table_full", s.table_full);
+            jc.set("evictions", s.evictions);
+            jc.set("wheel_backlog", std::move(jbacklog));
+            jcores.push_back(std::move(jc));
+        }
+        Json j = Json::make_object();
+        j.set("capacity", _capacity);
+        j.set("cores", std::move(jcores));
+        return j.unparse();
+#else
+        StringAccum acc;
+        for (int i = 0; i < _tables.weight(); i++) {
+            State &t = _tables.get_value(i);
+            FlowTableStats &s = t.stats;
+            acc << "core " << _tables.get_mapping(i);
+            if constexpr (State::need_fid())
+                acc << " used_ids " << (_capacity - t.flows_stack_i);
+            acc << " lookups " << s.lookups() << " hits " << s.hits
+                << " inserts " << s.inserts << " insert_failures " << s.insert_failures
+                << " table_full " << s.table_full << " evictions " << s.evictions
+                << " wheel_backlog";
+            for (int b = 0; b < FlowTableStats::backlog_buckets; b++)
+                acc << " " << s.wheel_backlog[b];
+            acc << "\n";
+        }
+        return acc.take_string();
+#endif
+    }
+
+    static uint64_t sum_migration(T *f, uint64_t FlowMigrationCore::*field) {
+        uint64_t total = 0;
+        if (!f->_groups)
+            return 0;
+        for (int i = 0; i < f->_tables.weight(); i++)
+            total += f->_tables.get_value(i).migration->*field;
+        return total;
+    }
+
     static String read_handler(Element *e, void *thunk) {
         T *f = static_cast<T *>(e);
 
@@ -497,26 +1134,71 @@ protected:
             return String(f->_capacity);
 
         case h_failed_searches: {
-            int total = 0;
-            for (int i = 0; i < f->_tables.weight(); i++) {
-                total += (f->_tables.get_value(i)._failed_searches);
-            }
-            return String(total);    
+            FlowTableStats s = f->total_stats();
+            return String(s.lookups() - s.hits);
         }
-
-        case h_successful_searches: {
-            int total = 0;
-            for (int i = 0; i < f->_tables.weight(); i++) {
-                total += (f->_tables.get_value(i)._successful_searches);
-            }
-            return String(total);
+        case h_successful_searches:
+        case h_hits:
+            return String(f->total_stats().hits);
+        case h_lookups:
+            return String(f->total_stats().lookups());
+        case h_inserts:
+            return String(f->total_stats().inserts);
+        case h_insert_failures:
+            return String(f->total_stats().insert_failures);
+        case h_table_full:
+            return String(f->total_stats().table_full);
+        case h_evictions:
+            return String(f->total_stats().evictions);
+        case h_wheel_backlog: {
+            FlowTableStats s = f->total_stats();
+            StringAccum acc;
+            for (int i = 0; i < FlowTableStats::backlog_buckets; i++)
+                acc << (i ? " " : "") << s.wheel_backlog[i];
+            return acc.take_string();
         }
+        case h_stats:
+            return f->unparse_stats();
+
+        case h_migrated:
+            return String(sum_migration(f, &FlowMigrationCore::migrated_in));
+        case h_migration_lost:
+            return String(sum_migration(f, &FlowMigrationCore::lost));
+        case h_migration_drops:
+            return String(sum_migration(f, &FlowMigrationCore::drops));
 
         default:
             return "<error>";
         }
     }
 
+    static int write_handler(const String &s, Element *e, void *thunk, ErrorHandler *errh) {
+        T *f = static_cast<T *>(e);
+        int group, dest;
+        if (!f->_groups)
+            return errh->error("GROUPS is not set");
+        if (Args(f, errh).push_back_words(s)
+                .read_mp("GROUP", group)
+                .read_mp("CORE", dest)
+                .complete() < 0)
+            return -1;
+        if (group < 0 || (uint32_t)group >= f->_groups)
+            return errh->error("Bad group %d", group);
+        if (dest < 0 || dest >= click_max_cpu_ids() || !f->_tables.get_value_for_thread(dest).migration)
+            return errh->error("Core %d does not pass through %p{element}", dest, f);
+        int from = __atomic_load_n(&f->_group_owner[group], __ATOMIC_ACQUIRE);
+        if (from < 0) {
+            //No core saw the group yet
+            __atomic_store_n(&f->_group_owner[group], dest, __ATOMIC_RELEASE);
+            return 0;
+        }
+        if (from == dest)
+            return 0;
+        f->migration_request(from, {{group, dest}});
+        f->migration_arm(from, 0);
+        return 0;
+    }
+
     void add_handlers() {
         add_read_handler("count", read_handler, h_count);
         add_read_handler("count_fids", read_handler, h_count_fids);
@@ -524,6 +1206,18 @@ protected:
         add_read_handler("total_capacity", read_handler, h_total_capacity);
         add_read_handler("failed_searches", read_handler, h_failed_searches);
         add_read_handler("successful_searches", read_handler, h_successful_searches);
+        add_read_handler("lookups", read_handler, h_lookups);
+        add_read_handler("hits", read_handler, h_hits);
+        add_read_handler("inserts", read_handler, h_inserts);
+        add_read_handler("insert_failures", read_handler, h_insert_failures);
+        add_read_handler("table_full", read_handler, h_table_full);
+        add_read_handler("evictions", read_handler, h_evictions);
+        add_read_handler("wheel_backlog", read_handler, h_wheel_backlog);
+        add_read_handler("stats", read_handler, h_stats);
+        add_read_handler("migrated", read_handler, h_migrated);
+        add_read_handler("migration_lost", read_handler, h_migration_lost);
+        add_read_handler("migration_drops", read_handler, h_migration_drops);
+        add_write_handler("migrate", write_handler, h_migrate);
     }
 
     per_thread_oread<State> _tables;
@@ -537,6 +1231,9 @@ protected:
     uint32_t _timeout_ms;          // Timeout for deletion
     uint32_t _epochs_per_sec;      // Granularity for the epoch
     uint16_t _recycle_interval_ms; // When to run the maintainer
+    uint32_t _groups;              // Number of migration groups, 0 if disabled
+    int *_group_owner;             // Core owning each group, -1 if none yet
+    int *_group_dest;              // Last requested destination of each group
     const bool have_maintainer = true;
 };
 
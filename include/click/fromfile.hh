@@ -44,8 +44,14 @@ class FromFile { public:
     String get_string(size_t, ErrorHandler* = 0);
     Packet* get_packet(size_t, uint32_t sec, uint32_t subsec, ErrorHandler *);
     Packet* get_packet_from_data(const void *buf, size_t buf_size, size_t full_size, uint32_t sec, uint32_t subsec, ErrorHandler *);
+    inline const uint8_t* peek(size_t size) const;
     void shift_pos(int delta)		{ _pos += delta; }
 
+#ifdef ALLOW_MMAP
+    bool zerocopy() const		{ return _zerocopy; }
+    inline void set_zerocopy(bool zerocopy);
+#endif
+
     int read_line(String &str, ErrorHandler *errh, bool temporary = false);
     int peek_line(String &str, ErrorHandler *errh, bool temporary = false);
 
@@ -73,6 +79,9 @@ class FromFile { public:
 
 #ifdef ALLOW_MMAP
     bool _mmap;
+    bool _zerocopy;
+    uint8_t *_zerocopy_map;
+    size_t _zerocopy_len;
 #endif
 
 #ifdef ALLOW_MMAP
@@ -89,6 +98,7 @@ class FromFile { public:
 
 #ifdef ALLOW_MMAP
     int read_buffer_mmap(ErrorHandler *);
+    int read_buffer_zerocopy(size_t, ErrorHandler *);
 #endif
     int read_buffer(ErrorHandler *);
     bool read_packet(ErrorHandler *);
@@ -101,5 +111,28 @@ class FromFile { public:
 
 };
 
+/** @brief Return a pointer to the next @a size bytes without consuming them,
+ * or null if they are not in the current buffer. */
+inline const uint8_t *
+FromFile::peek(size_t size) const
+{
+    return _pos + size <= _len ? _buffer + _pos : 0;
+}
+
+#ifdef ALLOW_MMAP
+/** @brief Map the whole file at once and build packets directly over the
+ * mapping, without copy nor reference to a shared buffer packet.
+ *
+ * The mapping is private and writable, so packets can be modified, and it is
+ * only released by cleanup(). Implies MMAP. */
+inline void
+FromFile::set_zerocopy(bool zerocopy)
+{
+    _zerocopy = zerocopy;
+    if (zerocopy)
+	_mmap = true;
+}
+#endif
+
 CLICK_ENDDECLS
 #endif
@@ -246,5 +246,51 @@ operator!=(const IP6FlowID &a, const IP6FlowID &b)
   return !(a == b);
 }
 
+/** @class IP6Flow5ID
+ * @brief An IP6FlowID qualified by the transport protocol.
+ *
+ * Like IP6FlowID, IPv4 packets are represented using IPv4-mapped addresses,
+ * so a single key type covers dual-stack traffic. */
+class IP6Flow5ID : public IP6FlowID { public:
+
+  /** @brief Construct a flow ID from @a p's ip/ip6_header() and udp_header().
+   *
+   * The protocol is the next header field of the IPv6 header, extension
+   * headers are not followed. @sa IP6FlowID(const Packet *, bool) */
+  explicit IP6Flow5ID(const Packet *p, bool reverse = false);
+
+  inline IP6Flow5ID() : IP6FlowID(), _proto(0) {
+  }
+
+  uint8_t proto() const			{ return _proto; }
+
+  inline hashcode_t hashcode() const;
+
+  String unparse() const;
+
+ protected:
+
+  uint8_t _proto;
+
+};
+
+inline hashcode_t IP6Flow5ID::hashcode() const
+{
+  return IP6FlowID::hashcode() ^ ((hashcode_t)_proto << 24);
+}
+
+inline bool
+operator==(const IP6Flow5ID &a, const IP6Flow5ID &b)
+{
+  return a.dport() == b.dport() && a.sport() == b.sport()
+    && a.daddr() == b.daddr() && a.saddr() == b.saddr() && a.proto() == b.proto();
+}
+
+inline bool
+operator!=(const IP6Flow5ID &a, const IP6Flow5ID &b)
+{
+  return !(a == b);
+}
+
 CLICK_ENDDECLS
 #endif
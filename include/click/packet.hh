@@ -39,8 +39,6 @@ struct click_udp;
 
 CLICK_DECLS
 
-//#define HAVE_VECTOR_PACKET_POOL 1
-
 #if HAVE_BATCH && HAVE_CLICK_PACKET_POOL
 #define HAVE_BATCH_RECYCLE 1
 #endif
@@ -888,6 +886,11 @@ class Packet { public:
 protected:
 #ifndef CLICK_NOINDIRECT
     atomic_uint32_t _use_count;
+#endif
+#if HAVE_CLICK_PACKET_POOL
+    uint8_t _pool_node; /* NUMA node of the pool that allocated the buffer */
+#endif
+#ifndef CLICK_NOINDIRECT
     Packet *_data_packet;
 #endif
 private:
@@ -945,26 +948,33 @@ private:
 };
 
 #if HAVE_CLICK_PACKET_POOL
+# define CLICK_PACKET_POOL_MAX_NODES    8
+# define CLICK_PACKET_POOL_REMOTE_BATCH 64
     struct PacketPool {
 
         PacketPool() :
-#if HAVE_VECTOR_PACKET_POOL
-            p(), pd()
-#else
-            p(0), pcount(0), pd(0), pdcount(0)
-#endif
+            p(0), pcount(0), pd(0), pdcount(0), node(0),
+            hits(0), allocs(0), refills(0), spills(0), frees(0), remote_frees(0)
+    #  if HAVE_MULTITHREAD
+            , remote(), remote_count(), thread_pool_next(0)
+    #  endif
         {
         }
-#if HAVE_VECTOR_PACKET_POOL
-        Stack<Packet*> p;
-        Stack<Packet*> pd;
-#else
         WritablePacket* p;          // free packets, linked by p->next()
         unsigned pcount;            // # packets in `p` list
         WritablePacket* pd;             // free data buffers, linked by pd->next
         unsigned pdcount;           // # buffers in `pd` list
-#endif
+        int node;                   // NUMA node of the thread
+
+        uint64_t hits;              // allocations served by this pool
+        uint64_t allocs;            // allocations from the system
+        uint64_t refills;           // lists taken from the global pool
+        uint64_t spills;            // lists given to the global pool
+        uint64_t frees;             // packets freed as the global pool was full
+        uint64_t remote_frees;      // buffers of other nodes recycled here
     #  if HAVE_MULTITHREAD
+        WritablePacket* remote[CLICK_PACKET_POOL_MAX_NODES]; // buffers to send back to their node
+        unsigned remote_count[CLICK_PACKET_POOL_MAX_NODES];
         PacketPool* thread_pool_next; // link to next per-thread pool
     #  endif
     };
@@ -1006,6 +1016,10 @@ class WritablePacket : public Packet { public:
 # if HAVE_CLICK_PACKET_POOL
     static PacketPool& get_local_packet_pool();
     static void initialize_local_packet_pool();
+    static PacketPool* packet_pools();
+    static void set_pool_size(unsigned packets, unsigned data);
+    static unsigned pool_size();
+    static unsigned data_pool_size();
 # endif
 
     static void pool_transfer(int from, int to);
@@ -1060,6 +1074,7 @@ class WritablePacket : public Packet { public:
     static WritablePacket *pool_allocate(uint32_t headroom, uint32_t length,
 					 uint32_t tailroom, bool clear =true);
 
+    static WritablePacket *pool_new_data(PacketPool &packet_pool);
     static void check_data_pool_size(PacketPool &packet_pool, unsigned n);
     static void check_packet_pool_size(PacketPool &packet_pool, unsigned n);
     static bool is_from_data_pool(WritablePacket *p);
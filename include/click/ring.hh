@@ -4,8 +4,8 @@
 
 #include <click/atomic.hh>
 #include <click/sync.hh>
+#include <click/algorithm.hh>
 #if HAVE_DPDK
-# include <click/algorithm.hh>
 # include <rte_ring.h>
 # include <rte_errno.h>
 # include <click/dpdk_glue.hh>
@@ -163,6 +163,66 @@ public:
 template <typename T>
 using DynamicRing = SPSCDynamicRing<T>;
 
+/**
+ * Lock-free single-producer single-consumer ring with size set at
+ * initialization time
+ *
+ * Unlike SPSCDynamicRing, the indexes are published with release/acquire
+ * ordering so the producer and the consumer may run on different cores.
+ * Each index is only written by one side and lives in its own cache line.
+ */
+template <typename T> class SPSCLockFreeRing {
+    uint32_t _mask;
+    T* ring;
+    uint32_t head CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+    uint32_t tail CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+
+public:
+    SPSCLockFreeRing() : _mask(0), ring(0), head(0), tail(0) {
+        static_assert(std::is_pointer<T>(), "SPSCLockFreeRing can only be used with pointers");
+    }
+
+    ~SPSCLockFreeRing() {
+        if (ring)
+            delete[] ring;
+    }
+
+    /**
+     * Allocate space for at least @a size elements
+     */
+    inline void initialize(int size, const char* = 0) {
+        assert(!ring);
+        _mask = next_pow2(size) - 1;
+        ring = new T[_mask + 1];
+    }
+
+    inline bool insert(T o) {
+        uint32_t h = head;
+        if (h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) > _mask)
+            return false;
+        ring[h & _mask] = o;
+        __atomic_store_n(&head, h + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    inline T extract() {
+        uint32_t t = tail;
+        if (t == __atomic_load_n(&head, __ATOMIC_ACQUIRE))
+            return 0;
+        T o = ring[t & _mask];
+        __atomic_store_n(&tail, t + 1, __ATOMIC_RELEASE);
+        return o;
+    }
+
+    inline unsigned int count() {
+        return __atomic_load_n(&head, __ATOMIC_ACQUIRE) - __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+    }
+
+    inline bool is_empty() {
+        return count() == 0;
+    }
+};
+
 #if HAVE_DPDK
 /**
  * Ring with size set at initialization time
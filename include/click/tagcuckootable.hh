@@ -0,0 +1,307 @@
+#ifndef CLICK_TAGCUCKOOTABLE_HH
+#define CLICK_TAGCUCKOOTABLE_HH 1
+#include <click/glue.hh>
+#include <click/hashcode.hh>
+#if defined(__SSE2__) && !CLICK_LINUXMODULE
+# include <emmintrin.h>
+# define TAGCUCKOO_SIMD 1
+#endif
+
+CLICK_DECLS
+
+/** @class TagCuckooTable
+ * @brief Single-threaded bucketized cuckoo hash table with 16-bit tags.
+ *
+ * Maps keys of type K to 32-bit values. Each bucket holds SLOTS entries and
+ * starts with the 16-bit tags of its entries, so a whole bucket is matched
+ * against a tag with a single SIMD comparison. The key is only compared for
+ * slots whose tag matched. Keys live in a separate array so a bucket of tags
+ * and values fills exactly one cache line.
+ *
+ * The alternate bucket of an entry is computed from its current bucket and
+ * its tag (partial-key cuckoo hashing), so displacement never rehashes keys.
+ *
+ * K must provide hashcode() and operator==. The table is meant to be
+ * instantiated per thread, no synchronization is done.
+ */
+template <typename K, int SLOTS = 8>
+class TagCuckooTable { public:
+
+    static_assert(SLOTS == 8, "TagCuckooTable buckets are matched as 8 x 16-bit lanes");
+
+    enum { max_kicks = 128 };
+
+    struct Bucket {
+        uint16_t tags[SLOTS];
+        uint32_t values[SLOTS];
+    } CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+
+    TagCuckooTable() : _buckets(0), _keys(0), _mask(0), _count(0) {
+    }
+
+    TagCuckooTable(const TagCuckooTable &) = delete;
+    TagCuckooTable &operator=(const TagCuckooTable &) = delete;
+
+    ~TagCuckooTable() {
+        destroy();
+    }
+
+    /**
+     * Allocate the table for at least @a capacity entries. The number of
+     * buckets is chosen so the table is at most half full at capacity.
+     * @return 0 on success, -1 on allocation failure
+     */
+    int initialize(uint32_t capacity) {
+        destroy();
+        uint32_t n = next_pow2((capacity * 2 + SLOTS - 1) / SLOTS);
+        if (n < 2)
+            n = 2;
+        _buckets = (Bucket*)CLICK_ALIGNED_ALLOC(sizeof(Bucket) * n);
+        _keys = (K*)CLICK_ALIGNED_ALLOC(sizeof(K) * n * SLOTS);
+        if (!_buckets || !_keys) {
+            destroy();
+            return -1;
+        }
+        bzero(_buckets, sizeof(Bucket) * n);
+        bzero((void*)_keys, sizeof(K) * n * SLOTS);
+        _mask = n - 1;
+        _count = 0;
+        return 0;
+    }
+
+    void destroy() {
+        if (_buckets)
+            CLICK_ALIGNED_FREE(_buckets, sizeof(Bucket) * (_mask + 1));
+        if (_keys)
+            CLICK_ALIGNED_FREE(_keys, sizeof(K) * (_mask + 1) * SLOTS);
+        _buckets = 0;
+        _keys = 0;
+        _mask = 0;
+        _count = 0;
+    }
+
+    /**
+     * Hash a key. The result is given to the *_hashed functions, which
+     * allows to hash a whole burst before touching the table.
+     */
+    static inline uint32_t hash(const K &key) {
+        //Finalizer of murmur3, spreads the bits of the key's hashcode
+        uint32_t h = (uint32_t)hashcode(key);
+        h ^= h >> 16;
+        h *= 0x85ebca6b;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35;
+        h ^= h >> 16;
+        return h;
+    }
+
+    /**
+     * Prefetch both candidate buckets of a hashed key.
+     */
+    inline void prefetch(uint32_t h) const {
+        uint16_t t = tag_of(h);
+        uint32_t b = h & _mask;
+        __builtin_prefetch(&_buckets[b]);
+        __builtin_prefetch(&_buckets[alt_bucket(b, t)]);
+    }
+
+    /**
+     * Prefetch the keys that may match a hashed key in its primary bucket.
+     * Useful as a second pipeline stage, once the buckets are in cache.
+     */
+    inline void prefetch_keys(uint32_t h) const {
+        uint32_t b = h & _mask;
+        unsigned m = match(b, tag_of(h));
+        if (m)
+            __builtin_prefetch(&_keys[b * SLOTS + first_lane(m)]);
+    }
+
+    /**
+     * @return the value associated with @a key, or -1 if it is not found
+     */
+    inline int find_hashed(const K &key, uint32_t h) const {
+        uint16_t t = tag_of(h);
+        uint32_t b = h & _mask;
+        int v = find_in(b, t, key);
+        if (v >= 0)
+            return v;
+        return find_in(alt_bucket(b, t), t, key);
+    }
+
+    inline int find(const K &key) const {
+        return find_hashed(key, hash(key));
+    }
+
+    /**
+     * Insert @a key, that must not be already in the table.
+     * @return 0 on success, -1 if the table is too full
+     */
+    int insert_hashed(const K &key, uint32_t h, uint32_t value) {
+        uint16_t t = tag_of(h);
+        uint32_t b = h & _mask;
+        int s = free_slot(b);
+        if (s < 0) {
+            b = alt_bucket(b, t);
+            s = free_slot(b);
+        }
+        if (s >= 0) {
+            set(b, s, t, value, key);
+            _count++;
+            return 0;
+        }
+
+        //Both buckets are full, kick entries to their alternate bucket
+        struct { uint32_t b; int s; } path[max_kicks];
+        uint16_t ct = t;
+        uint32_t cv = value;
+        K ck = key;
+        for (int n = 0; n < max_kicks; n++) {
+            s = (ct + n) & (SLOTS - 1);
+            path[n].b = b;
+            path[n].s = s;
+            swap_slot(b, s, ct, cv, ck);
+            b = alt_bucket(b, ct);
+            int f = free_slot(b);
+            if (f >= 0) {
+                set(b, f, ct, cv, ck);
+                _count++;
+                return 0;
+            }
+        }
+
+        //Undo the walk so no entry is lost
+        for (int n = max_kicks - 1; n >= 0; n--)
+            swap_slot(path[n].b, path[n].s, ct, cv, ck);
+        return -1;
+    }
+
+    inline int insert(const K &key, uint32_t value) {
+        return insert_hashed(key, hash(key), value);
+    }
+
+    /**
+     * @return 0 if @a key was removed, -1 if it was not found
+     */
+    int remove_hashed(const K &key, uint32_t h) {
+        uint16_t t = tag_of(h);
+        uint32_t b = h & _mask;
+        if (remove_in(b, t, key) == 0 || remove_in(alt_bucket(b, t), t, key) == 0) {
+            _count--;
+            return 0;
+        }
+        return -1;
+    }
+
+    inline int remove(const K &key) {
+        return remove_hashed(key, hash(key));
+    }
+
+    inline uint32_t count() const {
+        return _count;
+    }
+
+    inline uint32_t buckets() const {
+        return _mask + 1;
+    }
+
+    inline size_t memory() const {
+        return (_mask + 1) * (sizeof(Bucket) + sizeof(K) * SLOTS);
+    }
+
+  private:
+
+    Bucket *_buckets;
+    K *_keys;
+    uint32_t _mask;
+    uint32_t _count;
+
+    static inline uint16_t tag_of(uint32_t h) {
+        uint16_t t = h >> 16;
+        return t ? t : 1;
+    }
+
+    inline uint32_t alt_bucket(uint32_t b, uint16_t t) const {
+        return (b ^ (t * 0x5bd1e995)) & _mask;
+    }
+
+    static inline int first_lane(unsigned m) {
+#if TAGCUCKOO_SIMD
+        return __builtin_ctz(m) >> 1;
+#else
+        return __builtin_ctz(m);
+#endif
+    }
+
+    static inline unsigned clear_lane(unsigned m, int i) {
+#if TAGCUCKOO_SIMD
+        return m & ~(3U << (i * 2));
+#else
+        return m & ~(1U << i);
+#endif
+    }
+
+    /**
+     * Mask of the slots of bucket @a b whose tag is @a t. With SIMD, each
+     * slot is represented by two bits.
+     */
+    inline unsigned match(uint32_t b, uint16_t t) const {
+#if TAGCUCKOO_SIMD
+        __m128i tags = _mm_load_si128((const __m128i*)_buckets[b].tags);
+        return _mm_movemask_epi8(_mm_cmpeq_epi16(tags, _mm_set1_epi16(t)));
+#else
+        unsigned m = 0;
+        for (int i = 0; i < SLOTS; i++)
+            if (_buckets[b].tags[i] == t)
+                m |= 1U << i;
+        return m;
+#endif
+    }
+
+    inline int find_in(uint32_t b, uint16_t t, const K &key) const {
+        unsigned m = match(b, t);
+        while (m) {
+            int i = first_lane(m);
+            if (likely(_keys[b * SLOTS + i] == key))
+                return _buckets[b].values[i];
+            m = clear_lane(m, i);
+        }
+        return -1;
+    }
+
+    inline int remove_in(uint32_t b, uint16_t t, const K &key) {
+        unsigned m = match(b, t);
+        while (m) {
+            int i = first_lane(m);
+            if (_keys[b * SLOTS + i] == key) {
+                _buckets[b].tags[i] = 0;
+                return 0;
+            }
+            m = clear_lane(m, i);
+        }
+        return -1;
+    }
+
+    inline int free_slot(uint32_t b) const {
+        unsigned m = match(b, 0);
+        return m ? first_lane(m) : -1;
+    }
+
+    inline void set(uint32_t b, int s, uint16_t t, uint32_t v, const K &key) {
+        _buckets[b].tags[s] = t;
+        _buckets[b].values[s] = v;
+        _keys[b * SLOTS + s] = key;
+    }
+
+    inline void swap_slot(uint32_t b, int s, uint16_t &t, uint32_t &v, K &key) {
+        uint16_t ot = _buckets[b].tags[s];
+        uint32_t ov = _buckets[b].values[s];
+        K ok = _keys[b * SLOTS + s];
+        set(b, s, t, v, key);
+        t = ot;
+        v = ov;
+        key = ok;
+    }
+};
+
+CLICK_ENDDECLS
+#endif
@@ -5,6 +5,15 @@
 
 CLICK_DECLS
 
+/**
+ * Single-level timer wheel of intrusive lists. The links are handled by the
+ * caller: schedule_after() calls setter(obj, head) so obj links to the
+ * previous head of its bucket, and run_timers() calls expire(obj) on each
+ * object of the current bucket, which returns the next one.
+ *
+ * The wheel has one bucket per epoch of the maximal timeout, so for long
+ * timeouts with small epochs, prefer HierarchicalTimerWheel.
+ */
 template <typename T>
 class TimerWheel {
     public:
@@ -21,7 +30,8 @@ class TimerWheel {
          * Schedule @a obj for deletion in @a timeout epochs.
          * @pre timeout > 0 and <= max given epochs at initialization
          */
-        inline void schedule_after(T* obj, uint32_t timeout, const std::function<void(T*,T*)> setter) {
+        template <typename Setter>
+        inline void schedule_after(T* obj, uint32_t timeout, Setter setter) {
             assert(timeout > 0); //Likely a bug
             assert(timeout < _mask);
             unsigned id = ((*(volatile uint32_t*)&_index) + timeout) & _mask;
@@ -33,7 +43,8 @@ class TimerWheel {
             _buckets.unchecked_at(id) = obj;
         }
 
-        inline void schedule_after_mp(T* obj, uint32_t timeout, const std::function<void(T*,T*)> setter) {
+        template <typename Setter>
+        inline void schedule_after_mp(T* obj, uint32_t timeout, Setter setter) {
             _writers_lock.acquire();
             unsigned id = ((*(volatile uint32_t*)&_index) + timeout) & _mask;
 
@@ -48,7 +59,8 @@ class TimerWheel {
         /**
          * Must be called by one thread only!
          */
-        inline void run_timers(std::function<T*(T*)> expire) {
+        template <typename Expire>
+        inline void run_timers(Expire expire) {
             T* f = _buckets.unchecked_at((_index) & _mask);
             //click_chatter("Expire %d -> %d (_mask %d)", _index, _index & _mask, _mask);
             while (f != 0) {
@@ -58,7 +70,8 @@ class TimerWheel {
             _index++;
         }
 
-        bool debug_find(T*obj, std::function<T*(T*)> next ) {
+        template <typename Next>
+        bool debug_find(T*obj, Next next) {
             int id = _index;
             for (int i =0; i <= _mask; i++) {
                 T* a = _buckets[(id + i) & _mask];
@@ -78,5 +91,99 @@ class TimerWheel {
         Spinlock _writers_lock;
 };
 
+/**
+ * Hierarchical timer wheel of intrusive lists, with the same interface as
+ * TimerWheel but a constant memory footprint: LEVELS wheels of 2^BITS
+ * buckets cover timeouts up to 2^(LEVELS*BITS) epochs.
+ *
+ * An object is put in the level of the most significant digit of its
+ * expiry epoch that differs from the current epoch. The buckets of upper
+ * levels are not cascaded down eagerly: when the wheel reaches a bucket of
+ * level L, its objects are given to expire() up to 2^(L*BITS) - 1 epochs
+ * before their deadline. expire() must therefore check the actual deadline
+ * of the object and reschedule it with the remaining time, which will land
+ * in a lower level. Each object is thus seen at most LEVELS times, and a
+ * call to run_timers() costs O(objects due).
+ *
+ * The setter and expire functors are template parameters, so they are
+ * inlined. Like TimerWheel, only one thread may use the wheel.
+ */
+template <typename T, int LEVELS = 4, int BITS = 8>
+class HierarchicalTimerWheel {
+    public:
+        static_assert(LEVELS * BITS <= 32, "epochs are 32-bit");
+
+        enum { slots = 1 << BITS, slot_mask = slots - 1 };
+
+        HierarchicalTimerWheel() : _index(0) {
+            memset(_buckets, 0, sizeof(_buckets));
+        }
+
+        /**
+         * Check that timeouts up to @a max epochs can be handled. No memory
+         * is allocated.
+         */
+        void initialize(uint32_t max) {
+            assert((uint64_t) max < ((uint64_t) 1 << (LEVELS * BITS)));
+            (void)max;
+        }
+
+        /**
+         * Schedule @a obj to be given to the expire function of run_timers()
+         * in @a timeout epochs, or earlier for long timeouts. A timeout of 0
+         * is handled as 1, so that an object rescheduled from expire() is not
+         * put back in the bucket being fired.
+         */
+        template <typename Setter>
+        inline void schedule_after(T* obj, uint32_t timeout, Setter setter) {
+            if (timeout == 0)
+                timeout = 1;
+            uint32_t expires = _index + timeout;
+            int level = level_of(expires ^ _index);
+            T* &head = _buckets[level][(expires >> (level * BITS)) & slot_mask];
+            setter(obj, head);
+            head = obj;
+        }
+
+        /**
+         * Advance of one epoch, giving the due objects to @a expire.
+         */
+        template <typename Expire>
+        inline void run_timers(Expire expire) {
+            fire(0, expire);
+            for (int level = 1; level < LEVELS; level++) {
+                if (_index & ((1U << (level * BITS)) - 1))
+                    break;
+                fire(level, expire);
+            }
+            _index++;
+        }
+
+    private:
+        uint32_t _index;
+        T* _buckets[LEVELS][slots];
+
+        static inline int level_of(uint32_t diff) {
+            if (!diff)
+                return 0;
+            int level = (31 - __builtin_clz(diff)) / BITS;
+            return level < LEVELS ? level : LEVELS - 1;
+        }
+
+        /**
+         * Detach the current bucket of @a level before calling expire, as
+         * objects may be rescheduled in a bucket of a lower level.
+         */
+        template <typename Expire>
+        inline void fire(int level, Expire &expire) {
+            T* &head = _buckets[level][(_index >> (level * BITS)) & slot_mask];
+            T* f = head;
+            head = 0;
+            while (f != 0) {
+                f = expire(f);
+            }
+        }
+};
+
 CLICK_ENDDECLS
 #endif
@@ -0,0 +1,332 @@
+// -*- c-basic-offset: 4; related-file-name: "../include/click/classifierjit.hh" -*-
+/*
+ * classifierjit.{cc,hh} -- compile classifier decision trees with LLVM
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/classifierjit.hh>
+#include <click/error.hh>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <map>
+#include <mutex>
+#include <string>
+
+#if LLVM_VERSION_MAJOR < 14
+# error "the classifier JIT needs LLVM 14 or later"
+#endif
+
+CLICK_DECLS
+
+namespace {
+
+// A single JIT is shared by all classifiers. It is never destroyed, as
+// elements may release their code during static destruction.
+std::mutex jit_lock;
+llvm::orc::LLJIT *jit_instance;
+unsigned jit_serial;
+
+llvm::Expected<llvm::orc::ThreadSafeModule>
+optimize_module(llvm::orc::ThreadSafeModule tsm,
+                const llvm::orc::MaterializationResponsibility &)
+{
+    tsm.withModuleDo([](llvm::Module &m) {
+        llvm::LoopAnalysisManager lam;
+        llvm::FunctionAnalysisManager fam;
+        llvm::CGSCCAnalysisManager cgam;
+        llvm::ModuleAnalysisManager mam;
+        llvm::PassBuilder pb;
+        pb.registerModuleAnalyses(mam);
+        pb.registerCGSCCAnalyses(cgam);
+        pb.registerFunctionAnalyses(fam);
+        pb.registerLoopAnalyses(lam);
+        pb.crossRegisterProxies(lam, fam, cgam, mam);
+        llvm::ModulePassManager mpm =
+            pb.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O2);
+        mpm.run(m, mam);
+    });
+    return std::move(tsm);
+}
+
+// Pointers are opaque from LLVM 17, where typed pointer helpers such as
+// getInt8PtrTy() are deprecated, then removed
+llvm::Type *
+pointer_to(llvm::Type *t)
+{
+#if LLVM_VERSION_MAJOR >= 17
+    return llvm::PointerType::getUnqual(t->getContext());
+#else
+    return t->getPointerTo();
+#endif
+}
+
+// LLJIT::lookup() returns a JITEvaluatedSymbol up to LLVM 14, then an
+// ExecutorAddr
+template <typename S> auto
+symbol_address(const S &sym, int) -> decltype(sym.getValue())
+{
+    return sym.getValue();
+}
+
+template <typename S> auto
+symbol_address(const S &sym, long) -> decltype(sym.getAddress())
+{
+    return sym.getAddress();
+}
+
+llvm::orc::LLJIT *
+get_jit(ErrorHandler *errh)
+{
+    if (jit_instance)
+        return jit_instance;
+
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    auto jtmb = llvm::orc::JITTargetMachineBuilder::detectHost();
+    if (!jtmb) {
+        errh->error("JIT: %s", llvm::toString(jtmb.takeError()).c_str());
+        return 0;
+    }
+#if LLVM_VERSION_MAJOR >= 18
+    jtmb->setCodeGenOptLevel(llvm::CodeGenOptLevel::Aggressive);
+#else
+    jtmb->setCodeGenOptLevel(llvm::CodeGenOpt::Aggressive);
+#endif
+
+    auto jit = llvm::orc::LLJITBuilder()
+        .setJITTargetMachineBuilder(std::move(*jtmb))
+        .create();
+    if (!jit) {
+        errh->error("JIT: %s", llvm::toString(jit.takeError()).c_str());
+        return 0;
+    }
+    (*jit)->getIRTransformLayer().setTransform(optimize_module);
+    jit_instance = jit->release();
+    return jit_instance;
+}
+
+/* Builds the IR of a tree. There are two copies of the tree: the fast one
+ * never checks the packet length, the checked one is used for packets
+ * shorter than the safe length. */
+class TreeBuilder { public:
+
+    TreeBuilder(llvm::LLVMContext &ctx, llvm::Function *f,
+                const Vector<ClassifierJIT::Test> &tests, int nbases)
+        : _ctx(ctx), _f(f), _b(ctx), _tests(tests), _nbases(nbases) {
+    }
+
+    void build(int safe_length);
+
+  private:
+
+    llvm::LLVMContext &_ctx;
+    llvm::Function *_f;
+    llvm::IRBuilder<> _b;
+    const Vector<ClassifierJIT::Test> &_tests;
+    int _nbases;
+    Vector<llvm::Value *> _bases;
+    Vector<llvm::BasicBlock *> _fast;
+    Vector<llvm::BasicBlock *> _checked;
+    std::map<int, llvm::BasicBlock *> _outputs;
+
+    llvm::BasicBlock *target(int j, bool checked);
+    void emit_test(const ClassifierJIT::Test &t, bool checked);
+
+};
+
+llvm::BasicBlock *
+TreeBuilder::target(int j, bool checked)
+{
+    if (j > 0)
+        return checked ? _checked[j] : _fast[j];
+
+    llvm::BasicBlock *&bb = _outputs[-j];
+    if (!bb) {
+        bb = llvm::BasicBlock::Create(_ctx, "output", _f);
+        llvm::IRBuilder<> b(bb);
+        b.CreateRet(b.getInt32(-j));
+    }
+    return bb;
+}
+
+void
+TreeBuilder::emit_test(const ClassifierJIT::Test &t, bool checked)
+{
+    llvm::BasicBlock *yes = target(t.j[1], checked);
+    llvm::BasicBlock *no = target(t.j[0], checked);
+    if (t.mask == 0) {
+        _b.CreateBr(yes);
+        return;
+    }
+    llvm::Value *ptr = _b.CreateConstInBoundsGEP1_64(_b.getInt8Ty(), _bases[t.base], (int64_t) t.offset);
+    ptr = _b.CreateBitCast(ptr, pointer_to(_b.getInt32Ty()));
+    llvm::Value *data = _b.CreateAlignedLoad(_b.getInt32Ty(), ptr, llvm::MaybeAlign(1));
+    data = _b.CreateAnd(data, _b.getInt32(t.mask));
+    _b.CreateCondBr(_b.CreateICmpEQ(data, _b.getInt32(t.value)), yes, no);
+}
+
+void
+TreeBuilder::build(int safe_length)
+{
+    llvm::BasicBlock *entry = llvm::BasicBlock::Create(_ctx, "entry", _f);
+    for (int i = 0; i < _tests.size(); i++)
+        _fast.push_back(llvm::BasicBlock::Create(_ctx, "test", _f));
+    if (safe_length > 0)
+        for (int i = 0; i < _tests.size(); i++)
+            _checked.push_back(llvm::BasicBlock::Create(_ctx, "checked_test", _f));
+
+    llvm::Function::arg_iterator args = _f->arg_begin();
+    llvm::Value *bases = &*args++;
+    llvm::Value *length = &*args++;
+
+    _b.SetInsertPoint(entry);
+    for (int i = 0; i < _nbases; i++)
+        _bases.push_back(_b.CreateLoad(pointer_to(_b.getInt8Ty()), _b.CreateConstInBoundsGEP1_64(pointer_to(_b.getInt8Ty()), bases, i)));
+    if (safe_length > 0)
+        _b.CreateCondBr(_b.CreateICmpSLT(length, _b.getInt32(safe_length)),
+                        _checked[0], _fast[0]);
+    else
+        _b.CreateBr(_fast[0]);
+
+    for (int i = 0; i < _tests.size(); i++) {
+        _b.SetInsertPoint(_fast[i]);
+        emit_test(_tests[i], false);
+    }
+
+    for (int i = 0; i < _checked.size(); i++) {
+        const ClassifierJIT::Test &t = _tests[i];
+        // A test whose mask is empty still needs the byte at its offset.
+        int32_t need = t.offset + 1;
+        if ((int32_t) t.required_length > need)
+            need = t.required_length;
+        llvm::BasicBlock *ok = llvm::BasicBlock::Create(_ctx, "length_ok", _f);
+        _b.SetInsertPoint(_checked[i]);
+        _b.CreateCondBr(_b.CreateICmpSGE(length, _b.getInt32(need)),
+                        ok, target(t.j[t.short_output], true));
+        _b.SetInsertPoint(ok);
+        emit_test(t, true);
+    }
+}
+
+}
+
+ClassifierJIT::ClassifierJIT()
+    : _match(0), _batch(0), _nbases(0)
+{
+}
+
+ClassifierJIT::~ClassifierJIT()
+{
+    std::lock_guard<std::mutex> guard(jit_lock);
+    for (int i = 0; i < _code.size(); i++) {
+        llvm::consumeError(_code[i]->remove());
+        _code[i]->Release();
+    }
+}
+
+int
+ClassifierJIT::compile(const Vector<Test> &tests, int nbases, int safe_length,
+                       ErrorHandler *errh)
+{
+    disable();
+    if (tests.empty() || nbases <= 0)
+        return errh->error("JIT: empty program");
+
+    std::lock_guard<std::mutex> guard(jit_lock);
+    llvm::orc::LLJIT *jit = get_jit(errh);
+    if (!jit)
+        return -1;
+
+    std::string name = "click_classifier_" + std::to_string(++jit_serial);
+    auto ctx = std::make_unique<llvm::LLVMContext>();
+    auto m = std::make_unique<llvm::Module>(name, *ctx);
+    m->setDataLayout(jit->getDataLayout());
+    m->setTargetTriple(jit->getTargetTriple().str());
+
+    llvm::Type *i32 = llvm::Type::getInt32Ty(*ctx);
+    llvm::Type *i32p = pointer_to(i32);
+    llvm::Type *basesp = pointer_to(pointer_to(llvm::Type::getInt8Ty(*ctx)));
+
+    llvm::Function *match = llvm::Function::Create(
+        llvm::FunctionType::get(i32, {basesp, i32}, false),
+        llvm::Function::ExternalLinkage, name, *m);
+    match->addFnAttr(llvm::Attribute::NoUnwind);
+    match->addFnAttr(llvm::Attribute::AlwaysInline);
+    TreeBuilder(*ctx, match, tests, nbases).build(safe_length);
+
+    // for (i = 0; i < n; ++i) outputs[i] = match(bases + i * nbases, lengths[i]);
+    llvm::Function *batch = llvm::Function::Create(
+        llvm::FunctionType::get(llvm::Type::getVoidTy(*ctx), {basesp, i32p, i32p, i32}, false),
+        llvm::Function::ExternalLinkage, name + "_batch", *m);
+    batch->addFnAttr(llvm::Attribute::NoUnwind);
+    {
+        llvm::Function::arg_iterator args = batch->arg_begin();
+        llvm::Value *bases = &*args++;
+        llvm::Value *lengths = &*args++;
+        llvm::Value *outputs = &*args++;
+        llvm::Value *n = &*args++;
+        llvm::BasicBlock *entry = llvm::BasicBlock::Create(*ctx, "entry", batch);
+        llvm::BasicBlock *loop = llvm::BasicBlock::Create(*ctx, "loop", batch);
+        llvm::BasicBlock *done = llvm::BasicBlock::Create(*ctx, "done", batch);
+        llvm::IRBuilder<> b(entry);
+        b.CreateCondBr(b.CreateICmpSGT(n, b.getInt32(0)), loop, done);
+        b.SetInsertPoint(loop);
+        llvm::PHINode *i = b.CreatePHI(i32, 2);
+        i->addIncoming(b.getInt32(0), entry);
+        llvm::Value *pbases = b.CreateInBoundsGEP(pointer_to(b.getInt8Ty()), bases, b.CreateMul(i, b.getInt32(nbases)));
+        llvm::Value *length = b.CreateLoad(i32, b.CreateInBoundsGEP(i32, lengths, i));
+        llvm::Value *output = b.CreateCall(match, {pbases, length});
+        b.CreateStore(output, b.CreateInBoundsGEP(i32, outputs, i));
+        llvm::Value *next = b.CreateAdd(i, b.getInt32(1));
+        i->addIncoming(next, loop);
+        b.CreateCondBr(b.CreateICmpSLT(next, n), loop, done);
+        b.SetInsertPoint(done);
+        b.CreateRetVoid();
+    }
+
+    std::string msg;
+    llvm::raw_string_ostream os(msg);
+    if (llvm::verifyModule(*m, &os))
+        return errh->error("JIT: invalid module: %s", os.str().c_str());
+
+    llvm::orc::ResourceTrackerSP rt = jit->getMainJITDylib().createResourceTracker();
+    if (llvm::Error err = jit->addIRModule(rt, llvm::orc::ThreadSafeModule(std::move(m), std::move(ctx))))
+        return errh->error("JIT: %s", llvm::toString(std::move(err)).c_str());
+    auto match_sym = jit->lookup(name);
+    if (!match_sym) {
+        llvm::consumeError(rt->remove());
+        return errh->error("JIT: %s", llvm::toString(match_sym.takeError()).c_str());
+    }
+    auto batch_sym = jit->lookup(name + "_batch");
+    if (!batch_sym) {
+        llvm::consumeError(rt->remove());
+        return errh->error("JIT: %s", llvm::toString(batch_sym.takeError()).c_str());
+    }
+
+    rt->Retain();
+    _code.push_back(rt.get());
+    _nbases = nbases;
+    _batch = (BatchFunction) symbol_address(*batch_sym, 0);
+    _match = (MatchFunction) symbol_address(*match_sym, 0);
+    return 0;
+}
+
+CLICK_ENDDECLS
@@ -25,6 +25,9 @@
 #include <click/dpdkdevice.hh>
 #include <click/userutils.hh>
 #include <rte_errno.h>
+#if RTE_VERSION >= RTE_VERSION_NUM(18,05,0,0)
+#include <rte_bus_vdev.h>
+#endif
 #include <click/dpdk_glue.hh>
 
 #if CLICK_PACKET_USE_DPDK
@@ -595,6 +598,7 @@ int DPDKDevice::initialize_device(ErrorHandler *errh)
 
     info.mq_mode = (info.mq_mode == (enum rte_eth_rx_mq_mode)-1? ETH_MQ_RX_RSS : info.mq_mode);
     dev_conf.rxmode.mq_mode = info.mq_mode;
+    dev_conf.intr_conf.rxq = info.rx_intr;
 #if RTE_VERSION < RTE_VERSION_NUM(18,8,0,0)
     dev_conf.rxmode.hw_vlan_filter = 0;
 #endif
@@ -1055,6 +1059,11 @@ void DPDKDevice::set_init_fc_mode(FlowControlMode fc) {
     info.init_fc_mode = fc;
 }
 
+void DPDKDevice::set_init_rx_intr(bool rx_intr) {
+    assert(!_is_initialized);
+    info.rx_intr = rx_intr;
+}
+
 void DPDKDevice::set_rx_offload(uint64_t offload) {
     assert(!_is_initialized);
     info.rx_offload |= offload;
@@ -1361,10 +1370,14 @@ DPDKDeviceArg::parse(
     if (!IntArg().parse(str, port_id)) {
 #if RTE_VERSION >= RTE_VERSION_NUM(18,05,0,0)
        uint16_t id;
-       if (rte_eth_dev_get_port_by_name(str.c_str(), &id) != 0)
-           return false;
-       else
+       if (rte_eth_dev_get_port_by_name(str.c_str(), &id) == 0)
            port_id = id;
+       else if (str.starts_with("net_") || str.starts_with("eth_")) {
+           ErrorHandler *errh = ctx.errh() ? ctx.errh() : ErrorHandler::default_handler();
+           if (DPDKDevice::create_vdev(str, port_id, errh) != 0)
+               return false;
+       } else
+           return false;
 #else
        //Try parsing a ffff:ff:ff.f format. Code adapted from EtherAddressArg::parse
         unsigned data[4];
@@ -1421,6 +1434,36 @@ DPDKDeviceArg::parse(
 }
 
 
+#if RTE_VERSION >= RTE_VERSION_NUM(18,05,0,0)
+/**
+ * Create the virtual device described by spec, the name of the device
+ * possibly followed by a comma and its arguments, as for the --vdev EAL
+ * argument. If a device with the same name exists, it is simply returned,
+ * so elements can all give the same spec.
+ */
+int DPDKDevice::create_vdev(const String &spec, portid_t &port_id, ErrorHandler *errh)
+{
+    int comma = spec.find_left(',');
+    String name = comma < 0 ? spec : spec.substring(0, comma);
+    String args = comma < 0 ? String() : spec.substring(comma + 1);
+    uint16_t id;
+
+    if (!dpdk_enabled)
+        return errh->error("Supply the --dpdk argument to use DPDK.");
+    if (rte_eth_dev_get_port_by_name(name.c_str(), &id) != 0) {
+        if (rte_eal_process_type() != RTE_PROC_PRIMARY)
+            return errh->error("Virtual devices can only be created by the primary process");
+        int err = rte_vdev_init(name.c_str(), args.c_str());
+        if (err != 0)
+            return errh->error("Could not create virtual device %s: %s", name.c_str(), rte_strerror(-err));
+        if (rte_eth_dev_get_port_by_name(name.c_str(), &id) != 0)
+            return errh->error("%s is not an ethernet device", name.c_str());
+    }
+    port_id = id;
+    return 0;
+}
+#endif
+
 bool
 FlowControlModeArg::parse(
     const String &str, FlowControlMode &result, const ArgContext &) {
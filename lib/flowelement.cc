@@ -124,7 +124,7 @@ FlowType  FlowElement::getContext(int)
     return FLOW_NONE;
 }
 
-VirtualFlowSpaceElement::VirtualFlowSpaceElement() :_flow_data_offset(-1) {
+VirtualFlowSpaceElement::VirtualFlowSpaceElement() :_flow_data_offset(-1), _flow_batch(false) {
     if (flow_code() != Element::COMPLETE_FLOW) {
         click_chatter("Flow Elements must be x/x in their flows");
         assert(flow_code() == Element::COMPLETE_FLOW);
@@ -405,6 +405,18 @@ void VirtualFlowManager::_build_fcb(int verbose, bool _ordered) {
         e->_flow_data_offset = my_place;
     }
 
+    //Elements only use the FCB queue if all managers that reach them fill it
+    for (int i = 0; i < _entries.size(); i++) {
+        for (int j = 0; j < _entries[i]->_reachable_list.size(); j++)
+            dynamic_cast<VirtualFlowSpaceElement*>(_entries[i]->_reachable_list[j].first)->_flow_batch = true;
+    }
+    for (int i = 0; i < _entries.size(); i++) {
+        if (_entries[i]->pushes_flow_batch())
+            continue;
+        for (int j = 0; j < _entries[i]->_reachable_list.size(); j++)
+            dynamic_cast<VirtualFlowSpaceElement*>(_entries[i]->_reachable_list[j].first)->_flow_batch = false;
+    }
+
     //Set pool data size for classifiers
     for (int i = 0; i < _entries.size(); i++) {
         VirtualFlowManager* fc = _entries[i];
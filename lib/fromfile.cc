@@ -43,7 +43,7 @@ FromFile::FromFile()
       _buffer(0),
 #endif
 #ifdef ALLOW_MMAP
-      _mmap(true),
+      _mmap(true), _zerocopy(false), _zerocopy_map(0), _zerocopy_len(0),
 #endif
       _filename(), _pipe(0), _landmark_pattern("%f"), _lineno(0)
 {
@@ -153,6 +153,9 @@ FromFile::read_buffer_mmap(ErrorHandler *errh)
     if (_mmap_off >= statbuf.st_size)
 	return (_mmap_off == 0 ? -1 : 0);
 
+    if (_zerocopy)
+	return read_buffer_zerocopy(statbuf.st_size, errh);
+
     // actually mmap
     _len = _mmap_unit;
     if ((off_t)(_mmap_off + _len) > statbuf.st_size)
@@ -175,6 +178,36 @@ FromFile::read_buffer_mmap(ErrorHandler *errh)
 
     return 1;
 }
+
+int
+FromFile::read_buffer_zerocopy(size_t size, ErrorHandler *errh)
+{
+    // the mapping stays while packets may point into it, so only map again
+    // if the file changed
+    if (_zerocopy_map && _zerocopy_len != size) {
+	munmap((caddr_t)_zerocopy_map, _zerocopy_len);
+	_zerocopy_map = 0;
+    }
+    if (!_zerocopy_map) {
+	void *mmap_data = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, _fd, 0);
+	if (mmap_data == MAP_FAILED)
+	    return error(errh, "mmap: %s", strerror(errno));
+	_zerocopy_map = (uint8_t *)mmap_data;
+	_zerocopy_len = size;
+# ifdef HAVE_MADVISE
+	(void) madvise((caddr_t)mmap_data, size, MADV_SEQUENTIAL);
+# endif
+    }
+
+    _len = size - _mmap_off;
+    _data_packet = Packet::make(_zerocopy_map + _mmap_off, _len, Packet::empty_destructor, 0);
+    if (!_data_packet)
+	return error(errh, strerror(ENOMEM));
+    _buffer = _data_packet->data();
+    _file_offset = _mmap_off;
+    _mmap_off += _len;
+    return 1;
+}
 #endif
 
 int
@@ -203,6 +236,7 @@ FromFile::read_buffer(ErrorHandler *errh)
 	    return result;
 	// else, try a regular read
 	_mmap = false;
+	_zerocopy = false;
 	(void) lseek(_fd, _mmap_off, SEEK_SET);
 	_len = 0;
     }
@@ -488,6 +522,10 @@ FromFile::take_state(FromFile &o, ErrorHandler *errh)
     _mmap = o._mmap;
     _mmap_unit = o._mmap_unit;
     _mmap_off = o._mmap_off;
+    _zerocopy = o._zerocopy;
+    _zerocopy_map = o._zerocopy_map;
+    _zerocopy_len = o._zerocopy_len;
+    o._zerocopy_map = 0;
 #else
     (void) errh;
 #endif
@@ -513,6 +551,11 @@ FromFile::cleanup()
 	_data_packet->kill();
     _data_packet = 0;
 #endif
+#ifdef ALLOW_MMAP
+    if (_zerocopy_map)
+	munmap((caddr_t)_zerocopy_map, _zerocopy_len);
+    _zerocopy_map = 0;
+#endif
 }
 
 const uint8_t *
@@ -576,7 +619,15 @@ FromFile::get_packet(size_t size, uint32_t sec, uint32_t subsec, ErrorHandler *e
 #if CLICK_PACKET_USE_DPDK
 #else
     if (_pos + size <= _len) {
-
+# ifdef ALLOW_MMAP
+	if (_zerocopy) {
+	    if (WritablePacket *p = Packet::make(const_cast<uint8_t *>(_buffer + _pos), size, Packet::empty_destructor, 0)) {
+		p->timestamp_anno().assign(sec, subsec);
+		_pos += size;
+		return p;
+	    }
+	} else
+# endif
         if (Packet *p = _data_packet->clone()) {
             p->shrink_data(_buffer + _pos, size);
             p->timestamp_anno().assign(sec, subsec);
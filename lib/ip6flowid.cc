@@ -100,6 +100,24 @@ IP6FlowID::unparse() const
   return sa.take_string();
 }
 
+IP6Flow5ID::IP6Flow5ID(const Packet *p, bool reverse) : IP6FlowID(p, reverse)
+{
+  const click_ip6 *ip6h = p->ip6_header();
+  if (ip6h->ip6_v == 6)
+    _proto = ip6h->ip6_nxt;
+  else
+    _proto = p->ip_header()->ip_p;
+}
+
+String
+IP6Flow5ID::unparse() const
+{
+  StringAccum sa;
+  sa << '(' << (int)_proto << ": " << _saddr.unparse() << ", " << ntohs(_sport) << ", "
+     << _daddr.unparse() << ", " << ntohs(_dport) << ')';
+  return sa.take_string();
+}
+
 StringAccum &
 operator<<(StringAccum &sa, const IP6FlowID &flow_id)
 {
@@ -27,6 +27,10 @@
 #include <click/ring.hh>
 #include <click/vector.hh>
 #include <click/netmapdevice.hh>
+#if HAVE_NUMA && HAVE_MULTITHREAD && CLICK_USERLEVEL
+# include <click/numa.hh>
+# include <sched.h>
+#endif
 #if CLICK_USERLEVEL || CLICK_MINIOS
 # include <unistd.h>
 #endif
@@ -289,39 +293,41 @@ Packet::delete_buffer(unsigned char* head, unsigned char* end
 // important to do so quickly. This specialized packet allocator saves
 // pre-initialized Packet objects, either with or without data, for fast
 // reuse. It can support multithreaded deployments: each thread has its own
-// pool, with a global pool to even out imbalance.
+// pool, with a global pool per NUMA node to even out imbalance. Threads give
+// and take whole lists of packets to the global pool of their node, and
+// packets with data go back to the node of the thread that allocated their
+// buffer.
 
 #if HAVE_DPDK_PACKET_POOL
 #  define CLICK_PACKET_POOL_BUFSIZ		DPDKDevice::MBUF_DATA_SIZE
 #else
 #  define CLICK_PACKET_POOL_BUFSIZ		2048
 #endif
-// see LIMIT in packetpool-01.clicktest
-#  define CLICK_PACKET_POOL_SIZE		4096 
-#  define CLICK_PACKET_DATA_POOL_SIZE		4096
 #  define CLICK_GLOBAL_PACKET_POOL_COUNT	32
 #if HAVE_DPDK_PACKET_POOL || HAVE_NETMAP_PACKET_POOL
 #  define CLICK_GLOBAL_PACKET_DATA_POOL_COUNT	8
-#else 
+#else
 #  define CLICK_GLOBAL_PACKET_DATA_POOL_COUNT	32
 #endif
 
+// Maximal number of packets in each thread pool, see
+// WritablePacket::set_pool_size() and LIMIT in packetpool-01.clicktest
+static unsigned packet_pool_size = 4096;
+static unsigned packet_data_pool_size = 4096;
 
 #  if HAVE_MULTITHREAD
 static __thread PacketPool *thread_packet_pool;
 
-#if HAVE_VECTOR_PACKET_POOL
-typedef MPMCRing<WritablePacket**,CLICK_GLOBAL_PACKET_POOL_COUNT> BatchPRing;
-typedef MPMCRing<WritablePacket**,CLICK_GLOBAL_PACKET_DATA_POOL_COUNT> BatchPDRing;
-#else
 typedef MPMCRing<WritablePacket*,CLICK_GLOBAL_PACKET_POOL_COUNT> BatchPRing;
 typedef MPMCRing<WritablePacket*,CLICK_GLOBAL_PACKET_DATA_POOL_COUNT> BatchPDRing;
-#endif
 
 struct GlobalPacketPool {
-    BatchPRing pbatch;     // batches of free packets, linked by p->prev()
+    struct {
+        BatchPRing pbatch;      // batches of free packets, linked by p->next()
                                 //   p->anno_u32(0) is # packets in batch
-    BatchPDRing pdbatch;        // batches of packet with data buffers
+        BatchPDRing pdbatch;    // batches of packet with data buffers
+    } node[CLICK_PACKET_POOL_MAX_NODES];
+    unsigned nnodes;            // number of nodes having a thread pool
 
     PacketPool* thread_pools;   // all thread packet pools
 
@@ -329,7 +335,7 @@ struct GlobalPacketPool {
 };
 static GlobalPacketPool global_packet_pool;
 #else
-static PacketPool global_packet_pool = {0,0,0,0};
+static PacketPool global_packet_pool;
 #  endif
 
 /** @brief Return the local packet pool for this thread.
@@ -352,23 +358,182 @@ WritablePacket::get_local_packet_pool() {
     return local_packet_pool();
 }
 
-/** @brief Create and return a local packet pool for this thread. */
+/** @brief Return the first packet pool, the others are linked by
+ * thread_pool_next. */
+PacketPool*
+WritablePacket::packet_pools() {
+#  if HAVE_MULTITHREAD
+    return global_packet_pool.thread_pools;
+#  else
+    return &global_packet_pool;
+#  endif
+}
+
+/** @brief Set the maximal number of packets without and with data kept by
+ * each thread pool. Beyond, lists of packets go to the global pool. */
+void
+WritablePacket::set_pool_size(unsigned packets, unsigned data) {
+    packet_pool_size = packets;
+    packet_data_pool_size = data;
+}
+
+unsigned
+WritablePacket::pool_size() {
+    return packet_pool_size;
+}
+
+unsigned
+WritablePacket::data_pool_size() {
+    return packet_data_pool_size;
+}
+
+/** @brief Create and return a local packet pool for this thread.
+ *
+ * The pool takes the NUMA node of the CPU the thread runs on. Calling this
+ * again once the thread is pinned updates the node. */
 void WritablePacket::initialize_local_packet_pool() {
 #  if HAVE_MULTITHREAD
+    int node = 0;
+#   if HAVE_NUMA && CLICK_USERLEVEL
+    int cpu = sched_getcpu();
+    if (cpu >= 0 && numa_available() >= 0)
+        node = Numa::get_numa_node_of_cpu(cpu);
+    if (node < 0 || node >= CLICK_PACKET_POOL_MAX_NODES)
+        node = 0;
+#   endif
+
+    while (atomic_uint32_t::swap(global_packet_pool.lock, 1) == 1)
+        /* do nothing */;
     PacketPool *pp = thread_packet_pool;
     if (!pp) {
         pp = new PacketPool();
-        while (atomic_uint32_t::swap(global_packet_pool.lock, 1) == 1)
-            /* do nothing */;
         pp->thread_pool_next = global_packet_pool.thread_pools;
         global_packet_pool.thread_pools = pp;
         thread_packet_pool = pp;
-        click_compiler_fence();
-        global_packet_pool.lock = 0;
     }
+    pp->node = node;
+    if ((unsigned) node >= global_packet_pool.nnodes)
+        global_packet_pool.nnodes = node + 1;
+    click_compiler_fence();
+    global_packet_pool.lock = 0;
 #  endif
 }
 
+#  if HAVE_MULTITHREAD
+/**
+ * Give the list of free packets of this thread to the global pool of its
+ * node, or free them if the global pool is full.
+ */
+static void
+spill_packets(PacketPool &packet_pool)
+{
+    packet_pool.p->set_anno_u32(0, packet_pool.pcount);
+    if (global_packet_pool.node[packet_pool.node].pbatch.insert(packet_pool.p)) {
+        packet_pool.spills++;
+    } else {
+        while (WritablePacket *p = packet_pool.p) {
+            packet_pool.p = static_cast<WritablePacket *>(p->next());
+            ::operator delete((void *) p);
+        }
+        packet_pool.frees += packet_pool.pcount;
+    }
+    packet_pool.p = 0;
+    packet_pool.pcount = 0;
+}
+
+static void
+free_data_packets(WritablePacket *pd)
+{
+    while (pd) {
+        WritablePacket *next = static_cast<WritablePacket *>(pd->next());
+#if HAVE_DPDK_PACKET_POOL
+        rte_pktmbuf_free((struct rte_mbuf*)pd->destructor_argument());
+#else
+        Packet::release_buffer(pd->buffer());
+#endif
+        ::operator delete((void *) pd);
+        pd = next;
+    }
+}
+
+/**
+ * Give a list of packets with data to the global pool of a node, or free
+ * them if the global pool is full.
+ */
+static void
+spill_data_packets(PacketPool &packet_pool, int node, WritablePacket *head, unsigned count)
+{
+    head->set_anno_u32(0, count);
+    if (global_packet_pool.node[node].pdbatch.insert(head)) {
+        packet_pool.spills++;
+    } else {
+        free_data_packets(head);
+        packet_pool.frees += count;
+    }
+}
+
+/**
+ * Keep a packet with data allocated on another node aside, and send them
+ * back to their node by lists.
+ */
+static inline void
+recycle_remote_data(PacketPool &packet_pool, WritablePacket *p, int node)
+{
+    packet_pool.remote_frees++;
+    p->set_next(packet_pool.remote[node]);
+    packet_pool.remote[node] = p;
+    if (++packet_pool.remote_count[node] >= CLICK_PACKET_POOL_REMOTE_BATCH) {
+        spill_data_packets(packet_pool, node, packet_pool.remote[node], packet_pool.remote_count[node]);
+        packet_pool.remote[node] = 0;
+        packet_pool.remote_count[node] = 0;
+    }
+}
+
+/**
+ * Take a list of packets with data from the global pool of the node of this
+ * thread.
+ */
+static inline bool
+refill_data_packets(PacketPool &packet_pool)
+{
+    WritablePacket *pd = global_packet_pool.node[packet_pool.node].pdbatch.extract();
+    if (!pd)
+        return false;
+    unsigned count = pd->anno_u32(0);
+    if (packet_pool.pd) {
+        //The local list is the shortest one
+        WritablePacket *tail = packet_pool.pd;
+        while (tail->next())
+            tail = static_cast<WritablePacket *>(tail->next());
+        tail->set_next(pd);
+    } else
+        packet_pool.pd = pd;
+    packet_pool.pdcount += count;
+    packet_pool.refills++;
+    return true;
+}
+#  endif /* HAVE_MULTITHREAD */
+
+/**
+ * Allocate a new packet with a buffer of the pool size
+ */
+inline WritablePacket *
+WritablePacket::pool_new_data(PacketPool &packet_pool)
+{
+    WritablePacket *p = new WritablePacket;
+    p->alloc_data(0,CLICK_PACKET_POOL_BUFSIZ,0);
+#if HAVE_DPDK_PACKET_POOL
+    buffer_destructor_type type = p->_destructor;
+#endif
+    p->initialize(false);
+#if HAVE_DPDK_PACKET_POOL
+    p->_destructor = type;
+#endif
+    p->_pool_node = packet_pool.node;
+    packet_pool.allocs++;
+    return p;
+}
+
 /**
  * Allocate a batch of packets without buffer
  * The returned list is a simple linked list, not a standard PacketBatch
@@ -376,40 +541,62 @@ void WritablePacket::initialize_local_packet_pool() {
 WritablePacket *
 WritablePacket::pool_batch_allocate(uint16_t count)
 {
-        PacketPool& packet_pool = local_packet_pool();
-#if HAVE_VECTOR_PACKET_POOL
-        assert(false);
-        return 0;
-#else
-        WritablePacket *p = 0;
-        WritablePacket *head = 0;
-        int taken_from_pool = 0;
-
-        while (count > 0) {
-            p = packet_pool.p;
-            if (!p) {
-                packet_pool.pcount -= taken_from_pool;
-                taken_from_pool = 0;
-                p = pool_allocate();
-            } else {
-                packet_pool.p = static_cast<WritablePacket*>(p->next());
-                taken_from_pool++;
-            }
-            if (head == 0) {
-                head = p;
+    PacketPool& packet_pool = local_packet_pool();
+    WritablePacket *head = 0;
+    WritablePacket *last = 0;
+
+    while (count > 0) {
+#  if HAVE_MULTITHREAD
+        if (!packet_pool.p) {
+            WritablePacket *pp = global_packet_pool.node[packet_pool.node].pbatch.extract();
+            if (pp) {
+                packet_pool.p = pp;
+                packet_pool.pcount = pp->anno_u32(0);
+                packet_pool.refills++;
             }
-            count --;
         }
-        packet_pool.pcount -= taken_from_pool;
+#  endif
+        WritablePacket *p = packet_pool.p;
+        if (!p)
+            break;
+        //Take as many packets as possible from the list at once
+        unsigned n = 1;
+        WritablePacket *tail = p;
+        while (n < count && tail->next()) {
+            tail = static_cast<WritablePacket *>(tail->next());
+            n++;
+        }
+        packet_pool.p = static_cast<WritablePacket *>(tail->next());
+        packet_pool.pcount -= n;
+        packet_pool.hits += n;
+        if (last)
+            last->set_next(p);
+        else
+            head = p;
+        last = tail;
+        count -= n;
+    }
 
-        p->set_next(0);
+    for (; count > 0; count--) {
+        WritablePacket *p = new WritablePacket;
+        p->_pool_node = packet_pool.node;
+        packet_pool.allocs++;
+        if (last)
+            last->set_next(p);
+        else
+            head = p;
+        last = p;
+    }
 
-        return head;
-#endif
+    if (last)
+        last->set_next(0);
+    return head;
 }
 
 /**
- * Allocate a batch of packets with buffer
+ * Make sure the local pool has at least count packets with buffer, and
+ * return the list. The caller takes packets from the head of the list and
+ * must call pool_consumed_data_burst() with the remaining ones.
  */
 #if POOL_INLINING
 CLICK_ALWAYS_INLINE WritablePacket *
@@ -419,17 +606,12 @@ CLICK_OPTNONE WritablePacket *
 WritablePacket::pool_prepare_data_burst(uint16_t count)
 {
         PacketPool& packet_pool = local_packet_pool();
+#  if HAVE_MULTITHREAD
+        while (unlikely(packet_pool.pdcount < count) && refill_data_packets(packet_pool))
+            /* do nothing */;
+#  endif
         while (unlikely(packet_pool.pdcount < count)) {
-            //TODO : check from global pool
-            WritablePacket* p = new WritablePacket;
-            p->alloc_data(0,CLICK_PACKET_POOL_BUFSIZ,0);
-#if HAVE_DPDK_PACKET_POOL
-           buffer_destructor_type type = p->_destructor;
-#endif
-            p->initialize(false);
-#if HAVE_DPDK_PACKET_POOL
-            p->_destructor = type;
-#endif
+            WritablePacket* p = pool_new_data(packet_pool);
             p->set_next(packet_pool.pd);
             packet_pool.pd = p;
             packet_pool.pdcount++;
@@ -442,6 +624,7 @@ CLICK_ALWAYS_INLINE void
 WritablePacket::pool_consumed_data_burst(uint16_t n, WritablePacket* tail) {
         PacketPool& packet_pool = local_packet_pool();
         packet_pool.pdcount -= n;
+        packet_pool.hits += n;
         packet_pool.pd = tail;
 }
 
@@ -449,30 +632,28 @@ inline WritablePacket *
 WritablePacket::pool_allocate()
 {
     PacketPool& packet_pool = local_packet_pool();
-#if HAVE_VECTOR_PACKET_POOL
-        assert(false);
-#else
 #  if HAVE_MULTITHREAD
     if (!packet_pool.p) {
-        WritablePacket *pp = global_packet_pool.pbatch.extract();
+        WritablePacket *pp = global_packet_pool.node[packet_pool.node].pbatch.extract();
         if (pp) {
             packet_pool.p = pp;
             packet_pool.pcount = pp->anno_u32(0);
+            packet_pool.refills++;
         }
-
     }
 #  endif /* HAVE_MULTITHREAD */
 
-        WritablePacket *p = packet_pool.p;
-        if (p) {
-            packet_pool.p = static_cast<WritablePacket*>(p->next());
-            --packet_pool.pcount;
-        } else {
+    WritablePacket *p = packet_pool.p;
+    if (p) {
+        packet_pool.p = static_cast<WritablePacket*>(p->next());
+        --packet_pool.pcount;
+        packet_pool.hits++;
+    } else {
         p = new WritablePacket;
-        }
-        return p;
-#endif
-
+        packet_pool.allocs++;
+    }
+    p->_pool_node = packet_pool.node;
+    return p;
 }
 
 /**
@@ -482,29 +663,19 @@ WritablePacket *
 WritablePacket::pool_data_allocate()
 {
     PacketPool& packet_pool = local_packet_pool();
-#if HAVE_VECTOR_PACKET_POOL
-        assert(false);
-#else
 #  if HAVE_MULTITHREAD
-    if (unlikely(!packet_pool.pd)) {
-        WritablePacket *pd = global_packet_pool.pdbatch.extract();
-        if (pd) {
-            packet_pool.pd = pd;
-            packet_pool.pdcount = pd->anno_u32(0);
-        }
-	}
+    if (unlikely(!packet_pool.pd))
+        refill_data_packets(packet_pool);
 #  endif /* HAVE_MULTITHREAD */
 
     WritablePacket *pd = packet_pool.pd;
     if (pd) {
         packet_pool.pd = static_cast<WritablePacket*>(pd->next());
         --packet_pool.pdcount;
-    } else {
-        pd = pool_allocate();
-        pd->alloc_data(0,CLICK_PACKET_POOL_BUFSIZ,0);
-    }
+        packet_pool.hits++;
+    } else
+        pd = pool_new_data(packet_pool);
     return pd;
-#endif
 }
 
 /**
@@ -541,51 +712,18 @@ WritablePacket::pool_allocate(uint32_t headroom, uint32_t length,
 	return p;
 }
 
-#if HAVE_VECTOR_PACKET_POOL
-/**
- * @pre n <= CLICK_PACKET_POOL_SIZE / 2
- */
-inline void
-WritablePacket::check_packet_pool_size(PacketPool &packet_pool, unsigned n) {
-    if (unlikely(packet_pool.p.count() + n >= CLICK_PACKET_POOL_SIZE)) {
-        WritablePacket** ps = new WritablePacket*[CLICK_PACKET_POOL_SIZE / 2];
-        memcpy(ps, packet_pool.p.extract_burst(CLICK_PACKET_POOL_SIZE / 2), sizeof(WritablePacket*) * CLICK_PACKET_POOL_SIZE / 2);
-        global_packet_pool.pbatch.insert(ps);
-    }
-}
-
-/**
- * @pre n <= CLICK_PACKET_POOL_SIZE / 2
- */
-inline void
-WritablePacket::check_data_pool_size(PacketPool &packet_pool, unsigned n) {
-    if (unlikely(packet_pool.pd.count() + n >= CLICK_PACKET_DATA_POOL_SIZE)) {
-        WritablePacket** ps = new WritablePacket*[CLICK_PACKET_POOL_SIZE / 2];
-        memcpy(ps, packet_pool.pd.extract_burst(CLICK_PACKET_POOL_SIZE / 2), sizeof(WritablePacket*) * CLICK_PACKET_POOL_SIZE / 2);
-        global_packet_pool.pdbatch.insert(ps);
-    }
-}
-#else
 inline void
 WritablePacket::check_packet_pool_size(PacketPool &packet_pool, unsigned n) {
 #  if HAVE_MULTITHREAD
-    if (unlikely(packet_pool.p && packet_pool.pcount + n > CLICK_PACKET_POOL_SIZE)) {
-        packet_pool.p->set_anno_u32(0, packet_pool.pcount);
-        if (!global_packet_pool.pbatch.insert(packet_pool.p)) { //Si le nombre de batch est au max -> delete
-            while (WritablePacket *p = packet_pool.p) { //On supprime le batch
-                packet_pool.p = static_cast<WritablePacket *>(p->next());
-                ::operator delete((void *) p);
-            }
-        }
-        packet_pool.p = 0;
-        packet_pool.pcount = 0;
-    }
+    if (unlikely(packet_pool.p && packet_pool.pcount + n > packet_pool_size))
+        spill_packets(packet_pool);
 #  else /* !HAVE_MULTITHREAD */
-    if (packet_pool.pcount == CLICK_PACKET_POOL_SIZE) {
+    while (packet_pool.p && packet_pool.pcount + n > packet_pool_size) {
         WritablePacket* tmp = (WritablePacket*)packet_pool.p->next();
         ::operator delete((void *) packet_pool.p);
         packet_pool.p = tmp;
         packet_pool.pcount--;
+        packet_pool.frees++;
     }
 #  endif /* HAVE_MULTITHREAD */
 }
@@ -593,33 +731,21 @@ WritablePacket::check_packet_pool_size(PacketPool &packet_pool, unsigned n) {
 inline void
 WritablePacket::check_data_pool_size(PacketPool &packet_pool, unsigned n) {
 #  if HAVE_MULTITHREAD
-    if (unlikely(packet_pool.pd && packet_pool.pdcount + n > CLICK_PACKET_DATA_POOL_SIZE)) {
-        packet_pool.pd->set_anno_u32(0, packet_pool.pdcount);
-        if (!global_packet_pool.pdbatch.insert(packet_pool.pd)) {
-            while (WritablePacket *pd = packet_pool.pd) {
-                packet_pool.pd = static_cast<WritablePacket *>(pd->next());
-                #if HAVE_DPDK_PACKET_POOL
-                    rte_pktmbuf_free((struct rte_mbuf*)pd->destructor_argument());
-                #else
-                    Packet::release_buffer(pd->buffer());
-                #endif
-                ::operator delete((void *) pd);
-            }
-        }
+    if (unlikely(packet_pool.pd && packet_pool.pdcount + n > packet_data_pool_size)) {
+        spill_data_packets(packet_pool, packet_pool.node, packet_pool.pd, packet_pool.pdcount);
         packet_pool.pd = 0;
         packet_pool.pdcount = 0;
     }
-
 #  else /* !HAVE_MULTITHREAD */
-    if (packet_pool.pdcount == CLICK_PACKET_DATA_POOL_SIZE) {
+    while (packet_pool.pd && packet_pool.pdcount + n > packet_data_pool_size) {
         WritablePacket* tmp = (WritablePacket*)packet_pool.pd->next();
         ::operator delete((void *) packet_pool.pd);
         packet_pool.pd = tmp;
         packet_pool.pdcount--;
+        packet_pool.frees++;
     }
 #  endif /* HAVE_MULTITHREAD */
 }
-#endif
 
 inline bool WritablePacket::is_from_data_pool(WritablePacket *p) {
 #if HAVE_DPDK_PACKET_POOL
@@ -665,30 +791,29 @@ WritablePacket::recycle(WritablePacket *p)
     bool data = is_from_data_pool(p);
 
     if (likely(data)) {
+#  if HAVE_MULTITHREAD
+        int node = p->_pool_node;
+        if (unlikely(node != packet_pool.node) && (unsigned) node < global_packet_pool.nnodes) {
+            recycle_remote_data(packet_pool, p, node);
+            return;
+        }
+#  endif
         check_data_pool_size(packet_pool, 1);
-#if HAVE_VECTOR_PACKET_POOL
-        packet_pool.pd.insert(p);
-#else
         ++packet_pool.pdcount;
         p->set_next(packet_pool.pd);
         packet_pool.pd = p;
 # if !HAVE_BATCH_RECYCLE
-        assert(packet_pool.pdcount <= CLICK_PACKET_DATA_POOL_SIZE);
+        assert(packet_pool.pdcount <= packet_data_pool_size);
 # endif
-#endif
     } else {
         p->~WritablePacket();
         check_packet_pool_size(packet_pool, 1);
-#if HAVE_VECTOR_PACKET_POOL
-        packet_pool.p.insert(p);
-#else
         ++packet_pool.pcount;
         p->set_next(packet_pool.p);
         packet_pool.p = p;
 # if !HAVE_BATCH_RECYCLE
-        assert(packet_pool.pcount <= CLICK_PACKET_POOL_SIZE);
+        assert(packet_pool.pcount <= packet_pool_size);
 # endif
-#endif
     }
 
 }
@@ -709,9 +834,6 @@ WritablePacket::recycle_packet_batch(WritablePacket *head, Packet* tail, unsigne
     }
 #endif
     PacketPool& packet_pool = local_packet_pool();
-#if HAVE_VECTOR_PACKET_POOL
-    assert(false);
-#else
     Packet* next = ((head != 0)? head->next() : 0 );
     Packet* p = head;
     for (;p != 0;p=next,next=(p==0?0:p->next())) {
@@ -721,7 +843,6 @@ WritablePacket::recycle_packet_batch(WritablePacket *head, Packet* tail, unsigne
     packet_pool.pcount += count;
     tail->set_next(packet_pool.p);
     packet_pool.p = head;
-#endif
 }
 
 /**
@@ -740,15 +861,39 @@ WritablePacket::recycle_data_batch(WritablePacket *head, Packet* tail, unsigned
     }
 #endif
     PacketPool& packet_pool = local_packet_pool();
-#if HAVE_VECTOR_PACKET_POOL
-    assert(false);
-#else
+#  if HAVE_MULTITHREAD
+    //Only machines with multiple nodes need to look at each packet
+    if (unlikely(global_packet_pool.nnodes > 1)) {
+        WritablePacket *local = 0;
+        WritablePacket *local_tail = 0;
+        unsigned local_count = 0;
+        WritablePacket *p = head;
+        while (p) {
+            WritablePacket *next = static_cast<WritablePacket *>(p == tail ? 0 : p->next());
+            int node = p->_pool_node;
+            if (node != packet_pool.node && (unsigned) node < global_packet_pool.nnodes)
+                recycle_remote_data(packet_pool, p, node);
+            else {
+                if (!local_tail)
+                    local_tail = p;
+                p->set_next(local);
+                local = p;
+                local_count++;
+            }
+            p = next;
+        }
+        if (!local)
+            return;
+        head = local;
+        tail = local_tail;
+        count = local_count;
+    }
+#  endif
     check_data_pool_size(packet_pool, count);
     packet_pool.pdcount += count;
     tail->set_next(packet_pool.pd);
 
     packet_pool.pd = head;
-#endif
 }
 
 # endif /* HAVE_CLICK_PACKET_POOL */
@@ -1501,8 +1646,6 @@ Packet::shift_data(int offset, bool free_on_failure)
 static void
 cleanup_pool(PacketPool *pp, int global)
 {
-#if HAVE_VECTOR_PACKET_POOL
-#else
     unsigned pcount = 0, pdcount = 0;
     while (WritablePacket *p = pp->p) {
         ++pcount;
@@ -1519,12 +1662,17 @@ cleanup_pool(PacketPool *pp, int global)
 # endif
     ::operator delete((void *) pd);
     }
+# if HAVE_MULTITHREAD
+    for (int i = 0; i < CLICK_PACKET_POOL_MAX_NODES; i++) {
+        free_data_packets(pp->remote[i]);
+        pp->remote[i] = 0;
+    }
+# endif
 # if !HAVE_BATCH_RECYCLE
-    assert(pcount <= CLICK_PACKET_POOL_SIZE);
-    assert(pdcount <= CLICK_PACKET_DATA_POOL_SIZE);
+    assert(pcount <= packet_pool_size);
+    assert(pdcount <= packet_data_pool_size);
 # endif
     assert(global || (pcount == pp->pcount && pdcount == pp->pdcount));
-#endif
 }
 #endif
 
@@ -1532,7 +1680,7 @@ int
 Packet::max_data_pool_size()
 {
 #if HAVE_CLICK_PACKET_POOL
-	return CLICK_GLOBAL_PACKET_DATA_POOL_COUNT * CLICK_PACKET_DATA_POOL_SIZE;
+	return CLICK_GLOBAL_PACKET_DATA_POOL_COUNT * packet_data_pool_size;
 #else
 	return 0;
 #endif
@@ -1548,17 +1696,15 @@ Packet::static_cleanup()
 		cleanup_pool(pp, 0);
 		delete pp;
 		}
-    #  if HAVE_VECTOR_PACKET_POOL
-    #  else
-		PacketPool fake_pool;
-		do {
-			fake_pool.p = global_packet_pool.pbatch.extract();
-			fake_pool.pd = global_packet_pool.pdbatch.extract();
-			if (!fake_pool.p && !fake_pool.pd) break;
-			cleanup_pool(&fake_pool, 1);
-		} while(true);
-
-    #  endif
+		for (int i = 0; i < CLICK_PACKET_POOL_MAX_NODES; i++) {
+			PacketPool fake_pool;
+			do {
+				fake_pool.p = global_packet_pool.node[i].pbatch.extract();
+				fake_pool.pd = global_packet_pool.node[i].pdbatch.extract();
+				if (!fake_pool.p && !fake_pool.pd) break;
+				cleanup_pool(&fake_pool, 1);
+			} while(true);
+		}
 	# else
 		cleanup_pool(&global_packet_pool, 0);
 	# endif